@@ -0,0 +1,64 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Rendition choice for adaptive streaming from measured throughput and buffer occupancy.
+
+#include "pch.h"
+#include "common.h"
+#include "abrcontroller.h"
+#include <math.h>
+
+void CAbrController::Ewma::add(double weight, double value) {
+    const double alpha = pow(0.5, weight / halfLifeS);
+    estimate = value * (1 - alpha) + estimate * alpha;
+    totalWeight += weight;
+}
+
+double CAbrController::Ewma::get() const {
+    const double zeroFactor = 1 - pow(0.5, totalWeight / halfLifeS);
+    return zeroFactor > 0 ? estimate / zeroFactor : 0;
+}
+
+void CAbrController::addSample(int64_t bytes, int64_t elapsedNs, int64_t mediaDurationUs) {
+    if (bytes <= 0 || elapsedNs <= 0) {
+        return;
+    }
+    // Segments shorter than the averaging scale would otherwise count as much as long ones.
+    const double weight = std::max(mediaDurationUs, (int64_t)100000) / 1e6;
+    const double bps = bytes * 8.0 * 1e9 / elapsedNs;
+    mFast.add(weight, bps);
+    mSlow.add(weight, bps);
+}
+
+int64_t CAbrController::estimateBps() const {
+    return (int64_t)std::min(mFast.get(), mSlow.get());
+}
+
+int32_t CAbrController::select(const std::vector<int64_t>& bandwidths, int32_t current, int64_t bufferedUs) const {
+    const int64_t estimate = estimateBps();
+    if (bandwidths.empty() || estimate <= 0) {
+        return 0;  // start low: the first frame matters more than the first segment's quality
+    }
+    auto highestWithin = [&](double share) {
+        int32_t best = 0;
+        for (size_t i = 0; i < bandwidths.size(); i++) {
+            if (bandwidths[i] <= estimate * share) {
+                best = (int32_t)i;
+            }
+        }
+        return best;
+    };
+    if (current < 0) {
+        return highestWithin(kDownSwitchSafety);
+    }
+    if (bufferedUs < mBufferTargetUs / kPanicBufferDivisor) {
+        return 0;
+    }
+    if (bandwidths[current] > estimate * kDownSwitchSafety) {
+        return std::min(current, highestWithin(kDownSwitchSafety));
+    }
+    const int32_t up = highestWithin(kUpSwitchSafety);
+    if (up > current && bufferedUs >= mBufferTargetUs / 2) {
+        return up;
+    }
+    return current;
+}
@@ -0,0 +1,53 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Rendition choice for adaptive streaming from measured throughput and buffer occupancy.
+
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+// Throughput is tracked by two exponentially weighted moving averages over segment downloads,
+// weighted by the media time each download brought in: a fast one that reacts to drops within a
+// segment or two, and a slow one that ignores short bursts. The estimate is the lower of the two.
+//
+// Switching down happens as soon as the current rendition no longer fits the estimate (with a
+// safety margin), and immediately to the lowest one when the buffer is nearly empty. Switching up
+// needs a wider margin and a buffer at least half full, so a short burst of bandwidth doesn't
+// make the choice oscillate.
+class CAbrController {
+
+public:
+    explicit CAbrController(int64_t bufferTargetUs) : mBufferTargetUs(bufferTargetUs) {}
+
+    // One finished download of mediaDurationUs worth of segment.
+    void addSample(int64_t bytes, int64_t elapsedNs, int64_t mediaDurationUs);
+
+    // Bits per second, 0 before the first sample.
+    int64_t estimateBps() const;
+
+    // Rendition for the next segment. bandwidths ascend; current is the rendition of the previous
+    // segment, or -1 at the start; bufferedUs is the media fetched ahead of the demuxer.
+    int32_t select(const std::vector<int64_t>& bandwidths, int32_t current, int64_t bufferedUs) const;
+
+    static constexpr double kFastHalfLifeS = 2.0;
+    static constexpr double kSlowHalfLifeS = 8.0;
+    static constexpr double kDownSwitchSafety = 0.85;   // keep a rendition while it needs at most this share of the estimate
+    static constexpr double kUpSwitchSafety = 0.7;      // move up only to a rendition within this share
+    static constexpr int32_t kPanicBufferDivisor = 6;   // below bufferTarget / 6 of buffer, drop to the lowest rendition
+
+private:
+    struct Ewma {
+        double halfLifeS;
+        double estimate{0};
+        double totalWeight{0};
+
+        void add(double weight, double value);
+
+        // Corrected for the zero start, so the first samples aren't biased low.
+        double get() const;
+    };
+
+    int64_t mBufferTargetUs;
+    Ewma    mFast{kFastHalfLifeS};
+    Ewma    mSlow{kSlowHalfLifeS};
+};
@@ -0,0 +1,314 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Adaptive-bitrate DASH / HLS playback as an IMediaSource.
+
+#include "pch.h"
+#include "common.h"
+#include "adaptivesource.h"
+#include "mediaclock.h"
+
+CAdaptiveSource::CAdaptiveSource(std::shared_ptr<IMediaBackend> backend, std::shared_ptr<CSegmentCache> segmentCache, int64_t prefetchUs,
+                                 std::shared_ptr<AdaptiveStreamCounters> counters)
+    : mBackend(std::move(backend)), mSegmentCache(std::move(segmentCache)), mPrefetchUs(prefetchUs), mCounters(std::move(counters)),
+      mIoCounters(mBackend->getIoCounters()), mAbr(prefetchUs) {
+    if (mCounters == nullptr) {
+        mCounters = std::make_shared<AdaptiveStreamCounters>();
+    }
+}
+
+CAdaptiveSource::~CAdaptiveSource() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mFetchWake.notify_all();
+    mSegmentReady.notify_all();
+    // A download in flight finishes first; ReadMediaFile can't be interrupted.
+    if (mFetchThread.joinable()) {
+        mFetchThread.join();
+    }
+}
+
+bool CAdaptiveSource::open(const char* source) {
+    if (mSegmentCache == nullptr || !mSegmentCache->enabled()) {
+        Log::Write(Log::Level::Error, "adaptive streaming needs a segment cache directory");
+        return false;
+    }
+    if (!LoadAdaptiveManifest(source, mIoCounters, mManifest)) {
+        return false;
+    }
+    for (const Rendition& rendition : mManifest.renditions) {
+        mBandwidths.push_back(rendition.bandwidth);
+    }
+    mInitSegments.resize(mManifest.renditions.size());
+    mFetchThread = std::thread(&CAdaptiveSource::fetchLoop, this);
+
+    if (!openSegment(0)) {
+        return false;
+    }
+    const size_t trackCount = mSegment->getTrackCount();
+    mSelected.assign(trackCount, false);
+    mFormatChanged.assign(trackCount, false);
+    mTrackConfigs.resize(trackCount);
+    for (size_t i = 0; i < trackCount; i++) {
+        MediaTrackInfo info;
+        if (mSegment->getTrackInfo(i, info)) {
+            mTrackConfigs[i] = info.codecConfig;
+        }
+    }
+    Log::Write(Log::Level::Info, Fmt("adaptive: %d renditions, %d segments, %.1f s, starting at %lld bps",
+                                     (int32_t)mManifest.renditions.size(), (int32_t)segmentCount(), mManifest.durationUs / 1e6,
+                                     (long long)mBandwidths[mSegmentRendition]));
+    return true;
+}
+
+size_t CAdaptiveSource::getTrackCount() {
+    return mSegment ? mSegment->getTrackCount() : 0;
+}
+
+bool CAdaptiveSource::getTrackInfo(size_t track, MediaTrackInfo& info) {
+    if (mSegment == nullptr || !mSegment->getTrackInfo(track, info)) {
+        return false;
+    }
+    info.durationUs = mManifest.durationUs;
+    if (info.type == mediaTypeVideo && info.maxInputSize > 0) {
+        // Size the decoder input for the top rendition, by pixel count when the manifest gives
+        // resolutions and by bit rate otherwise, so switching up never truncates a sample.
+        const Rendition& current = mManifest.renditions[mSegmentRendition];
+        const Rendition& top = mManifest.renditions.back();
+        double scale = 1;
+        if (current.width * current.height > 0 && top.width * top.height > 0) {
+            scale = (double)top.width * top.height / ((double)current.width * current.height);
+        } else if (current.bandwidth > 0) {
+            scale = (double)top.bandwidth / current.bandwidth;
+        }
+        info.maxInputSize = (int32_t)std::min(info.maxInputSize * std::max(scale, 1.0), (double)INT32_MAX);
+    }
+    return true;
+}
+
+bool CAdaptiveSource::selectTrack(size_t track) {
+    if (mSegment == nullptr || track >= mSelected.size()) {
+        return false;
+    }
+    mSelected[track] = true;
+    return mSegment->selectTrack(track);
+}
+
+int32_t CAdaptiveSource::getSampleTrackIndex() {
+    while (mSegment) {
+        const int32_t track = mSegment->getSampleTrackIndex();
+        if (track >= 0 || mSegmentIndex + 1 >= segmentCount()) {
+            return track;
+        }
+        if (!openSegment(mSegmentIndex + 1)) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+int64_t CAdaptiveSource::getSampleTime() {
+    return mSegment ? mSegment->getSampleTime() : -1;
+}
+
+uint32_t CAdaptiveSource::getSampleFlags() {
+    if (mSegment == nullptr) {
+        return 0;
+    }
+    uint32_t flags = mSegment->getSampleFlags();
+    const int32_t track = mSegment->getSampleTrackIndex();
+    if (track >= 0 && (size_t)track < mFormatChanged.size() && mFormatChanged[track]) {
+        flags |= kSampleFlagFormatChange;
+    }
+    return flags;
+}
+
+ssize_t CAdaptiveSource::readSampleData(uint8_t* buffer, size_t capacity) {
+    return mSegment ? mSegment->readSampleData(buffer, capacity) : -1;
+}
+
+bool CAdaptiveSource::advance() {
+    if (mSegment == nullptr) {
+        return false;
+    }
+    const int32_t track = mSegment->getSampleTrackIndex();
+    if (track >= 0 && (size_t)track < mFormatChanged.size()) {
+        mFormatChanged[track] = false;
+    }
+    return mSegment->advance() || mSegmentIndex + 1 < segmentCount();
+}
+
+bool CAdaptiveSource::seekTo(int64_t timeUs) {
+    const std::vector<MediaSegment>& segments = mManifest.renditions[0].segments;
+    size_t index = 0;
+    while (index + 1 < segments.size() && segments[index + 1].startUs <= timeUs) {
+        index++;
+    }
+    {
+        // Restart the downloads at the target. Segments already fetched past it are kept.
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFetched.erase(mFetched.begin(), mFetched.lower_bound(index));
+        mFetchIndex = index;
+    }
+    mFetchWake.notify_all();
+    // A config still queued in the player when it seeks is dropped, so resend every config.
+    mDeliveredRendition = -1;
+    mTrackConfigs.assign(mTrackConfigs.size(), std::vector<uint8_t>());
+    if (!openSegment(index)) {
+        return false;
+    }
+    return mSegment->seekTo(timeUs);
+}
+
+IMediaSource* CAdaptiveSource::getDemuxer() {
+    return mSegment ? mSegment->getDemuxer() : this;
+}
+
+std::vector<int64_t> CAdaptiveSource::getSegmentTimes() const {
+    std::vector<int64_t> times;
+    if (!mManifest.renditions.empty()) {
+        for (const MediaSegment& segment : mManifest.renditions[0].segments) {
+            times.push_back(segment.startUs);
+        }
+    }
+    return times;
+}
+
+int64_t CAdaptiveSource::bufferedUsLocked() const {
+    const std::vector<MediaSegment>& segments = mManifest.renditions[0].segments;
+    if (mFetchIndex <= mDemuxIndex || mDemuxIndex >= segments.size()) {
+        return 0;
+    }
+    const int64_t fetchedEndUs = mFetchIndex < segments.size() ? segments[mFetchIndex].startUs : mManifest.durationUs;
+    return fetchedEndUs - segments[mDemuxIndex].startUs;
+}
+
+void CAdaptiveSource::fetchLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mStopping) {
+        while (mFetchIndex < segmentCount() && mFetched.count(mFetchIndex) > 0) {
+            mFetchIndex++;
+        }
+        const int64_t bufferedUs = bufferedUsLocked();
+        mCounters->bufferedUs = bufferedUs;
+        // The segment the demuxer waits for is always fetched, whatever the buffer says.
+        if (mFetchIndex >= segmentCount() || (bufferedUs >= mPrefetchUs && mFetchIndex > mDemuxIndex)) {
+            mFetchWake.wait(lock);
+            continue;
+        }
+        const size_t index = mFetchIndex;
+        const int32_t rendition = mAbr.select(mBandwidths, mLastFetchRendition, bufferedUs);
+        lock.unlock();
+
+        std::string path;
+        int32_t fetchedRendition = rendition;
+        for (int32_t attempt = 0; attempt < kFetchAttempts && path.empty() && !mStopping; attempt++) {
+            fetchedRendition = attempt == 0 ? rendition : 0;
+            path = fetchSegment(index, fetchedRendition);
+        }
+
+        lock.lock();
+        if (path.empty()) {
+            mCounters->fetchFailures++;
+            Log::Write(Log::Level::Error, Fmt("adaptive: segment %d failed after %d attempts", (int32_t)index, kFetchAttempts));
+        } else {
+            mLastFetchRendition = fetchedRendition;
+        }
+        // After a seek the result is still in the cache, but no longer the one wanted next.
+        if (index == mFetchIndex) {
+            mFetched[index] = Fetched{fetchedRendition, path};
+            mFetchIndex++;
+            mSegmentReady.notify_all();
+        }
+    }
+}
+
+std::string CAdaptiveSource::fetchSegment(size_t index, int32_t rendition) {
+    const Rendition& entry = mManifest.renditions[rendition];
+    const MediaSegment& segment = entry.segments[index];
+    const std::string key = entry.initUrl + "\n" + segment.url;
+    std::string path = mSegmentCache->lookup(key);
+    if (!path.empty()) {
+        mCounters->segmentCacheHits++;
+        return path;
+    }
+
+    std::vector<uint8_t>& init = mInitSegments[rendition];
+    if (init.empty() && !ReadMediaFile(entry.initUrl.c_str(), mIoCounters, init)) {
+        init.clear();
+        return std::string();
+    }
+    std::vector<uint8_t> media;
+    const int64_t startNs = CMediaClock::monotonicNow();
+    if (!ReadMediaFile(segment.url.c_str(), mIoCounters, media)) {
+        return std::string();
+    }
+    mAbr.addSample((int64_t)media.size(), CMediaClock::monotonicNow() - startNs, segment.durationUs);
+    mCounters->throughputBps = mAbr.estimateBps();
+    mCounters->segmentsDownloaded++;
+    return mSegmentCache->store(key, {&init, &media});
+}
+
+bool CAdaptiveSource::openSegment(size_t index) {
+    std::shared_ptr<IMediaSource> segment = mBackend->createSegmentSource();
+    Fetched fetched;
+    for (int32_t attempt = 0;; attempt++) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mDemuxIndex = index;
+            mFetchWake.notify_all();
+            mSegmentReady.wait(lock, [&] { return mStopping || mFetched.count(index) > 0; });
+            if (mStopping) {
+                return false;
+            }
+            fetched = mFetched[index];
+            mFetched.erase(mFetched.begin(), mFetched.upper_bound(index));
+        }
+        if (fetched.path.empty()) {
+            return false;
+        }
+        if (segment->open(fetched.path.c_str())) {
+            break;
+        }
+        if (attempt > 0) {
+            Log::Write(Log::Level::Error, Fmt("adaptive: can't open segment %d", (int32_t)index));
+            return false;
+        }
+        // Evicted between the download and now: fetch it again.
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFetchIndex = index;
+        }
+    }
+
+    for (size_t i = 0; i < mSelected.size(); i++) {
+        if (mSelected[i]) {
+            segment->selectTrack(i);
+        }
+    }
+    mSegment = segment;
+    mSegmentIndex = index;
+    mSegmentRendition = fetched.rendition;
+    mCounters->rendition = fetched.rendition;
+
+    if (fetched.rendition != mDeliveredRendition) {
+        if (mDeliveredRendition >= 0) {
+            mCounters->renditionSwitches++;
+            Log::Write(Log::Level::Info, Fmt("adaptive: segment %d switches to %lld bps (estimate %lld bps, %lld ms buffered)", (int32_t)index,
+                                             (long long)mBandwidths[fetched.rendition], (long long)mCounters->throughputBps.load(),
+                                             (long long)(mCounters->bufferedUs / 1000)));
+        }
+        // Flag the tracks whose decoder needs the new rendition's config; renditions usually
+        // share their audio, which then goes on untouched.
+        for (size_t i = 0; i < mTrackConfigs.size(); i++) {
+            MediaTrackInfo info;
+            if (segment->getTrackInfo(i, info) && info.codecConfig != mTrackConfigs[i]) {
+                mFormatChanged[i] = mSelected[i];
+                mTrackConfigs[i] = info.codecConfig;
+            }
+        }
+        mDeliveredRendition = fetched.rendition;
+    }
+    return true;
+}
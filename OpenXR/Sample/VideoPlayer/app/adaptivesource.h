@@ -0,0 +1,127 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Adaptive-bitrate DASH / HLS playback as an IMediaSource.
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mediabackend.h"
+#include "manifest.h"
+#include "segmentcache.h"
+#include "abrcontroller.h"
+
+// Shared by the adaptive sources of one player (the playing one and a gapless-loop standby).
+typedef struct AdaptiveStreamCounters_tag {
+    std::atomic<int32_t>  rendition{-1};            // of the segment being demuxed
+    std::atomic<uint64_t> renditionSwitches{0};
+    std::atomic<int64_t>  throughputBps{0};         // current estimate
+    std::atomic<int64_t>  bufferedUs{0};            // media fetched ahead of the demuxer
+    std::atomic<uint64_t> segmentsDownloaded{0};
+    std::atomic<uint64_t> segmentCacheHits{0};
+    std::atomic<uint64_t> fetchFailures{0};
+}AdaptiveStreamCounters;
+
+// Plays the renditions of a manifest as one stream. A fetch thread keeps up to prefetchUs of
+// media downloaded ahead of the demuxer, choosing each segment's rendition with CAbrController,
+// and stores every segment in the segment cache as init + media. The demux side opens the
+// segment files one after the other with the backend's own demuxer and forwards to it, so
+// renditions only change at segment boundaries.
+//
+// The decoders and the render side are never rebuilt at a switch: the first sample of a track in
+// a rendition with another codec config carries kSampleFlagFormatChange, and the player queues
+// that config in-band ahead of it.
+class CAdaptiveSource : public IMediaSource {
+
+public:
+    CAdaptiveSource(std::shared_ptr<IMediaBackend> backend, std::shared_ptr<CSegmentCache> segmentCache, int64_t prefetchUs,
+                    std::shared_ptr<AdaptiveStreamCounters> counters);
+
+    ~CAdaptiveSource() override;
+
+    bool open(const char* source) override;
+
+    size_t getTrackCount() override;
+
+    // Describes the rendition being demuxed, with the duration of the whole presentation and, for
+    // video, an input size large enough for the top rendition.
+    bool getTrackInfo(size_t track, MediaTrackInfo& info) override;
+
+    bool selectTrack(size_t track) override;
+
+    // Moves on to the next segment (waiting for it if needed) when the current one is done.
+    int32_t getSampleTrackIndex() override;
+
+    int64_t getSampleTime() override;
+
+    uint32_t getSampleFlags() override;
+
+    ssize_t readSampleData(uint8_t* buffer, size_t capacity) override;
+
+    // No getSampleData(): a segment's file is released when the next one opens, before its
+    // packets are necessarily decoded.
+
+    bool advance() override;
+
+    bool seekTo(int64_t timeUs) override;
+
+    IMediaSource* getDemuxer() override;
+
+    // Start of every segment. Segments start with a sync sample, so this is the keyframe index.
+    std::vector<int64_t> getSegmentTimes() const;
+
+    static constexpr int32_t kFetchAttempts = 3;  // the retries go to the lowest rendition
+
+private:
+    struct Fetched {
+        int32_t     rendition;
+        std::string path;   // empty when every attempt failed
+    };
+
+    void fetchLoop();
+
+    // The segment's file from the cache, downloading it on a miss. Fetch thread only.
+    std::string fetchSegment(size_t index, int32_t rendition);
+
+    // Waits for the segment and makes it the current one.
+    bool openSegment(size_t index);
+
+    int64_t bufferedUsLocked() const;
+
+    size_t segmentCount() const { return mManifest.renditions.empty() ? 0 : mManifest.renditions[0].segments.size(); }
+
+    std::shared_ptr<IMediaBackend>          mBackend;
+    std::shared_ptr<CSegmentCache>          mSegmentCache;
+    int64_t                                 mPrefetchUs;
+    std::shared_ptr<AdaptiveStreamCounters> mCounters;
+    std::shared_ptr<MediaIoCounters>        mIoCounters;
+    AdaptiveManifest                        mManifest;
+    std::vector<int64_t>                    mBandwidths;
+
+    // Fetch thread only.
+    CAbrController                          mAbr;
+    std::vector<std::vector<uint8_t>>       mInitSegments;  // per rendition, downloaded once
+    int32_t                                 mLastFetchRendition{-1};
+
+    // Demux side only.
+    std::shared_ptr<IMediaSource>           mSegment;
+    size_t                                  mSegmentIndex{0};
+    int32_t                                 mSegmentRendition{0};
+    int32_t                                 mDeliveredRendition{-1};  // rendition whose codec configs the decoders have
+    std::vector<bool>                       mSelected;
+    std::vector<bool>                       mFormatChanged;   // per track, until its first sample after a config change
+    std::vector<std::vector<uint8_t>>       mTrackConfigs;    // per track, last config delivered
+
+    std::mutex                              mMutex;
+    std::condition_variable                 mFetchWake;
+    std::condition_variable                 mSegmentReady;
+    std::map<size_t, Fetched>               mFetched;       // downloaded, not yet opened
+    size_t                                  mFetchIndex{0};  // next segment to download
+    size_t                                  mDemuxIndex{0};
+    std::atomic<bool>                       mStopping{false};
+    std::thread                             mFetchThread;
+};
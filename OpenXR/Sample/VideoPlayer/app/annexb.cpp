@@ -0,0 +1,244 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// NAL unit parsing for Annex-B H.264 / HEVC elementary streams.
+
+#include "pch.h"
+#include "common.h"
+#include "annexb.h"
+
+namespace {
+
+// Reads the RBSP of a NAL unit, skipping emulation prevention bytes (00 00 03). Reading past the
+// end yields zero bits and sets overrun.
+class RbspReader {
+public:
+    RbspReader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+    uint32_t bits(int32_t count) {
+        uint32_t value = 0;
+        for (int32_t i = 0; i < count; i++) {
+            value = (value << 1) | bit();
+        }
+        return value;
+    }
+
+    uint32_t bit() {
+        if (mBit == 0) {
+            nextByte();
+        }
+        mBit--;
+        return (mByte >> mBit) & 1;
+    }
+
+    void skip(int32_t count) {
+        for (int32_t i = 0; i < count; i++) {
+            bit();
+        }
+    }
+
+    // Exp-Golomb ue(v); 32 leading zeros or more count as corrupt.
+    uint32_t ue() {
+        int32_t zeros = 0;
+        while (bit() == 0) {
+            if (++zeros >= 32 || overrun) {
+                overrun = true;
+                return 0;
+            }
+        }
+        return ((1u << zeros) - 1) + bits(zeros);
+    }
+
+    int32_t se() {
+        const uint32_t value = ue();
+        return (value & 1) ? (int32_t)((value + 1) / 2) : -(int32_t)(value / 2);
+    }
+
+    bool overrun = false;
+
+private:
+    void nextByte() {
+        if (mPos >= mSize) {
+            overrun = true;
+            mByte = 0;
+        } else {
+            if (mZeros >= 2 && mData[mPos] == 3) {
+                mPos++;
+                mZeros = 0;
+            }
+            mByte = mPos < mSize ? mData[mPos++] : 0;
+            mZeros = (mByte == 0) ? mZeros + 1 : 0;
+        }
+        mBit = 8;
+    }
+
+    const uint8_t* mData;
+    size_t         mSize;
+    size_t         mPos = 0;
+    int32_t        mZeros = 0;
+    uint8_t        mByte = 0;
+    int32_t        mBit = 0;
+};
+
+void SkipAvcScalingList(RbspReader& reader, int32_t size) {
+    int32_t lastScale = 8;
+    int32_t nextScale = 8;
+    for (int32_t i = 0; i < size; i++) {
+        if (nextScale != 0) {
+            nextScale = (lastScale + reader.se() + 256) % 256;
+        }
+        lastScale = (nextScale == 0) ? lastScale : nextScale;
+    }
+}
+
+bool ParseAvcSps(RbspReader& reader, int32_t& width, int32_t& height) {
+    const uint32_t profile = reader.bits(8);
+    reader.skip(16);  // constraint flags, level_idc
+    reader.ue();      // seq_parameter_set_id
+    uint32_t chromaFormat = 1;
+    bool separateColourPlanes = false;
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 244 || profile == 44 || profile == 83 || profile == 86 ||
+        profile == 118 || profile == 128 || profile == 138 || profile == 139 || profile == 134 || profile == 135) {
+        chromaFormat = reader.ue();
+        if (chromaFormat == 3) {
+            separateColourPlanes = reader.bit();
+        }
+        reader.ue();    // bit_depth_luma_minus8
+        reader.ue();    // bit_depth_chroma_minus8
+        reader.skip(1); // qpprime_y_zero_transform_bypass_flag
+        if (reader.bit()) {
+            for (int32_t i = 0; i < (chromaFormat != 3 ? 8 : 12); i++) {
+                if (reader.bit()) {
+                    SkipAvcScalingList(reader, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+    reader.ue();  // log2_max_frame_num_minus4
+    const uint32_t pocType = reader.ue();
+    if (pocType == 0) {
+        reader.ue();
+    } else if (pocType == 1) {
+        reader.skip(1);
+        reader.se();
+        reader.se();
+        const uint32_t cycle = reader.ue();
+        for (uint32_t i = 0; i < cycle && !reader.overrun; i++) {
+            reader.se();
+        }
+    }
+    reader.ue();    // max_num_ref_frames
+    reader.skip(1); // gaps_in_frame_num_value_allowed_flag
+    const uint32_t widthInMbs = reader.ue() + 1;
+    const uint32_t heightInMapUnits = reader.ue() + 1;
+    const uint32_t frameMbsOnly = reader.bit();
+    if (!frameMbsOnly) {
+        reader.skip(1);
+    }
+    reader.skip(1); // direct_8x8_inference_flag
+    uint32_t cropLeft = 0, cropRight = 0, cropTop = 0, cropBottom = 0;
+    if (reader.bit()) {
+        cropLeft = reader.ue();
+        cropRight = reader.ue();
+        cropTop = reader.ue();
+        cropBottom = reader.ue();
+    }
+    if (reader.overrun) {
+        return false;
+    }
+    const bool monochrome = chromaFormat == 0 || separateColourPlanes;
+    const uint32_t cropUnitX = monochrome ? 1 : (chromaFormat == 3 ? 1 : 2);
+    const uint32_t cropUnitY = (monochrome ? 1 : (chromaFormat == 1 ? 2 : 1)) * (2 - frameMbsOnly);
+    width = (int32_t)(widthInMbs * 16 - cropUnitX * (cropLeft + cropRight));
+    height = (int32_t)((2 - frameMbsOnly) * heightInMapUnits * 16 - cropUnitY * (cropTop + cropBottom));
+    return width > 0 && height > 0;
+}
+
+bool ParseHevcSps(RbspReader& reader, int32_t& width, int32_t& height) {
+    reader.skip(4);  // sps_video_parameter_set_id
+    const uint32_t maxSubLayersMinus1 = reader.bits(3);
+    reader.skip(1);  // sps_temporal_id_nesting_flag
+    // profile_tier_level(1, sps_max_sub_layers_minus1)
+    reader.skip(96);
+    bool profilePresent[8] = {};
+    bool levelPresent[8] = {};
+    for (uint32_t i = 0; i < maxSubLayersMinus1; i++) {
+        profilePresent[i] = reader.bit();
+        levelPresent[i] = reader.bit();
+    }
+    if (maxSubLayersMinus1 > 0) {
+        reader.skip(2 * (8 - maxSubLayersMinus1));
+    }
+    for (uint32_t i = 0; i < maxSubLayersMinus1; i++) {
+        reader.skip((profilePresent[i] ? 88 : 0) + (levelPresent[i] ? 8 : 0));
+    }
+    reader.ue();  // sps_seq_parameter_set_id
+    const uint32_t chromaFormat = reader.ue();
+    if (chromaFormat == 3) {
+        reader.skip(1);
+    }
+    const uint32_t lumaWidth = reader.ue();
+    const uint32_t lumaHeight = reader.ue();
+    uint32_t cropLeft = 0, cropRight = 0, cropTop = 0, cropBottom = 0;
+    if (reader.bit()) {
+        cropLeft = reader.ue();
+        cropRight = reader.ue();
+        cropTop = reader.ue();
+        cropBottom = reader.ue();
+    }
+    if (reader.overrun) {
+        return false;
+    }
+    const uint32_t subWidth = (chromaFormat == 1 || chromaFormat == 2) ? 2 : 1;
+    const uint32_t subHeight = (chromaFormat == 1) ? 2 : 1;
+    width = (int32_t)(lumaWidth - subWidth * (cropLeft + cropRight));
+    height = (int32_t)(lumaHeight - subHeight * (cropTop + cropBottom));
+    return width > 0 && height > 0;
+}
+}  // namespace
+
+const uint8_t* FindStartCode(const uint8_t* begin, const uint8_t* end) {
+    for (const uint8_t* p = begin; p + 3 <= end; p++) {
+        if (p[2] > 1) {
+            p += 2;  // none of the three bytes can start a code at p, p+1 or p+2
+        } else if (p[0] == 0 && p[1] == 0 && p[2] == 1) {
+            return p;
+        }
+    }
+    return end;
+}
+
+NalUnitInfo ClassifyNalUnit(bool hevc, const uint8_t* nal, size_t size) {
+    NalUnitInfo info;
+    if (size < (hevc ? 3u : 2u)) {
+        return info;
+    }
+    if (hevc) {
+        info.type = (nal[0] >> 1) & 0x3f;
+        info.vcl = info.type < 32;
+        info.firstSlice = info.vcl && (nal[2] & 0x80);        // first_slice_segment_in_pic_flag
+        info.keyframe = info.type >= 16 && info.type <= 21;   // BLA, IDR, CRA
+        info.sps = info.type == 33;
+        info.pps = info.type == 34;
+        info.parameterSet = info.type >= 32 && info.type <= 34;
+        info.startsAccessUnit = info.parameterSet || info.type == 35 || info.type == 39;  // AUD, prefix SEI
+    } else {
+        info.type = nal[0] & 0x1f;
+        info.vcl = info.type >= 1 && info.type <= 5;
+        info.firstSlice = info.vcl && (nal[1] & 0x80);        // first_mb_in_slice == 0
+        info.keyframe = info.type == 5;
+        info.sps = info.type == 7;
+        info.pps = info.type == 8;
+        info.parameterSet = info.sps || info.pps;
+        info.startsAccessUnit = info.parameterSet || info.type == 9 || info.type == 6;    // AUD, SEI
+    }
+    return info;
+}
+
+bool ParseSpsPictureSize(bool hevc, const uint8_t* nal, size_t size, int32_t& width, int32_t& height) {
+    const size_t headerSize = hevc ? 2 : 1;
+    if (size <= headerSize) {
+        return false;
+    }
+    RbspReader reader(nal + headerSize, size - headerSize);
+    return hevc ? ParseHevcSps(reader, width, height) : ParseAvcSps(reader, width, height);
+}
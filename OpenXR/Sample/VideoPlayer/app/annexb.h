@@ -0,0 +1,28 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// NAL unit parsing for Annex-B H.264 / HEVC elementary streams.
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct NalUnitInfo_tag {
+    NalUnitInfo_tag() : type(-1), vcl(false), firstSlice(false), keyframe(false), parameterSet(false), sps(false), pps(false), startsAccessUnit(false) {};
+    int32_t type;
+    bool vcl;               // coded slice
+    bool firstSlice;        // first slice of a picture
+    bool keyframe;          // IDR (H.264) or IRAP (HEVC) slice
+    bool parameterSet;      // VPS, SPS or PPS
+    bool sps;
+    bool pps;
+    bool startsAccessUnit;  // AUD, parameter set or prefix SEI: only ever precedes the slices of a picture
+}NalUnitInfo;
+
+// First three-byte start code (00 00 01) in [begin, end), or end.
+const uint8_t* FindStartCode(const uint8_t* begin, const uint8_t* end);
+
+// nal points at the NAL unit header, past the start code.
+NalUnitInfo ClassifyNalUnit(bool hevc, const uint8_t* nal, size_t size);
+
+// Cropped picture size from a sequence parameter set NAL unit.
+bool ParseSpsPictureSize(bool hevc, const uint8_t* nal, size_t size, int32_t& width, int32_t& height);
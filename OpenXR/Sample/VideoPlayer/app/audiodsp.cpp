@@ -0,0 +1,615 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Audio DSP between the decoder and the audio sink: sample format conversion, downmix to the
+// device's channel count and resampling to its native rate.
+
+#include "pch.h"
+#include "common.h"
+#include "audiodsp.h"
+
+#include <cmath>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AUDIODSP_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define AUDIODSP_SSE2 1
+#endif
+
+namespace {
+
+constexpr float kInt16Scale = 32768.0f;
+constexpr float kMinusThreeDb = 0.70710678f;
+constexpr double kRolloff = 0.9;        // passband edge as a fraction of the lower Nyquist rate
+constexpr double kKaiserBeta = 8.0;     // about 80 dB stopband
+constexpr int32_t kMaxTaps = 128;
+
+#if defined(AUDIODSP_SSE2)
+inline float HorizontalSum(__m128 v) {
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+// Sum of a[i] * b[i].
+inline float DotProduct(const float* a, const float* b, int32_t count) {
+    int32_t i = 0;
+    float sum = 0.0f;
+#if defined(AUDIODSP_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (; i + 8 <= count; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    for (; i + 4 <= count; i += 4) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+#elif defined(AUDIODSP_SSE2)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= count; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    for (; i + 4 <= count; i += 4) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    sum = HorizontalSum(_mm_add_ps(acc0, acc1));
+#endif
+    for (; i < count; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#if defined(AUDIODSP_NEON) || defined(AUDIODSP_SSE2)
+// Downmix of 5.1 or 7.1 to stereo, four frames at a time: the frames are transposed so that each
+// vector holds one input channel of all four, and each output is then a sum of those vectors
+// scaled by its broadcast matrix coefficients. Returns the number of frames done.
+template <int32_t InChannels>
+int32_t MixSurroundToStereo(const float* in, int32_t numFrames, const float* matrix, float* const* out, int32_t outStride) {
+    static_assert(InChannels == 6 || InChannels == 8, "four channels transposed, then the remaining two or four");
+    int32_t i = 0;
+#if defined(AUDIODSP_NEON)
+    float32x4_t left[InChannels];
+    float32x4_t right[InChannels];
+    for (int32_t k = 0; k < InChannels; k++) {
+        left[k] = vdupq_n_f32(matrix[k]);
+        right[k] = vdupq_n_f32(matrix[InChannels + k]);
+    }
+    for (; i + 4 <= numFrames; i += 4) {
+        const float* f = in + (size_t)i * InChannels;
+        float32x4_t channel[InChannels];
+        for (int32_t k = 0; k + 4 <= InChannels; k += 4) {
+            const float32x4x2_t t01 = vtrnq_f32(vld1q_f32(f + k), vld1q_f32(f + InChannels + k));
+            const float32x4x2_t t23 = vtrnq_f32(vld1q_f32(f + 2 * InChannels + k), vld1q_f32(f + 3 * InChannels + k));
+            channel[k] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+            channel[k + 1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+            channel[k + 2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+            channel[k + 3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+        }
+        if (InChannels == 6) {
+            const float32x4x2_t pairs = vuzpq_f32(vcombine_f32(vld1_f32(f + 4), vld1_f32(f + 10)), vcombine_f32(vld1_f32(f + 16), vld1_f32(f + 22)));
+            channel[4] = pairs.val[0];
+            channel[5] = pairs.val[1];
+        }
+        float32x4_t l = vmulq_f32(channel[0], left[0]);
+        float32x4_t r = vmulq_f32(channel[0], right[0]);
+        for (int32_t k = 1; k < InChannels; k++) {
+            l = vfmaq_f32(l, channel[k], left[k]);
+            r = vfmaq_f32(r, channel[k], right[k]);
+        }
+        if (outStride == 1) {
+            vst1q_f32(out[0] + i, l);
+            vst1q_f32(out[1] + i, r);
+        } else if (outStride == 2 && out[1] == out[0] + 1) {
+            float32x4x2_t lr;
+            lr.val[0] = l;
+            lr.val[1] = r;
+            vst2q_f32(out[0] + 2 * (size_t)i, lr);
+        } else {
+            for (int32_t j = 0; j < 4; j++) {
+                out[0][(size_t)(i + j) * outStride] = vgetq_lane_f32(l, 0);
+                out[1][(size_t)(i + j) * outStride] = vgetq_lane_f32(r, 0);
+                l = vextq_f32(l, l, 1);
+                r = vextq_f32(r, r, 1);
+            }
+        }
+    }
+#elif defined(AUDIODSP_SSE2)
+    __m128 left[InChannels];
+    __m128 right[InChannels];
+    for (int32_t k = 0; k < InChannels; k++) {
+        left[k] = _mm_set1_ps(matrix[k]);
+        right[k] = _mm_set1_ps(matrix[InChannels + k]);
+    }
+    for (; i + 4 <= numFrames; i += 4) {
+        const float* f = in + (size_t)i * InChannels;
+        __m128 channel[InChannels];
+        for (int32_t k = 0; k + 4 <= InChannels; k += 4) {
+            __m128 r0 = _mm_loadu_ps(f + k);
+            __m128 r1 = _mm_loadu_ps(f + InChannels + k);
+            __m128 r2 = _mm_loadu_ps(f + 2 * InChannels + k);
+            __m128 r3 = _mm_loadu_ps(f + 3 * InChannels + k);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            channel[k] = r0;
+            channel[k + 1] = r1;
+            channel[k + 2] = r2;
+            channel[k + 3] = r3;
+        }
+        if (InChannels == 6) {
+            // Channels 4 and 5 of frames 0 and 1, then of frames 2 and 3, 64 bits per frame.
+            const __m128 p01 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(f + 4)), (const __m64*)(f + 10));
+            const __m128 p23 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(f + 16)), (const __m64*)(f + 22));
+            channel[4] = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0));
+            channel[5] = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1));
+        }
+        __m128 l = _mm_mul_ps(channel[0], left[0]);
+        __m128 r = _mm_mul_ps(channel[0], right[0]);
+        for (int32_t k = 1; k < InChannels; k++) {
+            l = _mm_add_ps(l, _mm_mul_ps(channel[k], left[k]));
+            r = _mm_add_ps(r, _mm_mul_ps(channel[k], right[k]));
+        }
+        if (outStride == 1) {
+            _mm_storeu_ps(out[0] + i, l);
+            _mm_storeu_ps(out[1] + i, r);
+        } else if (outStride == 2 && out[1] == out[0] + 1) {
+            _mm_storeu_ps(out[0] + 2 * (size_t)i, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(out[0] + 2 * (size_t)i + 4, _mm_unpackhi_ps(l, r));
+        } else {
+            for (int32_t j = 0; j < 4; j++) {
+                out[0][(size_t)(i + j) * outStride] = _mm_cvtss_f32(l);
+                out[1][(size_t)(i + j) * outStride] = _mm_cvtss_f32(r);
+                l = _mm_shuffle_ps(l, l, _MM_SHUFFLE(0, 3, 2, 1));
+                r = _mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 3, 2, 1));
+            }
+        }
+    }
+#endif
+    return i;
+}
+#endif
+
+// Modified Bessel function of the first kind, order 0, for the Kaiser window.
+double BesselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int32_t k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+}  // namespace
+
+void ConvertInt16ToFloat(const int16_t* in, float* out, int32_t count) {
+    int32_t i = 0;
+#if defined(AUDIODSP_NEON)
+    for (; i + 8 <= count; i += 8) {
+        const int16x8_t s = vld1q_s16(in + i);
+        vst1q_f32(out + i, vcvtq_n_f32_s32(vmovl_s16(vget_low_s16(s)), 15));
+        vst1q_f32(out + i + 4, vcvtq_n_f32_s32(vmovl_s16(vget_high_s16(s)), 15));
+    }
+#endif
+    // No SSE2 path: the compiler vectorizes this loop itself, and bench_audiodsp had a hand-written
+    // unpack, shift and convert slower than it.
+    for (; i < count; i++) {
+        out[i] = in[i] * (1.0f / kInt16Scale);
+    }
+}
+
+void ConvertFloatToInt16(const float* in, int16_t* out, int32_t count) {
+    int32_t i = 0;
+#if defined(AUDIODSP_NEON)
+    const float32x4_t scale = vdupq_n_f32(kInt16Scale);
+    for (; i + 8 <= count; i += 8) {
+        const int32x4_t lo = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i), scale));
+        const int32x4_t hi = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i + 4), scale));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+#elif defined(AUDIODSP_SSE2)
+    const __m128 scale = _mm_set1_ps(kInt16Scale);
+    for (; i + 8 <= count; i += 8) {
+        // cvtps rounds to nearest even under the default MXCSR; packs saturates to int16.
+        const __m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+        const __m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for (; i < count; i++) {
+        const float s = std::nearbyint(in[i] * kInt16Scale);
+        out[i] = (int16_t)std::min(32767.0f, std::max(-32768.0f, s));
+    }
+}
+
+void MixChannels(const float* in, int32_t inChannels, int32_t numFrames, const float* matrix, float* const* out, int32_t outChannels, int32_t outStride) {
+    if (inChannels == 2 && outChannels == 2 && outStride == 1 && matrix[0] == 1.0f && matrix[1] == 0.0f && matrix[2] == 0.0f && matrix[3] == 1.0f) {
+        // Plain deinterleave, the common stereo case in front of the resampler.
+        int32_t i = 0;
+#if defined(AUDIODSP_NEON)
+        for (; i + 4 <= numFrames; i += 4) {
+            const float32x4x2_t lr = vld2q_f32(in + 2 * i);
+            vst1q_f32(out[0] + i, lr.val[0]);
+            vst1q_f32(out[1] + i, lr.val[1]);
+        }
+#elif defined(AUDIODSP_SSE2)
+        for (; i + 4 <= numFrames; i += 4) {
+            const __m128 a = _mm_loadu_ps(in + 2 * i);
+            const __m128 b = _mm_loadu_ps(in + 2 * i + 4);
+            _mm_storeu_ps(out[0] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(out[1] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+#endif
+        for (; i < numFrames; i++) {
+            out[0][i] = in[2 * i];
+            out[1][i] = in[2 * i + 1];
+        }
+        return;
+    }
+    int32_t i = 0;
+#if defined(AUDIODSP_NEON) || defined(AUDIODSP_SSE2)
+    if (inChannels == 6 && outChannels == 2) {
+        i = MixSurroundToStereo<6>(in, numFrames, matrix, out, outStride);
+    } else if (inChannels == 8 && outChannels == 2) {
+        i = MixSurroundToStereo<8>(in, numFrames, matrix, out, outStride);
+    }
+#endif
+    for (; i < numFrames; i++) {
+        const float* frame = in + (size_t)i * inChannels;
+        for (int32_t c = 0; c < outChannels; c++) {
+            out[c][(size_t)i * outStride] = DotProduct(frame, matrix + (size_t)c * inChannels, inChannels);
+        }
+    }
+}
+
+void ComplexMultiplyAccumulate(const float* aRe, const float* aIm, const float* bRe, const float* bIm, float* accRe, float* accIm, int32_t count) {
+    int32_t i = 0;
+#if defined(AUDIODSP_NEON)
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t ar = vld1q_f32(aRe + i);
+        const float32x4_t ai = vld1q_f32(aIm + i);
+        const float32x4_t br = vld1q_f32(bRe + i);
+        const float32x4_t bi = vld1q_f32(bIm + i);
+        vst1q_f32(accRe + i, vfmsq_f32(vfmaq_f32(vld1q_f32(accRe + i), ar, br), ai, bi));
+        vst1q_f32(accIm + i, vfmaq_f32(vfmaq_f32(vld1q_f32(accIm + i), ar, bi), ai, br));
+    }
+#elif defined(AUDIODSP_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        const __m128 ar = _mm_loadu_ps(aRe + i);
+        const __m128 ai = _mm_loadu_ps(aIm + i);
+        const __m128 br = _mm_loadu_ps(bRe + i);
+        const __m128 bi = _mm_loadu_ps(bIm + i);
+        _mm_storeu_ps(accRe + i, _mm_add_ps(_mm_loadu_ps(accRe + i), _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi))));
+        _mm_storeu_ps(accIm + i, _mm_add_ps(_mm_loadu_ps(accIm + i), _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))));
+    }
+#endif
+    for (; i < count; i++) {
+        accRe[i] += aRe[i] * bRe[i] - aIm[i] * bIm[i];
+        accIm[i] += aRe[i] * bIm[i] + aIm[i] * bRe[i];
+    }
+}
+
+void RampedMultiplyAccumulate(const float* in, float gain, float step, float* out, int32_t count) {
+    int32_t i = 0;
+#if defined(AUDIODSP_NEON)
+    const float lanes[4] = {1.0f, 2.0f, 3.0f, 4.0f};
+    float32x4_t g = vmlaq_n_f32(vdupq_n_f32(gain), vld1q_f32(lanes), step);
+    const float32x4_t advance = vdupq_n_f32(4.0f * step);
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(out + i, vfmaq_f32(vld1q_f32(out + i), g, vld1q_f32(in + i)));
+        g = vaddq_f32(g, advance);
+    }
+#elif defined(AUDIODSP_SSE2)
+    __m128 g = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(_mm_setr_ps(1.0f, 2.0f, 3.0f, 4.0f), _mm_set1_ps(step)));
+    const __m128 advance = _mm_set1_ps(4.0f * step);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(g, _mm_loadu_ps(in + i))));
+        g = _mm_add_ps(g, advance);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] += (gain + step * (i + 1)) * in[i];
+    }
+}
+
+void CFft::configure(int32_t size) {
+    mSize = size;
+    int32_t bits = 0;
+    while ((1 << bits) < size) {
+        bits++;
+    }
+    mBitReverse.resize(size);
+    for (int32_t i = 0; i < size; i++) {
+        int32_t reversed = 0;
+        for (int32_t b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        mBitReverse[i] = reversed;
+    }
+    mTwiddleRe.resize(std::max(size - 1, 1));
+    mTwiddleIm.resize(std::max(size - 1, 1));
+    for (int32_t half = 1; half < size; half <<= 1) {
+        for (int32_t j = 0; j < half; j++) {
+            const double angle = -M_PI * j / half;
+            mTwiddleRe[half - 1 + j] = (float)std::cos(angle);
+            mTwiddleIm[half - 1 + j] = (float)std::sin(angle);
+        }
+    }
+}
+
+void CFft::forward(float* re, float* im) const {
+    for (int32_t i = 0; i < mSize; i++) {
+        const int32_t j = mBitReverse[i];
+        if (j > i) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+    for (int32_t half = 1; half < mSize; half <<= 1) {
+        const float* twRe = mTwiddleRe.data() + half - 1;
+        const float* twIm = mTwiddleIm.data() + half - 1;
+        for (int32_t start = 0; start < mSize; start += 2 * half) {
+            float* aRe = re + start;
+            float* aIm = im + start;
+            float* bRe = aRe + half;
+            float* bIm = aIm + half;
+            int32_t j = 0;
+#if defined(AUDIODSP_NEON)
+            for (; j + 4 <= half; j += 4) {
+                const float32x4_t wr = vld1q_f32(twRe + j);
+                const float32x4_t wi = vld1q_f32(twIm + j);
+                const float32x4_t xr = vld1q_f32(bRe + j);
+                const float32x4_t xi = vld1q_f32(bIm + j);
+                const float32x4_t tr = vfmsq_f32(vmulq_f32(wr, xr), wi, xi);
+                const float32x4_t ti = vfmaq_f32(vmulq_f32(wr, xi), wi, xr);
+                const float32x4_t ur = vld1q_f32(aRe + j);
+                const float32x4_t ui = vld1q_f32(aIm + j);
+                vst1q_f32(aRe + j, vaddq_f32(ur, tr));
+                vst1q_f32(aIm + j, vaddq_f32(ui, ti));
+                vst1q_f32(bRe + j, vsubq_f32(ur, tr));
+                vst1q_f32(bIm + j, vsubq_f32(ui, ti));
+            }
+#elif defined(AUDIODSP_SSE2)
+            for (; j + 4 <= half; j += 4) {
+                const __m128 wr = _mm_loadu_ps(twRe + j);
+                const __m128 wi = _mm_loadu_ps(twIm + j);
+                const __m128 xr = _mm_loadu_ps(bRe + j);
+                const __m128 xi = _mm_loadu_ps(bIm + j);
+                const __m128 tr = _mm_sub_ps(_mm_mul_ps(wr, xr), _mm_mul_ps(wi, xi));
+                const __m128 ti = _mm_add_ps(_mm_mul_ps(wr, xi), _mm_mul_ps(wi, xr));
+                const __m128 ur = _mm_loadu_ps(aRe + j);
+                const __m128 ui = _mm_loadu_ps(aIm + j);
+                _mm_storeu_ps(aRe + j, _mm_add_ps(ur, tr));
+                _mm_storeu_ps(aIm + j, _mm_add_ps(ui, ti));
+                _mm_storeu_ps(bRe + j, _mm_sub_ps(ur, tr));
+                _mm_storeu_ps(bIm + j, _mm_sub_ps(ui, ti));
+            }
+#endif
+            for (; j < half; j++) {
+                const float tr = twRe[j] * bRe[j] - twIm[j] * bIm[j];
+                const float ti = twRe[j] * bIm[j] + twIm[j] * bRe[j];
+                bRe[j] = aRe[j] - tr;
+                bIm[j] = aIm[j] - ti;
+                aRe[j] += tr;
+                aIm[j] += ti;
+            }
+        }
+    }
+}
+
+std::vector<float> CreateDownmixMatrix(int32_t inChannels, int32_t outChannels) {
+    std::vector<float> matrix((size_t)outChannels * inChannels, 0.0f);
+    // Left and right gains of each input channel, for the layouts the decoders emit.
+    static const float kFront[2][2] = {{1.0f, 0.0f}, {0.0f, 1.0f}};
+    static const float kCentre[2] = {kMinusThreeDb, kMinusThreeDb};
+    static const float kLfe[2] = {0.0f, 0.0f};
+    static const float kLeft[2] = {kMinusThreeDb, 0.0f};
+    static const float kRight[2] = {0.0f, kMinusThreeDb};
+    const float* layout[8] = {};
+    switch (inChannels) {
+        case 3: {  // FL FR FC
+            const float* channels[] = {kFront[0], kFront[1], kCentre};
+            std::copy(std::begin(channels), std::end(channels), layout);
+            break;
+        }
+        case 4: {  // FL FR BL BR
+            const float* channels[] = {kFront[0], kFront[1], kLeft, kRight};
+            std::copy(std::begin(channels), std::end(channels), layout);
+            break;
+        }
+        case 5: {  // FL FR FC BL BR
+            const float* channels[] = {kFront[0], kFront[1], kCentre, kLeft, kRight};
+            std::copy(std::begin(channels), std::end(channels), layout);
+            break;
+        }
+        case 6: {  // FL FR FC LFE BL BR
+            const float* channels[] = {kFront[0], kFront[1], kCentre, kLfe, kLeft, kRight};
+            std::copy(std::begin(channels), std::end(channels), layout);
+            break;
+        }
+        case 8: {  // FL FR FC LFE BL BR SL SR
+            const float* channels[] = {kFront[0], kFront[1], kCentre, kLfe, kLeft, kRight, kLeft, kRight};
+            std::copy(std::begin(channels), std::end(channels), layout);
+            break;
+        }
+        default:
+            break;
+    }
+    if (outChannels == 2 && layout[0] != nullptr) {
+        for (int32_t c = 0; c < 2; c++) {
+            float sum = 0.0f;
+            for (int32_t i = 0; i < inChannels; i++) {
+                sum += layout[i][c];
+            }
+            for (int32_t i = 0; i < inChannels; i++) {
+                matrix[(size_t)c * inChannels + i] = layout[i][c] / sum;
+            }
+        }
+    } else if (inChannels == 1) {
+        for (int32_t c = 0; c < outChannels; c++) {
+            matrix[c] = 1.0f;
+        }
+    } else {
+        for (int32_t c = 0; c < std::min(inChannels, outChannels); c++) {
+            matrix[(size_t)c * inChannels + c] = 1.0f;
+        }
+    }
+    return matrix;
+}
+
+bool CPolyphaseResampler::configure(int32_t channelCount, int32_t inRate, int32_t outRate) {
+    if (channelCount <= 0 || inRate <= 0 || outRate <= 0) {
+        return false;
+    }
+    int32_t divisor = inRate;
+    for (int32_t rest = outRate; rest != 0;) {
+        std::swap(divisor, rest);
+        rest %= divisor;
+    }
+    mUp = outRate / divisor;
+    mDown = inRate / divisor;
+    if (mUp > kMaxPhases) {
+        Log::Write(Log::Level::Error, Fmt("resampler: %d -> %d Hz needs %d phases", inRate, outRate, mUp));
+        return false;
+    }
+    mChannelCount = channelCount;
+    // Downsampling lowers the cutoff below the input Nyquist rate, which takes proportionally more taps.
+    const int32_t ratio = (mDown + mUp - 1) / mUp;
+    mTaps = std::min(kMaxTaps, kTapsPerPhase * ratio);
+
+    // Prototype at the upsampled rate, cut off below the lower Nyquist rate and with a gain of mUp
+    // to make up for the zeros the upsampling inserts.
+    const int32_t length = mUp * mTaps;
+    const double cutoff = 0.5 * kRolloff / std::max(mUp, mDown);
+    const double centre = (length - 1) / 2.0;
+    const double windowScale = 1.0 / BesselI0(kKaiserBeta);
+    std::vector<double> prototype(length);
+    double sum = 0.0;
+    for (int32_t n = 0; n < length; n++) {
+        const double t = n - centre;
+        const double x = 2.0 * cutoff * t;
+        const double sinc = (t == 0.0) ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+        const double r = t / centre;
+        const double window = BesselI0(kKaiserBeta * std::sqrt(std::max(0.0, 1.0 - r * r))) * windowScale;
+        prototype[n] = 2.0 * cutoff * sinc * window;
+        sum += prototype[n];
+    }
+    // Phase p sees prototype taps p, p + L, p + 2L... against the newest input first; each row is
+    // stored oldest input first so it lines up with the history buffer.
+    mCoefficients.assign((size_t)mUp * mTaps, 0.0f);
+    for (int32_t p = 0; p < mUp; p++) {
+        for (int32_t j = 0; j < mTaps; j++) {
+            mCoefficients[(size_t)p * mTaps + (mTaps - 1 - j)] = (float)(prototype[p + j * mUp] * mUp / sum);
+        }
+    }
+    mDelayFrames = centre / mDown;
+    mHistory.assign(channelCount, std::vector<float>());
+    mInputs.assign(channelCount, nullptr);
+    reset();
+    return true;
+}
+
+void CPolyphaseResampler::reset() {
+    for (std::vector<float>& history : mHistory) {
+        std::fill(history.begin(), history.end(), 0.0f);
+        if (history.size() < (size_t)(mTaps - 1)) {
+            history.resize(mTaps - 1, 0.0f);
+        }
+    }
+    mPosition = 0;
+}
+
+int32_t CPolyphaseResampler::maxOutputFrames(int32_t numFrames) const {
+    return (int32_t)((int64_t)numFrames * mUp / mDown + 1);
+}
+
+float* const* CPolyphaseResampler::prepare(int32_t numFrames) {
+    for (int32_t c = 0; c < mChannelCount; c++) {
+        std::vector<float>& history = mHistory[c];
+        if (history.size() < (size_t)(mTaps - 1 + numFrames)) {
+            history.resize(mTaps - 1 + numFrames);
+        }
+        mInputs[c] = history.data() + mTaps - 1;
+    }
+    return mInputs.data();
+}
+
+int32_t CPolyphaseResampler::process(int32_t numFrames, float* out) {
+    const int64_t end = (int64_t)numFrames * mUp;
+    int32_t produced = 0;
+    for (; mPosition < end; mPosition += mDown, produced++) {
+        // Newest input frame and phase of this output; its filter spans the mTaps frames up to it,
+        // which start at that index in the history buffer.
+        const int32_t newest = (int32_t)(mPosition / mUp);
+        const float* coefficients = mCoefficients.data() + (size_t)(mPosition % mUp) * mTaps;
+        for (int32_t c = 0; c < mChannelCount; c++) {
+            out[(size_t)produced * mChannelCount + c] = DotProduct(coefficients, mHistory[c].data() + newest, mTaps);
+        }
+    }
+    mPosition -= end;
+    for (std::vector<float>& history : mHistory) {
+        memmove(history.data(), history.data() + numFrames, (mTaps - 1) * sizeof(float));
+    }
+    return produced;
+}
+
+bool CAudioConverter::configure(int32_t inChannels, int32_t inRate, int32_t outChannels, int32_t outRate) {
+    mInChannels = inChannels;
+    mOutChannels = outChannels;
+    mOutRate = outRate;
+    mPassthrough = (inChannels == outChannels && inRate == outRate);
+    mResample = (inRate != outRate);
+    mMatrix = CreateDownmixMatrix(inChannels, outChannels);
+    mOutputs.assign(outChannels, nullptr);
+    if (mResample && !mResampler.configure(outChannels, inRate, outRate)) {
+        return false;
+    }
+    if (!mPassthrough) {
+        Log::Write(Log::Level::Info, Fmt("audio converter: %d channels @ %d Hz -> %d channels @ %d Hz", inChannels, inRate, outChannels, outRate));
+    }
+    return true;
+}
+
+int32_t CAudioConverter::process(const int16_t* in, int32_t numFrames) {
+    if (mPassthrough) {
+        mOutput.assign(in, in + (size_t)numFrames * mInChannels);
+        return numFrames;
+    }
+    mFloat.resize((size_t)numFrames * mInChannels);
+    ConvertInt16ToFloat(in, mFloat.data(), numFrames * mInChannels);
+
+    int32_t outFrames = numFrames;
+    if (mResample) {
+        float* const* planes = mResampler.prepare(numFrames);
+        MixChannels(mFloat.data(), mInChannels, numFrames, mMatrix.data(), planes, mOutChannels, 1);
+        mMixed.resize((size_t)mResampler.maxOutputFrames(numFrames) * mOutChannels);
+        outFrames = mResampler.process(numFrames, mMixed.data());
+    } else {
+        mMixed.resize((size_t)numFrames * mOutChannels);
+        for (int32_t c = 0; c < mOutChannels; c++) {
+            mOutputs[c] = mMixed.data() + c;
+        }
+        MixChannels(mFloat.data(), mInChannels, numFrames, mMatrix.data(), mOutputs.data(), mOutChannels, mOutChannels);
+    }
+    mOutput.resize((size_t)outFrames * mOutChannels);
+    ConvertFloatToInt16(mMixed.data(), mOutput.data(), outFrames * mOutChannels);
+    return outFrames;
+}
+
+void CAudioConverter::reset() {
+    if (mResample) {
+        mResampler.reset();
+    }
+}
+
+int64_t CAudioConverter::delayNs() const {
+    return mResample ? (int64_t)(mResampler.delayFrames() * 1000000000.0 / mOutRate) : 0;
+}
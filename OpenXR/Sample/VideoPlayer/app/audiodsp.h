@@ -0,0 +1,127 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Audio DSP between the decoder and the audio sink: sample format conversion, downmix to the
+// device's channel count and resampling to its native rate. The kernels use NEON on arm64 and
+// SSE2 on x86-64, with a scalar version elsewhere that defines their results.
+
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+// 16-bit to float in [-1, 1): divides by 32768.
+void ConvertInt16ToFloat(const int16_t* in, float* out, int32_t count);
+
+// Float to 16-bit: multiplies by 32768, rounds to nearest and saturates.
+void ConvertFloatToInt16(const float* in, int16_t* out, int32_t count);
+
+// Mixes interleaved frames of inChannels into outChannels: out[c][i * outStride] is the dot product
+// of frame i with row c of the outChannels x inChannels matrix. With outStride 1 and one pointer
+// per plane the output is planar; with out[c] = base + c and outStride outChannels, interleaved.
+void MixChannels(const float* in, int32_t inChannels, int32_t numFrames, const float* matrix, float* const* out, int32_t outChannels, int32_t outStride);
+
+// Downmix matrix in the decoders' channel order (FL FR FC LFE BL BR SL SR): centre and surrounds
+// at -3 dB, LFE dropped, rows scaled so a full-scale signal on every channel does not clip. Mono
+// is copied to both sides; layouts it does not know keep their first outChannels channels.
+std::vector<float> CreateDownmixMatrix(int32_t inChannels, int32_t outChannels);
+
+// accRe + i accIm += (aRe + i aIm) * (bRe + i bIm), element by element.
+void ComplexMultiplyAccumulate(const float* aRe, const float* aIm, const float* bRe, const float* bIm, float* accRe, float* accIm, int32_t count);
+
+// out[i] += (gain + step * (i + 1)) * in[i]: a gain ramped across a block.
+void RampedMultiplyAccumulate(const float* in, float gain, float step, float* out, int32_t count);
+
+// Radix-2 complex FFT over split real/imaginary arrays, with its twiddles laid out stage by stage
+// so every butterfly pass streams through contiguous memory.
+class CFft {
+
+public:
+    void configure(int32_t size);
+
+    int32_t size() const { return mSize; }
+
+    // In place. Unscaled in both directions.
+    void forward(float* re, float* im) const;
+
+    void inverse(float* re, float* im) const { forward(im, re); }
+
+private:
+    int32_t               mSize = 0;
+    std::vector<int32_t>  mBitReverse;
+    std::vector<float>    mTwiddleRe;   // stage with half-length h starts at index h - 1
+    std::vector<float>    mTwiddleIm;
+};
+
+// Rational polyphase resampler over planar float channels. The prototype is a Kaiser-windowed
+// sinc cut off below the lower of the two Nyquist rates, split into one short filter per output
+// phase, so each output sample costs one dot product over contiguous input.
+class CPolyphaseResampler {
+
+public:
+    // False when the ratio has more phases than kMaxPhases after reducing it.
+    bool configure(int32_t channelCount, int32_t inRate, int32_t outRate);
+
+    // Forgets the input history, as after a seek.
+    void reset();
+
+    // Output frames numFrames more input frames can produce, at most.
+    int32_t maxOutputFrames(int32_t numFrames) const;
+
+    // One plane per channel with room for numFrames new input frames, placed after the history so
+    // they are filtered where they are written.
+    float* const* prepare(int32_t numFrames);
+
+    // Filters the numFrames written after prepare() and writes the output interleaved; returns the
+    // number of output frames.
+    int32_t process(int32_t numFrames, float* out);
+
+    // Group delay of the filter, in output frames.
+    double delayFrames() const { return mDelayFrames; }
+
+    static constexpr int32_t kMaxPhases = 1024;
+    static constexpr int32_t kTapsPerPhase = 16;   // per phase when upsampling; downsampling widens it
+
+private:
+    int32_t               mChannelCount = 0;
+    int32_t               mUp = 1;          // L: output phases per input frame
+    int32_t               mDown = 1;        // M: input step per output frame, in phases
+    int32_t               mTaps = 0;
+    int64_t               mPosition = 0;    // next output, in phases past the first new input frame
+    double                mDelayFrames = 0;
+    std::vector<float>    mCoefficients;    // mUp rows of mTaps, oldest input first
+    std::vector<std::vector<float>> mHistory;   // per channel: mTaps - 1 previous frames, then the new ones
+    std::vector<float*>   mInputs;
+};
+
+// Interleaved 16-bit PCM from the decoder's layout and rate to the sink's. Runs on the audio decode
+// thread only; buffers grow to the largest buffer seen and are then reused.
+class CAudioConverter {
+
+public:
+    bool configure(int32_t inChannels, int32_t inRate, int32_t outChannels, int32_t outRate);
+
+    bool passthrough() const { return mPassthrough; }
+
+    // Converts numFrames input frames; returns the output frame count, the frames are in output().
+    int32_t process(const int16_t* in, int32_t numFrames);
+
+    const int16_t* output() const { return mOutput.data(); }
+
+    // Drops the resampler history.
+    void reset();
+
+    // Output delay behind the input, from the resampler filter.
+    int64_t delayNs() const;
+
+private:
+    int32_t               mInChannels = 0;
+    int32_t               mOutChannels = 0;
+    int32_t               mOutRate = 0;
+    bool                  mPassthrough = true;
+    bool                  mResample = false;
+    std::vector<float>    mMatrix;
+    std::vector<float>    mFloat;
+    std::vector<float*>   mOutputs;
+    std::vector<float>    mMixed;
+    std::vector<int16_t>  mOutput;
+    CPolyphaseResampler   mResampler;
+};
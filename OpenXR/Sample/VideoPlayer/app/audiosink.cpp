@@ -0,0 +1,239 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Callback-driven audio output: the decode thread fills a lock-free PCM ring that the device
+// drains from its own real-time callback.
+
+#include "pch.h"
+#include "common.h"
+#include "audiosink.h"
+#include "mediaclock.h"
+
+void CPcmRing::allocate(int32_t channelCount, int32_t capacityFrames) {
+    uint32_t size = 2;
+    while (size < (uint32_t)capacityFrames) {
+        size <<= 1;
+    }
+    mSamples.reset(new int16_t[(size_t)size * channelCount]());
+    mChannelCount = channelCount;
+    mMask = size - 1;
+    mWritePosition.store(0, std::memory_order_relaxed);
+    mReadPosition.store(0, std::memory_order_relaxed);
+}
+
+int32_t CPcmRing::write(const int16_t* pcm, int32_t numFrames) {
+    const int64_t writePosition = mWritePosition.load(std::memory_order_relaxed);
+    const int64_t free = capacity() - (writePosition - mReadPosition.load(std::memory_order_acquire));
+    const int32_t frames = (int32_t)std::min<int64_t>(numFrames, free);
+    // At most two copies: up to the end of the buffer, then from its start.
+    const uint32_t start = (uint32_t)(writePosition & mMask);
+    const int32_t first = std::min<int32_t>(frames, capacity() - start);
+    memcpy(mSamples.get() + (size_t)start * mChannelCount, pcm, (size_t)first * mChannelCount * sizeof(int16_t));
+    memcpy(mSamples.get(), pcm + (size_t)first * mChannelCount, (size_t)(frames - first) * mChannelCount * sizeof(int16_t));
+    mWritePosition.store(writePosition + frames, std::memory_order_release);
+    return frames;
+}
+
+int32_t CPcmRing::read(int16_t* pcm, int32_t numFrames) {
+    const int64_t readPosition = mReadPosition.load(std::memory_order_relaxed);
+    const int32_t frames = (int32_t)std::min<int64_t>(numFrames, mWritePosition.load(std::memory_order_acquire) - readPosition);
+    const uint32_t start = (uint32_t)(readPosition & mMask);
+    const int32_t first = std::min<int32_t>(frames, capacity() - start);
+    memcpy(pcm, mSamples.get() + (size_t)start * mChannelCount, (size_t)first * mChannelCount * sizeof(int16_t));
+    memcpy(pcm + (size_t)first * mChannelCount, mSamples.get(), (size_t)(frames - first) * mChannelCount * sizeof(int16_t));
+    mReadPosition.store(readPosition + frames, std::memory_order_release);
+    return frames;
+}
+
+void CPcmRing::skipTo(int64_t position) {
+    const int64_t readPosition = mReadPosition.load(std::memory_order_relaxed);
+    const int64_t writePosition = mWritePosition.load(std::memory_order_acquire);
+    mReadPosition.store(std::max(readPosition, std::min(position, writePosition)), std::memory_order_release);
+}
+
+bool CRingAudioSink::openRing(int32_t channelCount, int32_t sampleRate, int32_t ambisonicOrder) {
+    mChannelCount = channelCount;
+    mOutputChannelCount = channelCount;
+    mSampleRate = sampleRate;
+    mAmbisonicOrder = 0;
+    if (ambisonicOrder > 0) {
+        if (!mSpatial.configure(ambisonicOrder, sampleRate) || mSpatial.channelCount() != channelCount) {
+            Log::Write(Log::Level::Error, Fmt("audio sink: can't render order %d ambisonics from %d channels", ambisonicOrder, channelCount));
+            return false;
+        }
+        mAmbisonicOrder = ambisonicOrder;
+        mOutputChannelCount = 2;
+        mSpatialInput.assign((size_t)CAmbisonicRenderer::kBlockFrames * channelCount, 0);
+        mSpatialOutput.assign((size_t)CAmbisonicRenderer::kBlockFrames * 2, 0);
+        mSpatialOffset = CAmbisonicRenderer::kBlockFrames;
+        mSpatialPosition = 0;
+        mSpatialFlushPosition = 0;
+        mSpatialOrder = mSpatial.activeOrder();
+    }
+    mRing.allocate(channelCount, (int32_t)(kRingNs * sampleRate / 1000000000));
+    mFlushPosition = 0;
+    mStarved = true;
+    mStamped = false;
+    return true;
+}
+
+int32_t CRingAudioSink::write(const void* pcm, int32_t numFrames) {
+    const int32_t written = mRing.write((const int16_t*)pcm, numFrames);
+    if (written < numFrames) {
+        mRingFullWrites++;
+    }
+    return written;
+}
+
+void CRingAudioSink::flush() {
+    mFlushPosition.store(mRing.writePosition(), std::memory_order_release);
+}
+
+void CRingAudioSink::setHeadOrientation(const float orientation[4]) {
+    const uint32_t sequence = mPoseSequence.load(std::memory_order_relaxed);
+    mPoseSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int32_t i = 0; i < 4; i++) {
+        mPose[i].store(orientation[i], std::memory_order_relaxed);
+    }
+    mPoseTime.store(CMediaClock::monotonicNow(), std::memory_order_relaxed);
+    mPoseSequence.store(sequence + 2, std::memory_order_release);
+}
+
+int32_t CRingAudioSink::renderSpatial(int16_t* out, int32_t numFrames, int64_t latencyNs, int64_t& position) {
+    const int32_t blockFrames = CAmbisonicRenderer::kBlockFrames;
+    int32_t frames = 0;
+    position = mRing.readPosition();
+    while (frames < numFrames) {
+        if (mSpatialOffset == blockFrames) {
+            // Whole blocks only: a partial one would put silence in the middle of the convolution.
+            if (mRing.writePosition() - mRing.readPosition() < blockFrames) {
+                break;
+            }
+            const uint32_t sequence = mPoseSequence.load(std::memory_order_acquire);
+            if ((sequence & 1) == 0) {
+                float orientation[4];
+                for (int32_t i = 0; i < 4; i++) {
+                    orientation[i] = mPose[i].load(std::memory_order_relaxed);
+                }
+                const int64_t poseTime = mPoseTime.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (mPoseSequence.load(std::memory_order_relaxed) == sequence && poseTime != 0) {
+                    memcpy(mOrientation, orientation, sizeof(mOrientation));
+                    if (poseTime != mPoseTimeUsed) {
+                        // The new pose is heard from this block's first frame on.
+                        mPoseTimeUsed = poseTime;
+                        const int64_t heardAt = CMediaClock::monotonicNow() + latencyNs + (int64_t)frames * 1000000000 / mSampleRate;
+                        mPoseToAudioNs.store(heardAt - poseTime, std::memory_order_relaxed);
+                        if (heardAt - poseTime > mMaxPoseToAudioNs.load(std::memory_order_relaxed)) {
+                            mMaxPoseToAudioNs.store(heardAt - poseTime, std::memory_order_relaxed);
+                        }
+                    }
+                }
+            }
+            mSpatialPosition = mRing.readPosition();
+            mRing.read(mSpatialInput.data(), blockFrames);
+            mSpatial.process(mSpatialInput.data(), mOrientation, mSpatialOutput.data());
+            mSpatialOffset = 0;
+            mSpatialOrder.store(mSpatial.activeOrder(), std::memory_order_relaxed);
+            mSpatialBlockNs.store(mSpatial.blockNs(), std::memory_order_relaxed);
+            mSpatialMaxBlockNs.store(mSpatial.maxBlockNs(), std::memory_order_relaxed);
+        }
+        const int32_t count = std::min(blockFrames - mSpatialOffset, numFrames - frames);
+        if (frames == 0) {
+            position = mSpatialPosition + mSpatialOffset;
+        }
+        memcpy(out + (size_t)frames * 2, mSpatialOutput.data() + (size_t)mSpatialOffset * 2, (size_t)count * 2 * sizeof(int16_t));
+        mSpatialOffset += count;
+        frames += count;
+    }
+    return frames;
+}
+
+void CRingAudioSink::render(int16_t* out, int32_t numFrames, int64_t latencyNs) {
+    const int64_t flushPosition = mFlushPosition.load(std::memory_order_acquire);
+    if (mRing.readPosition() < flushPosition) {
+        mRing.skipTo(flushPosition);
+        mStarved = true;  // running dry after a flush is expected, not an underrun
+    }
+    if (mAmbisonicOrder > 0 && flushPosition != mSpatialFlushPosition) {
+        mSpatialFlushPosition = flushPosition;
+        if (mSpatialPosition < flushPosition) {
+            // The rendered block and the convolution tail are from before the flush too.
+            mSpatialOffset = CAmbisonicRenderer::kBlockFrames;
+            mSpatial.reset();
+        }
+    }
+    const uint32_t pauses = mPauses.load(std::memory_order_acquire);
+    int64_t position = 0;
+    int32_t frames = 0;
+    if (mAmbisonicOrder > 0) {
+        frames = renderSpatial(out, numFrames, latencyNs, position);
+    } else {
+        position = mRing.readPosition();
+        frames = mRing.read(out, numFrames);
+    }
+    if (frames < numFrames) {
+        memset(out + (size_t)frames * mOutputChannelCount, 0, (size_t)(numFrames - frames) * mOutputChannelCount * sizeof(int16_t));
+        if (!mStarved) {
+            mUnderruns++;
+        }
+        mStarved = true;
+    } else {
+        mStarved = false;
+    }
+    if (frames > 0) {
+        const uint32_t sequence = mStampSequence.load(std::memory_order_relaxed);
+        mStampSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        mStampPosition.store(position, std::memory_order_relaxed);
+        mStampTime.store(CMediaClock::monotonicNow() + latencyNs, std::memory_order_relaxed);
+        mStampPauses.store(pauses, std::memory_order_relaxed);
+        mStampSequence.store(sequence + 2, std::memory_order_release);
+        mStamped.store(true, std::memory_order_release);
+    }
+    mLatencyNs.store(latencyNs, std::memory_order_relaxed);
+    if (latencyNs > mMaxLatencyNs.load(std::memory_order_relaxed)) {
+        mMaxLatencyNs.store(latencyNs, std::memory_order_relaxed);
+    }
+}
+
+bool CRingAudioSink::getTimestamp(int64_t& framePosition, int64_t& monotonicTime) {
+    if (!mStamped.load(std::memory_order_acquire)) {
+        return false;
+    }
+    for (int32_t attempt = 0; attempt < 4; attempt++) {
+        const uint32_t sequence = mStampSequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            continue;
+        }
+        const int64_t position = mStampPosition.load(std::memory_order_relaxed);
+        const int64_t time = mStampTime.load(std::memory_order_relaxed);
+        const uint32_t pauses = mStampPauses.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (mStampSequence.load(std::memory_order_relaxed) != sequence) {
+            continue;
+        }
+        if (pauses != mPauses.load(std::memory_order_acquire)) {
+            return false;
+        }
+        framePosition = position;
+        monotonicTime = time;
+        return true;
+    }
+    return false;
+}
+
+AudioSinkStats CRingAudioSink::getStats() {
+    AudioSinkStats stats;
+    stats.underruns = mUnderruns;
+    stats.ringFullWrites = mRingFullWrites;
+    stats.outputLatencyNs = mLatencyNs;
+    stats.maxOutputLatencyNs = mMaxLatencyNs;
+    stats.bufferedFrames = (int32_t)(mRing.writePosition() - mRing.readPosition());
+    stats.ambisonicOrder = mSpatialOrder;
+    stats.spatialBlockNs = mSpatialBlockNs;
+    stats.maxSpatialBlockNs = mSpatialMaxBlockNs;
+    stats.poseToAudioNs = mPoseToAudioNs;
+    stats.maxPoseToAudioNs = mMaxPoseToAudioNs;
+    return stats;
+}
@@ -0,0 +1,138 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Callback-driven audio output: the decode thread fills a lock-free PCM ring that the device
+// drains from its own real-time callback.
+
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "mediabackend.h"
+#include "spatialaudio.h"
+
+// Single-producer/single-consumer ring of interleaved 16-bit frames. Positions count frames over
+// the life of the ring, so each side sees how far the other got with one acquire load and
+// neither ever waits for the other.
+class CPcmRing {
+
+public:
+    // capacityFrames is rounded up to a power of two. Not thread-safe; call before either side runs.
+    void allocate(int32_t channelCount, int32_t capacityFrames);
+
+    int32_t capacity() const { return (int32_t)(mMask + 1); }
+
+    // Producer side. Copies as many frames as fit and returns that number.
+    int32_t write(const int16_t* pcm, int32_t numFrames);
+
+    // Consumer side. Copies out up to numFrames queued frames and returns that number.
+    int32_t read(int16_t* pcm, int32_t numFrames);
+
+    // Consumer side. Drops every frame written before position.
+    void skipTo(int64_t position);
+
+    int64_t writePosition() const { return mWritePosition.load(std::memory_order_acquire); }
+
+    int64_t readPosition() const { return mReadPosition.load(std::memory_order_acquire); }
+
+private:
+    std::unique_ptr<int16_t[]> mSamples;
+    int32_t        mChannelCount = 0;
+    uint32_t       mMask = 0;
+
+    // Separate cache lines, as in SpscRing.
+    alignas(64) std::atomic<int64_t> mWritePosition{0};
+    alignas(64) std::atomic<int64_t> mReadPosition{0};
+};
+
+// IAudioSink over a CPcmRing. write() never blocks: it queues what fits, and counts a full-ring
+// write when that is not everything; the caller writes the rest later, so nothing is dropped.
+// The device side calls render() from its callback, which never locks or allocates: it copies
+// out what is queued, pads with silence when the ring runs dry (an underrun) and stamps the
+// first frame it played with the time the device will present it.
+// Positions reported by getTimestamp() count written frames only, so the silence played during
+// an underrun does not shift the mapping from written frames to presentation time.
+// Opened with an ambisonic order, the ring keeps the ambisonic channels and render() turns them
+// into stereo a renderer block at a time, against the latest setHeadOrientation(), so a head
+// movement is heard one device buffer later rather than after the whole ring has drained.
+class CRingAudioSink : public IAudioSink {
+
+public:
+    int32_t write(const void* pcm, int32_t numFrames) override;
+
+    void flush() override;
+
+    bool getTimestamp(int64_t& framePosition, int64_t& monotonicTime) override;
+
+    AudioSinkStats getStats() override;
+
+    void setHeadOrientation(const float orientation[4]) override;
+
+    void getFormat(int32_t& channelCount, int32_t& sampleRate) override {
+        channelCount = mChannelCount;
+        sampleRate = mSampleRate;
+    }
+
+    static constexpr int64_t kRingNs = 200 * 1000 * 1000;   // how far decoding may run ahead of the device
+
+protected:
+    // Sizes the ring for the stream; call from open(). channelCount is what write() takes; with
+    // an ambisonicOrder the device gets stereo instead.
+    bool openRing(int32_t channelCount, int32_t sampleRate, int32_t ambisonicOrder);
+
+    // Device callback. latencyNs is how long until the first frame of out is heard. out holds
+    // numFrames of mOutputChannelCount.
+    void render(int16_t* out, int32_t numFrames, int64_t latencyNs);
+
+    // Call from pause(): stamps from before it describe a timeline the clock has left.
+    void invalidateTimestamp() { mPauses.fetch_add(1, std::memory_order_acq_rel); }
+
+    int32_t               mChannelCount = 0;
+    int32_t               mOutputChannelCount = 0;
+    int32_t               mSampleRate = 0;
+
+private:
+    // render() for ambisonic streams: fills out from rendered blocks, rendering a new one whenever a
+    // whole block is queued, and returns the frames filled and the ring position of the first.
+    int32_t renderSpatial(int16_t* out, int32_t numFrames, int64_t latencyNs, int64_t& position);
+
+    CPcmRing              mRing;
+    std::atomic<int64_t>  mFlushPosition{0};    // set by flush(), applied by the next render()
+    bool                  mStarved = true;      // render() only
+
+    // Seqlock: render() is the only writer, getTimestamp() retries while a stamp is half written.
+    std::atomic<uint32_t> mStampSequence{0};
+    std::atomic<int64_t>  mStampPosition{0};
+    std::atomic<int64_t>  mStampTime{0};
+    std::atomic<uint32_t> mStampPauses{0};
+    std::atomic<bool>     mStamped{false};
+    std::atomic<uint32_t> mPauses{0};
+
+    std::atomic<uint64_t> mUnderruns{0};
+    std::atomic<uint64_t> mRingFullWrites{0};
+    std::atomic<int64_t>  mLatencyNs{0};
+    std::atomic<int64_t>  mMaxLatencyNs{0};
+
+    // Binaural rendering, render() only except where noted.
+    int32_t               mAmbisonicOrder = 0;
+    CAmbisonicRenderer    mSpatial;
+    std::vector<int16_t>  mSpatialInput;        // one block of ambisonic frames
+    std::vector<int16_t>  mSpatialOutput;       // the last block rendered, stereo
+    int32_t               mSpatialOffset = 0;   // frames of it already played
+    int64_t               mSpatialPosition = 0; // ring position of its first frame
+    int64_t               mSpatialFlushPosition = 0;
+    float                 mOrientation[4] = {0, 0, 0, 1};
+
+    // Seqlock: setHeadOrientation() is the only writer, render() keeps the last orientation it read
+    // when a write is in progress.
+    std::atomic<uint32_t> mPoseSequence{0};
+    std::atomic<float>    mPose[4];
+    std::atomic<int64_t>  mPoseTime{0};
+    int64_t               mPoseTimeUsed = 0;    // render() only
+
+    std::atomic<int32_t>  mSpatialOrder{0};     // stats, written by render()
+    std::atomic<int64_t>  mSpatialBlockNs{0};
+    std::atomic<int64_t>  mSpatialMaxBlockNs{0};
+    std::atomic<int64_t>  mPoseToAudioNs{0};
+    std::atomic<int64_t>  mMaxPoseToAudioNs{0};
+};
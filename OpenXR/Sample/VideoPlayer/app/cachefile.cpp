@@ -0,0 +1,53 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Files of the on-disk caches.
+
+#include "pch.h"
+#include "common.h"
+#include "cachefile.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+uint64_t HashCacheKey(const std::string& key) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : key) {
+        hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+void MakeCacheDirectories(const std::string& directory) {
+    for (size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1)) {
+        mkdir(directory.substr(0, slash).c_str(), 0770);
+        if (slash == std::string::npos) {
+            break;
+        }
+    }
+}
+
+bool WriteCacheFile(const std::string& path, const std::vector<const std::vector<uint8_t>*>& parts) {
+    const std::string temp = path + Fmt(".%d", (int32_t)getpid()) + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0660);
+    if (fd < 0) {
+        return false;
+    }
+    bool complete = true;
+    for (const std::vector<uint8_t>* part : parts) {
+        size_t written = 0;
+        while (written < part->size()) {
+            const ssize_t got = write(fd, part->data() + written, part->size() - written);
+            if (got <= 0) {
+                break;
+            }
+            written += got;
+        }
+        complete = complete && written == part->size();
+    }
+    close(fd);
+    if (!complete || rename(temp.c_str(), path.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
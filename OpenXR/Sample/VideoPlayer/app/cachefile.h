@@ -0,0 +1,19 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Files of the on-disk caches: names hashed from what they cache, and atomic replacement.
+
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// FNV-1a over the key. Callers that can tell keys apart store the key in the file as well.
+uint64_t HashCacheKey(const std::string& key);
+
+// Creates the directory and any missing parents.
+void MakeCacheDirectories(const std::string& directory);
+
+// Writes the parts one after another to a temporary file next to path and renames it over path,
+// so readers, and maps of the old file, see either the old file or the whole new one. On failure
+// nothing is left behind; when the temporary file can't be created errno still says why.
+bool WriteCacheFile(const std::string& path, const std::vector<const std::vector<uint8_t>*>& parts);
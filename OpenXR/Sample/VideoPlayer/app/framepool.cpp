@@ -0,0 +1,62 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Preallocated MediaFrame objects handed out as move-only handles.
+
+#include "pch.h"
+#include "common.h"
+#include "framepool.h"
+#include "player.h"
+
+void MediaFrameRecycler::operator()(MediaFrame* frame) const {
+    if (frame && pool) {
+        pool->recycle(frame);
+    }
+}
+
+CFramePool::CFramePool(uint32_t capacity) : mFrames(capacity) {
+    mFree.reserve(capacity);
+    for (MediaFrame& frame : mFrames) {
+        mFree.push_back(&frame);
+    }
+}
+
+CFramePool::~CFramePool() {
+    if (mFree.size() != mFrames.size()) {
+        Log::Write(Log::Level::Error, Fmt("frame pool destroyed with %d frames outstanding", (int32_t)(mFrames.size() - mFree.size())));
+    }
+}
+
+MediaFrameHandle CFramePool::acquire(const std::shared_ptr<IMediaDecoder>& decoder, ssize_t bufferIndex) {
+    MediaFrame* frame = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        if (!mFree.empty()) {
+            frame = mFree.back();
+            mFree.pop_back();
+        }
+    }
+    if (frame == nullptr) {
+        Log::Write(Log::Level::Error, "frame pool exhausted, dropping decoded frame");
+        if (decoder) {
+            decoder->releaseOutputBuffer(bufferIndex, false);
+        }
+        return MediaFrameHandle(nullptr, MediaFrameRecycler{this});
+    }
+    frame->decoder = decoder;
+    frame->bufferIndex = bufferIndex;
+    return MediaFrameHandle(frame, MediaFrameRecycler{this});
+}
+
+uint32_t CFramePool::available() {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return (uint32_t)mFree.size();
+}
+
+void CFramePool::recycle(MediaFrame* frame) {
+    if (frame->decoder && frame->bufferIndex >= 0) {
+        frame->decoder->releaseOutputBuffer(frame->bufferIndex, false);
+    }
+    *frame = MediaFrame();
+    std::lock_guard<std::mutex> guard(mMutex);
+    mFree.push_back(frame);
+}
@@ -0,0 +1,53 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Preallocated MediaFrame objects handed out as move-only handles.
+
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "mediabackend.h"
+
+struct MediaFrame_tag;
+class CFramePool;
+
+// Deleter of MediaFrameHandle: gives the codec output buffer back to its decoder and the
+// MediaFrame back to its pool, so a frame can't be dropped without releasing its buffer.
+struct MediaFrameRecycler {
+    CFramePool* pool = nullptr;
+    void operator()(struct MediaFrame_tag* frame) const;
+};
+
+typedef std::unique_ptr<struct MediaFrame_tag, MediaFrameRecycler> MediaFrameHandle;
+
+// Decode threads acquire, whichever thread drops a handle recycles. The free list is guarded by a
+// mutex; it is held for a push or pop only and never allocates after construction.
+class CFramePool {
+
+public:
+    explicit CFramePool(uint32_t capacity);
+
+    ~CFramePool();
+
+    CFramePool(const CFramePool&) = delete;
+    CFramePool& operator=(const CFramePool&) = delete;
+
+    // Wraps decoder output buffer bufferIndex in a pooled frame. When the pool is exhausted the
+    // buffer is released straight away and an empty handle is returned. A frame whose data the
+    // caller owns (decoder nullptr) has nothing to release.
+    MediaFrameHandle acquire(const std::shared_ptr<IMediaDecoder>& decoder, ssize_t bufferIndex);
+
+    uint32_t capacity() const { return (uint32_t)mFrames.size(); }
+
+    uint32_t available();
+
+private:
+    friend struct MediaFrameRecycler;
+
+    void recycle(struct MediaFrame_tag* frame);
+
+    std::vector<struct MediaFrame_tag> mFrames;
+    std::vector<struct MediaFrame_tag*> mFree;
+    std::mutex mMutex;
+};
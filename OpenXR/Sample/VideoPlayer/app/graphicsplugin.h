@@ -36,8 +36,12 @@ struct IGraphicsPlugin {
     virtual void RenderView(const XrCompositionLayerProjectionView& layerView, const XrSwapchainImageBaseHeader* swapchainImage,
                             int64_t swapchainFormat, const std::vector<Cube>& cubes) = 0;
 
+    // Makes frame the picture the following RenderView calls draw. Called once per XR frame before the
+    // views are rendered; a frame already resident from an earlier refresh is not uploaded again.
+    virtual void UploadFrame(const MediaFrame* frame) {};
+
     virtual void RenderView(const XrCompositionLayerProjectionView& layerView, const XrSwapchainImageBaseHeader* swapchainImage,
-                            int64_t swapchainFormat, const std::shared_ptr<MediaFrame>& frame, const int32_t eye) {};
+                            int64_t swapchainFormat, const MediaFrame* frame, const int32_t eye) {};
 
     virtual void SetVideoWidthHeight(int32_t videoWidth, int32_t videoHeight) {};
 
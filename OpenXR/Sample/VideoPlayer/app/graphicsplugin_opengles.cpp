@@ -7,6 +7,7 @@
 #include "geometry.h"
 #include "graphicsplugin.h"
 #include "options.h"
+#include "yuvconvert.h"
 
 #ifdef XR_USE_GRAPHICS_API_OPENGL_ES
 
@@ -364,8 +365,68 @@ struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
                     int64_t swapchainFormat, const std::vector<Cube>& cubes) override {
     }
 
+    void UploadFrame(const MediaFrame* frame) override {
+        if (frame == nullptr || frame->number == m_uploadedFrame) {
+            return;
+        }
+        const int width = frame->width;
+        const int height = frame->height;
+        const int stride = std::max(frame->stride, width);
+        const int sliceHeight = std::max(frame->sliceHeight, height);
+        // A buffer shorter than its picture is skipped before the texture storage is resized for
+        // it, and the last picture stays up.
+        if (width <= 0 || height <= 0 || frame->size < GetYuv420BufferSize(width, height, stride, sliceHeight, frame->planarChroma)) {
+            if (!m_skippingFrames) {
+                Log::Write(Log::Level::Warning, Fmt("UploadFrame: %dx%d frame (stride %d, slice height %d) in %u bytes, skipped", width, height,
+                                                    stride, sliceHeight, frame->size));
+            }
+            m_skippingFrames = true;
+            m_uploadedFrame = frame->number;
+            return;
+        }
+        m_skippingFrames = false;
+
+        // Texture storage is only reallocated when the size changes, e.g. between playlist items.
+        // Padded decoder rows are skipped by the unpack row length, in texels; rows need not start
+        // on 4 bytes.
+        const bool resize = (width != m_textureWidth || height != m_textureHeight);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_textureId[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+        if (resize) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, frame->data);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_LUMINANCE, GL_UNSIGNED_BYTE, frame->data);
+        }
+
+        // The chroma texture takes NV12's interleaved plane; I420 is interleaved into it first.
+        const uint8_t* chroma = frame->data + (size_t)stride * sliceHeight;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / 2);
+        if (frame->planarChroma) {
+            const size_t chromaStride = stride / 2;
+            m_chroma.resize((size_t)(width / 2) * 2 * (height / 2));
+            InterleaveChromaRows(chroma, chroma + chromaStride * (sliceHeight / 2), chromaStride, m_chroma.data(), (size_t)(width / 2) * 2, width / 2,
+                                 height / 2);
+            chroma = m_chroma.data();
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        }
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_textureId[1]);
+        if (resize) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, width / 2, height / 2, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, chroma);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width / 2, height / 2, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, chroma);
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        m_textureWidth = width;
+        m_textureHeight = height;
+        m_uploadedFrame = frame->number;
+    }
+
     void RenderView(const XrCompositionLayerProjectionView& layerView, const XrSwapchainImageBaseHeader* swapchainImage,
-                    int64_t swapchainFormat, const std::shared_ptr<MediaFrame>& frame, const int32_t eye) override {
+                    int64_t swapchainFormat, const MediaFrame* frame, const int32_t eye) override {
         CHECK(layerView.subImage.imageArrayIndex == 0);  // Texture arrays not supported.
         UNUSED_PARM(swapchainFormat);                    // Not used in this function for now.
 
@@ -415,10 +476,7 @@ struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
         XrMatrix4x4f_CreateTranslationRotationScale(&model, &m_pose.position, &m_pose.orientation, &m_scale);
         XrMatrix4x4f_Multiply(&mvp, &vp, &model);
 
-        if (frame.get()) {
-            int width = frame->width;
-            int height = frame->height;
-            
+        if (frame) {
             if (m_options->VideoMode == "3D-SBS" || m_options->VideoMode == "3D-OU") {
                 GLuint aTexCoord = (GLuint) glGetAttribLocation(m_program, "aTexCoord");
                 int32_t offset = 3 + (eye * 2);
@@ -429,11 +487,8 @@ struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
 
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, m_textureId[0]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, frame->data);
-
             glActiveTexture(GL_TEXTURE1);
             glBindTexture(GL_TEXTURE_2D, m_textureId[1]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, width / 2, height / 2, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, frame->data + (width * height));
 
             glUniformMatrix4fv(m_modelViewProjectionUniformLocation, 1, GL_FALSE, reinterpret_cast<const GLfloat*>(&mvp));
             
@@ -518,6 +573,11 @@ struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
     // Map color buffer to associated depth buffer. This map is populated on demand.
     std::map<uint32_t, uint32_t> m_colorToDepthMap;
     GLuint m_textureId[2];
+    int32_t m_textureWidth{0};  // size the texture storage was last allocated for
+    int32_t m_textureHeight{0};
+    uint32_t m_uploadedFrame{0};  // MediaFrame::number of the picture in the textures
+    bool m_skippingFrames{false};  // the last frame was too short to upload; logged once per run of them
+    std::vector<uint8_t> m_chroma;  // I420 chroma, interleaved for upload
     std::shared_ptr<Options> m_options;
     float m_radius = 50;
     uint32_t m_vertexCount;
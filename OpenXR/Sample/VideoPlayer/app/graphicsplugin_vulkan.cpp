@@ -7,6 +7,7 @@
 #include "geometry.h"
 #include "graphicsplugin.h"
 #include "options.h"
+#include "yuvconvert.h"
 
 #ifdef XR_USE_GRAPHICS_API_VULKAN
 
@@ -21,6 +22,7 @@ struct Vertex {
 };
 
 VkFormat g_imageFormat = VK_FORMAT_R8_UNORM;
+VkFormat g_chromaImageFormat = VK_FORMAT_R8G8_UNORM;   // NV12's interleaved UV plane, sampled as .rg
 
 std::vector<Vertex> s_vertexCoordData = {
     {{-1.0f,  1.0f,  0.0f}, {0.0f, 0.0f}},
@@ -709,26 +711,21 @@ struct PipelineLayout {
     void* uniformBufferMapped{nullptr};
     VkPhysicalDevice vkPhysicalDevice{VK_NULL_HANDLE};
     VkImage textureImage_y;
-    VkImage textureImage_u;
-    VkImage textureImage_v;
+    VkImage textureImage_uv;
     VkImageView textureImageView_y;
-    VkImageView textureImageView_u;
-    VkImageView textureImageView_v;
+    VkImageView textureImageView_uv;
     VkDeviceMemory textureImageMemory_y;
-    VkDeviceMemory textureImageMemory_u;
-    VkDeviceMemory textureImageMemory_v;
+    VkDeviceMemory textureImageMemory_uv;
     VkSampler textureSampler_y;
-    VkSampler textureSampler_u;
-    VkSampler textureSampler_v;
+    VkSampler textureSampler_uv;
     VkBuffer yuvBuffer_y;
-    VkBuffer yuvBuffer_u;
-    VkBuffer yuvBuffer_v;
+    VkBuffer yuvBuffer_uv;
     VkDeviceMemory yuvBufferMemory_y;
-    VkDeviceMemory yuvBufferMemory_u;
-    VkDeviceMemory yuvBufferMemory_v;
+    VkDeviceMemory yuvBufferMemory_uv;
     void* yuvBufferMemoryMapped_y{nullptr};
-    void* yuvBufferMemoryMapped_u{nullptr};
-    void* yuvBufferMemoryMapped_v{nullptr};
+    void* yuvBufferMemoryMapped_uv{nullptr};
+    uint32_t textureWidth{0};
+    uint32_t textureHeight{0};
 
     PipelineLayout() = default;
 
@@ -740,24 +737,9 @@ struct PipelineLayout {
             if (descriptorSetLayout != VK_NULL_HANDLE) {
                 vkDestroyDescriptorSetLayout(m_vkDevice, descriptorSetLayout, nullptr);
             }
-            vkDestroyBuffer(m_vkDevice, yuvBuffer_y, nullptr);
-            vkDestroyBuffer(m_vkDevice, yuvBuffer_u, nullptr);
-            vkDestroyBuffer(m_vkDevice, yuvBuffer_v, nullptr);
-            vkFreeMemory(m_vkDevice, textureImageMemory_y, nullptr);
-            vkFreeMemory(m_vkDevice, textureImageMemory_u, nullptr);
-            vkFreeMemory(m_vkDevice, textureImageMemory_v, nullptr);
-            vkDestroyImage(m_vkDevice, textureImage_y, nullptr);
-            vkDestroyImage(m_vkDevice, textureImage_u, nullptr);
-            vkDestroyImage(m_vkDevice, textureImage_v, nullptr);
+            DestroyTextureImage();
             vkDestroySampler(m_vkDevice, textureSampler_y, nullptr);
-            vkDestroySampler(m_vkDevice, textureSampler_u, nullptr);
-            vkDestroySampler(m_vkDevice, textureSampler_v, nullptr);
-            vkFreeMemory(m_vkDevice, yuvBufferMemory_y, nullptr);
-            vkFreeMemory(m_vkDevice, yuvBufferMemory_u, nullptr);
-            vkFreeMemory(m_vkDevice, yuvBufferMemory_v, nullptr);
-            vkDestroySampler(m_vkDevice, textureSampler_y, nullptr);
-            vkDestroySampler(m_vkDevice, textureSampler_u, nullptr);
-            vkDestroySampler(m_vkDevice, textureSampler_v, nullptr);
+            vkDestroySampler(m_vkDevice, textureSampler_uv, nullptr);
         }
         pipelineLayout = VK_NULL_HANDLE;
         descriptorSetLayout = VK_NULL_HANDLE;
@@ -786,21 +768,14 @@ struct PipelineLayout {
         samplerLayoutBinding_y.pImmutableSamplers = nullptr;
         samplerLayoutBinding_y.stageFlags =  VK_SHADER_STAGE_FRAGMENT_BIT;
 
-        VkDescriptorSetLayoutBinding samplerLayoutBinding_u{};
-        samplerLayoutBinding_u.binding = 2;
-        samplerLayoutBinding_u.descriptorCount = 1;
-        samplerLayoutBinding_u.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding_u.pImmutableSamplers = nullptr;
-        samplerLayoutBinding_u.stageFlags =  VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        VkDescriptorSetLayoutBinding samplerLayoutBinding_v{};
-        samplerLayoutBinding_v.binding = 3;
-        samplerLayoutBinding_v.descriptorCount = 1;
-        samplerLayoutBinding_v.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding_v.pImmutableSamplers = nullptr;
-        samplerLayoutBinding_v.stageFlags =  VK_SHADER_STAGE_FRAGMENT_BIT;        
-
-        std::array<VkDescriptorSetLayoutBinding, 4> bindings = { uboLayoutBinding, samplerLayoutBinding_y, samplerLayoutBinding_u, samplerLayoutBinding_v };
+        VkDescriptorSetLayoutBinding samplerLayoutBinding_uv{};
+        samplerLayoutBinding_uv.binding = 2;
+        samplerLayoutBinding_uv.descriptorCount = 1;
+        samplerLayoutBinding_uv.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        samplerLayoutBinding_uv.pImmutableSamplers = nullptr;
+        samplerLayoutBinding_uv.stageFlags =  VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        std::array<VkDescriptorSetLayoutBinding, 3> bindings = { uboLayoutBinding, samplerLayoutBinding_y, samplerLayoutBinding_uv };
         VkDescriptorSetLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
         layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -817,6 +792,14 @@ struct PipelineLayout {
         CreateDescriptorSets();
     }
 
+    // Recreates the planes and staging buffers for frames of another size (adaptive streams switch
+    // resolution between renditions). The caller makes sure no submitted work still uses them.
+    void ResizeTextures(uint32_t width, uint32_t height) {
+        DestroyTextureImage();
+        CreateTextureImage(width, height);
+        WriteDescriptorSets();
+    }
+
     void CreateUniformBuffer() {
         VkDeviceSize bufferSize = sizeof(XrMatrix4x4f); //mvp
         VkBufferCreateInfo bufferInfo{};
@@ -838,7 +821,7 @@ struct PipelineLayout {
         poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         poolSizes[0].descriptorCount = 1;
         poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = 3;
+        poolSizes[1].descriptorCount = 2;
 
         VkDescriptorPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -850,19 +833,32 @@ struct PipelineLayout {
 
     void CreateTextureImage(uint32_t width, uint32_t height) {
         m_memAllocator->createBuffer(width * height, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, yuvBuffer_y, yuvBufferMemory_y);
-        m_memAllocator->createBuffer(width * height / 4, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, yuvBuffer_u, yuvBufferMemory_u);
-        m_memAllocator->createBuffer(width * height / 4, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, yuvBuffer_v, yuvBufferMemory_v);
+        m_memAllocator->createBuffer(width * height / 2, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, yuvBuffer_uv, yuvBufferMemory_uv);
         vkMapMemory(m_vkDevice, yuvBufferMemory_y, 0, width * height, 0, &yuvBufferMemoryMapped_y);
-        vkMapMemory(m_vkDevice, yuvBufferMemory_u, 0, width * height / 4, 0, &yuvBufferMemoryMapped_u);
-        vkMapMemory(m_vkDevice, yuvBufferMemory_v, 0, width * height / 4, 0, &yuvBufferMemoryMapped_v);
+        vkMapMemory(m_vkDevice, yuvBufferMemory_uv, 0, width * height / 2, 0, &yuvBufferMemoryMapped_uv);
 
         createImage(width, height, g_imageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage_y, textureImageMemory_y);
-        createImage(width/2, height/2, g_imageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage_u, textureImageMemory_u);
-        createImage(width/2, height/2, g_imageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage_v, textureImageMemory_v);
+        createImage(width/2, height/2, g_chromaImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage_uv, textureImageMemory_uv);
 
         textureImageView_y = createImageView(textureImage_y, g_imageFormat);
-        textureImageView_u = createImageView(textureImage_u, g_imageFormat);
-        textureImageView_v = createImageView(textureImage_v, g_imageFormat);
+        textureImageView_uv = createImageView(textureImage_uv, g_chromaImageFormat);
+        textureWidth = width;
+        textureHeight = height;
+    }
+
+    void DestroyTextureImage() {
+        vkDestroyImageView(m_vkDevice, textureImageView_y, nullptr);
+        vkDestroyImageView(m_vkDevice, textureImageView_uv, nullptr);
+        vkDestroyImage(m_vkDevice, textureImage_y, nullptr);
+        vkDestroyImage(m_vkDevice, textureImage_uv, nullptr);
+        vkFreeMemory(m_vkDevice, textureImageMemory_y, nullptr);
+        vkFreeMemory(m_vkDevice, textureImageMemory_uv, nullptr);
+        vkDestroyBuffer(m_vkDevice, yuvBuffer_y, nullptr);
+        vkDestroyBuffer(m_vkDevice, yuvBuffer_uv, nullptr);
+        vkFreeMemory(m_vkDevice, yuvBufferMemory_y, nullptr);  // also unmaps
+        vkFreeMemory(m_vkDevice, yuvBufferMemory_uv, nullptr);
+        textureWidth = 0;
+        textureHeight = 0;
     }
 
     void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
@@ -924,8 +920,7 @@ struct PipelineLayout {
         samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
         samplerInfo.unnormalizedCoordinates = VK_FALSE;
         CHECK_VKCMD(vkCreateSampler(m_vkDevice, &samplerInfo, nullptr, &textureSampler_y));
-        CHECK_VKCMD(vkCreateSampler(m_vkDevice, &samplerInfo, nullptr, &textureSampler_u));
-        CHECK_VKCMD(vkCreateSampler(m_vkDevice, &samplerInfo, nullptr, &textureSampler_v));
+        CHECK_VKCMD(vkCreateSampler(m_vkDevice, &samplerInfo, nullptr, &textureSampler_uv));
     }
 
     void CreateDescriptorSets() {
@@ -936,7 +931,10 @@ struct PipelineLayout {
         allocInfo.descriptorSetCount = 1;
         allocInfo.pSetLayouts = layouts.data();
         CHECK_VKCMD(vkAllocateDescriptorSets(m_vkDevice, &allocInfo, &descriptorSets));
+        WriteDescriptorSets();
+    }
 
+    void WriteDescriptorSets() {
         VkDescriptorBufferInfo bufferInfo{};
         bufferInfo.buffer = uniformBuffer;
         bufferInfo.offset = 0;
@@ -947,17 +945,12 @@ struct PipelineLayout {
         imageInfo_y.imageView = textureImageView_y;
         imageInfo_y.sampler = textureSampler_y;
 
-        VkDescriptorImageInfo imageInfo_u{};
-        imageInfo_u.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo_u.imageView = textureImageView_u;
-        imageInfo_u.sampler = textureSampler_u;
-
-        VkDescriptorImageInfo imageInfo_v{};
-        imageInfo_v.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo_v.imageView = textureImageView_v;
-        imageInfo_v.sampler = textureSampler_v;
+        VkDescriptorImageInfo imageInfo_uv{};
+        imageInfo_uv.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo_uv.imageView = textureImageView_uv;
+        imageInfo_uv.sampler = textureSampler_uv;
 
-        std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+        std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
         descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrites[0].dstSet = descriptorSets;
         descriptorWrites[0].dstBinding = 0;
@@ -980,15 +973,7 @@ struct PipelineLayout {
         descriptorWrites[2].dstArrayElement = 0;
         descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         descriptorWrites[2].descriptorCount = 1;
-        descriptorWrites[2].pImageInfo = &imageInfo_u;
-
-        descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[3].dstSet = descriptorSets;
-        descriptorWrites[3].dstBinding = 3;
-        descriptorWrites[3].dstArrayElement = 0;
-        descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[3].descriptorCount = 1;
-        descriptorWrites[3].pImageInfo = &imageInfo_v;
+        descriptorWrites[2].pImageInfo = &imageInfo_uv;
 
         vkUpdateDescriptorSets(m_vkDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
     }
@@ -1427,11 +1412,21 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
     }
 
     void InitializeResources() {
+        // Built from vulkan_shaders/shader.vert and shader.frag when glslangValidator is available,
+        // otherwise the checked-in copies.
         std::vector<uint32_t> vertexSPIRV = {
+#if defined(USE_GENERATED_SPIRV)
+#include "spirv/vert.spv"
+#else
 #include "vulkan_shaders/vert.spv"
+#endif
         };
         std::vector<uint32_t> fragmentSPIRV = {
+#if defined(USE_GENERATED_SPIRV)
+#include "spirv/frag.spv"
+#else
 #include "vulkan_shaders/frag.spv"
+#endif
         };
         if (vertexSPIRV.empty()) {THROW("Failed to compile vertex shader");}
         if (fragmentSPIRV.empty()) {THROW("Failed to compile fragment shader");}
@@ -1505,8 +1500,48 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
                     int64_t /*swapchainFormat*/, const std::vector<Cube>& cubes) override {
     }
 
+    void UploadFrame(const MediaFrame* frame) override {
+        if (frame == nullptr || frame->number == m_uploadedFrame) {
+            return;
+        }
+        const int32_t width = frame->width;
+        const int32_t height = frame->height;
+        const int32_t stride = std::max(frame->stride, width);
+        const int32_t sliceHeight = std::max(frame->sliceHeight, height);
+        // A buffer shorter than its picture (a decoder error, a format change not seen yet) is
+        // skipped before the textures are resized for it, and the last picture stays up.
+        if (width <= 0 || height <= 0 || frame->size < GetYuv420BufferSize(width, height, stride, sliceHeight, frame->planarChroma)) {
+            if (!m_skippingFrames) {
+                Log::Write(Log::Level::Warning, Fmt("UploadFrame: %dx%d frame (stride %d, slice height %d) in %u bytes, skipped", width, height,
+                                                    stride, sliceHeight, frame->size));
+            }
+            m_skippingFrames = true;
+            m_uploadedFrame = frame->number;
+            return;
+        }
+        m_skippingFrames = false;
+        if ((uint32_t)width != m_pipelineLayout.textureWidth || (uint32_t)height != m_pipelineLayout.textureHeight) {
+            // The last view's commands were waited for, so nothing in flight uses the textures.
+            m_pipelineLayout.ResizeTextures(width, height);
+        }
+        //copy yuv into the packed staging buffers: NV12 chroma goes up as it is, I420 is interleaved into the same layout
+        const uint8_t* chroma = frame->data + (size_t)stride * sliceHeight;
+        uint8_t* uv = (uint8_t*)m_pipelineLayout.yuvBufferMemoryMapped_uv;
+        CopyPlane(frame->data, stride, (uint8_t*)m_pipelineLayout.yuvBufferMemoryMapped_y, width, width, height);
+        if (frame->planarChroma) {
+            const size_t chromaStride = stride / 2;
+            InterleaveChromaRows(chroma, chroma + chromaStride * (sliceHeight / 2), chromaStride, uv, (size_t)(width / 2) * 2, width / 2, height / 2);
+        } else {
+            CopyPlane(chroma, stride, uv, (size_t)(width / 2) * 2, (size_t)(width / 2) * 2, height / 2);
+        }
+        //copy image
+        copyBufferToImage(m_pipelineLayout.yuvBuffer_y, m_pipelineLayout.textureImage_y, width, height);
+        copyBufferToImage(m_pipelineLayout.yuvBuffer_uv, m_pipelineLayout.textureImage_uv, width / 2, height / 2);
+        m_uploadedFrame = frame->number;
+    }
+
     void RenderView(const XrCompositionLayerProjectionView& layerView, const XrSwapchainImageBaseHeader* swapchainImage,
-                        int64_t swapchainFormat, const std::shared_ptr<MediaFrame>& frame, const int32_t eye) override {
+                        int64_t swapchainFormat, const MediaFrame* frame, const int32_t eye) override {
         CHECK(layerView.subImage.imageArrayIndex == 0);  // Texture arrays not supported.
         auto swapchainContext = m_swapchainImageContextMap[swapchainImage];
         uint32_t imageIndex = swapchainContext->ImageIndex(swapchainImage);
@@ -1585,26 +1620,6 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
         } else if (m_options->VideoMode == "2D") {
         }
 
-        if (frame.get()) {
-            uint32_t size_y = frame->width * frame->height;
-            uint32_t size_u = size_y / 4;
-            uint32_t size_v = size_y / 4;
-            //copy yuv
-            memcpy(m_pipelineLayout.yuvBufferMemoryMapped_y, frame->data, size_y);
-            uint8_t *bufferu = (uint8_t*)m_pipelineLayout.yuvBufferMemoryMapped_u;
-            for (int32_t i = size_y; i < frame->size; i += 2) {
-                *bufferu++ = frame->data[i];
-            }
-            uint8_t *bufferv = (uint8_t*)m_pipelineLayout.yuvBufferMemoryMapped_v;
-            for (int32_t i = size_y; i < frame->size; i += 2) {
-                *bufferv++ = frame->data[i+1];
-            }
-            //copy image
-            copyBufferToImage(m_pipelineLayout.yuvBuffer_y, m_pipelineLayout.textureImage_y, frame->width, frame->height);
-            copyBufferToImage(m_pipelineLayout.yuvBuffer_u, m_pipelineLayout.textureImage_u, frame->width / 2, frame->height / 2);
-            copyBufferToImage(m_pipelineLayout.yuvBuffer_v, m_pipelineLayout.textureImage_v, frame->width / 2, frame->height / 2);
-        }
-
         vkCmdBindIndexBuffer(m_cmdBuffer.buf, m_drawBuffer.indexBuffer, 0, VK_INDEX_TYPE_UINT16);
         vkCmdBindDescriptorSets(m_cmdBuffer.buf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout.pipelineLayout, 0, 1, &m_pipelineLayout.descriptorSets, 0, nullptr);
         vkCmdDrawIndexed(m_cmdBuffer.buf, m_drawBuffer.count.idx, 1, 0, 0, 0);
@@ -1715,6 +1730,8 @@ protected:
     XrPosef m_pose = Translation({0.f, 0.f, -3.0f});
     XrVector3f m_scale{1.f, 1.f, 1.f};
     float m_radius = 50;
+    uint32_t m_uploadedFrame{0};  // MediaFrame::number of the picture in the textures
+    bool m_skippingFrames{false};  // the last frame was too short to upload; logged once per run of them
     int32_t m_videoWidth;
     int32_t m_videoHeight;
     float m_backgroundColor[4] = {0.01f, 0.01f, 0.01f, 1.0f};
@@ -0,0 +1,351 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Media file served over HTTP with range requests and a bounded read-ahead block cache.
+
+#include "pch.h"
+#include "common.h"
+#include "httpfile.h"
+#include "mediaclock.h"
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+
+namespace {
+
+constexpr int32_t kSocketTimeoutSec = 10;
+constexpr size_t kMaxHeaderBytes = 16 * 1024;
+
+bool SendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t got = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (got <= 0) {
+            return false;
+        }
+        sent += got;
+    }
+    return true;
+}
+
+// Value of a response header, matched case-insensitively, or "" if absent.
+std::string HeaderValue(const std::string& headers, const char* name) {
+    const size_t nameLength = strlen(name);
+    for (size_t line = headers.find("\r\n"); line != std::string::npos; line = headers.find("\r\n", line + 2)) {
+        const size_t start = line + 2;
+        if (headers.size() - start > nameLength && strncasecmp(headers.c_str() + start, name, nameLength) == 0 && headers[start + nameLength] == ':') {
+            size_t value = start + nameLength + 1;
+            while (value < headers.size() && headers[value] == ' ') {
+                value++;
+            }
+            return headers.substr(value, headers.find("\r\n", value) - value);
+        }
+    }
+    return std::string();
+}
+}  // namespace
+
+void CHttpFile::Connection::reset() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+CHttpFile::~CHttpFile() {
+    close();
+}
+
+bool CHttpFile::open(const char* url, int64_t readAhead, std::shared_ptr<MediaIoCounters> counters) {
+    close();
+    mCounters = counters ? std::move(counters) : std::make_shared<MediaIoCounters>();
+    if (strncasecmp(url, "https://", 8) == 0) {
+        Log::Write(Log::Level::Error, Fmt("http source: %s needs TLS, which this build doesn't include", url));
+        return false;
+    }
+    if (strncasecmp(url, "http://", 7) != 0) {
+        return false;
+    }
+    const std::string rest(url + 7);
+    const size_t slash = rest.find('/');
+    const std::string authority = rest.substr(0, slash);
+    mPath = slash == std::string::npos ? "/" : rest.substr(slash);
+    const size_t colon = authority.rfind(':');
+    mHost = colon == std::string::npos ? authority : authority.substr(0, colon);
+    mPort = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+
+    // The first block doubles as the size probe: a 206 reply carries the total in Content-Range.
+    Connection probe;
+    std::vector<uint8_t> first;
+    int64_t totalSize = -1;
+    const bool fetched = fetch(probe, 0, kBlockSize, first, &totalSize);
+    probe.reset();
+    if (!fetched || totalSize < 0) {
+        Log::Write(Log::Level::Error, Fmt("http source: %s is not reachable or doesn't serve byte ranges", url));
+        return false;
+    }
+    mSize = totalSize;
+    mReadAheadBlocks = (readAhead + kBlockSize - 1) / kBlockSize;
+    mCapacityBlocks = std::max<size_t>(kMinCacheBlocks, 2 * mReadAheadBlocks + kConnections);
+    Block& block = mBlocks[0];
+    block.data = std::move(first);
+    block.ready = true;
+
+    mStopping = false;
+    for (int32_t i = 0; i < kConnections; i++) {
+        mWorkers.emplace_back(&CHttpFile::worker, this);
+    }
+    Log::Write(Log::Level::Info, Fmt("http source: %s, %lld bytes, %d KB blocks, read-ahead %lld blocks", url, (long long)mSize,
+                                     (int32_t)(kBlockSize >> 10), (long long)mReadAheadBlocks));
+    return true;
+}
+
+void CHttpFile::close() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWorkReady.notify_all();
+    for (std::thread& worker : mWorkers) {
+        worker.join();
+    }
+    mWorkers.clear();
+    mBlocks.clear();
+    mQueue.clear();
+    mSize = 0;
+}
+
+ssize_t CHttpFile::readAt(int64_t offset, void* buffer, size_t size) {
+    if (offset < 0 || offset > mSize) {
+        return -1;
+    }
+    size = (size_t)std::min<int64_t>(size, mSize - offset);
+    if (size == 0) {
+        return 0;
+    }
+    const int64_t firstBlock = offset / kBlockSize;
+    const int64_t lastBlock = (offset + (int64_t)size - 1) / kBlockSize;
+    int64_t stallStartNs = -1;
+    size_t copied = 0;
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (copied < size) {
+        const int64_t position = offset + copied;
+        const int64_t index = position / kBlockSize;
+        Block& block = mBlocks[index];
+        if (block.failed) {
+            mBlocks.erase(index);  // let a later read retry
+            break;
+        }
+        if (!block.ready) {
+            if (stallStartNs < 0) {
+                stallStartNs = CMediaClock::monotonicNow();
+                // A miss usually means a seek: don't make it wait behind read-ahead for the old position.
+                for (auto it = mQueue.begin(); it != mQueue.end();) {
+                    if (*it < firstBlock || *it > lastBlock + mReadAheadBlocks) {
+                        mBlocks.erase(*it);
+                        it = mQueue.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            queue(index, true);
+            mBlockReady.wait(lock, [&] {
+                auto it = mBlocks.find(index);
+                return it == mBlocks.end() || it->second.ready || it->second.failed;
+            });
+            continue;
+        }
+        block.lastUse = ++mUseClock;
+        const size_t inBlock = (size_t)(position - index * kBlockSize);
+        const size_t count = std::min(size - copied, block.data.size() - inBlock);
+        memcpy((uint8_t*)buffer + copied, block.data.data() + inBlock, count);
+        copied += count;
+    }
+    for (int64_t index = lastBlock + 1; index <= lastBlock + mReadAheadBlocks && index * kBlockSize < mSize; index++) {
+        if (mBlocks.find(index) == mBlocks.end()) {
+            queue(index, false);
+        }
+    }
+    evict(firstBlock, lastBlock + mReadAheadBlocks);
+    lock.unlock();
+
+    if (stallStartNs >= 0) {
+        mCounters->stalls++;
+        mCounters->stallNs += CMediaClock::monotonicNow() - stallStartNs;
+    }
+    mCounters->reads++;
+    mCounters->bytesRead += copied;
+    return copied == size ? (ssize_t)copied : -1;
+}
+
+// Called with mMutex held.
+void CHttpFile::queue(int64_t index, bool urgent) {
+    Block& block = mBlocks[index];
+    if (block.queued) {
+        if (!urgent) {
+            return;
+        }
+        auto it = std::find(mQueue.begin(), mQueue.end(), index);
+        if (it == mQueue.end()) {
+            return;  // already being fetched
+        }
+        mQueue.erase(it);
+    }
+    block.queued = true;
+    if (urgent) {
+        mQueue.push_front(index);
+    } else {
+        mQueue.push_back(index);
+    }
+    mWorkReady.notify_one();
+}
+
+// Called with mMutex held. Blocks still queued or in flight are never evicted.
+void CHttpFile::evict(int64_t keepFrom, int64_t keepTo) {
+    while (mBlocks.size() > mCapacityBlocks) {
+        auto victim = mBlocks.end();
+        for (auto it = mBlocks.begin(); it != mBlocks.end(); ++it) {
+            if ((it->second.ready || it->second.failed) && (it->first < keepFrom || it->first > keepTo) &&
+                (victim == mBlocks.end() || it->second.lastUse < victim->second.lastUse)) {
+                victim = it;
+            }
+        }
+        if (victim == mBlocks.end()) {
+            break;
+        }
+        mBlocks.erase(victim);
+    }
+}
+
+void CHttpFile::worker() {
+    Connection connection;
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (;;) {
+        mWorkReady.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+        if (mStopping) {
+            break;
+        }
+        const int64_t index = mQueue.front();
+        mQueue.pop_front();
+        lock.unlock();
+
+        const int64_t offset = index * kBlockSize;
+        const int64_t length = std::min<int64_t>(kBlockSize, mSize - offset);
+        std::vector<uint8_t> data;
+        bool ok = fetch(connection, offset, length, data, nullptr) && (int64_t)data.size() == length;
+        if (!ok) {
+            // The server may have dropped the keep-alive connection; retry once on a fresh one.
+            connection.reset();
+            ok = fetch(connection, offset, length, data, nullptr) && (int64_t)data.size() == length;
+        }
+        if (!ok) {
+            Log::Write(Log::Level::Error, Fmt("http source: range %lld+%lld failed", (long long)offset, (long long)length));
+        }
+
+        lock.lock();
+        auto it = mBlocks.find(index);
+        if (it != mBlocks.end()) {
+            it->second.data = std::move(data);
+            it->second.ready = ok;
+            it->second.failed = !ok;
+            it->second.queued = false;
+        }
+        mBlockReady.notify_all();
+    }
+    connection.reset();
+}
+
+bool CHttpFile::connect(Connection& connection) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(mHost.c_str(), mPort.c_str(), &hints, &addresses) != 0) {
+        Log::Write(Log::Level::Error, Fmt("http source: can't resolve %s", mHost.c_str()));
+        return false;
+    }
+    for (addrinfo* address = addresses; address; address = address->ai_next) {
+        int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        timeval timeout = {kSocketTimeoutSec, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            connection.fd = fd;
+            break;
+        }
+        ::close(fd);
+    }
+    freeaddrinfo(addresses);
+    return connection.fd >= 0;
+}
+
+bool CHttpFile::fetch(Connection& connection, int64_t offset, int64_t length, std::vector<uint8_t>& body, int64_t* totalSize) {
+    if (connection.fd < 0 && !connect(connection)) {
+        return false;
+    }
+    const std::string request = Fmt("GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%lld-%lld\r\nConnection: keep-alive\r\n\r\n", mPath.c_str(),
+                                    mHost.c_str(), (long long)offset, (long long)(offset + length - 1));
+    if (!SendAll(connection.fd, request)) {
+        connection.reset();
+        return false;
+    }
+
+    // Headers, plus whatever part of the body arrived with them.
+    std::string headers;
+    size_t headerEnd = std::string::npos;
+    char chunk[4096];
+    while (headerEnd == std::string::npos) {
+        const ssize_t got = recv(connection.fd, chunk, sizeof(chunk), 0);
+        if (got <= 0 || headers.size() > kMaxHeaderBytes) {
+            connection.reset();
+            return false;
+        }
+        headers.append(chunk, got);
+        headerEnd = headers.find("\r\n\r\n");
+    }
+    std::string extra = headers.substr(headerEnd + 4);
+    headers.resize(headerEnd + 2);
+
+    int32_t status = 0;
+    sscanf(headers.c_str(), "HTTP/%*d.%*d %d", &status);
+    const std::string contentLength = HeaderValue(headers, "Content-Length");
+    if (status != 206 || contentLength.empty()) {
+        // A 200 means the server ignored the range; reading the whole file per block is not an option.
+        Log::Write(Log::Level::Error, Fmt("http source: range request answered with status %d", status));
+        connection.reset();
+        return false;
+    }
+    if (totalSize) {
+        const std::string range = HeaderValue(headers, "Content-Range");
+        const size_t total = range.rfind('/');
+        *totalSize = (total == std::string::npos || range[total + 1] == '*') ? -1 : atoll(range.c_str() + total + 1);
+    }
+
+    const size_t bodyLength = (size_t)atoll(contentLength.c_str());
+    body.assign(extra.begin(), extra.begin() + std::min(extra.size(), bodyLength));
+    body.resize(bodyLength);
+    size_t received = std::min(extra.size(), bodyLength);
+    while (received < bodyLength) {
+        const ssize_t got = recv(connection.fd, body.data() + received, bodyLength - received, 0);
+        if (got <= 0) {
+            connection.reset();
+            return false;
+        }
+        received += got;
+    }
+    mCounters->requests++;
+    mCounters->fetchedBytes += bodyLength;
+    if (strcasecmp(HeaderValue(headers, "Connection").c_str(), "close") == 0) {
+        connection.reset();
+    }
+    return true;
+}
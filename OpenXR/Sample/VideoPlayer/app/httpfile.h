@@ -0,0 +1,86 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Media file served over HTTP with range requests and a bounded read-ahead block cache.
+
+#pragma once
+#include "mediafile.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The file is fetched in kBlockSize blocks by kConnections worker threads, each keeping its own
+// keep-alive connection, so several range requests are in flight at once. A read queues any
+// missing block at the front and waits for it (a stall), then queues the blocks up to readAhead
+// bytes past it at the back. At most capacity blocks are held; the least recently used block
+// outside the read-ahead window is evicted first.
+//
+// Plain http:// only: the build has no TLS library.
+class CHttpFile : public IMediaFile {
+
+public:
+    CHttpFile() = default;
+
+    ~CHttpFile() override;
+
+    CHttpFile(const CHttpFile&) = delete;
+    CHttpFile& operator=(const CHttpFile&) = delete;
+
+    // Learns the size from a first range request; fails if the server doesn't serve ranges.
+    bool open(const char* url, int64_t readAhead, std::shared_ptr<MediaIoCounters> counters);
+
+    void close();
+
+    int64_t size() const override { return mSize; }
+
+    ssize_t readAt(int64_t offset, void* buffer, size_t size) override;
+
+    static constexpr int64_t kBlockSize = 256 * 1024;
+    static constexpr int32_t kConnections = 3;
+    static constexpr int64_t kMinCacheBlocks = 8;
+
+private:
+    struct Block {
+        std::vector<uint8_t> data;
+        bool     ready{false};
+        bool     failed{false};
+        bool     queued{false};
+        uint64_t lastUse{0};
+    };
+
+    // One keep-alive connection, owned by a single worker.
+    struct Connection {
+        int  fd{-1};
+        void reset();
+    };
+
+    void worker();
+
+    bool fetch(Connection& connection, int64_t offset, int64_t length, std::vector<uint8_t>& body, int64_t* totalSize);
+
+    bool connect(Connection& connection);
+
+    void queue(int64_t block, bool urgent);
+
+    void evict(int64_t keepFrom, int64_t keepTo);
+
+    std::string                      mHost;
+    std::string                      mPort;
+    std::string                      mPath;
+    int64_t                          mSize{0};
+    int64_t                          mReadAheadBlocks{0};
+    size_t                           mCapacityBlocks{kMinCacheBlocks};
+    std::shared_ptr<MediaIoCounters> mCounters;
+
+    std::mutex                       mMutex;
+    std::condition_variable          mWorkReady;
+    std::condition_variable          mBlockReady;
+    std::map<int64_t, Block>         mBlocks;
+    std::deque<int64_t>              mQueue;
+    uint64_t                         mUseClock{0};
+    bool                             mStopping{false};
+    std::vector<std::thread>         mWorkers;
+};
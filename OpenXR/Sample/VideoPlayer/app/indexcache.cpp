@@ -0,0 +1,151 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// On-disk cache of indexes built from media files (sample tables, keyframe lists).
+
+#include "pch.h"
+#include "common.h"
+#include "indexcache.h"
+#include "cachefile.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr uint32_t kCacheMagic = 0x58444958;  // "XIDX"
+
+// Identifies the media file the entry was built from.
+typedef struct CacheHeader_tag {
+    uint32_t magic;
+    uint32_t version;
+    int64_t  fileSize;
+    int64_t  fileMtimeNs;
+    uint32_t pathLength;
+    uint32_t kindLength;
+}CacheHeader;
+
+bool StatMedia(const char* source, int64_t& size, int64_t& mtimeNs) {
+    struct stat statbuff;
+    if (stat(source, &statbuff) < 0) {
+        return false;
+    }
+    size = statbuff.st_size;
+    mtimeNs = (int64_t)statbuff.st_mtim.tv_sec * 1000000000 + statbuff.st_mtim.tv_nsec;
+    return true;
+}
+
+size_t AlignUp(size_t value) { return (value + 7) & ~(size_t)7; }
+}  // namespace
+
+CIndexCacheEntry::CIndexCacheEntry(void* map, size_t mapSize, size_t payloadOffset) : mMap(map), mMapSize(mapSize), mPayloadOffset(payloadOffset) {
+}
+
+CIndexCacheEntry::~CIndexCacheEntry() {
+    munmap(mMap, mMapSize);
+}
+
+void CIndexWriter::putString(const std::string& value) {
+    put<uint32_t>((uint32_t)value.size());
+    putBytes(value.data(), value.size());
+}
+
+void CIndexWriter::putBytes(const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    mPayload.insert(mPayload.end(), bytes, bytes + size);
+}
+
+void CIndexWriter::align() {
+    mPayload.resize(AlignUp(mPayload.size()), 0);
+}
+
+std::string CIndexReader::getString() {
+    const uint32_t length = get<uint32_t>();
+    const char* chars = (const char*)take(length, 1, false);
+    return chars ? std::string(chars, length) : std::string();
+}
+
+const uint8_t* CIndexReader::take(size_t count, size_t elementSize, bool aligned) {
+    const size_t pos = aligned ? AlignUp(mPos) : mPos;
+    if (mFailed || pos > mSize || count > (mSize - pos) / elementSize) {
+        mFailed = true;
+        return nullptr;
+    }
+    mPos = pos + count * elementSize;
+    return mData + pos;
+}
+
+CIndexCache::CIndexCache(std::string directory) : mDirectory(std::move(directory)) {
+}
+
+std::string CIndexCache::entryPath(const char* source, const char* kind) const {
+    // Collisions are caught by the path stored in the header.
+    return Fmt("%s/%016llx.%s", mDirectory.c_str(), (unsigned long long)HashCacheKey(source), kind);
+}
+
+std::shared_ptr<CIndexCacheEntry> CIndexCache::load(const char* source, const char* kind) {
+    if (mDirectory.empty()) {
+        return nullptr;
+    }
+    int64_t fileSize = 0;
+    int64_t mtimeNs = 0;
+    const std::string path = entryPath(source, kind);
+    int fd = StatMedia(source, fileSize, mtimeNs) ? ::open(path.c_str(), O_RDONLY) : -1;
+    if (fd < 0) {
+        mMisses++;
+        return nullptr;
+    }
+    struct stat statbuff;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &statbuff) == 0 && statbuff.st_size >= (off_t)sizeof(CacheHeader)) {
+        map = mmap(nullptr, statbuff.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        mMisses++;
+        return nullptr;
+    }
+
+    const size_t mapSize = statbuff.st_size;
+    CacheHeader header;
+    memcpy(&header, map, sizeof(header));
+    const size_t payloadOffset = AlignUp(sizeof(header) + header.pathLength + header.kindLength);
+    const char* names = (const char*)map + sizeof(header);
+    if (header.magic != kCacheMagic || header.version != kFormatVersion || header.fileSize != fileSize || header.fileMtimeNs != mtimeNs ||
+        payloadOffset > mapSize || header.pathLength != strlen(source) || memcmp(names, source, header.pathLength) != 0 ||
+        header.kindLength != strlen(kind) || memcmp(names + header.pathLength, kind, header.kindLength) != 0) {
+        munmap(map, mapSize);
+        mMisses++;
+        return nullptr;
+    }
+    mHits++;
+    return std::make_shared<CIndexCacheEntry>(map, mapSize, payloadOffset);
+}
+
+bool CIndexCache::store(const char* source, const char* kind, const std::vector<uint8_t>& payload) {
+    if (mDirectory.empty()) {
+        return false;
+    }
+    CacheHeader header = {};
+    header.magic = kCacheMagic;
+    header.version = kFormatVersion;
+    header.pathLength = (uint32_t)strlen(source);
+    header.kindLength = (uint32_t)strlen(kind);
+    if (!StatMedia(source, header.fileSize, header.fileMtimeNs)) {
+        return false;
+    }
+    std::vector<uint8_t> file(AlignUp(sizeof(header) + header.pathLength + header.kindLength), 0);
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + sizeof(header), source, header.pathLength);
+    memcpy(file.data() + sizeof(header) + header.pathLength, kind, header.kindLength);
+    file.insert(file.end(), payload.begin(), payload.end());
+
+    // Create the directory chain on first use.
+    MakeCacheDirectories(mDirectory);
+    const std::string path = entryPath(source, kind);
+    if (!WriteCacheFile(path, {&file})) {
+        Log::Write(Log::Level::Warning, Fmt("index cache: can't write %s, errno %d", path.c_str(), errno));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,119 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// On-disk cache of indexes built from media files (sample tables, keyframe lists).
+
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A cache file mapped read-only. Payload arrays written 8-byte aligned by CIndexWriter can be
+// used in place for as long as the entry is referenced.
+class CIndexCacheEntry {
+
+public:
+    CIndexCacheEntry(void* map, size_t mapSize, size_t payloadOffset);
+
+    ~CIndexCacheEntry();
+
+    const uint8_t* data() const { return (const uint8_t*)mMap + mPayloadOffset; }
+
+    size_t size() const { return mMapSize - mPayloadOffset; }
+
+private:
+    void*  mMap;
+    size_t mMapSize;
+    size_t mPayloadOffset;
+};
+
+// Appends payload fields; arrays start 8-byte aligned so a mapped entry can hand out typed pointers.
+class CIndexWriter {
+
+public:
+    template <typename T>
+    void put(const T& value) { putBytes(&value, sizeof(value)); }
+
+    template <typename T>
+    void putArray(const T* values, size_t count) {
+        align();
+        putBytes(values, sizeof(T) * count);
+    }
+
+    void putString(const std::string& value);
+
+    const std::vector<uint8_t>& payload() const { return mPayload; }
+
+private:
+    void putBytes(const void* data, size_t size);
+
+    void align();
+
+    std::vector<uint8_t> mPayload;
+};
+
+// Reads back what CIndexWriter wrote, in the same order. Any read past the end leaves the
+// reader failed, and every later read returns zeros / nullptr.
+class CIndexReader {
+
+public:
+    CIndexReader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+    template <typename T>
+    T get() {
+        T value{};
+        const uint8_t* bytes = take(1, sizeof(T), false);
+        if (bytes) {
+            memcpy(&value, bytes, sizeof(T));
+        }
+        return value;
+    }
+
+    template <typename T>
+    const T* getArray(size_t count) { return (const T*)take(count, sizeof(T), true); }
+
+    std::string getString();
+
+    bool failed() const { return mFailed; }
+
+private:
+    // count elements of elementSize bytes. count comes from the file, so it is checked against the
+    // bytes left before it is multiplied.
+    const uint8_t* take(size_t count, size_t elementSize, bool aligned);
+
+    const uint8_t* mData;
+    size_t         mSize;
+    size_t         mPos{0};
+    bool           mFailed{false};
+};
+
+// One file per (media file, index kind) in the cache directory, named by a hash of the media
+// path. The header repeats the path with the file's size and mtime, so an entry is only used
+// while the media file is unchanged; a format version bump invalidates everything.
+class CIndexCache {
+
+public:
+    // An empty directory disables the cache.
+    explicit CIndexCache(std::string directory);
+
+    // The cached payload of this kind for source, or nullptr if absent or stale.
+    std::shared_ptr<CIndexCacheEntry> load(const char* source, const char* kind);
+
+    // Replaces the entry atomically (written to a temporary file, then renamed).
+    bool store(const char* source, const char* kind, const std::vector<uint8_t>& payload);
+
+    uint64_t hits() const { return mHits; }
+
+    uint64_t misses() const { return mMisses; }
+
+    static constexpr uint32_t kFormatVersion = 2;
+
+private:
+    std::string entryPath(const char* source, const char* kind) const;
+
+    std::string           mDirectory;
+    std::atomic<uint64_t> mHits{0};
+    std::atomic<uint64_t> mMisses{0};
+};
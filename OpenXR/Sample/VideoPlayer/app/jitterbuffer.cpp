@@ -0,0 +1,37 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Playout scheduling for live streams that arrive without timestamps.
+
+#include "pch.h"
+#include "common.h"
+#include "jitterbuffer.h"
+
+int64_t CJitterBuffer::schedule(int64_t arrivalNs) {
+    if (mLastArrivalNs >= 0) {
+        const int64_t gap = arrivalNs - mLastArrivalNs;
+        if (mIntervalNs > 0 && gap > kDiscontinuityIntervals * mIntervalNs && gap > kMinDiscontinuityNs) {
+            mLastReleaseNs = -1;
+        } else if (mIntervalNs == 0) {
+            mIntervalNs = gap;
+        } else {
+            mIntervalNs += (gap - mIntervalNs) / kGainDivisor;
+            mJitterNs += (std::abs(gap - mIntervalNs) - mJitterNs) / kGainDivisor;
+        }
+    }
+    mLastArrivalNs = arrivalNs;
+    mDelayNs = std::min(kJitterMultiplier * mJitterNs, mMaxDelayNs);
+
+    int64_t releaseNs = (mLastReleaseNs >= 0) ? mLastReleaseNs + mIntervalNs : arrivalNs;
+    releaseNs = std::max(releaseNs, arrivalNs);
+    releaseNs = std::min(releaseNs, arrivalNs + mDelayNs);
+    mLastReleaseNs = releaseNs;
+    return releaseNs;
+}
+
+void CJitterBuffer::reset() {
+    mIntervalNs = 0;
+    mJitterNs = 0;
+    mDelayNs = 0;
+    mLastArrivalNs = -1;
+    mLastReleaseNs = -1;
+}
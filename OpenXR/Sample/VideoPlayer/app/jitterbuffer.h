@@ -0,0 +1,45 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Playout scheduling for live streams that arrive without timestamps.
+
+#pragma once
+#include <stdint.h>
+
+// Frames of a live stream reach the player unevenly (network bursts, the sender's write
+// scheduling) but were produced at a steady rate. Each frame is released one frame interval
+// after the previous one, so bursts are spread back out, but never before it arrived and never
+// held longer than the current delay target.
+//
+// The interval and the jitter are smoothed the way RFC 3550 estimates interarrival jitter, and the
+// delay target follows the jitter up to maxDelayNs: a clean local feed is played with no delay at
+// all, a jittery one gets just enough to play smoothly. A gap much longer than the interval (the
+// sender paused or restarted) restarts the schedule instead of skewing the estimates.
+class CJitterBuffer {
+
+public:
+    explicit CJitterBuffer(int64_t maxDelayNs) : mMaxDelayNs(maxDelayNs) {}
+
+    // Release time for a frame that arrived at arrivalNs (CLOCK_MONOTONIC).
+    int64_t schedule(int64_t arrivalNs);
+
+    void reset();
+
+    int64_t delayNs() const { return mDelayNs; }
+
+    int64_t intervalNs() const { return mIntervalNs; }
+
+    int64_t jitterNs() const { return mJitterNs; }
+
+    static constexpr int64_t kGainDivisor = 16;        // RFC 3550 smoothing
+    static constexpr int64_t kJitterMultiplier = 3;    // delay target, in smoothed jitters
+    static constexpr int64_t kDiscontinuityIntervals = 8;
+    static constexpr int64_t kMinDiscontinuityNs = 250 * 1000 * 1000;  // shorter gaps are bursts, even after a tiny first interval
+
+private:
+    int64_t mMaxDelayNs;
+    int64_t mIntervalNs = 0;
+    int64_t mJitterNs = 0;
+    int64_t mDelayNs = 0;
+    int64_t mLastArrivalNs = -1;
+    int64_t mLastReleaseNs = -1;
+};
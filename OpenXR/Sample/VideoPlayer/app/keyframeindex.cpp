@@ -0,0 +1,178 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Sync-sample (keyframe) index of one track, used to plan seeks.
+
+#include "pch.h"
+#include "common.h"
+#include "keyframeindex.h"
+#include "mediaclock.h"
+#include "mediafile.h"
+#include <algorithm>
+#include <thread>
+
+// A scan runs on its own thread with its own source; the index owning it reads the result once
+// done is set. Destroying the scan stops the thread at the next sample and joins it.
+struct CKeyframeIndex::Scan {
+    ~Scan() {
+        cancel = true;
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    std::thread          thread;
+    std::atomic<bool>    cancel{false};
+    std::atomic<bool>    done{false};
+    std::vector<int64_t> timesUs;       // written by the thread before done is set
+    int64_t              buildTimeNs{0};
+};
+
+CKeyframeIndex::CKeyframeIndex() = default;
+
+CKeyframeIndex::~CKeyframeIndex() = default;
+
+CKeyframeIndex::CKeyframeIndex(CKeyframeIndex&& other) = default;
+
+CKeyframeIndex& CKeyframeIndex::operator=(CKeyframeIndex&& other) = default;
+
+bool CKeyframeIndex::build(IMediaBackend& backend, IMediaSource& opened, const char* source, int32_t track, bool background) {
+    const int64_t startNs = CMediaClock::monotonicNow();
+    clear();
+    std::shared_ptr<CIndexCache> cache = backend.getIndexCache();
+    const std::string kind = Fmt("keyframes%d", track);
+    if (cache && load(*cache, source, kind)) {
+        mFromCache = true;
+        mBuildTimeNs = CMediaClock::monotonicNow() - startNs;
+        Log::Write(Log::Level::Info, Fmt("keyframe index: %d keyframes loaded from cache in %lld us", (int32_t)mTimesUs.size(), (long long)(mBuildTimeNs / 1000)));
+        return true;
+    }
+    // The container's sample table already lists them; it is cached with the demuxer's own index.
+    if (opened.getSyncSampleTimes(track, mTimesUs) && !mTimesUs.empty()) {
+        mBuildTimeNs = CMediaClock::monotonicNow() - startNs;
+        Log::Write(Log::Level::Info, Fmt("keyframe index: %d keyframes from the sample table in %lld us", (int32_t)mTimesUs.size(), (long long)(mBuildTimeNs / 1000)));
+        return true;
+    }
+    mTimesUs.clear();
+    if (IsRemoteMediaPath(source)) {
+        Log::Write(Log::Level::Info, Fmt("keyframe index: none for remote %s, seeks go to the demuxer's sync sample", source));
+        return false;
+    }
+
+    // Advancing a demuxer reads every sample on some backends (AMediaExtractor does), so a scan
+    // costs as much as reading the whole file.
+    std::shared_ptr<IMediaSource> scanner = backend.createSource();
+    if (scanner == nullptr || !scanner->open(source) || !scanner->selectTrack(track)) {
+        Log::Write(Log::Level::Error, Fmt("keyframe index: open %s track %d error", source, track));
+        return false;
+    }
+    auto finish = [cache, kind](const std::string& path, const std::vector<int64_t>& timesUs, int64_t buildTimeNs) {
+        Log::Write(Log::Level::Info, Fmt("keyframe index: %d keyframes scanned in %lld us", (int32_t)timesUs.size(), (long long)(buildTimeNs / 1000)));
+        if (cache && !timesUs.empty()) {
+            CIndexWriter writer;
+            writer.put<uint64_t>(timesUs.size());
+            writer.putArray(timesUs.data(), timesUs.size());
+            cache->store(path.c_str(), kind.c_str(), writer.payload());
+        }
+    };
+    if (!background) {
+        const std::atomic<bool> cancel{false};
+        mTimesUs = ScanSamples(*scanner, track, cancel);
+        mBuildTimeNs = CMediaClock::monotonicNow() - startNs;
+        finish(source, mTimesUs, mBuildTimeNs);
+        return !mTimesUs.empty();
+    }
+    mScan.reset(new Scan());
+    Scan* scan = mScan.get();
+    const std::string path(source);
+    scan->thread = std::thread([scan, scanner, track, startNs, finish, path] {
+        scan->timesUs = ScanSamples(*scanner, track, scan->cancel);
+        scan->buildTimeNs = CMediaClock::monotonicNow() - startNs;
+        if (!scan->cancel) {
+            finish(path, scan->timesUs, scan->buildTimeNs);
+        }
+        scan->done.store(true, std::memory_order_release);
+    });
+    return true;
+}
+
+std::vector<int64_t> CKeyframeIndex::ScanSamples(IMediaSource& scanner, int32_t track, const std::atomic<bool>& cancel) {
+    std::vector<int64_t> timesUs;
+    while (!cancel && scanner.getSampleTrackIndex() >= 0) {
+        if (scanner.getSampleTrackIndex() == track && (scanner.getSampleFlags() & IMediaSource::kSampleFlagSync)) {
+            timesUs.push_back(scanner.getSampleTime());
+        }
+        if (!scanner.advance()) {
+            break;
+        }
+    }
+    std::sort(timesUs.begin(), timesUs.end());
+    return timesUs;
+}
+
+bool CKeyframeIndex::load(CIndexCache& cache, const char* source, const std::string& kind) {
+    std::shared_ptr<CIndexCacheEntry> entry = cache.load(source, kind.c_str());
+    if (entry == nullptr) {
+        return false;
+    }
+    CIndexReader reader(entry->data(), entry->size());
+    const size_t count = (size_t)reader.get<uint64_t>();
+    const int64_t* times = reader.getArray<int64_t>(count);
+    if (reader.failed() || count == 0) {
+        return false;
+    }
+    mTimesUs.assign(times, times + count);
+    return true;
+}
+
+void CKeyframeIndex::collect() {
+    if (mScan && mScan->done.load(std::memory_order_acquire)) {
+        mTimesUs = std::move(mScan->timesUs);
+        mBuildTimeNs = mScan->buildTimeNs;
+        mScan.reset();
+    }
+}
+
+void CKeyframeIndex::assign(std::vector<int64_t> timesUs) {
+    clear();
+    mTimesUs = std::move(timesUs);
+}
+
+void CKeyframeIndex::clear() {
+    mScan.reset();
+    mTimesUs.clear();
+    mBuildTimeNs = 0;
+    mFromCache = false;
+}
+
+bool CKeyframeIndex::empty() {
+    collect();
+    return mTimesUs.empty() && mScan == nullptr;
+}
+
+size_t CKeyframeIndex::size() {
+    collect();
+    return mTimesUs.size();
+}
+
+bool CKeyframeIndex::ready() {
+    collect();
+    return mScan == nullptr;
+}
+
+int64_t CKeyframeIndex::findAtOrBefore(int64_t timeUs) {
+    collect();
+    if (mTimesUs.empty()) {
+        return timeUs;
+    }
+    auto it = std::upper_bound(mTimesUs.begin(), mTimesUs.end(), timeUs);
+    return it == mTimesUs.begin() ? *it : *(it - 1);
+}
+
+int64_t CKeyframeIndex::findAtOrAfter(int64_t timeUs) {
+    collect();
+    if (mTimesUs.empty()) {
+        return timeUs;
+    }
+    auto it = std::lower_bound(mTimesUs.begin(), mTimesUs.end(), timeUs);
+    return it == mTimesUs.end() ? mTimesUs.back() : *it;
+}
@@ -0,0 +1,74 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Sync-sample (keyframe) index of one track, used to plan seeks.
+
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mediabackend.h"
+
+class CKeyframeIndex {
+
+public:
+    CKeyframeIndex();
+
+    // Stops a background scan still running.
+    ~CKeyframeIndex();
+
+    CKeyframeIndex(CKeyframeIndex&& other);
+
+    CKeyframeIndex& operator=(CKeyframeIndex&& other);
+
+    // Takes the keyframes from the backend's index cache, or else from the sample table of 'opened'
+    // (an open source of the same file, left where it is) when its container has one. Otherwise a
+    // local file is scanned sample by sample with a separate source: on a thread of its own when
+    // background is set, the index staying empty until the scan ends, or before returning. Remote
+    // files are never scanned, as that would download them whole. Returns false when no keyframes
+    // are known or coming.
+    bool build(IMediaBackend& backend, IMediaSource& opened, const char* source, int32_t track, bool background);
+
+    // Takes keyframe times known up front, such as the segment starts of a streaming manifest.
+    void assign(std::vector<int64_t> timesUs);
+
+    // Also stops a background scan.
+    void clear();
+
+    // False while a background scan runs.
+    bool empty();
+
+    size_t size();
+
+    // Latest keyframe at or before timeUs (the first keyframe if timeUs precedes it). timeUs itself
+    // while the index is empty, leaving the choice to the demuxer's own seek.
+    int64_t findAtOrBefore(int64_t timeUs);
+
+    // Earliest keyframe at or after timeUs (the last keyframe if none follows), or timeUs while empty.
+    int64_t findAtOrAfter(int64_t timeUs);
+
+    // Time to load or read the index, or for a background scan to run, once it has.
+    int64_t buildTimeNs() const { return mBuildTimeNs; }
+
+    bool fromCache() const { return mFromCache; }
+
+    // False while a background scan runs.
+    bool ready();
+
+private:
+    struct Scan;
+
+    bool load(CIndexCache& cache, const char* source, const std::string& kind);
+
+    // Keyframe times of the source's track in ascending order, stopping early once cancel is set.
+    static std::vector<int64_t> ScanSamples(IMediaSource& scanner, int32_t track, const std::atomic<bool>& cancel);
+
+    // Moves the result of a finished background scan into mTimesUs.
+    void collect();
+
+    std::vector<int64_t>  mTimesUs;  // ascending
+    std::unique_ptr<Scan> mScan;     // background scan, until collect() takes its result
+    int64_t               mBuildTimeNs = 0;
+    bool                  mFromCache = false;
+};
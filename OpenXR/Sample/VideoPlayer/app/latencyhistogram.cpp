@@ -0,0 +1,62 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Lock-free latency histogram.
+
+#include "pch.h"
+#include "common.h"
+#include "latencyhistogram.h"
+
+CLatencyHistogram::CLatencyHistogram() {
+    reset();
+}
+
+int32_t CLatencyHistogram::bucketOf(uint64_t us) {
+    if (us < kSubBuckets) {
+        return (int32_t)us;
+    }
+    int32_t exponent = 63 - __builtin_clzll(us);  // us >= 8, so exponent >= 3
+    const int32_t bucket = (exponent - 2) * kSubBuckets + (int32_t)((us >> (exponent - 3)) - kSubBuckets);
+    return std::min(bucket, kBuckets - 1);
+}
+
+uint64_t CLatencyHistogram::bucketUpperUs(int32_t bucket) {
+    if (bucket < kSubBuckets) {
+        return (uint64_t)bucket;
+    }
+    const int32_t exponent = bucket / kSubBuckets + 2;
+    const uint64_t mantissa = (uint64_t)(bucket % kSubBuckets + kSubBuckets);
+    return ((mantissa + 1) << (exponent - 3)) - 1;
+}
+
+void CLatencyHistogram::add(int64_t latencyNs) {
+    latencyNs = std::max<int64_t>(latencyNs, 0);
+    mBuckets[bucketOf((uint64_t)latencyNs / 1000)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    int64_t max = mMaxNs.load(std::memory_order_relaxed);
+    while (latencyNs > max && !mMaxNs.compare_exchange_weak(max, latencyNs, std::memory_order_relaxed)) {
+    }
+}
+
+void CLatencyHistogram::reset() {
+    for (std::atomic<uint64_t>& bucket : mBuckets) {
+        bucket = 0;
+    }
+    mCount = 0;
+    mMaxNs = 0;
+}
+
+int64_t CLatencyHistogram::percentileNs(double fraction) const {
+    const uint64_t count = mCount.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>((uint64_t)(fraction * count + 0.5), 1);
+    uint64_t seen = 0;
+    for (int32_t i = 0; i < kBuckets; i++) {
+        seen += mBuckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min((int64_t)bucketUpperUs(i) * 1000 + 999, mMaxNs.load(std::memory_order_relaxed));
+        }
+    }
+    return mMaxNs;
+}
@@ -0,0 +1,38 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Lock-free latency histogram.
+
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// Log-linear buckets over microseconds: exact below 8 us, then eight buckets per power of two,
+// so every percentile is within 12.5% up to about a day. One thread may add while others read.
+class CLatencyHistogram {
+
+public:
+    CLatencyHistogram();
+
+    void add(int64_t latencyNs);
+
+    void reset();
+
+    uint64_t count() const { return mCount; }
+
+    // Upper bound of the bucket holding the given fraction (0..1) of the samples; 0 when empty.
+    int64_t percentileNs(double fraction) const;
+
+    int64_t maxNs() const { return mMaxNs; }
+
+    static constexpr int32_t kSubBuckets = 8;
+    static constexpr int32_t kBuckets = kSubBuckets * 36;
+
+private:
+    static int32_t bucketOf(uint64_t us);
+
+    static uint64_t bucketUpperUs(int32_t bucket);
+
+    std::atomic<uint64_t> mBuckets[kBuckets];
+    std::atomic<uint64_t> mCount{0};
+    std::atomic<int64_t>  mMaxNs{0};
+};
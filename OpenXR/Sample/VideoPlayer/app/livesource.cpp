@@ -0,0 +1,356 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Live Annex-B H.264 / HEVC ingest from a UDP socket or a FIFO.
+
+#include "pch.h"
+#include "common.h"
+#include "livesource.h"
+#include "mediaclock.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr uint8_t kStartCode[] = {0, 0, 0, 1};
+
+bool StartsWithStartCode(const std::vector<uint8_t>& bytes) {
+    return bytes.size() >= 3 && bytes[0] == 0 && bytes[1] == 0 && bytes[2] == 1;
+}
+
+void AppendNalUnit(std::vector<uint8_t>& out, const uint8_t* nal, size_t size) {
+    out.insert(out.end(), kStartCode, kStartCode + sizeof(kStartCode));
+    out.insert(out.end(), nal, nal + size);
+}
+}  // namespace
+
+bool IsLiveSourcePath(const char* path) {
+    if (strncmp(path, "udp://", 6) == 0 || strncmp(path, "pipe:", 5) == 0) {
+        return true;
+    }
+    struct stat statbuff;
+    return stat(path, &statbuff) == 0 && S_ISFIFO(statbuff.st_mode);
+}
+
+std::string GetLiveCodecMime(const std::string& name) {
+    if (EqualsIgnoreCase(name, "H264")) {
+        return "video/avc";
+    } else if (EqualsIgnoreCase(name, "HEVC")) {
+        return "video/hevc";
+    }
+    throw std::invalid_argument(Fmt("Unknown live codec '%s'", name.c_str()));
+}
+
+CLiveSource::CLiveSource(std::string mime, int64_t maxJitterDelayNs, std::shared_ptr<LiveIngestCounters> counters)
+    : mMime(std::move(mime)), mHevc(mMime == "video/hevc"), mCounters(std::move(counters)), mJitterBuffer(maxJitterDelayNs) {
+    if (mCounters == nullptr) {
+        mCounters = std::make_shared<LiveIngestCounters>();
+    }
+}
+
+CLiveSource::~CLiveSource() {
+    mStopping = true;
+    if (mReceiveThread.joinable()) {
+        mReceiveThread.join();
+    }
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+bool CLiveSource::open(const char* source) {
+    mSourceName = source;
+    if (!openInput(source)) {
+        return false;
+    }
+    mReceiveThread = std::thread(&CLiveSource::receiveLoop, this);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mUnitQueued.wait_for(lock, std::chrono::microseconds(kOpenTimeoutUs), [&] { return mFailed || !mUnits.empty(); });
+    if (mUnits.empty()) {
+        Log::Write(Log::Level::Error, Fmt("live source %s: no parameter sets and keyframe within %lld s", source, (long long)(kOpenTimeoutUs / 1000000)));
+        return false;
+    }
+    mFrontFormat = mUnits.front().format;
+    Log::Write(Log::Level::Info, Fmt("live source %s: %s %dx%d", source, mMime.c_str(), mFrontFormat->width, mFrontFormat->height));
+    return true;
+}
+
+bool CLiveSource::openInput(const char* source) {
+    if (strncmp(source, "udp://", 6) == 0) {
+        const std::string address = source + 6;
+        const size_t colon = address.rfind(':');
+        const int32_t port = (colon == std::string::npos) ? 0 : atoi(address.c_str() + colon + 1);
+        const std::string host = (colon == std::string::npos) ? address : address.substr(0, colon);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (port <= 0 || port > 65535 || (!host.empty() && inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)) {
+            Log::Write(Log::Level::Error, Fmt("live source %s: expected udp://[IPv4 address]:port", source));
+            return false;
+        }
+        mFd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (mFd < 0) {
+            Log::Write(Log::Level::Error, Fmt("live source %s: socket error %d", source, errno));
+            return false;
+        }
+        const int32_t reuse = 1;
+        setsockopt(mFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        // A keyframe can arrive as a burst of datagrams larger than the default buffer.
+        setsockopt(mFd, SOL_SOCKET, SO_RCVBUF, &kSocketBufferSize, sizeof(kSocketBufferSize));
+        if (bind(mFd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+            Log::Write(Log::Level::Error, Fmt("live source %s: bind error %d", source, errno));
+            return false;
+        }
+        return true;
+    }
+    const char* path = (strncmp(source, "pipe:", 5) == 0) ? source + 5 : source;
+    // Opened read-write, so the FIFO never reports end of stream and a sender may stop and
+    // restart; this also keeps the open from blocking until a sender appears.
+    mFd = ::open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (mFd < 0) {
+        Log::Write(Log::Level::Error, Fmt("live source %s: open error %d", path, errno));
+        return false;
+    }
+    return true;
+}
+
+void CLiveSource::receiveLoop() {
+    std::vector<uint8_t> buffer(kReadSize);
+    while (!mStopping) {
+        pollfd pfd{mFd, POLLIN, 0};
+        const bool assembling = !mPending.empty() || mAssemblingPicture;
+        const int32_t ready = poll(&pfd, 1, (int32_t)((assembling ? kIdleFlushUs : kPollWaitUs) / 1000));
+        const int64_t nowNs = CMediaClock::monotonicNow();
+        if (ready == 0) {
+            if (assembling) {
+                onIdle(nowNs);
+            }
+            continue;
+        }
+        const ssize_t size = (ready > 0) ? read(mFd, buffer.data(), buffer.size()) : -1;
+        if (size < 0 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        }
+        if (size < 0) {
+            Log::Write(Log::Level::Error, Fmt("live source %s: read error %d", mSourceName.c_str(), errno));
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFailed = true;
+            mUnitQueued.notify_all();
+            break;
+        }
+        mCounters->bytesReceived += size;
+        onBytes(buffer.data(), (size_t)size, nowNs);
+    }
+}
+
+void CLiveSource::onBytes(const uint8_t* data, size_t size, int64_t nowNs) {
+    const size_t scanned = mPending.size();
+    mPending.insert(mPending.end(), data, data + size);
+    const uint8_t* begin = mPending.data();
+    const uint8_t* end = begin + mPending.size();
+    const uint8_t* scanFrom = begin + 3;
+    if (!StartsWithStartCode(mPending)) {
+        // Not in sync yet: drop everything before the first start code, keeping two bytes in
+        // case one straddles the next read.
+        const uint8_t* start = FindStartCode(begin, end);
+        if (start == end) {
+            mPending.erase(mPending.begin(), mPending.end() - std::min<size_t>(mPending.size(), 2));
+            return;
+        }
+        begin = start;
+        scanFrom = begin + 3;
+    } else if (scanned >= 5) {
+        scanFrom = begin + scanned - 2;  // earlier bytes were searched on a previous call
+    }
+
+    for (const uint8_t* next = FindStartCode(scanFrom, end); next != end; next = FindStartCode(begin + 3, end)) {
+        const uint8_t* nalEnd = next;
+        while (nalEnd > begin + 3 && nalEnd[-1] == 0) {
+            nalEnd--;  // trailing zeros, or the leading byte of a four-byte start code
+        }
+        onNalUnit(begin + 3, nalEnd - (begin + 3), nowNs);
+        begin = next;
+    }
+    mPending.erase(mPending.begin(), mPending.begin() + (begin - mPending.data()));
+}
+
+void CLiveSource::onIdle(int64_t nowNs) {
+    if (StartsWithStartCode(mPending)) {
+        size_t size = mPending.size();
+        while (size > 3 && mPending[size - 1] == 0) {
+            size--;
+        }
+        onNalUnit(mPending.data() + 3, size - 3, nowNs);
+    }
+    mPending.clear();
+    finishUnit(nowNs);
+}
+
+void CLiveSource::onNalUnit(const uint8_t* nal, size_t size, int64_t nowNs) {
+    const NalUnitInfo info = ClassifyNalUnit(mHevc, nal, size);
+    if (info.type < 0) {
+        return;
+    }
+    if (mAssemblingPicture && (info.startsAccessUnit || info.firstSlice)) {
+        finishUnit(nowNs);
+    }
+    if (info.parameterSet) {
+        std::vector<uint8_t>& saved = info.sps ? mSps : (info.pps ? mPps : mVps);
+        if (saved.size() != size || memcmp(saved.data(), nal, size) != 0) {
+            saved.assign(nal, nal + size);
+            mParameterSetsChanged = true;
+        }
+    }
+    AppendNalUnit(mAssembling.data, nal, size);
+    if (info.vcl) {
+        mAssemblingPicture = true;
+    }
+    if (info.keyframe) {
+        mAssembling.flags |= IMediaSource::kSampleFlagSync;
+    }
+}
+
+void CLiveSource::updateFormat() {
+    if (!mParameterSetsChanged || mSps.empty() || mPps.empty() || (mHevc && mVps.empty())) {
+        return;
+    }
+    mParameterSetsChanged = false;
+    std::shared_ptr<MediaTrackInfo> format = std::make_shared<MediaTrackInfo>();
+    if (!ParseSpsPictureSize(mHevc, mSps.data(), mSps.size(), format->width, format->height)) {
+        Log::Write(Log::Level::Error, Fmt("live source %s: unreadable sequence parameter set", mSourceName.c_str()));
+        return;
+    }
+    format->type = mediaTypeVideo;
+    format->mime = mMime;
+    format->maxInputSize = format->width * format->height * 3 / 2;
+    format->lowLatency = true;
+    if (mHevc) {
+        AppendNalUnit(format->codecConfig, mVps.data(), mVps.size());
+    }
+    AppendNalUnit(format->codecConfig, mSps.data(), mSps.size());
+    AppendNalUnit(format->codecConfig, mPps.data(), mPps.size());
+    if (mFormat) {
+        mAssembling.flags |= kSampleFlagFormatChange;
+        Log::Write(Log::Level::Info, Fmt("live source %s: now %dx%d", mSourceName.c_str(), format->width, format->height));
+    }
+    mFormat = format;
+}
+
+void CLiveSource::finishUnit(int64_t nowNs) {
+    if (!mAssemblingPicture) {
+        return;  // parameter sets or SEI so far: they go with the picture that follows
+    }
+    updateFormat();
+    AccessUnit unit = std::move(mAssembling);
+    mAssembling = AccessUnit();
+    mAssemblingPicture = false;
+    unit.arrivalNs = nowNs;
+    unit.releaseNs = mJitterBuffer.schedule(nowNs);
+    unit.format = mFormat;
+    mCounters->unitsReceived++;
+    mCounters->jitterDelayNs = mJitterBuffer.delayNs();
+    mCounters->frameIntervalNs = mJitterBuffer.intervalNs();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (unit.format == nullptr || (mWaitForKeyframe && !(unit.flags & kSampleFlagSync))) {
+        mCarryFormatChange |= (unit.flags & kSampleFlagFormatChange) != 0;
+        mCounters->unitsDiscarded++;
+        return;
+    }
+    mWaitForKeyframe = false;
+    if (mCarryFormatChange) {
+        unit.flags |= kSampleFlagFormatChange;
+        mCarryFormatChange = false;
+    }
+    mUnits.push_back(std::move(unit));
+    mUnitQueued.notify_all();
+}
+
+bool CLiveSource::getTrackInfo(size_t track, MediaTrackInfo& info) {
+    if (track != 0 || mFrontFormat == nullptr) {
+        return false;
+    }
+    info = *mFrontFormat;
+    return true;
+}
+
+int32_t CLiveSource::getSampleTrackIndex() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (mUnits.size() > kMaxQueuedUnits) {
+        // The decoder fell behind: go on from the newest keyframe queued, or wait for the next one.
+        size_t keep = mUnits.size();
+        for (size_t i = mUnits.size(); i-- > 0;) {
+            if (mUnits[i].flags & kSampleFlagSync) {
+                keep = i;
+                break;
+            }
+        }
+        for (size_t i = 0; i < keep; i++) {
+            mCarryFormatChange |= (mUnits.front().flags & kSampleFlagFormatChange) != 0;
+            mUnits.pop_front();
+        }
+        mWaitForKeyframe = mUnits.empty();
+        if (!mUnits.empty() && mCarryFormatChange) {
+            mUnits.front().flags |= kSampleFlagFormatChange;
+            mCarryFormatChange = false;
+        }
+        mCounters->unitsDiscarded += keep;
+        Log::Write(Log::Level::Info, Fmt("live source %s: %d units behind, skipped to the newest keyframe", mSourceName.c_str(), (int32_t)keep));
+    }
+
+    int64_t nowNs = CMediaClock::monotonicNow();
+    const int64_t deadlineNs = nowNs + kPollWaitUs * 1000;
+    for (;;) {
+        if (!mUnits.empty() && mUnits.front().releaseNs <= nowNs) {
+            mFrontFormat = mUnits.front().format;
+            return 0;
+        }
+        if (mFailed && mUnits.empty()) {
+            return -1;
+        }
+        if (nowNs >= deadlineNs) {
+            return kSampleNotReady;
+        }
+        const int64_t wakeNs = mUnits.empty() ? deadlineNs : std::min(deadlineNs, mUnits.front().releaseNs);
+        mUnitQueued.wait_for(lock, std::chrono::nanoseconds(wakeNs - nowNs));
+        nowNs = CMediaClock::monotonicNow();
+    }
+}
+
+int64_t CLiveSource::getSampleTime() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mUnits.empty() ? -1 : mUnits.front().arrivalNs / 1000;
+}
+
+uint32_t CLiveSource::getSampleFlags() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mUnits.empty() ? 0 : mUnits.front().flags;
+}
+
+ssize_t CLiveSource::readSampleData(uint8_t* buffer, size_t capacity) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mUnits.empty()) {
+        return -1;
+    }
+    const std::vector<uint8_t>& data = mUnits.front().data;
+    if (data.size() > capacity) {
+        Log::Write(Log::Level::Error, Fmt("live source %s: %d byte unit exceeds the %d byte buffer", mSourceName.c_str(), (int32_t)data.size(), (int32_t)capacity));
+        return -1;
+    }
+    memcpy(buffer, data.data(), data.size());
+    return (ssize_t)data.size();
+}
+
+bool CLiveSource::advance() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mUnits.empty()) {
+        mUnits.pop_front();
+    }
+    return !mFailed || !mUnits.empty();
+}
@@ -0,0 +1,131 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Live Annex-B H.264 / HEVC ingest from a UDP socket or a FIFO.
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mediabackend.h"
+#include "annexb.h"
+#include "jitterbuffer.h"
+
+// Shared with the player for its stats.
+typedef struct LiveIngestCounters_tag {
+    std::atomic<uint64_t> bytesReceived{0};
+    std::atomic<uint64_t> unitsReceived{0};
+    std::atomic<uint64_t> unitsDiscarded{0};   // before the first keyframe, or cut from a backlog
+    std::atomic<int64_t>  jitterDelayNs{0};    // current jitter buffer delay target
+    std::atomic<int64_t>  frameIntervalNs{0};  // measured between arrivals
+}LiveIngestCounters;
+
+// True for "udp://[address]:port", "pipe:path" and paths naming a FIFO.
+bool IsLiveSourcePath(const char* path);
+
+// Mime of a LiveCodec option value ("H264" or "HEVC"). Throws std::invalid_argument for other names.
+std::string GetLiveCodecMime(const std::string& name);
+
+// One video track. A receive thread reads the byte stream (UDP datagrams are concatenated, so
+// senders may split units anywhere), cuts it into access units at picture boundaries and stamps
+// each with its arrival time, which is also its sample time: live samples carry no timestamps of
+// their own. A unit is complete when the next one starts, or once the input has been quiet for
+// kIdleFlushUs, since live senders write whole pictures.
+//
+// Units are released through CJitterBuffer. open() waits for the parameter sets and a keyframe;
+// until the next keyframe after it, and whenever more than kMaxQueuedUnits back up behind a slow
+// decoder, units are discarded so playback resumes from the newest decodable picture.
+class CLiveSource : public IMediaSource {
+
+public:
+    CLiveSource(std::string mime, int64_t maxJitterDelayNs, std::shared_ptr<LiveIngestCounters> counters);
+
+    ~CLiveSource() override;
+
+    bool open(const char* source) override;
+
+    size_t getTrackCount() override { return 1; }
+
+    bool getTrackInfo(size_t track, MediaTrackInfo& info) override;
+
+    bool selectTrack(size_t track) override { return track == 0; }
+
+    // kSampleNotReady when no unit is due within kPollWaitUs; -1 only when the input failed.
+    int32_t getSampleTrackIndex() override;
+
+    // Arrival time of the unit, CLOCK_MONOTONIC microseconds.
+    int64_t getSampleTime() override;
+
+    uint32_t getSampleFlags() override;
+
+    ssize_t readSampleData(uint8_t* buffer, size_t capacity) override;
+
+    bool advance() override;
+
+    bool seekTo(int64_t timeUs) override { return false; }
+
+    static constexpr int64_t  kOpenTimeoutUs = 10 * 1000 * 1000;
+    static constexpr int64_t  kPollWaitUs = 10000;
+    static constexpr int64_t  kIdleFlushUs = 2000;
+    static constexpr size_t   kMaxQueuedUnits = 30;
+    static constexpr size_t   kReadSize = 64 * 1024;
+    static constexpr int32_t  kSocketBufferSize = 4 * 1024 * 1024;
+
+private:
+    struct AccessUnit {
+        std::vector<uint8_t> data;   // Annex-B, four-byte start codes
+        int64_t  arrivalNs{0};
+        int64_t  releaseNs{0};
+        uint32_t flags{0};
+        std::shared_ptr<const MediaTrackInfo> format;
+    };
+
+    bool openInput(const char* source);
+
+    void receiveLoop();
+
+    // Appends received bytes and hands every NAL unit that is now complete to onNalUnit().
+    void onBytes(const uint8_t* data, size_t size, int64_t nowNs);
+
+    // The input went quiet: the NAL unit still pending is complete, and so is the picture.
+    void onIdle(int64_t nowNs);
+
+    void onNalUnit(const uint8_t* nal, size_t size, int64_t nowNs);
+
+    // Queues the unit being assembled once it holds a picture.
+    void finishUnit(int64_t nowNs);
+
+    void updateFormat();
+
+    std::string                         mMime;
+    bool                                mHevc;
+    std::shared_ptr<LiveIngestCounters> mCounters;
+    std::string                         mSourceName;
+    int32_t                             mFd{-1};
+    std::thread                         mReceiveThread;
+    std::atomic<bool>                   mStopping{false};
+
+    // Receive thread only.
+    std::vector<uint8_t>                mPending;        // from the start code of the NAL unit still arriving
+    AccessUnit                          mAssembling;
+    bool                                mAssemblingPicture{false};
+    std::vector<uint8_t>                mVps;
+    std::vector<uint8_t>                mSps;
+    std::vector<uint8_t>                mPps;
+    bool                                mParameterSetsChanged{false};
+    std::shared_ptr<const MediaTrackInfo> mFormat;       // as of the last unit assembled
+    CJitterBuffer                       mJitterBuffer;
+
+    std::mutex                          mMutex;
+    std::condition_variable             mUnitQueued;
+    std::deque<AccessUnit>              mUnits;
+    bool                                mWaitForKeyframe{true};
+    bool                                mCarryFormatChange{false};  // a discarded unit changed the format
+    bool                                mFailed{false};
+
+    // Demux side only.
+    std::shared_ptr<const MediaTrackInfo> mFrontFormat;  // format of the unit at the front
+};
@@ -0,0 +1,45 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Decoded pictures of one pass through a short clip, replayed instead of decoding it again.
+
+#include "pch.h"
+#include "common.h"
+#include "loopframecache.h"
+#include <algorithm>
+
+bool CLoopFrameCache::append(const uint8_t* data, uint32_t size, int32_t width, int32_t height, int32_t stride, int32_t sliceHeight, bool planarChroma,
+                             int64_t pts) {
+    if (mOverflowed) {
+        return false;
+    }
+    if (mBytes + size > mBudgetBytes) {
+        clear();
+        mOverflowed = true;
+        return false;
+    }
+    CachedFrame frame;
+    frame.pts = pts;
+    frame.width = width;
+    frame.height = height;
+    frame.stride = stride;
+    frame.sliceHeight = sliceHeight;
+    frame.planarChroma = planarChroma;
+    frame.size = size;
+    frame.data.reset(new uint8_t[size]);
+    memcpy(frame.data.get(), data, size);
+    mFrames.push_back(std::move(frame));
+    mBytes += size;
+    return true;
+}
+
+void CLoopFrameCache::clear() {
+    mFrames.clear();
+    mFrames.shrink_to_fit();
+    mBytes = 0;
+    mOverflowed = false;
+}
+
+size_t CLoopFrameCache::findAtOrAfter(int64_t pts) const {
+    auto it = std::lower_bound(mFrames.begin(), mFrames.end(), pts, [](const CachedFrame& frame, int64_t value) { return frame.pts < value; });
+    return (size_t)(it - mFrames.begin());
+}
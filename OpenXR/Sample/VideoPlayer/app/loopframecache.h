@@ -0,0 +1,55 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Decoded pictures of one pass through a short clip, replayed instead of decoding it again.
+
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+typedef struct CachedFrame_tag {
+    CachedFrame_tag() : pts(0), width(0), height(0), stride(0), sliceHeight(0), planarChroma(false), size(0) {};
+    int64_t pts;        // file time, nanoseconds
+    int32_t width;
+    int32_t height;
+    int32_t stride;     // as MediaFrame::stride and sliceHeight: the buffer is copied as the decoder laid it out
+    int32_t sliceHeight;
+    bool planarChroma;  // as MediaFrame::planarChroma
+    uint32_t size;
+    std::unique_ptr<uint8_t[]> data;
+}CachedFrame;
+
+// Holds copies of the decoder's NV12 output, in presentation order, within a byte budget. Only the
+// video decode thread appends; frames handed out stay valid until clear().
+class CLoopFrameCache {
+
+public:
+    void setBudget(uint64_t budgetBytes) { mBudgetBytes = budgetBytes; }
+
+    uint64_t budget() const { return mBudgetBytes; }
+
+    // Copies a picture. Once the budget would be exceeded the cache is emptied, marked
+    // overflowed and false is returned; later appends are ignored until clear().
+    bool append(const uint8_t* data, uint32_t size, int32_t width, int32_t height, int32_t stride, int32_t sliceHeight, bool planarChroma, int64_t pts);
+
+    void clear();
+
+    bool overflowed() const { return mOverflowed; }
+
+    bool empty() const { return mFrames.empty(); }
+
+    size_t size() const { return mFrames.size(); }
+
+    uint64_t bytes() const { return mBytes; }
+
+    const CachedFrame& frame(size_t index) const { return mFrames[index]; }
+
+    // First frame at or after pts, or size() if there is none.
+    size_t findAtOrAfter(int64_t pts) const;
+
+private:
+    std::vector<CachedFrame> mFrames;
+    uint64_t mBudgetBytes = 0;
+    uint64_t mBytes = 0;
+    bool     mOverflowed = false;
+};
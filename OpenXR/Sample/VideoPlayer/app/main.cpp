@@ -9,12 +9,17 @@
 #include "platformplugin.h"
 #include "graphicsplugin.h"
 #include "openxr_program.h"
+#include "medialibrary.h"
 
 void ShowHelp() {
     Log::Write(Log::Level::Info, "adb shell setprop debug.xr.graphicsPlugin OpenGLES|Vulkan");
     Log::Write(Log::Level::Info, "adb shell setprop debug.xr.formFactor Hmd|Handheld");
     Log::Write(Log::Level::Info, "adb shell setprop debug.xr.viewConfiguration Stereo|Mono");
     Log::Write(Log::Level::Info, "adb shell setprop debug.xr.blendMode Opaque|Additive|AlphaBlend");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.videoFile <file or library directory>");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.libraryItem <n>");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.playlist <m3u file or library directory>");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.loopCacheMB <n>");
 }
 
 bool UpdateOptionsFromSystemProperties(Options& options) {
@@ -22,6 +27,18 @@ bool UpdateOptionsFromSystemProperties(Options& options) {
     if (__system_property_get("debug.xr.graphicsPlugin", value) != 0) {
         options.GraphicsPlugin = value;
     }
+    if (__system_property_get("debug.xr.videoFile", value) != 0) {
+        options.VideoFileName = value;
+    }
+    if (__system_property_get("debug.xr.libraryItem", value) != 0) {
+        options.LibraryItem = (uint32_t)strtoul(value, nullptr, 10);
+    }
+    if (__system_property_get("debug.xr.playlist", value) != 0) {
+        options.Playlist = value;
+    }
+    if (__system_property_get("debug.xr.loopCacheMB", value) != 0) {
+        options.LoopCacheMB = (uint32_t)strtoul(value, nullptr, 10);
+    }
     // Check for required parameters.
     if (options.GraphicsPlugin.empty()) {
         Log::Write(Log::Level::Warning, "GraphicsPlugin Default OpenGLES");
@@ -106,6 +123,10 @@ void android_main(struct android_app* app) {
         if (!UpdateOptionsFromSystemProperties(*options)) {
             return;
         }
+        // Before the plugins are created: the library entry can decide the video mode.
+        if (!SelectLibraryItem(*options)) {
+            return;
+        }
 
         std::shared_ptr<PlatformData> data = std::make_shared<PlatformData>();
         data->applicationVM = app->activity->vm;
@@ -0,0 +1,494 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// DASH (.mpd) and HLS (.m3u8) manifests reduced to a list of fragmented-MP4 renditions.
+
+#include "pch.h"
+#include "common.h"
+#include "manifest.h"
+#include <algorithm>
+#include <array>
+#include <map>
+
+namespace {
+
+bool EndsWith(const std::string& value, const char* suffix) {
+    const size_t length = strlen(suffix);
+    return value.size() >= length && strcasecmp(value.c_str() + value.size() - length, suffix) == 0;
+}
+
+std::string StripQuery(const std::string& url) {
+    return url.substr(0, url.find_first_of("?#"));
+}
+
+std::vector<std::string> SplitLines(const std::vector<uint8_t>& data) {
+    std::vector<std::string> lines;
+    std::string line;
+    for (uint8_t c : data) {
+        if (c == '\n') {
+            lines.push_back(line);
+            line.clear();
+        } else if (c != '\r') {
+            line.push_back((char)c);
+        }
+    }
+    if (!line.empty()) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+bool StartsWith(const std::string& value, const char* prefix) {
+    return value.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// HLS attribute list: NAME=value pairs separated by commas, values optionally quoted.
+std::string HlsAttribute(const std::string& list, const char* name) {
+    const size_t nameLength = strlen(name);
+    size_t pos = 0;
+    while (pos < list.size()) {
+        const size_t equals = list.find('=', pos);
+        if (equals == std::string::npos) {
+            break;
+        }
+        size_t end = equals + 1;
+        std::string value;
+        if (end < list.size() && list[end] == '"') {
+            const size_t quote = list.find('"', end + 1);
+            value = list.substr(end + 1, quote == std::string::npos ? std::string::npos : quote - end - 1);
+            end = quote == std::string::npos ? list.size() : quote + 1;
+        } else {
+            end = std::min(list.find(',', end), list.size());
+            value = list.substr(equals + 1, end - equals - 1);
+        }
+        if (equals - pos == nameLength && list.compare(pos, nameLength, name) == 0) {
+            return value;
+        }
+        pos = list.find(',', end);
+        pos = pos == std::string::npos ? list.size() : pos + 1;
+    }
+    return std::string();
+}
+
+bool ParseHlsMediaPlaylist(const std::string& url, const std::vector<uint8_t>& data, Rendition& rendition) {
+    int64_t startUs = 0;
+    int64_t nextDurationUs = -1;
+    for (const std::string& line : SplitLines(data)) {
+        if (StartsWith(line, "#EXTINF:")) {
+            nextDurationUs = (int64_t)(atof(line.c_str() + 8) * 1000000);
+        } else if (StartsWith(line, "#EXT-X-MAP:")) {
+            rendition.initUrl = ResolveMediaUrl(url, HlsAttribute(line.substr(11), "URI"));
+            if (!HlsAttribute(line.substr(11), "BYTERANGE").empty()) {
+                Log::Write(Log::Level::Error, Fmt("hls: %s uses byte ranges, not supported", url.c_str()));
+                return false;
+            }
+        } else if (StartsWith(line, "#EXT-X-BYTERANGE")) {
+            Log::Write(Log::Level::Error, Fmt("hls: %s uses byte ranges, not supported", url.c_str()));
+            return false;
+        } else if (StartsWith(line, "#EXT-X-KEY") && line.find("METHOD=NONE") == std::string::npos) {
+            Log::Write(Log::Level::Error, Fmt("hls: %s is encrypted, not supported", url.c_str()));
+            return false;
+        } else if (!line.empty() && line[0] != '#' && nextDurationUs >= 0) {
+            rendition.segments.push_back(MediaSegment{ResolveMediaUrl(url, line), startUs, nextDurationUs});
+            startUs += nextDurationUs;
+            nextDurationUs = -1;
+        }
+    }
+    if (rendition.initUrl.empty() && !rendition.segments.empty()) {
+        Log::Write(Log::Level::Error, Fmt("hls: %s has no EXT-X-MAP; only fragmented MP4 segments are supported", url.c_str()));
+        return false;
+    }
+    return !rendition.segments.empty();
+}
+
+bool ParseHls(const std::string& url, const std::vector<uint8_t>& data, std::shared_ptr<MediaIoCounters> counters, AdaptiveManifest& manifest) {
+    const std::vector<std::string> lines = SplitLines(data);
+    bool master = false;
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (!StartsWith(lines[i], "#EXT-X-STREAM-INF:")) {
+            continue;
+        }
+        master = true;
+        const std::string attributes = lines[i].substr(18);
+        size_t uriLine = i + 1;
+        while (uriLine < lines.size() && (lines[uriLine].empty() || lines[uriLine][0] == '#')) {
+            uriLine++;
+        }
+        if (uriLine >= lines.size()) {
+            break;
+        }
+        if (!HlsAttribute(attributes, "AUDIO").empty()) {
+            Log::Write(Log::Level::Warning, Fmt("hls: separate audio renditions in %s are ignored", url.c_str()));
+        }
+        Rendition rendition;
+        rendition.bandwidth = atoll(HlsAttribute(attributes, "BANDWIDTH").c_str());
+        sscanf(HlsAttribute(attributes, "RESOLUTION").c_str(), "%dx%d", &rendition.width, &rendition.height);
+        const std::string playlistUrl = ResolveMediaUrl(url, lines[uriLine]);
+        std::vector<uint8_t> playlist;
+        if (!ReadMediaFile(playlistUrl.c_str(), counters, playlist) || !ParseHlsMediaPlaylist(playlistUrl, playlist, rendition)) {
+            Log::Write(Log::Level::Warning, Fmt("hls: skipping rendition %s", playlistUrl.c_str()));
+            continue;
+        }
+        manifest.renditions.push_back(std::move(rendition));
+    }
+    if (!master) {
+        Rendition rendition;
+        if (ParseHlsMediaPlaylist(url, data, rendition)) {
+            manifest.renditions.push_back(std::move(rendition));
+        }
+    }
+    return !manifest.renditions.empty();
+}
+
+// ISO 8601 duration as used by MPD attributes, e.g. "PT1M30.5S".
+int64_t ParseIsoDurationUs(const std::string& value) {
+    double seconds = 0;
+    bool time = false;
+    const char* p = value.c_str();
+    if (*p++ != 'P') {
+        return 0;
+    }
+    while (*p) {
+        if (*p == 'T') {
+            time = true;
+            p++;
+            continue;
+        }
+        char* end = nullptr;
+        const double number = strtod(p, &end);
+        if (end == p || *end == 0) {
+            break;
+        }
+        switch (*end) {
+            case 'Y': seconds += number * 365 * 86400; break;
+            case 'M': seconds += time ? number * 60 : number * 30 * 86400; break;
+            case 'W': seconds += number * 7 * 86400; break;
+            case 'D': seconds += number * 86400; break;
+            case 'H': seconds += number * 3600; break;
+            case 'S': seconds += number; break;
+            default: break;
+        }
+        p = end + 1;
+    }
+    return (int64_t)(seconds * 1000000);
+}
+
+// One XML start or end tag. The MPD is read as a flat sequence of these; no DOM is built.
+struct XmlTag {
+    std::string name;
+    std::map<std::string, std::string> attributes;
+    bool closing{false};      // </name>
+    bool selfClosing{false};  // <name ... />
+
+    std::string get(const char* attribute) const {
+        auto it = attributes.find(attribute);
+        return it == attributes.end() ? std::string() : it->second;
+    }
+};
+
+bool NextXmlTag(const std::string& text, size_t& pos, XmlTag& tag) {
+    while ((pos = text.find('<', pos)) != std::string::npos) {
+        if (text.compare(pos, 4, "<!--") == 0) {
+            pos = text.find("-->", pos);
+            continue;
+        }
+        if (text[pos + 1] == '?' || text[pos + 1] == '!') {
+            pos = text.find('>', pos);
+            continue;
+        }
+        break;
+    }
+    if (pos == std::string::npos) {
+        return false;
+    }
+    const size_t end = text.find('>', pos);
+    if (end == std::string::npos) {
+        return false;
+    }
+    std::string body = text.substr(pos + 1, end - pos - 1);
+    pos = end + 1;
+    tag = XmlTag();
+    tag.closing = !body.empty() && body[0] == '/';
+    tag.selfClosing = !body.empty() && body.back() == '/';
+    if (tag.closing) {
+        body.erase(0, 1);
+    }
+    if (tag.selfClosing) {
+        body.pop_back();
+    }
+    size_t cursor = body.find_first_of(" \t\r\n");
+    tag.name = body.substr(0, cursor);
+    const size_t colon = tag.name.find(':');
+    if (colon != std::string::npos) {
+        tag.name.erase(0, colon + 1);  // namespace prefix
+    }
+    while (cursor != std::string::npos && cursor < body.size()) {
+        const size_t equals = body.find('=', cursor);
+        if (equals == std::string::npos) {
+            break;
+        }
+        const size_t nameStart = body.find_first_not_of(" \t\r\n", cursor);
+        const size_t quote = body.find_first_of("\"'", equals);
+        if (quote == std::string::npos) {
+            break;
+        }
+        const size_t closeQuote = body.find(body[quote], quote + 1);
+        if (closeQuote == std::string::npos) {
+            break;
+        }
+        std::string name = body.substr(nameStart, equals - nameStart);
+        name.erase(name.find_last_not_of(" \t\r\n") + 1);
+        tag.attributes[name] = body.substr(quote + 1, closeQuote - quote - 1);
+        cursor = closeQuote + 1;
+    }
+    return true;
+}
+
+typedef struct SegmentTemplate_tag {
+    std::string initialization;
+    std::string media;
+    int64_t startNumber{1};
+    int64_t timescale{1};
+    int64_t duration{0};
+    std::vector<std::array<int64_t, 3>> timeline;  // S elements: t (-1 if absent), d, r
+    bool present{false};
+}SegmentTemplate;
+
+void ReadSegmentTemplate(const XmlTag& tag, SegmentTemplate& segmentTemplate) {
+    // Attributes not given keep what the enclosing level set.
+    segmentTemplate.present = true;
+    if (!tag.get("initialization").empty()) {
+        segmentTemplate.initialization = tag.get("initialization");
+    }
+    if (!tag.get("media").empty()) {
+        segmentTemplate.media = tag.get("media");
+    }
+    if (!tag.get("startNumber").empty()) {
+        segmentTemplate.startNumber = atoll(tag.get("startNumber").c_str());
+    }
+    if (!tag.get("timescale").empty()) {
+        segmentTemplate.timescale = std::max<int64_t>(1, atoll(tag.get("timescale").c_str()));
+    }
+    if (!tag.get("duration").empty()) {
+        segmentTemplate.duration = atoll(tag.get("duration").c_str());
+    }
+}
+
+// Expands $RepresentationID$, $Number$, $Time$ and $Bandwidth$, with optional %0Nd widths.
+std::string ExpandTemplate(const std::string& pattern, const std::string& id, int64_t number, int64_t time, int64_t bandwidth) {
+    std::string out;
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        const size_t start = pattern.find('$', pos);
+        const size_t end = start == std::string::npos ? std::string::npos : pattern.find('$', start + 1);
+        if (end == std::string::npos) {
+            out += pattern.substr(pos);
+            break;
+        }
+        out += pattern.substr(pos, start - pos);
+        const std::string identifier = pattern.substr(start + 1, end - start - 1);
+        const size_t percent = identifier.find('%');
+        const std::string name = identifier.substr(0, percent);
+        std::string format = percent == std::string::npos ? "%d" : identifier.substr(percent);
+        if (!format.empty() && format.back() == 'd') {
+            format = format.substr(0, format.size() - 1) + "lld";
+        }
+        if (identifier.empty()) {
+            out += '$';
+        } else if (name == "RepresentationID") {
+            out += id;
+        } else if (name == "Number" || name == "Time" || name == "Bandwidth") {
+            const long long value = name == "Number" ? number : (name == "Time" ? time : bandwidth);
+            char formatted[32];
+            snprintf(formatted, sizeof(formatted), format.c_str(), value);
+            out += formatted;
+        }
+        pos = end + 1;
+    }
+    return out;
+}
+
+bool BuildDashRendition(const std::string& url, const SegmentTemplate& segmentTemplate, const std::string& id, int64_t durationUs,
+                        Rendition& rendition) {
+    if (!segmentTemplate.present || segmentTemplate.media.empty() || segmentTemplate.initialization.empty()) {
+        Log::Write(Log::Level::Warning, Fmt("dash: representation %s has no SegmentTemplate, skipped", id.c_str()));
+        return false;
+    }
+    rendition.initUrl = ResolveMediaUrl(url, ExpandTemplate(segmentTemplate.initialization, id, 0, 0, rendition.bandwidth));
+    const int64_t timescale = segmentTemplate.timescale;
+    int64_t number = segmentTemplate.startNumber;
+    if (!segmentTemplate.timeline.empty()) {
+        int64_t time = 0;
+        for (size_t i = 0; i < segmentTemplate.timeline.size(); i++) {
+            const std::array<int64_t, 3>& s = segmentTemplate.timeline[i];
+            if (s[0] >= 0) {
+                time = s[0];
+            }
+            if (s[1] <= 0) {
+                continue;
+            }
+            // A negative repeat count runs to the next S element, or to the end of the period.
+            int64_t repeat = s[2];
+            if (repeat < 0) {
+                const int64_t endTime = (i + 1 < segmentTemplate.timeline.size() && segmentTemplate.timeline[i + 1][0] >= 0)
+                                            ? segmentTemplate.timeline[i + 1][0]
+                                            : durationUs * timescale / 1000000;
+                repeat = (endTime - time + s[1] - 1) / s[1] - 1;
+            }
+            for (int64_t r = 0; r <= repeat; r++) {
+                const std::string media = ExpandTemplate(segmentTemplate.media, id, number++, time, rendition.bandwidth);
+                rendition.segments.push_back(MediaSegment{ResolveMediaUrl(url, media), time * 1000000 / timescale, s[1] * 1000000 / timescale});
+                time += s[1];
+            }
+        }
+    } else if (segmentTemplate.duration > 0 && durationUs > 0) {
+        const int64_t segmentUs = segmentTemplate.duration * 1000000 / timescale;
+        for (int64_t startUs = 0; startUs < durationUs; startUs += segmentUs) {
+            const std::string media = ExpandTemplate(segmentTemplate.media, id, number++, startUs * timescale / 1000000, rendition.bandwidth);
+            rendition.segments.push_back(MediaSegment{ResolveMediaUrl(url, media), startUs, std::min(segmentUs, durationUs - startUs)});
+        }
+    }
+    return !rendition.segments.empty();
+}
+
+bool ParseDash(const std::string& url, const std::vector<uint8_t>& data, AdaptiveManifest& manifest) {
+    const std::string text(data.begin(), data.end());
+    size_t pos = 0;
+    XmlTag tag;
+    bool periodSeen = false;
+    bool inPeriod = false;
+    bool skipSet = false;          // audio / text adaptation set
+    SegmentTemplate setTemplate;   // AdaptationSet level
+    SegmentTemplate repTemplate;   // Representation level, starts as a copy of the set's
+    SegmentTemplate* current = nullptr;
+    Rendition rendition;
+    std::string id;
+    bool inRepresentation = false;
+
+    auto finishRepresentation = [&]() {
+        if (BuildDashRendition(url, repTemplate, id, manifest.durationUs, rendition)) {
+            manifest.renditions.push_back(std::move(rendition));
+        }
+        rendition = Rendition();
+        inRepresentation = false;
+    };
+    auto isSkippedType = [](const XmlTag& t) {
+        const std::string type = t.get("contentType").empty() ? t.get("mimeType") : t.get("contentType");
+        return StartsWith(type, "audio") || StartsWith(type, "text") || StartsWith(type, "application");
+    };
+
+    while (NextXmlTag(text, pos, tag)) {
+        if (tag.name == "MPD" && !tag.closing) {
+            manifest.durationUs = ParseIsoDurationUs(tag.get("mediaPresentationDuration"));
+            if (tag.get("type") == "dynamic") {
+                Log::Write(Log::Level::Warning, Fmt("dash: %s is live, playing the segments it lists", url.c_str()));
+            }
+        } else if (tag.name == "Period") {
+            if (!tag.closing && periodSeen) {
+                Log::Write(Log::Level::Warning, "dash: only the first period is played");
+                break;
+            }
+            periodSeen = true;
+            inPeriod = !tag.closing;
+            if (!tag.closing && manifest.durationUs == 0) {
+                manifest.durationUs = ParseIsoDurationUs(tag.get("duration"));
+            }
+        } else if (!inPeriod) {
+            continue;
+        } else if (tag.name == "AdaptationSet") {
+            setTemplate = SegmentTemplate();
+            skipSet = !tag.closing && isSkippedType(tag);
+            if (skipSet) {
+                Log::Write(Log::Level::Warning, Fmt("dash: separate %s adaptation set ignored", tag.get("contentType").empty() ? tag.get("mimeType").c_str() : tag.get("contentType").c_str()));
+            }
+            current = tag.closing ? nullptr : &setTemplate;
+        } else if (skipSet) {
+            continue;
+        } else if (tag.name == "Representation" && tag.closing) {
+            if (inRepresentation) {
+                finishRepresentation();
+            }
+            current = &setTemplate;
+        } else if (tag.name == "Representation") {
+            if (isSkippedType(tag)) {
+                continue;
+            }
+            id = tag.get("id");
+            rendition.bandwidth = atoll(tag.get("bandwidth").c_str());
+            rendition.width = atoi(tag.get("width").c_str());
+            rendition.height = atoi(tag.get("height").c_str());
+            repTemplate = setTemplate;
+            inRepresentation = true;
+            current = &repTemplate;
+            if (tag.selfClosing) {
+                finishRepresentation();
+                current = &setTemplate;
+            }
+        } else if (tag.name == "SegmentTemplate" && !tag.closing && current) {
+            ReadSegmentTemplate(tag, *current);
+            current->timeline.clear();
+        } else if (tag.name == "S" && !tag.closing && current) {
+            current->timeline.push_back({tag.get("t").empty() ? -1 : atoll(tag.get("t").c_str()), atoll(tag.get("d").c_str()),
+                                         atoll(tag.get("r").c_str())});
+        } else if (tag.name == "SegmentList" || tag.name == "SegmentBase") {
+            Log::Write(Log::Level::Warning, Fmt("dash: %s addressing is not supported", tag.name.c_str()));
+        }
+    }
+    return !manifest.renditions.empty();
+}
+}  // namespace
+
+bool IsAdaptiveManifestPath(const char* path) {
+    const std::string file = StripQuery(path);
+    return EndsWith(file, ".mpd") || EndsWith(file, ".m3u8");
+}
+
+std::string ResolveMediaUrl(const std::string& base, const std::string& reference) {
+    if (reference.find("://") != std::string::npos) {
+        return reference;
+    }
+    const std::string baseFile = StripQuery(base);
+    if (!reference.empty() && reference[0] == '/') {
+        // Absolute path: keep the scheme and authority of the base, if it has them.
+        const size_t scheme = baseFile.find("://");
+        const size_t pathStart = scheme == std::string::npos ? 0 : baseFile.find('/', scheme + 3);
+        return pathStart == std::string::npos ? baseFile + reference : baseFile.substr(0, pathStart) + reference;
+    }
+    const size_t slash = baseFile.rfind('/');
+    return slash == std::string::npos ? reference : baseFile.substr(0, slash + 1) + reference;
+}
+
+bool LoadAdaptiveManifest(const char* url, std::shared_ptr<MediaIoCounters> counters, AdaptiveManifest& manifest) {
+    manifest = AdaptiveManifest();
+    std::vector<uint8_t> data;
+    if (!ReadMediaFile(url, counters, data)) {
+        Log::Write(Log::Level::Error, Fmt("manifest %s can't be read", url));
+        return false;
+    }
+    const bool dash = EndsWith(StripQuery(url), ".mpd");
+    if (!(dash ? ParseDash(url, data, manifest) : ParseHls(url, data, counters, manifest))) {
+        Log::Write(Log::Level::Error, Fmt("manifest %s has no playable rendition", url));
+        return false;
+    }
+
+    // Switching at segment boundaries needs one timeline: keep the renditions that match the lowest one.
+    std::stable_sort(manifest.renditions.begin(), manifest.renditions.end(),
+                     [](const Rendition& a, const Rendition& b) { return a.bandwidth < b.bandwidth; });
+    const size_t segmentCount = manifest.renditions[0].segments.size();
+    for (size_t i = manifest.renditions.size(); i-- > 1;) {
+        if (manifest.renditions[i].segments.size() != segmentCount) {
+            Log::Write(Log::Level::Warning, Fmt("manifest %s: rendition of %lld bps has %d segments instead of %d, skipped", url,
+                                                (long long)manifest.renditions[i].bandwidth, (int32_t)manifest.renditions[i].segments.size(),
+                                                (int32_t)segmentCount));
+            manifest.renditions.erase(manifest.renditions.begin() + i);
+        }
+    }
+    const MediaSegment& last = manifest.renditions[0].segments.back();
+    if (manifest.durationUs <= 0) {
+        manifest.durationUs = last.startUs + last.durationUs;
+    }
+    for (const Rendition& rendition : manifest.renditions) {
+        Log::Write(Log::Level::Info, Fmt("manifest %s: rendition %dx%d @ %lld bps, %d segments", url, rendition.width, rendition.height,
+                                         (long long)rendition.bandwidth, (int32_t)rendition.segments.size()));
+    }
+    return true;
+}
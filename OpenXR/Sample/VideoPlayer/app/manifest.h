@@ -0,0 +1,44 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// DASH (.mpd) and HLS (.m3u8) manifests reduced to a list of fragmented-MP4 renditions.
+
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mediafile.h"
+
+typedef struct MediaSegment_tag {
+    std::string url;
+    int64_t startUs;
+    int64_t durationUs;
+}MediaSegment;
+
+typedef struct Rendition_tag {
+    Rendition_tag() : bandwidth(0), width(0), height(0) {};
+    int64_t bandwidth;      // advertised bits per second
+    int32_t width;          // 0 when the manifest doesn't say
+    int32_t height;
+    std::string initUrl;    // fMP4 init segment (moov), prepended to every media segment
+    std::vector<MediaSegment> segments;
+}Rendition;
+
+// Renditions are sorted by ascending bandwidth and share one segment timeline, so segment i of
+// any rendition covers the same media time and a switch can happen at every segment boundary.
+typedef struct AdaptiveManifest_tag {
+    AdaptiveManifest_tag() : durationUs(0) {};
+    std::vector<Rendition> renditions;
+    int64_t durationUs;
+}AdaptiveManifest;
+
+// True for a .mpd or .m3u8 path or URL (a query string is ignored).
+bool IsAdaptiveManifestPath(const char* path);
+
+// Fetches and parses the manifest, and for HLS every media playlist it lists. VOD only: a live
+// playlist is played as far as it goes. Only renditions with audio and video muxed together are
+// played; separate audio renditions (EXT-X-MEDIA, audio adaptation sets) are ignored.
+bool LoadAdaptiveManifest(const char* url, std::shared_ptr<MediaIoCounters> counters, AdaptiveManifest& manifest);
+
+// Resolves a URL reference found in a manifest against the manifest's own URL (or path).
+std::string ResolveMediaUrl(const std::string& base, const std::string& reference);
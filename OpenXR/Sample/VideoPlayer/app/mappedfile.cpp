@@ -0,0 +1,130 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Read-only media file access through mmap with a read-ahead window that follows the reader.
+
+#include "pch.h"
+#include "common.h"
+#include "mappedfile.h"
+#include "mediaclock.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+CMappedFile::~CMappedFile() {
+    close();
+}
+
+bool CMappedFile::open(const char* path, int64_t readAhead, std::shared_ptr<MediaIoCounters> counters) {
+    close();
+    mCounters = counters ? std::move(counters) : std::make_shared<MediaIoCounters>();
+    mFd = ::open(path, O_RDONLY);
+    if (mFd < 0) {
+        Log::Write(Log::Level::Error, Fmt("open file %s error, ret=%d", path, mFd));
+        return false;
+    }
+    struct stat statbuff;
+    if (fstat(mFd, &statbuff) < 0) {
+        Log::Write(Log::Level::Error, Fmt("stat file %s error", path));
+        close();
+        return false;
+    }
+    mSize = statbuff.st_size;
+    mPageSize = sysconf(_SC_PAGESIZE);
+    mReadAhead = readAhead;
+    mWindowStart = -1;
+    if (mReadAhead > 0 && mSize > 0) {
+        void* data = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, mFd, 0);
+        if (data == MAP_FAILED) {
+            Log::Write(Log::Level::Warning, Fmt("mmap %s (%lld bytes) failed, errno %d, reading with pread", path, (long long)mSize, errno));
+        } else {
+            mData = (uint8_t*)data;
+            madvise(mData, mSize, MADV_SEQUENTIAL);
+        }
+    }
+    return true;
+}
+
+void CMappedFile::close() {
+    if (mData) {
+        munmap(mData, mSize);
+        mData = nullptr;
+    }
+    if (mFd >= 0) {
+        ::close(mFd);
+        mFd = -1;
+    }
+    mSize = 0;
+}
+
+ssize_t CMappedFile::readAt(int64_t offset, void* buffer, size_t size) {
+    if (offset < 0 || offset > mSize) {
+        return -1;
+    }
+    size = (size_t)std::min<int64_t>(size, mSize - offset);
+    if (size == 0) {
+        return 0;
+    }
+    if (mData) {
+        memcpy(buffer, map(offset, size), size);
+        return (ssize_t)size;
+    }
+    ssize_t got = pread(mFd, buffer, size, offset);
+    if (got < 0) {
+        return -1;
+    }
+    mCounters->bytesRead += got;
+    mCounters->reads++;
+    return got;
+}
+
+const uint8_t* CMappedFile::map(int64_t offset, size_t size) {
+    if (mData == nullptr || offset < 0 || offset + (int64_t)size > mSize) {
+        return nullptr;
+    }
+    advise(offset, size);
+    if (!isResident(offset, size)) {
+        // Take the page faults here rather than wherever the bytes are consumed.
+        const int64_t startNs = CMediaClock::monotonicNow();
+        volatile uint8_t sink = 0;
+        for (int64_t page = offset & ~(mPageSize - 1); page < offset + (int64_t)size; page += mPageSize) {
+            sink += mData[std::max(page, offset)];
+        }
+        (void)sink;
+        mCounters->stalls++;
+        mCounters->stallNs += CMediaClock::monotonicNow() - startNs;
+    }
+    mCounters->bytesRead += size;
+    mCounters->reads++;
+    return mData + offset;
+}
+
+void CMappedFile::advise(int64_t offset, size_t size) {
+    // Re-request once the reader is past the middle of the window or has jumped out of it (seek, index reads).
+    if (mWindowStart >= 0 && offset >= mWindowStart && offset + (int64_t)size <= mWindowStart + mReadAhead / 2) {
+        return;
+    }
+    const int64_t start = offset & ~(mPageSize - 1);
+    const int64_t length = std::min<int64_t>(std::max<int64_t>(mReadAhead, size), mSize - start);
+    madvise(mData + start, length, MADV_WILLNEED);
+    mWindowStart = start;
+}
+
+bool CMappedFile::isResident(int64_t offset, size_t size) const {
+    const int64_t first = offset & ~(mPageSize - 1);
+    const int64_t end = offset + (int64_t)size;
+    unsigned char pages[64];
+    for (int64_t chunk = first; chunk < end; chunk += (int64_t)sizeof(pages) * mPageSize) {
+        const int64_t length = std::min<int64_t>((int64_t)sizeof(pages) * mPageSize, end - chunk);
+        if (mincore(mData + chunk, length, pages) != 0) {
+            return true;  // can't tell; don't count a stall
+        }
+        const int64_t count = (length + mPageSize - 1) / mPageSize;
+        for (int64_t i = 0; i < count; i++) {
+            if ((pages[i] & 1) == 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Read-only media file access through mmap with a read-ahead window that follows the reader.
+
+#pragma once
+#include "mediafile.h"
+
+// With a read-ahead distance the whole file is mapped MADV_SEQUENTIAL and the next readAhead bytes
+// past the read position are kept requested with MADV_WILLNEED, re-issued each time the reader
+// crosses half of the window (or jumps outside it). With readAhead 0, or if mmap fails, reads
+// fall back to pread.
+class CMappedFile : public IMediaFile {
+
+public:
+    CMappedFile() = default;
+
+    ~CMappedFile() override;
+
+    CMappedFile(const CMappedFile&) = delete;
+    CMappedFile& operator=(const CMappedFile&) = delete;
+
+    bool open(const char* path, int64_t readAhead, std::shared_ptr<MediaIoCounters> counters);
+
+    void close();
+
+    int64_t size() const override { return mSize; }
+
+    bool isMapped() const { return mData != nullptr; }
+
+    ssize_t readAt(int64_t offset, void* buffer, size_t size) override;
+
+    // Zero-copy access for mapped files: faults the range in on the calling thread and returns a
+    // pointer into the mapping, valid until close(). nullptr when not mapped or out of range.
+    const uint8_t* map(int64_t offset, size_t size) override;
+
+private:
+    void advise(int64_t offset, size_t size);
+
+    bool isResident(int64_t offset, size_t size) const;
+
+    int              mFd = -1;
+    uint8_t*         mData = nullptr;
+    int64_t          mSize = 0;
+    int64_t          mReadAhead = 0;
+    int64_t          mWindowStart = -1;
+    int64_t          mPageSize = 4096;
+    std::shared_ptr<MediaIoCounters> mCounters;
+};
@@ -0,0 +1,207 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Interfaces that decouple CPlayer from the platform demuxer, decoders and audio output,
+// so the decode pipeline can run both on device (NDK) and on a Linux host.
+
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mediafile.h"
+#include "indexcache.h"
+
+typedef enum {
+    mediaTypeVideo = 0,
+    mediaTypeAudio
+}mediaType;
+
+// Uncompressed formats the host backend decodes: packed I420 frames and interleaved 16-bit PCM.
+// The codec config of a raw video track is its width and height, two little-endian int32.
+constexpr const char* kMimeRawVideo = "video/x-raw-i420";
+constexpr const char* kMimeRawAudio = "audio/raw";
+
+typedef struct MediaTrackInfo_tag {
+    MediaTrackInfo_tag() : type(mediaTypeVideo), width(0), height(0), durationUs(0), channelCount(0), sampleRate(0), maxInputSize(0), lowLatency(false) {};
+    mediaType type;
+    std::string mime;
+    int32_t width;
+    int32_t height;
+    int64_t durationUs;
+    int32_t channelCount;
+    int32_t sampleRate;
+    int32_t maxInputSize;   // 0 when the container doesn't say
+    std::vector<uint8_t> codecConfig;  // AVC/HEVC: Annex-B parameter sets; AAC: AudioSpecificConfig; empty if unknown
+    bool lowLatency;        // live track: decoders should output each frame as soon as it is decoded
+}MediaTrackInfo;
+
+// Demuxer. Delivers compressed samples of the selected tracks in file order.
+struct IMediaSource {
+    static constexpr uint32_t kSampleFlagSync = 1;
+    static constexpr uint32_t kSampleFlagFormatChange = 2;  // first sample in a new format; getTrackInfo() describes it
+    static constexpr int32_t  kSampleNotReady = -2;         // live sources: nothing due yet, ask again
+
+    virtual ~IMediaSource() = default;
+
+    virtual bool open(const char* source) = 0;
+
+    virtual size_t getTrackCount() = 0;
+
+    virtual bool getTrackInfo(size_t track, MediaTrackInfo& info) = 0;
+
+    virtual bool selectTrack(size_t track) = 0;
+
+    // Track of the current sample, -1 at the end of the stream, or kSampleNotReady.
+    virtual int32_t getSampleTrackIndex() = 0;
+
+    virtual int64_t getSampleTime() = 0;
+
+    // kSampleFlagSync for samples that decode without earlier ones.
+    virtual uint32_t getSampleFlags() = 0;
+
+    virtual ssize_t readSampleData(uint8_t* buffer, size_t capacity) = 0;
+
+    // The current sample in place, for sources that keep the file mapped. The pointer stays valid
+    // for the life of the source. nullptr when the sample has to be copied with readSampleData().
+    virtual const uint8_t* getSampleData(size_t& size) { return nullptr; }
+
+    virtual bool advance() = 0;
+
+    // Seeks to the closest sync sample.
+    virtual bool seekTo(int64_t timeUs) = 0;
+
+    // Presentation times of the track's sync samples, ascending, from the container's sample table
+    // and without reading any sample data. False when only a pass over every sample would tell.
+    virtual bool getSyncSampleTimes(size_t track, std::vector<int64_t>& timesUs) { return false; }
+
+    // The source that demuxes the current sample. Wrappers return the one they delegate to, so a
+    // backend can reach its own demuxer (and the formats it holds) behind them.
+    virtual IMediaSource* getDemuxer() { return this; }
+};
+
+typedef struct DecoderBufferInfo_tag {
+    int32_t offset;
+    int32_t size;
+    int64_t presentationTimeUs;
+    uint32_t flags;
+}DecoderBufferInfo;
+
+// Decoder with MediaCodec-style buffer ownership: callers dequeue an input slot, fill and
+// queue it, then dequeue output slots and hand them back with releaseOutputBuffer().
+// Output buffers stay valid until released, so frames can be rendered in place.
+struct IMediaDecoder {
+    static constexpr ssize_t  kTryAgainLater = -1;
+    static constexpr ssize_t  kOutputFormatChanged = -2;
+    static constexpr uint32_t kFlagCodecConfig = 2;     // input holds a track's codecConfig, applied to the samples after it
+    static constexpr uint32_t kFlagEndOfStream = 4;
+
+    virtual ~IMediaDecoder() = default;
+
+    virtual bool start() = 0;
+
+    virtual void stop() = 0;
+
+    virtual void flush() = 0;
+
+    virtual ssize_t dequeueInputBuffer(int64_t timeoutUs) = 0;
+
+    virtual uint8_t* getInputBuffer(size_t index, size_t* capacity) = 0;
+
+    virtual bool queueInputBuffer(size_t index, size_t size, int64_t ptsUs, uint32_t flags) = 0;
+
+    // Returns an output index, or a negative value (kTryAgainLater, format change...) when none is ready.
+    virtual ssize_t dequeueOutputBuffer(DecoderBufferInfo& info, int64_t timeoutUs) = 0;
+
+    virtual uint8_t* getOutputBuffer(size_t index) = 0;
+
+    virtual void releaseOutputBuffer(size_t index, bool render) = 0;
+
+    // Picture size of the frames now coming out, once the decoder knows it. It changes (after
+    // kOutputFormatChanged) when a codec config for another resolution was queued.
+    virtual bool getOutputSize(int32_t& width, int32_t& height) { return false; }
+
+    // True while frames come out as I420 (U plane, then V plane) rather than NV12. Changes with
+    // the output format, like getOutputSize().
+    virtual bool isOutputPlanar() { return false; }
+
+    // Bytes per luma row and luma rows before the chroma in the output buffers, when the decoder
+    // reports them; they can exceed the picture size. Changes with the output format.
+    virtual bool getOutputLayout(int32_t& stride, int32_t& sliceHeight) { return false; }
+};
+
+typedef struct AudioSinkStats_tag {
+    AudioSinkStats_tag() : underruns(0), ringFullWrites(0), outputLatencyNs(0), maxOutputLatencyNs(0), bufferedFrames(0), ambisonicOrder(0), spatialBlockNs(0),
+                           maxSpatialBlockNs(0), poseToAudioNs(0), maxPoseToAudioNs(0) {};
+    uint64_t underruns;         // times the device ran out of queued frames and played silence
+    uint64_t ringFullWrites;    // writes that found the queue full; back-pressure, the caller writes the rest later
+    int64_t outputLatencyNs;    // measured by the device: a frame leaving the queue to it being heard
+    int64_t maxOutputLatencyNs;
+    int32_t bufferedFrames;     // written but not yet taken by the device
+    int32_t ambisonicOrder;     // order rendered binaurally, 0 for loudspeaker channels
+    int64_t spatialBlockNs;     // binaural renderer cost per block, averaged, and the worst seen
+    int64_t maxSpatialBlockNs;
+    int64_t poseToAudioNs;      // setHeadOrientation() to the first frame rendered with it being heard
+    int64_t maxPoseToAudioNs;
+}AudioSinkStats;
+
+// Interleaved 16-bit PCM output. The device pulls frames from its own callback thread; writers
+// only queue them and are never blocked by the device.
+struct IAudioSink {
+    virtual ~IAudioSink() = default;
+
+    // channelCount and sampleRate describe the PCM to be played; the device may open at its native
+    // rate and with at most two channels instead, and writes must then be in that format.
+    // With an ambisonicOrder of 1 or 2 the channels are AmbiX of that order and are kept: they are
+    // rendered to stereo headphones on the device side, turned with setHeadOrientation().
+    virtual bool open(int32_t channelCount, int32_t sampleRate, int32_t ambisonicOrder) = 0;
+
+    // Format write() expects, once open.
+    virtual void getFormat(int32_t& channelCount, int32_t& sampleRate) = 0;
+
+    virtual void close() = 0;
+
+    // Queues as many frames as fit without blocking and returns that number.
+    virtual int32_t write(const void* pcm, int32_t numFrames) = 0;
+
+    // Drops the frames queued but not played yet.
+    virtual void flush() = 0;
+
+    virtual void pause() = 0;
+
+    virtual void resume() = 0;
+
+    // Reports that the frame at framePosition (counted over all frames written, flushed ones
+    // included) is presented at monotonicTime (CLOCK_MONOTONIC ns). Silence the device plays while
+    // the queue is empty is not counted. False until a written frame has been played since open
+    // or the last pause.
+    virtual bool getTimestamp(int64_t& framePosition, int64_t& monotonicTime) = 0;
+
+    // Head orientation for ambisonic output: an x, y, z, w quaternion in OpenXR axes, where the
+    // video centre is straight ahead along -z. Callable from any thread.
+    virtual void setHeadOrientation(const float orientation[4]) = 0;
+
+    virtual AudioSinkStats getStats() = 0;
+};
+
+struct IMediaBackend {
+    virtual ~IMediaBackend() = default;
+
+    virtual std::shared_ptr<IMediaSource> createSource() = 0;
+
+    // Source for a short-lived file such as a streaming segment: no index cache entry is kept.
+    virtual std::shared_ptr<IMediaSource> createSegmentSource() = 0;
+
+    virtual std::shared_ptr<IMediaDecoder> createDecoder(IMediaSource& source, size_t track) = 0;
+
+    virtual std::shared_ptr<IAudioSink> createAudioSink() = 0;
+
+    // File I/O totals over every source this backend created.
+    virtual std::shared_ptr<MediaIoCounters> getIoCounters() = 0;
+
+    // Persistent index cache shared by the backend's sources, or nullptr when disabled.
+    virtual std::shared_ptr<CIndexCache> getIndexCache() = 0;
+};
+
+// Create the media backend named in the options ("NDK" or "Host").
+std::shared_ptr<IMediaBackend> CreateMediaBackend(const struct Options& options);
@@ -0,0 +1,36 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+
+#include "pch.h"
+#include "common.h"
+#include "options.h"
+#include "mediabackend.h"
+
+// Media backend factories are forward declared here.
+#ifdef XR_USE_PLATFORM_ANDROID
+std::shared_ptr<IMediaBackend> CreateMediaBackend_Ndk(const Options& options);
+#endif
+std::shared_ptr<IMediaBackend> CreateMediaBackend_Host(const Options& options);
+
+namespace {
+using MediaBackendFactory = std::function<std::shared_ptr<IMediaBackend>(const Options& options)>;
+
+std::map<std::string, MediaBackendFactory, IgnoreCaseStringLess> mediaBackendMap = {
+#ifdef XR_USE_PLATFORM_ANDROID
+    {"NDK", [](const Options& options) { return CreateMediaBackend_Ndk(options); }},
+#endif
+    {"Host", [](const Options& options) { return CreateMediaBackend_Host(options); }},
+};
+}  // namespace
+
+std::shared_ptr<IMediaBackend> CreateMediaBackend(const Options& options) {
+    if (options.MediaBackend.empty()) {
+        throw std::invalid_argument("No media backend specified");
+    }
+
+    const auto backendIt = mediaBackendMap.find(options.MediaBackend);
+    if (backendIt == mediaBackendMap.end()) {
+        throw std::invalid_argument(Fmt("Unsupported media backend '%s'", options.MediaBackend.c_str()));
+    }
+
+    return backendIt->second(options);
+}
@@ -0,0 +1,721 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Portable media backend for running the decode pipeline off-device.
+// Video comes from a raw YUV4MPEG2 (.y4m) file, audio from a 16-bit PCM .wav file
+// next to it with the same base name, or both from an MP4/MOV read by CMp4Demuxer.
+// The "decoders" only repack raw samples into NV12 / PCM output slots and the audio
+// sink plays samples into nothing (or a file) at real-time pace.
+
+#include "pch.h"
+#include "common.h"
+#include "options.h"
+#include "mediabackend.h"
+#include "mediafile.h"
+#include "mp4demuxer.h"
+#include "audiosink.h"
+
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+constexpr int32_t kAudioFramesPerPacket = 1024;
+constexpr int32_t kOutputAlignment = 16;  // matches the stride hardware decoders emit and CPlayer assumes
+
+struct HostTrack {
+    MediaTrackInfo info;
+    std::unique_ptr<IMediaFile> file;
+    bool selected{false};
+    // video: one entry per frame
+    std::vector<int64_t> frameOffsets;
+    int64_t frameSize{0};
+    int64_t frameDurationNum{0};  // frame duration = num / den seconds
+    int64_t frameDurationDen{1};
+    // audio: one contiguous data chunk
+    int64_t dataOffset{0};
+    int64_t dataSize{0};
+    int32_t bytesPerFrame{0};
+    // read position, in frames (video) or PCM frames (audio)
+    int64_t position{0};
+};
+
+struct HostMediaSource : public IMediaSource {
+    HostMediaSource(int64_t readAhead, std::shared_ptr<MediaIoCounters> ioCounters) : mReadAhead(readAhead), mIoCounters(std::move(ioCounters)) {}
+
+    ~HostMediaSource() override {
+        for (HostTrack& track : mTracks) {
+            closeFd(track);
+        }
+    }
+
+    bool open(const char* source) override {
+        std::string path(source);
+        HostTrack video;
+        if (openY4m(path, video)) {
+            mTracks.push_back(std::move(video));
+        }
+        std::string wavPath = path;
+        const size_t dot = wavPath.find_last_of('.');
+        wavPath = (dot == std::string::npos ? wavPath : wavPath.substr(0, dot)) + ".wav";
+        HostTrack audio;
+        if (openWav(wavPath, audio)) {
+            mTracks.push_back(std::move(audio));
+        }
+        if (mTracks.empty()) {
+            Log::Write(Log::Level::Error, Fmt("host source: no playable y4m/wav for %s", source));
+            return false;
+        }
+        return true;
+    }
+
+    size_t getTrackCount() override { return mTracks.size(); }
+
+    bool getTrackInfo(size_t track, MediaTrackInfo& info) override {
+        if (track >= mTracks.size()) {
+            return false;
+        }
+        info = mTracks[track].info;
+        return true;
+    }
+
+    bool selectTrack(size_t track) override {
+        if (track >= mTracks.size()) {
+            return false;
+        }
+        mTracks[track].selected = true;
+        return true;
+    }
+
+    int32_t getSampleTrackIndex() override {
+        int32_t best = -1;
+        int64_t bestTime = 0;
+        for (size_t i = 0; i < mTracks.size(); i++) {
+            if (!mTracks[i].selected || atEnd(mTracks[i])) {
+                continue;
+            }
+            int64_t time = sampleTime(mTracks[i]);
+            if (best < 0 || time < bestTime) {
+                best = (int32_t)i;
+                bestTime = time;
+            }
+        }
+        return best;
+    }
+
+    int64_t getSampleTime() override {
+        int32_t index = getSampleTrackIndex();
+        return index < 0 ? -1 : sampleTime(mTracks[index]);
+    }
+
+    // Raw video frames and PCM packets never depend on each other.
+    uint32_t getSampleFlags() override { return kSampleFlagSync; }
+
+    ssize_t readSampleData(uint8_t* buffer, size_t capacity) override {
+        int32_t index = getSampleTrackIndex();
+        if (index < 0) {
+            return -1;
+        }
+        const HostTrack& track = mTracks[index];
+        int64_t offset = 0;
+        int64_t size = 0;
+        sampleRange(track, offset, size);
+        if ((int64_t)capacity < size) {
+            return -1;
+        }
+        return track.file->readAt(offset, buffer, size);
+    }
+
+    const uint8_t* getSampleData(size_t& size) override {
+        int32_t index = getSampleTrackIndex();
+        if (index < 0) {
+            return nullptr;
+        }
+        const HostTrack& track = mTracks[index];
+        int64_t offset = 0;
+        int64_t length = 0;
+        sampleRange(track, offset, length);
+        size = (size_t)length;
+        return track.file->map(offset, size);
+    }
+
+    bool advance() override {
+        int32_t index = getSampleTrackIndex();
+        if (index < 0) {
+            return false;
+        }
+        HostTrack& track = mTracks[index];
+        track.position += (track.info.type == mediaTypeVideo) ? 1 : kAudioFramesPerPacket;
+        return getSampleTrackIndex() >= 0;
+    }
+
+    bool seekTo(int64_t timeUs) override {
+        for (HostTrack& track : mTracks) {
+            if (track.info.type == mediaTypeVideo) {
+                // every raw frame is a sync sample
+                track.position = timeUs * track.frameDurationDen / (track.frameDurationNum * 1000000);
+            } else {
+                track.position = timeUs * track.info.sampleRate / 1000000 / kAudioFramesPerPacket * kAudioFramesPerPacket;
+            }
+        }
+        return true;
+    }
+
+    // Every raw frame is a sync sample, and the frame index is built at open().
+    bool getSyncSampleTimes(size_t track, std::vector<int64_t>& timesUs) override {
+        if (track >= mTracks.size() || mTracks[track].info.type != mediaTypeVideo) {
+            return false;
+        }
+        const HostTrack& video = mTracks[track];
+        timesUs.resize(video.frameOffsets.size());
+        for (size_t i = 0; i < timesUs.size(); i++) {
+            timesUs[i] = sampleTimeOf(video, i);
+        }
+        return true;
+    }
+
+   private:
+    static bool atEnd(const HostTrack& track) {
+        if (track.info.type == mediaTypeVideo) {
+            return track.position >= (int64_t)track.frameOffsets.size();
+        }
+        return track.position * track.bytesPerFrame >= track.dataSize;
+    }
+
+    static int64_t sampleTime(const HostTrack& track) {
+        if (track.info.type == mediaTypeVideo) {
+            return track.position * track.frameDurationNum * 1000000 / track.frameDurationDen;
+        }
+        return track.position * 1000000 / track.info.sampleRate;
+    }
+
+    static void sampleRange(const HostTrack& track, int64_t& offset, int64_t& size) {
+        if (track.info.type == mediaTypeVideo) {
+            offset = track.frameOffsets[track.position];
+            size = track.frameSize;
+        } else {
+            offset = track.dataOffset + track.position * track.bytesPerFrame;
+            size = std::min<int64_t>((int64_t)kAudioFramesPerPacket * track.bytesPerFrame, track.dataSize - track.position * track.bytesPerFrame);
+        }
+    }
+
+    static void closeFd(HostTrack& track) { track.file.reset(); }
+
+    bool openFile(const std::string& path, HostTrack& track) {
+        track.file = OpenMediaFile(path.c_str(), mReadAhead, mIoCounters);
+        return track.file != nullptr;
+    }
+
+    // "YUV4MPEG2 W<w> H<h> F<num>:<den> ... C420..." followed by "FRAME[ params]\n<i420 data>" records.
+    bool openY4m(const std::string& path, HostTrack& track) {
+        if (!openFile(path, track)) {
+            return false;
+        }
+        char header[256] = {};
+        ssize_t got = track.file->readAt(0, header, sizeof(header) - 1);
+        char* eol = got > 0 ? (char*)memchr(header, '\n', got) : nullptr;
+        if (eol == nullptr || strncmp(header, "YUV4MPEG2 ", 10) != 0) {
+            closeFd(track);
+            return false;
+        }
+        *eol = '\0';
+        int32_t width = 0;
+        int32_t height = 0;
+        int64_t rateNum = 30;
+        int64_t rateDen = 1;
+        char* save = nullptr;
+        for (char* token = strtok_r(header + 10, " ", &save); token; token = strtok_r(nullptr, " ", &save)) {
+            switch (token[0]) {
+                case 'W': width = atoi(token + 1); break;
+                case 'H': height = atoi(token + 1); break;
+                case 'F': sscanf(token + 1, "%lld:%lld", (long long*)&rateNum, (long long*)&rateDen); break;
+                case 'C':
+                    if (strncmp(token + 1, "420", 3) != 0) {
+                        Log::Write(Log::Level::Error, Fmt("host source: unsupported y4m colorspace %s", token));
+                        closeFd(track);
+                        return false;
+                    }
+                    break;
+                default: break;
+            }
+        }
+        if (width <= 0 || height <= 0 || rateNum <= 0 || rateDen <= 0) {
+            closeFd(track);
+            return false;
+        }
+        track.frameSize = (int64_t)width * height + 2 * (int64_t)((width + 1) / 2) * ((height + 1) / 2);
+        track.frameDurationNum = rateDen;
+        track.frameDurationDen = rateNum;
+
+        // Index the frame records; FRAME headers may carry parameters so they can't be assumed fixed size.
+        const int64_t fileSize = track.file->size();
+        int64_t offset = (eol - header) + 1;
+        while (offset < fileSize) {
+            char frameHeader[64] = {};
+            got = track.file->readAt(offset, frameHeader, sizeof(frameHeader));
+            char* end = got > 0 ? (char*)memchr(frameHeader, '\n', got) : nullptr;
+            if (end == nullptr || strncmp(frameHeader, "FRAME", 5) != 0) {
+                break;
+            }
+            int64_t dataOffset = offset + (end - frameHeader) + 1;
+            if (dataOffset + track.frameSize > fileSize) {
+                break;
+            }
+            track.frameOffsets.push_back(dataOffset);
+            offset = dataOffset + track.frameSize;
+        }
+
+        track.info.type = mediaTypeVideo;
+        track.info.mime = kMimeRawVideo;
+        track.info.width = width;
+        track.info.height = height;
+        track.info.durationUs = sampleTimeOf(track, track.frameOffsets.size());
+        track.info.maxInputSize = (int32_t)track.frameSize;
+        Log::Write(Log::Level::Info, Fmt("host source: %s %dx%d %lld/%lld fps, %d frames", path.c_str(), width, height,
+                                         (long long)rateNum, (long long)rateDen, (int32_t)track.frameOffsets.size()));
+        return !track.frameOffsets.empty();
+    }
+
+    static int64_t sampleTimeOf(const HostTrack& track, int64_t position) {
+        return position * track.frameDurationNum * 1000000 / track.frameDurationDen;
+    }
+
+    bool openWav(const std::string& path, HostTrack& track) {
+        if (!openFile(path, track)) {
+            return false;
+        }
+        uint8_t riff[12];
+        if (track.file->readAt(0, riff, sizeof(riff)) != sizeof(riff) || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+            closeFd(track);
+            return false;
+        }
+        int64_t offset = 12;
+        int32_t channels = 0;
+        int32_t sampleRate = 0;
+        int32_t bitsPerSample = 0;
+        int32_t format = 0;
+        for (;;) {
+            uint8_t chunk[8];
+            if (track.file->readAt(offset, chunk, sizeof(chunk)) != sizeof(chunk)) {
+                break;
+            }
+            const uint32_t chunkSize = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | ((uint32_t)chunk[7] << 24);
+            if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16) {
+                uint8_t fmt[16];
+                if (track.file->readAt(offset + 8, fmt, sizeof(fmt)) != sizeof(fmt)) {
+                    break;
+                }
+                format = fmt[0] | (fmt[1] << 8);
+                channels = fmt[2] | (fmt[3] << 8);
+                sampleRate = fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | (fmt[7] << 24);
+                bitsPerSample = fmt[14] | (fmt[15] << 8);
+            } else if (memcmp(chunk, "data", 4) == 0) {
+                track.dataOffset = offset + 8;
+                track.dataSize = chunkSize;
+                break;
+            }
+            offset += 8 + chunkSize + (chunkSize & 1);
+        }
+        if (format != 1 || bitsPerSample != 16 || channels <= 0 || sampleRate <= 0 || track.dataSize <= 0) {
+            Log::Write(Log::Level::Error, Fmt("host source: %s is not 16-bit PCM", path.c_str()));
+            closeFd(track);
+            return false;
+        }
+        track.bytesPerFrame = channels * (int32_t)sizeof(int16_t);
+        track.info.type = mediaTypeAudio;
+        track.info.mime = kMimeRawAudio;
+        track.info.channelCount = channels;
+        track.info.sampleRate = sampleRate;
+        track.info.durationUs = track.dataSize / track.bytesPerFrame * 1000000 / sampleRate;
+        track.info.maxInputSize = kAudioFramesPerPacket * track.bytesPerFrame;
+        return true;
+    }
+
+    std::vector<HostTrack> mTracks;
+    int64_t mReadAhead;
+    std::shared_ptr<MediaIoCounters> mIoCounters;
+};
+
+// Picks the demuxer from the file itself once open() sees it, and forwards to it.
+struct HostSource : public IMediaSource {
+    HostSource(int64_t readAhead, std::shared_ptr<MediaIoCounters> ioCounters, std::shared_ptr<CIndexCache> indexCache)
+        : mReadAhead(readAhead), mIoCounters(std::move(ioCounters)), mIndexCache(std::move(indexCache)) {}
+
+    bool open(const char* source) override {
+        if (CMp4Demuxer::probe(source)) {
+            mImpl.reset(new CMp4Demuxer(mReadAhead, mIoCounters, mIndexCache));
+        } else {
+            mImpl.reset(new HostMediaSource(mReadAhead, mIoCounters));
+        }
+        return mImpl->open(source);
+    }
+
+    size_t getTrackCount() override { return mImpl->getTrackCount(); }
+
+    bool getTrackInfo(size_t track, MediaTrackInfo& info) override { return mImpl->getTrackInfo(track, info); }
+
+    bool selectTrack(size_t track) override { return mImpl->selectTrack(track); }
+
+    int32_t getSampleTrackIndex() override { return mImpl->getSampleTrackIndex(); }
+
+    int64_t getSampleTime() override { return mImpl->getSampleTime(); }
+
+    uint32_t getSampleFlags() override { return mImpl->getSampleFlags(); }
+
+    ssize_t readSampleData(uint8_t* buffer, size_t capacity) override { return mImpl->readSampleData(buffer, capacity); }
+
+    const uint8_t* getSampleData(size_t& size) override { return mImpl->getSampleData(size); }
+
+    bool advance() override { return mImpl->advance(); }
+
+    bool seekTo(int64_t timeUs) override { return mImpl->seekTo(timeUs); }
+
+    bool getSyncSampleTimes(size_t track, std::vector<int64_t>& timesUs) override { return mImpl->getSyncSampleTimes(track, timesUs); }
+
+    IMediaSource* getDemuxer() override { return mImpl->getDemuxer(); }
+
+   private:
+    int64_t mReadAhead;
+    std::shared_ptr<MediaIoCounters> mIoCounters;
+    std::shared_ptr<CIndexCache> mIndexCache;
+    std::unique_ptr<IMediaSource> mImpl;
+};
+
+// Passthrough "decoder" with a fixed pool of input and output slots.
+// Video input is planar I420 and is repacked to NV12 with 16-aligned width and height; a codec
+// config input switches the picture size for the frames queued after it.
+struct HostMediaDecoder : public IMediaDecoder {
+    static constexpr size_t kInputSlots = 4;
+    static constexpr size_t kOutputSlots = 8;
+
+    explicit HostMediaDecoder(const MediaTrackInfo& info) : mInfo(info) {
+        mInputs.resize(kInputSlots);
+        mOutputs.resize(kOutputSlots);
+        for (Slot& slot : mInputs) {
+            slot.data.resize(std::max(info.maxInputSize, 1));
+        }
+        if (info.type == mediaTypeVideo) {
+            setPictureSize(info.width, info.height);
+            for (Slot& slot : mOutputs) {
+                slot.data.resize((size_t)mAlignedWidth * mAlignedHeight * 3 / 2);
+            }
+        } else {
+            for (Slot& slot : mOutputs) {
+                slot.data.resize(std::max(info.maxInputSize, 1));
+            }
+        }
+    }
+
+    bool start() override { return true; }
+
+    void stop() override { flush(); }
+
+    void flush() override {
+        std::lock_guard<std::mutex> guard(mMutex);
+        for (Slot& slot : mInputs) {
+            slot.state = Slot::Free;
+        }
+        for (Slot& slot : mOutputs) {
+            slot.state = Slot::Free;
+        }
+        mQueued.clear();
+        mCond.notify_all();
+    }
+
+    ssize_t dequeueInputBuffer(int64_t timeoutUs) override {
+        std::unique_lock<std::mutex> lock(mMutex);
+        ssize_t index = -1;
+        waitFor(lock, timeoutUs, [&] { return (index = findSlot(mInputs, Slot::Free)) >= 0; });
+        if (index >= 0) {
+            mInputs[index].state = Slot::Dequeued;
+        }
+        return index >= 0 ? index : kTryAgainLater;
+    }
+
+    uint8_t* getInputBuffer(size_t index, size_t* capacity) override {
+        if (capacity) {
+            *capacity = mInputs[index].data.size();
+        }
+        return mInputs[index].data.data();
+    }
+
+    bool queueInputBuffer(size_t index, size_t size, int64_t ptsUs, uint32_t flags) override {
+        std::lock_guard<std::mutex> guard(mMutex);
+        Slot& slot = mInputs[index];
+        slot.state = Slot::Queued;
+        slot.size = size;
+        slot.ptsUs = ptsUs;
+        slot.flags = flags;
+        mQueued.push_back(index);
+        mCond.notify_all();
+        return true;
+    }
+
+    ssize_t dequeueOutputBuffer(DecoderBufferInfo& info, int64_t timeoutUs) override {
+        std::unique_lock<std::mutex> lock(mMutex);
+        ssize_t output = -1;
+        auto configQueued = [&] { return !mQueued.empty() && (mInputs[mQueued.front()].flags & kFlagCodecConfig); };
+        waitFor(lock, timeoutUs, [&] { return configQueued() || (!mQueued.empty() && (output = findSlot(mOutputs, Slot::Free)) >= 0); });
+        if (configQueued()) {
+            Slot& in = mInputs[mQueued.front()];
+            mQueued.pop_front();
+            int32_t size[2] = {};
+            if (mInfo.type == mediaTypeVideo && in.size >= sizeof(size)) {
+                memcpy(size, in.data.data(), sizeof(size));
+                setPictureSize(size[0], size[1]);
+            }
+            in.state = Slot::Free;
+            mCond.notify_all();
+            return kOutputFormatChanged;
+        }
+        if (output < 0) {
+            return kTryAgainLater;
+        }
+        Slot& in = mInputs[mQueued.front()];
+        Slot& out = mOutputs[output];
+        mQueued.pop_front();
+        if (mInfo.type == mediaTypeVideo) {
+            // Free slots are resized on reuse after a picture size change; held ones keep their frame.
+            out.data.resize((size_t)mAlignedWidth * mAlignedHeight * 3 / 2);
+            out.size = repackNv12(in.data.data(), in.size, out.data.data());
+        } else {
+            out.size = std::min(in.size, out.data.size());
+            memcpy(out.data.data(), in.data.data(), out.size);
+        }
+        out.ptsUs = in.ptsUs;
+        out.flags = in.flags;
+        out.state = Slot::Dequeued;
+        in.state = Slot::Free;
+        mCond.notify_all();
+
+        info.offset = 0;
+        info.size = (int32_t)out.size;
+        info.presentationTimeUs = out.ptsUs;
+        info.flags = out.flags;
+        return output;
+    }
+
+    uint8_t* getOutputBuffer(size_t index) override { return mOutputs[index].data.data(); }
+
+    void releaseOutputBuffer(size_t index, bool /*render*/) override {
+        std::lock_guard<std::mutex> guard(mMutex);
+        mOutputs[index].state = Slot::Free;
+        mCond.notify_all();
+    }
+
+    bool getOutputSize(int32_t& width, int32_t& height) override {
+        std::lock_guard<std::mutex> guard(mMutex);
+        if (mInfo.type != mediaTypeVideo) {
+            return false;
+        }
+        width = mInfo.width;
+        height = mInfo.height;
+        return true;
+    }
+
+   private:
+    struct Slot {
+        enum State { Free, Dequeued, Queued } state{Free};
+        std::vector<uint8_t> data;
+        size_t size{0};
+        int64_t ptsUs{0};
+        uint32_t flags{0};
+    };
+
+    static ssize_t findSlot(const std::vector<Slot>& slots, Slot::State state) {
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (slots[i].state == state) {
+                return (ssize_t)i;
+            }
+        }
+        return -1;
+    }
+
+    template <typename Pred>
+    void waitFor(std::unique_lock<std::mutex>& lock, int64_t timeoutUs, Pred ready) {
+        if (timeoutUs < 0) {
+            mCond.wait(lock, ready);
+        } else {
+            mCond.wait_for(lock, std::chrono::microseconds(timeoutUs), ready);
+        }
+    }
+
+    void setPictureSize(int32_t width, int32_t height) {
+        mInfo.width = width;
+        mInfo.height = height;
+        mAlignedWidth = (width + kOutputAlignment - 1) / kOutputAlignment * kOutputAlignment;
+        mAlignedHeight = (height + kOutputAlignment - 1) / kOutputAlignment * kOutputAlignment;
+    }
+
+    size_t repackNv12(const uint8_t* i420, size_t size, uint8_t* nv12) const {
+        const int32_t width = mInfo.width;
+        const int32_t height = mInfo.height;
+        const int32_t chromaWidth = (width + 1) / 2;
+        const int32_t chromaHeight = (height + 1) / 2;
+        const size_t outSize = (size_t)mAlignedWidth * mAlignedHeight * 3 / 2;
+        if (size < (size_t)width * height + 2 * (size_t)chromaWidth * chromaHeight) {
+            return 0;
+        }
+        memset(nv12, 0, (size_t)mAlignedWidth * mAlignedHeight);
+        memset(nv12 + (size_t)mAlignedWidth * mAlignedHeight, 128, (size_t)mAlignedWidth * mAlignedHeight / 2);
+        for (int32_t y = 0; y < height; y++) {
+            memcpy(nv12 + (size_t)y * mAlignedWidth, i420 + (size_t)y * width, width);
+        }
+        const uint8_t* u = i420 + (size_t)width * height;
+        const uint8_t* v = u + (size_t)chromaWidth * chromaHeight;
+        uint8_t* uv = nv12 + (size_t)mAlignedWidth * mAlignedHeight;
+        for (int32_t y = 0; y < chromaHeight; y++) {
+            uint8_t* row = uv + (size_t)y * mAlignedWidth;
+            for (int32_t x = 0; x < chromaWidth; x++) {
+                row[2 * x] = u[(size_t)y * chromaWidth + x];
+                row[2 * x + 1] = v[(size_t)y * chromaWidth + x];
+            }
+        }
+        return outSize;
+    }
+
+    MediaTrackInfo mInfo;
+    int32_t mAlignedWidth{0};
+    int32_t mAlignedHeight{0};
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    std::vector<Slot> mInputs;
+    std::vector<Slot> mOutputs;
+    std::deque<size_t> mQueued;
+};
+
+// Stands in for an audio device: a thread drains the ring in bursts at real-time pace, as an
+// audio callback would, and appends what it plays to a file when one is configured.
+struct NullAudioSink : public CRingAudioSink {
+    static constexpr int64_t kBurstNs = 5 * 1000 * 1000;
+    static constexpr int64_t kLatencyNs = 20 * 1000 * 1000;  // simulated mixer + DAC delay
+    static constexpr int32_t kNativeRate = 48000;
+
+    explicit NullAudioSink(const std::string& dumpFile) : mDumpFile(dumpFile) {}
+
+    ~NullAudioSink() override { close(); }
+
+    bool open(int32_t channelCount, int32_t sampleRate, int32_t ambisonicOrder) override {
+        if (sampleRate <= 0) {
+            return false;
+        }
+        // Like a phone's mixer: stereo at 48 kHz whatever the media is.
+        if (!openRing(ambisonicOrder > 0 ? channelCount : std::min(channelCount, 2), kNativeRate, ambisonicOrder)) {
+            return false;
+        }
+        if (!mDumpFile.empty()) {
+            mDump = fopen(mDumpFile.c_str(), "ab");
+            if (mDump == nullptr) {
+                Log::Write(Log::Level::Error, Fmt("null audio sink: can't open %s", mDumpFile.c_str()));
+            }
+        }
+        mRunning = true;
+        mPaused = false;
+        mThread = std::thread(&NullAudioSink::deviceThread, this);
+        Log::Write(Log::Level::Info, Fmt("null audio sink: %d channels @ %d Hz for %d channels @ %d Hz, ambisonic order %d", mOutputChannelCount, mSampleRate,
+                                         channelCount, sampleRate, ambisonicOrder));
+        return true;
+    }
+
+    void close() override {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mRunning = false;
+        }
+        mCond.notify_all();
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+        if (mDump != nullptr) {
+            fclose(mDump);
+            mDump = nullptr;
+        }
+    }
+
+    void pause() override {
+        invalidateTimestamp();
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPaused = true;
+    }
+
+    void resume() override {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPaused = false;
+        }
+        mCond.notify_all();
+    }
+
+   private:
+    void deviceThread() {
+        const int32_t burstFrames = (int32_t)(kBurstNs * mSampleRate / 1000000000);
+        std::vector<int16_t> burst((size_t)burstFrames * mOutputChannelCount);
+        auto next = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (mRunning) {
+            if (mPaused) {
+                mCond.wait(lock, [this] { return !mRunning || !mPaused; });
+                next = std::chrono::steady_clock::now();
+                continue;
+            }
+            if (mCond.wait_until(lock, next, [this] { return !mRunning || mPaused; })) {
+                continue;
+            }
+            lock.unlock();
+            render(burst.data(), burstFrames, kLatencyNs);
+            if (mDump != nullptr) {
+                fwrite(burst.data(), sizeof(int16_t) * mOutputChannelCount, burstFrames, mDump);
+            }
+            next += std::chrono::nanoseconds((int64_t)burstFrames * 1000000000 / mSampleRate);
+            lock.lock();
+        }
+    }
+
+    std::string mDumpFile;
+    FILE* mDump{nullptr};
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    bool mRunning{false};
+    bool mPaused{false};
+};
+
+struct HostMediaBackend : public IMediaBackend {
+    explicit HostMediaBackend(const Options& options)
+        : mReadAhead((int64_t)options.ReadAheadMB << 20), mAudioDumpFile(options.AudioDumpFile) {
+        if (!options.IndexCacheDir.empty()) {
+            mIndexCache = std::make_shared<CIndexCache>(options.IndexCacheDir);
+        }
+    }
+
+    std::shared_ptr<IMediaSource> createSource() override { return std::make_shared<HostSource>(mReadAhead, mIoCounters, mIndexCache); }
+
+    std::shared_ptr<IMediaSource> createSegmentSource() override { return std::make_shared<HostSource>(mReadAhead, mIoCounters, nullptr); }
+
+    std::shared_ptr<IMediaDecoder> createDecoder(IMediaSource& source, size_t track) override {
+        MediaTrackInfo info;
+        if (!source.getTrackInfo(track, info) || (info.mime != kMimeRawVideo && info.mime != kMimeRawAudio)) {
+            Log::Write(Log::Level::Error, Fmt("host backend can't decode track %d", (int32_t)track));
+            return nullptr;
+        }
+        return std::make_shared<HostMediaDecoder>(info);
+    }
+
+    std::shared_ptr<IAudioSink> createAudioSink() override { return std::make_shared<NullAudioSink>(mAudioDumpFile); }
+
+    std::shared_ptr<MediaIoCounters> getIoCounters() override { return mIoCounters; }
+
+    std::shared_ptr<CIndexCache> getIndexCache() override { return mIndexCache; }
+
+   private:
+    int64_t mReadAhead;
+    std::string mAudioDumpFile;
+    std::shared_ptr<MediaIoCounters> mIoCounters{std::make_shared<MediaIoCounters>()};
+    std::shared_ptr<CIndexCache> mIndexCache;
+};
+}  // namespace
+
+std::shared_ptr<IMediaBackend> CreateMediaBackend_Host(const Options& options) { return std::make_shared<HostMediaBackend>(options); }
@@ -0,0 +1,543 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Media backend built on AMediaExtractor, AMediaCodec and Oboe.
+
+#include "pch.h"
+#include "common.h"
+#include "options.h"
+#include "mediabackend.h"
+#include "mediafile.h"
+#include "mp4demuxer.h"
+#include "annexb.h"
+#include "audiosink.h"
+#include "mediaclock.h"
+
+#ifdef XR_USE_PLATFORM_ANDROID
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <media/NdkMediaExtractor.h>
+#include <media/NdkMediaCodec.h>
+#include "oboe/Oboe.h"
+
+struct AMediaDataSource;
+
+namespace {
+
+// AMediaDataSource arrived in API 28 and the app still runs on 26, so it is looked up at
+// runtime; without it the extractor falls back to reading the fd itself.
+struct MediaDataSourceApi {
+    typedef ssize_t (*ReadAtFn)(void* userdata, off64_t offset, void* buffer, size_t size);
+    typedef ssize_t (*GetSizeFn)(void* userdata);
+    typedef void (*CloseFn)(void* userdata);
+
+    AMediaDataSource* (*create)();
+    void (*destroy)(AMediaDataSource*);
+    void (*setUserdata)(AMediaDataSource*, void*);
+    void (*setReadAt)(AMediaDataSource*, ReadAtFn);
+    void (*setGetSize)(AMediaDataSource*, GetSizeFn);
+    void (*setClose)(AMediaDataSource*, CloseFn);
+    media_status_t (*setDataSourceCustom)(AMediaExtractor*, AMediaDataSource*);
+
+    static const MediaDataSourceApi* get() {
+        static const MediaDataSourceApi* api = load();
+        return api;
+    }
+
+   private:
+    static const MediaDataSourceApi* load() {
+        static MediaDataSourceApi api;
+        void* lib = dlopen("libmediandk.so", RTLD_NOW);
+        if (lib == nullptr) {
+            return nullptr;
+        }
+        api.create = (AMediaDataSource * (*)()) dlsym(lib, "AMediaDataSource_new");
+        api.destroy = (void (*)(AMediaDataSource*))dlsym(lib, "AMediaDataSource_delete");
+        api.setUserdata = (void (*)(AMediaDataSource*, void*))dlsym(lib, "AMediaDataSource_setUserdata");
+        api.setReadAt = (void (*)(AMediaDataSource*, ReadAtFn))dlsym(lib, "AMediaDataSource_setReadAt");
+        api.setGetSize = (void (*)(AMediaDataSource*, GetSizeFn))dlsym(lib, "AMediaDataSource_setGetSize");
+        api.setClose = (void (*)(AMediaDataSource*, CloseFn))dlsym(lib, "AMediaDataSource_setClose");
+        api.setDataSourceCustom = (media_status_t (*)(AMediaExtractor*, AMediaDataSource*))dlsym(lib, "AMediaExtractor_setDataSourceCustom");
+        if (!api.create || !api.destroy || !api.setUserdata || !api.setReadAt || !api.setGetSize || !api.setClose || !api.setDataSourceCustom) {
+            Log::Write(Log::Level::Info, "AMediaDataSource not available, extractor reads the file itself");
+            return nullptr;
+        }
+        return &api;
+    }
+};
+
+struct NdkMediaSource : public IMediaSource {
+    NdkMediaSource(int64_t readAhead, std::shared_ptr<MediaIoCounters> ioCounters, std::shared_ptr<CIndexCache> indexCache)
+        : mReadAhead(readAhead), mIoCounters(std::move(ioCounters)), mIndexCache(std::move(indexCache)) {}
+
+    ~NdkMediaSource() override {
+        for (AMediaFormat* format : mFormats) {
+            AMediaFormat_delete(format);
+        }
+        if (mExtractor) {
+            AMediaExtractor_delete(mExtractor);
+            mExtractor = nullptr;
+        }
+        // The extractor may read until it is deleted, so the data source goes after it.
+        if (mDataSource) {
+            MediaDataSourceApi::get()->destroy(mDataSource);
+            mDataSource = nullptr;
+        }
+        if (mFd > 0) {
+            close(mFd);
+            mFd = -1;
+        }
+    }
+
+    bool open(const char* source) override {
+        mPath = source;
+        if (mExtractor == nullptr) {
+            mExtractor = AMediaExtractor_new();
+            if (mExtractor == nullptr) {
+                Log::Write(Log::Level::Error, "AMediaExtractor_new error");
+                return false;
+            }
+        }
+
+        int64_t fileLen = -1;
+        const MediaDataSourceApi* api = MediaDataSourceApi::get();
+        const bool remote = IsRemoteMediaPath(source);
+        if (api != nullptr && (mReadAhead > 0 || remote)) {
+            if (!openCustom(api, source, fileLen)) {
+                return false;
+            }
+        } else if (remote) {
+            // No AMediaDataSource before API 28: let the extractor fetch the URL itself.
+            media_status_t status = AMediaExtractor_setDataSource(mExtractor, source);
+            if (status != AMEDIA_OK) {
+                Log::Write(Log::Level::Error, Fmt("setDataSource %s error, ret = %d", source, status));
+                return false;
+            }
+        } else {
+            struct stat statbuff;
+            if (stat(source, &statbuff) < 0) {
+                Log::Write(Log::Level::Error, Fmt("setDataSource error, open file %s error", source));
+                return false;
+            } else {
+                fileLen = statbuff.st_size;
+            }
+
+            if (mFd > 0) {
+                close(mFd);
+                mFd = -1;
+            }
+            mFd = ::open(source, O_RDONLY);
+            if (mFd < 0) {
+                Log::Write(Log::Level::Error, Fmt("setDataSource error, open file %s error, ret=%d", source, mFd));
+                return false;
+            }
+
+            media_status_t status = AMediaExtractor_setDataSourceFd(mExtractor, mFd, 0, fileLen);
+            if (status != AMEDIA_OK) {
+                Log::Write(Log::Level::Error, Fmt("setDataSource error, ret = %d", status));
+                return false;
+            }
+        }
+
+        size_t track = AMediaExtractor_getTrackCount(mExtractor);
+        Log::Write(Log::Level::Error, Fmt("setDataSource success, file size %lld track = %d", (long long)fileLen, track));
+        for (size_t i = 0; i < track; i++) {
+            AMediaFormat *format = AMediaExtractor_getTrackFormat(mExtractor, i);
+            Log::Write(Log::Level::Error, Fmt("track %d format %s", i, AMediaFormat_toString(format)));
+            mFormats.push_back(format);
+        }
+        return true;
+    }
+
+    size_t getTrackCount() override { return mFormats.size(); }
+
+    bool getTrackInfo(size_t track, MediaTrackInfo& info) override {
+        if (track >= mFormats.size()) {
+            return false;
+        }
+        AMediaFormat* format = mFormats[track];
+        const char *mime = nullptr;
+        if (!AMediaFormat_getString(format, "mime", &mime)) {
+            return false;
+        }
+        info = MediaTrackInfo();
+        info.mime = mime;
+        info.type = strstr(mime, "video") ? mediaTypeVideo : mediaTypeAudio;
+        AMediaFormat_getInt32(format, "width", &info.width);
+        AMediaFormat_getInt32(format, "height", &info.height);
+        AMediaFormat_getInt64(format, "durationUs", &info.durationUs);
+        AMediaFormat_getInt32(format, "channel-count", &info.channelCount);
+        AMediaFormat_getInt32(format, "sample-rate", &info.sampleRate);
+        AMediaFormat_getInt32(format, "max-input-size", &info.maxInputSize);
+        for (const char* key : {"csd-0", "csd-1"}) {
+            void* data = nullptr;
+            size_t size = 0;
+            if (AMediaFormat_getBuffer(format, key, &data, &size)) {
+                info.codecConfig.insert(info.codecConfig.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+            }
+        }
+        return true;
+    }
+
+    bool selectTrack(size_t track) override {
+        media_status_t status = AMediaExtractor_selectTrack(mExtractor, track);
+        if (status != AMEDIA_OK) {
+            Log::Write(Log::Level::Error, Fmt("AMediaExtractor_selectTrack error, status = %d", status));
+            return false;
+        }
+        return true;
+    }
+
+    int32_t getSampleTrackIndex() override { return AMediaExtractor_getSampleTrackIndex(mExtractor); }
+
+    int64_t getSampleTime() override { return AMediaExtractor_getSampleTime(mExtractor); }
+
+    uint32_t getSampleFlags() override {
+        return (AMediaExtractor_getSampleFlags(mExtractor) & AMEDIAEXTRACTOR_SAMPLE_FLAG_SYNC) ? kSampleFlagSync : 0;
+    }
+
+    ssize_t readSampleData(uint8_t* buffer, size_t capacity) override {
+        return AMediaExtractor_readSampleData(mExtractor, buffer, capacity);
+    }
+
+    bool advance() override { return AMediaExtractor_advance(mExtractor); }
+
+    bool seekTo(int64_t timeUs) override {
+        return AMediaExtractor_seekTo(mExtractor, timeUs, AMEDIAEXTRACTOR_SEEK_CLOSEST_SYNC) == AMEDIA_OK;
+    }
+
+    // AMediaExtractor has no sample table API, so a local MP4's own is read with CMp4Demuxer: moov
+    // only (or its index cache entry), never the samples the extractor would read on advance().
+    bool getSyncSampleTimes(size_t track, std::vector<int64_t>& timesUs) override {
+        if (track >= mFormats.size() || IsRemoteMediaPath(mPath.c_str()) || !CMp4Demuxer::probe(mPath.c_str())) {
+            return false;
+        }
+        CMp4Demuxer demuxer(0, mIoCounters, mIndexCache);
+        MediaTrackInfo own;
+        MediaTrackInfo table;
+        // Both list the file's tracks in order; anything else means they disagree about the file.
+        if (!demuxer.open(mPath.c_str()) || demuxer.getTrackCount() != mFormats.size() || !getTrackInfo(track, own) ||
+            !demuxer.getTrackInfo(track, table) || own.mime != table.mime) {
+            return false;
+        }
+        return demuxer.getSyncSampleTimes(track, timesUs);
+    }
+
+    AMediaFormat* getFormat(size_t track) const { return track < mFormats.size() ? mFormats[track] : nullptr; }
+
+   private:
+    // Serves the extractor from an mmap of the file (or the HTTP block cache for URLs) with a
+    // read-ahead window in front of it, instead of letting it pread() the fd a few KB at a time.
+    bool openCustom(const MediaDataSourceApi* api, const char* source, int64_t& fileLen) {
+        mFile = OpenMediaFile(source, mReadAhead, mIoCounters);
+        if (mFile == nullptr) {
+            Log::Write(Log::Level::Error, Fmt("setDataSource error, open file %s error", source));
+            return false;
+        }
+        fileLen = mFile->size();
+        mDataSource = api->create();
+        api->setUserdata(mDataSource, mFile.get());
+        api->setReadAt(mDataSource, [](void* userdata, off64_t offset, void* buffer, size_t size) -> ssize_t {
+            return ((IMediaFile*)userdata)->readAt(offset, buffer, size);
+        });
+        api->setGetSize(mDataSource, [](void* userdata) -> ssize_t { return (ssize_t)((IMediaFile*)userdata)->size(); });
+        api->setClose(mDataSource, [](void*) {});
+        media_status_t status = api->setDataSourceCustom(mExtractor, mDataSource);
+        if (status != AMEDIA_OK) {
+            Log::Write(Log::Level::Error, Fmt("setDataSourceCustom error, ret = %d", status));
+            return false;
+        }
+        return true;
+    }
+
+    AMediaExtractor* mExtractor{nullptr};
+    int32_t mFd{-1};
+    std::vector<AMediaFormat*> mFormats;
+    int64_t mReadAhead;
+    std::shared_ptr<MediaIoCounters> mIoCounters;
+    std::shared_ptr<CIndexCache> mIndexCache;
+    std::string mPath;
+    std::unique_ptr<IMediaFile> mFile;
+    AMediaDataSource* mDataSource{nullptr};
+};
+
+struct NdkMediaDecoder : public IMediaDecoder {
+    ~NdkMediaDecoder() override {
+        if (mCodec) {
+            AMediaCodec_delete(mCodec);
+            mCodec = nullptr;
+        }
+    }
+
+    bool configure(AMediaFormat* format) {
+        const char *mime = nullptr;
+        AMediaFormat_getString(format, "mime", &mime);
+        mCodec = AMediaCodec_createDecoderByType(mime);
+        if (mCodec == nullptr) {
+            Log::Write(Log::Level::Error, Fmt("create mediacodec %s error", mime));
+            return false;
+        }
+        media_status_t status = AMediaCodec_configure(mCodec, format, nullptr, nullptr, 0);
+        if (status != AMEDIA_OK) {
+            Log::Write(Log::Level::Error, Fmt("AMediaCodec_configure error, status = %d", status));
+            return false;
+        }
+        Log::Write(Log::Level::Info, Fmt("%s AMediaCodec_configure successfuly", mime));
+        return true;
+    }
+
+    bool start() override {
+        media_status_t status = AMediaCodec_start(mCodec);
+        if (status != AMEDIA_OK) {
+            Log::Write(Log::Level::Error, Fmt("AMediaCodec_start error, status = %d", status));
+            return false;
+        }
+        Log::Write(Log::Level::Info, "AMediaCodec_start successfully");
+        return true;
+    }
+
+    void stop() override { AMediaCodec_stop(mCodec); }
+
+    void flush() override { AMediaCodec_flush(mCodec); }
+
+    ssize_t dequeueInputBuffer(int64_t timeoutUs) override { return AMediaCodec_dequeueInputBuffer(mCodec, timeoutUs); }
+
+    uint8_t* getInputBuffer(size_t index, size_t* capacity) override { return AMediaCodec_getInputBuffer(mCodec, index, capacity); }
+
+    bool queueInputBuffer(size_t index, size_t size, int64_t ptsUs, uint32_t flags) override {
+        return AMediaCodec_queueInputBuffer(mCodec, index, 0, size, ptsUs, flags) == AMEDIA_OK;
+    }
+
+    ssize_t dequeueOutputBuffer(DecoderBufferInfo& info, int64_t timeoutUs) override {
+        AMediaCodecBufferInfo bufferInfo;
+        ssize_t index = AMediaCodec_dequeueOutputBuffer(mCodec, &bufferInfo, timeoutUs);
+        if (index >= 0) {
+            info.offset = bufferInfo.offset;
+            info.size = bufferInfo.size;
+            info.presentationTimeUs = bufferInfo.presentationTimeUs;
+            info.flags = bufferInfo.flags;
+        } else if (index == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            AMediaFormat* format = AMediaCodec_getOutputFormat(mCodec);
+            if (format) {
+                AMediaFormat_getInt32(format, "width", &mOutputWidth);
+                AMediaFormat_getInt32(format, "height", &mOutputHeight);
+                int32_t colorFormat = 0;
+                mOutputPlanar = AMediaFormat_getInt32(format, "color-format", &colorFormat) &&
+                                (colorFormat == kColorFormatYUV420Planar || colorFormat == kColorFormatYUV420PackedPlanar);
+                // Not every codec reports its buffer layout; 0 leaves the planes packed at the picture size.
+                mOutputStride = 0;
+                mOutputSliceHeight = 0;
+                AMediaFormat_getInt32(format, "stride", &mOutputStride);
+                AMediaFormat_getInt32(format, "slice-height", &mOutputSliceHeight);
+                AMediaFormat_delete(format);
+            }
+            return kOutputFormatChanged;
+        }
+        return index;
+    }
+
+    uint8_t* getOutputBuffer(size_t index) override { return AMediaCodec_getOutputBuffer(mCodec, index, nullptr); }
+
+    void releaseOutputBuffer(size_t index, bool render) override { AMediaCodec_releaseOutputBuffer(mCodec, index, render); }
+
+    bool getOutputSize(int32_t& width, int32_t& height) override {
+        if (mOutputWidth <= 0 || mOutputHeight <= 0) {
+            return false;
+        }
+        width = mOutputWidth;
+        height = mOutputHeight;
+        return true;
+    }
+
+    bool isOutputPlanar() override { return mOutputPlanar; }
+
+    bool getOutputLayout(int32_t& stride, int32_t& sliceHeight) override {
+        if (mOutputStride <= 0 || mOutputSliceHeight <= 0) {
+            return false;
+        }
+        stride = mOutputStride;
+        sliceHeight = mOutputSliceHeight;
+        return true;
+    }
+
+   private:
+    // MediaCodecInfo.CodecCapabilities color formats that put U and V in separate planes.
+    static constexpr int32_t kColorFormatYUV420Planar = 19;
+    static constexpr int32_t kColorFormatYUV420PackedPlanar = 20;
+
+    AMediaCodec* mCodec{nullptr};
+    int32_t mOutputWidth{0};   // from the last output format change
+    int32_t mOutputHeight{0};
+    bool mOutputPlanar{false};
+    int32_t mOutputStride{0};
+    int32_t mOutputSliceHeight{0};
+};
+
+// Decoder format for a track that has no extractor behind it (live ingest). MediaCodec wants the
+// H.264 SPS and PPS as separate buffers, while HEVC takes VPS, SPS and PPS together.
+AMediaFormat* CreateVideoFormat(const MediaTrackInfo& info) {
+    AMediaFormat* format = AMediaFormat_new();
+    AMediaFormat_setString(format, "mime", info.mime.c_str());
+    AMediaFormat_setInt32(format, "width", info.width);
+    AMediaFormat_setInt32(format, "height", info.height);
+    if (info.maxInputSize > 0) {
+        AMediaFormat_setInt32(format, "max-input-size", info.maxInputSize);
+    }
+    const std::vector<uint8_t>& config = info.codecConfig;
+    if (info.mime == "video/avc") {
+        std::vector<uint8_t> sps, pps;
+        const uint8_t* end = config.data() + config.size();
+        for (const uint8_t* start = FindStartCode(config.data(), end); start != end;) {
+            const uint8_t* next = FindStartCode(start + 3, end);
+            const uint8_t* nalEnd = (next != end && next[-1] == 0) ? next - 1 : next;
+            const NalUnitInfo nal = ClassifyNalUnit(false, start + 3, nalEnd - (start + 3));
+            if (nal.sps || nal.pps) {
+                std::vector<uint8_t>& csd = nal.sps ? sps : pps;
+                csd.insert(csd.end(), {0, 0, 0, 1});
+                csd.insert(csd.end(), start + 3, nalEnd);
+            }
+            start = next;
+        }
+        AMediaFormat_setBuffer(format, "csd-0", sps.data(), sps.size());
+        AMediaFormat_setBuffer(format, "csd-1", pps.data(), pps.size());
+    } else if (!config.empty()) {
+        AMediaFormat_setBuffer(format, "csd-0", config.data(), config.size());
+    }
+    if (info.lowLatency) {
+        // Honoured from API 30; older codecs ignore the keys and may hold a few frames back.
+        AMediaFormat_setInt32(format, "low-latency", 1);
+        AMediaFormat_setInt32(format, "priority", 0);
+    }
+    return format;
+}
+
+// Low-latency Oboe stream pulling from the PCM ring on its real-time data callback.
+struct OboeAudioSink : public CRingAudioSink, public oboe::AudioStreamDataCallback {
+    ~OboeAudioSink() override { close(); }
+
+    // Opens at the device's native rate, stereo at most: the player converts, so the stream stays
+    // on the fast path without a framework resampler or downmixer in front of it. Ambisonic audio
+    // is rendered to stereo in the callback.
+    bool open(int32_t channelCount, int32_t sampleRate, int32_t ambisonicOrder) override {
+        oboe::AudioStreamBuilder playStreamBuilder;
+        playStreamBuilder.setDirection(oboe::Direction::Output);
+        playStreamBuilder.setPerformanceMode(oboe::PerformanceMode::LowLatency);
+        playStreamBuilder.setSharingMode(oboe::SharingMode::Exclusive);
+        playStreamBuilder.setFormat(oboe::AudioFormat::I16);
+        playStreamBuilder.setChannelCount(oboe::ChannelCount(ambisonicOrder > 0 ? 2 : std::min(channelCount, 2)));
+        playStreamBuilder.setDataCallback(this);
+
+        oboe::Result ret = playStreamBuilder.openStream(mStream);
+        if (ret != oboe::Result::OK) {
+            Log::Write(Log::Level::Error, Fmt("Failed to open playback stream. Error: %s", oboe::convertToText(ret)));
+            return false;
+        }
+        // The callback only starts with the stream, so the ring is ready before it first runs.
+        if (ambisonicOrder > 0 && mStream->getChannelCount() != 2) {
+            Log::Write(Log::Level::Error, Fmt("Ambisonic audio needs a stereo stream, got %d channels", mStream->getChannelCount()));
+            return false;
+        }
+        if (!openRing(ambisonicOrder > 0 ? channelCount : mStream->getChannelCount(), mStream->getSampleRate(), ambisonicOrder)) {
+            return false;
+        }
+        Log::Write(Log::Level::Info, Fmt("audio stream: %d channels @ %d Hz for %d channels @ %d Hz, ambisonic order %d", mStream->getChannelCount(),
+                                         mStream->getSampleRate(), channelCount, sampleRate, ambisonicOrder));
+        int32_t bufferSizeFrames = mStream->getFramesPerBurst() * 2;
+        ret = mStream->setBufferSizeInFrames(bufferSizeFrames);
+        Log::Write(Log::Level::Info, Fmt("bufferSizeFrames: %d, performance mode: %s", bufferSizeFrames,
+                                         oboe::convertToText(mStream->getPerformanceMode())));
+        if (ret != oboe::Result::OK) {
+            Log::Write(Log::Level::Error, Fmt("Failed to set playback stream buffer size to: %d. Error: %s", bufferSizeFrames, oboe::convertToText(ret)));
+            return false;
+        }
+        ret = mStream->start();
+        if (ret != oboe::Result::OK) {
+            Log::Write(Log::Level::Error, Fmt("Failed to start playback stream. Error: %s", oboe::convertToText(ret)));
+            return false;
+        }
+        return true;
+    }
+
+    void close() override {
+        if (mStream) {
+            mStream->stop();
+            mStream->close();
+            mStream.reset();
+        }
+    }
+
+    void pause() override {
+        invalidateTimestamp();
+        mStream->requestPause();
+    }
+
+    void resume() override { mStream->requestStart(); }
+
+    // Real-time thread: must not block, lock or allocate.
+    oboe::DataCallbackResult onAudioReady(oboe::AudioStream* stream, void* audioData, int32_t numFrames) override {
+        // The device timestamp says when an earlier frame was presented; everything written since
+        // is still queued ahead of this buffer.
+        int64_t latencyNs = (int64_t)stream->getBufferSizeInFrames() * 1000000000 / mSampleRate;
+        int64_t framePosition = 0;
+        int64_t presentedAt = 0;
+        if (stream->getTimestamp(CLOCK_MONOTONIC, &framePosition, &presentedAt) == oboe::Result::OK) {
+            const int64_t queuedNs = (stream->getFramesWritten() - framePosition) * 1000000000 / mSampleRate;
+            latencyNs = std::max<int64_t>(0, presentedAt + queuedNs - CMediaClock::monotonicNow());
+        }
+        render((int16_t*)audioData, numFrames, latencyNs);
+        return oboe::DataCallbackResult::Continue;
+    }
+
+   private:
+    std::shared_ptr<oboe::AudioStream> mStream;
+};
+
+struct NdkMediaBackend : public IMediaBackend {
+    explicit NdkMediaBackend(const Options& options) : mReadAhead((int64_t)options.ReadAheadMB << 20) {
+        if (!options.IndexCacheDir.empty()) {
+            mIndexCache = std::make_shared<CIndexCache>(options.IndexCacheDir);
+        }
+    }
+
+    std::shared_ptr<IMediaSource> createSource() override { return std::make_shared<NdkMediaSource>(mReadAhead, mIoCounters, mIndexCache); }
+
+    std::shared_ptr<IMediaSource> createSegmentSource() override { return std::make_shared<NdkMediaSource>(mReadAhead, mIoCounters, nullptr); }
+
+    std::shared_ptr<IMediaDecoder> createDecoder(IMediaSource& source, size_t track) override {
+        NdkMediaSource* ndkSource = dynamic_cast<NdkMediaSource*>(source.getDemuxer());
+        MediaTrackInfo info;
+        if (ndkSource == nullptr && source.getTrackInfo(track, info) && info.type == mediaTypeVideo && !info.codecConfig.empty()) {
+            AMediaFormat* format = CreateVideoFormat(info);
+            std::shared_ptr<NdkMediaDecoder> decoder = std::make_shared<NdkMediaDecoder>();
+            const bool configured = decoder->configure(format);
+            AMediaFormat_delete(format);
+            return configured ? decoder : nullptr;
+        }
+        if (ndkSource == nullptr || ndkSource->getFormat(track) == nullptr) {
+            return nullptr;
+        }
+        std::shared_ptr<NdkMediaDecoder> decoder = std::make_shared<NdkMediaDecoder>();
+        if (!decoder->configure(ndkSource->getFormat(track))) {
+            return nullptr;
+        }
+        return decoder;
+    }
+
+    std::shared_ptr<IAudioSink> createAudioSink() override { return std::make_shared<OboeAudioSink>(); }
+
+    std::shared_ptr<MediaIoCounters> getIoCounters() override { return mIoCounters; }
+
+    std::shared_ptr<CIndexCache> getIndexCache() override { return mIndexCache; }
+
+   private:
+    int64_t mReadAhead;
+    std::shared_ptr<MediaIoCounters> mIoCounters{std::make_shared<MediaIoCounters>()};
+    std::shared_ptr<CIndexCache> mIndexCache;
+};
+}  // namespace
+
+std::shared_ptr<IMediaBackend> CreateMediaBackend_Ndk(const Options& options) { return std::make_shared<NdkMediaBackend>(options); }
+
+#endif
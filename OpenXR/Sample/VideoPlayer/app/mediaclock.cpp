@@ -0,0 +1,112 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Media clock mapping the content timeline onto CLOCK_MONOTONIC.
+
+#include "pch.h"
+#include "mediaclock.h"
+#include <chrono>
+
+CMediaClock::CMediaClock() : mStarted(false), mPaused(false), mRate(1.0), mAnchorMedia(0), mAnchorSystem(0) {
+}
+
+// steady_clock is CLOCK_MONOTONIC on Android and Linux, the clock XrTime converts to.
+// (GetTimeNanoseconds() in utils/nanoseconds.h is rebased to its first call, and uses
+// gettimeofday on Linux, so it can't be compared with XR display times.)
+int64_t CMediaClock::monotonicNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CMediaClock::start(int64_t mediaTime) {
+    std::lock_guard<std::mutex> guard(mMutex);
+    mAnchorMedia = mediaTime;
+    mAnchorSystem = monotonicNow();
+    mStarted = true;
+}
+
+bool CMediaClock::isStarted() const {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mStarted;
+}
+
+void CMediaClock::reset() {
+    std::lock_guard<std::mutex> guard(mMutex);
+    mStarted = false;
+    mPaused = false;
+    mRate = 1.0;
+    mAnchorMedia = 0;
+    mAnchorSystem = 0;
+}
+
+void CMediaClock::pause() {
+    std::lock_guard<std::mutex> guard(mMutex);
+    if (mPaused) {
+        return;
+    }
+    const int64_t now = monotonicNow();
+    mAnchorMedia = mediaTimeLocked(now);
+    mAnchorSystem = now;
+    mPaused = true;
+}
+
+void CMediaClock::resume() {
+    std::lock_guard<std::mutex> guard(mMutex);
+    if (!mPaused) {
+        return;
+    }
+    mAnchorSystem = monotonicNow();
+    mPaused = false;
+}
+
+bool CMediaClock::isPaused() const {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mPaused;
+}
+
+void CMediaClock::setRate(double rate) {
+    if (rate <= 0.0) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(mMutex);
+    const int64_t now = monotonicNow();
+    mAnchorMedia = mediaTimeLocked(now);
+    mAnchorSystem = now;
+    mRate = rate;
+}
+
+double CMediaClock::getRate() const {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mRate;
+}
+
+void CMediaClock::seek(int64_t mediaTime) {
+    std::lock_guard<std::mutex> guard(mMutex);
+    mAnchorMedia = mediaTime;
+    mAnchorSystem = monotonicNow();
+}
+
+int64_t CMediaClock::getMediaTime(int64_t systemTime) const {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mediaTimeLocked(systemTime);
+}
+
+int64_t CMediaClock::syncToAudio(int64_t mediaTime, int64_t systemTime) {
+    std::lock_guard<std::mutex> guard(mMutex);
+    if (!mStarted || mPaused) {
+        return 0;
+    }
+    const int64_t drift = mediaTime - mediaTimeLocked(systemTime);
+    if (llabs(drift) > kResyncThreshold) {
+        mAnchorMedia = mediaTime;
+        mAnchorSystem = systemTime;
+    } else {
+        mAnchorMedia += drift / kSlewDivisor;
+    }
+    return drift;
+}
+
+int64_t CMediaClock::mediaTimeLocked(int64_t systemTime) const {
+    if (!mStarted || mPaused) {
+        return mAnchorMedia;
+    }
+    return mAnchorMedia + (int64_t)((systemTime - mAnchorSystem) * mRate);
+}
@@ -0,0 +1,63 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Media clock mapping the content timeline onto CLOCK_MONOTONIC.
+
+#pragma once
+#include <stdint.h>
+#include <mutex>
+
+// All times are nanoseconds. "Media time" is the position on the content timeline
+// (frame/sample timestamps), "system time" is CLOCK_MONOTONIC. The clock free-runs from
+// its last anchor at the current rate and, while audio plays, is slaved to the position
+// the audio device reports so video follows what is actually heard.
+class CMediaClock {
+
+public:
+    CMediaClock();
+
+    static int64_t monotonicNow();
+
+    // Starts (or restarts) running with mediaTime presented now.
+    void start(int64_t mediaTime);
+
+    bool isStarted() const;
+
+    // Back to the initial stopped state at media time 0, rate 1.
+    void reset();
+
+    void pause();
+
+    void resume();
+
+    bool isPaused() const;
+
+    void setRate(double rate);
+
+    double getRate() const;
+
+    // Jumps to mediaTime, keeping the running/paused state.
+    void seek(int64_t mediaTime);
+
+    // Media time that is presented at systemTime.
+    int64_t getMediaTime(int64_t systemTime) const;
+
+    // Audio master update: the sample with timestamp mediaTime is presented at systemTime.
+    // Small drift is slewed out to avoid visible jumps; large drift re-anchors the clock.
+    // Returns the drift (audio minus clock) before correction.
+    int64_t syncToAudio(int64_t mediaTime, int64_t systemTime);
+
+private:
+    int64_t mediaTimeLocked(int64_t systemTime) const;
+
+public:
+    static constexpr int64_t kResyncThreshold = 40 * 1000 * 1000;  // beyond this, jump instead of slewing
+    static constexpr int64_t kSlewDivisor = 8;                      // fraction of small drift removed per update
+
+private:
+    mutable std::mutex mMutex;
+    bool             mStarted;
+    bool             mPaused;
+    double           mRate;
+    int64_t          mAnchorMedia;
+    int64_t          mAnchorSystem;
+};
@@ -0,0 +1,48 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Random-access byte source behind the demuxers: a local file or an HTTP URL.
+
+#include "pch.h"
+#include "common.h"
+#include "mediafile.h"
+#include "mappedfile.h"
+#include "httpfile.h"
+
+bool IsRemoteMediaPath(const char* path) {
+    return strncasecmp(path, "http://", 7) == 0 || strncasecmp(path, "https://", 8) == 0;
+}
+
+std::unique_ptr<IMediaFile> OpenMediaFile(const char* path, int64_t readAhead, std::shared_ptr<MediaIoCounters> counters) {
+    if (IsRemoteMediaPath(path)) {
+        std::unique_ptr<CHttpFile> file(new CHttpFile());
+        if (!file->open(path, readAhead, std::move(counters))) {
+            return nullptr;
+        }
+        return file;
+    }
+    std::unique_ptr<CMappedFile> file(new CMappedFile());
+    if (!file->open(path, readAhead, std::move(counters))) {
+        return nullptr;
+    }
+    return file;
+}
+
+bool ReadMediaFile(const char* path, std::shared_ptr<MediaIoCounters> counters, std::vector<uint8_t>& data) {
+    // Reading in block-sized pieces with the whole file as read-ahead lets the HTTP workers
+    // fetch the rest in parallel while the first pieces are copied.
+    constexpr int64_t kWholeFileReadAhead = 256 << 20;
+    constexpr size_t kPieceSize = 256 * 1024;
+    std::unique_ptr<IMediaFile> file = OpenMediaFile(path, kWholeFileReadAhead, std::move(counters));
+    if (file == nullptr) {
+        return false;
+    }
+    data.resize((size_t)file->size());
+    for (size_t offset = 0; offset < data.size(); offset += kPieceSize) {
+        const size_t size = std::min(kPieceSize, data.size() - offset);
+        if (file->readAt(offset, data.data() + offset, size) != (ssize_t)size) {
+            Log::Write(Log::Level::Error, Fmt("read %s error at %lld", path, (long long)offset));
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Random-access byte source behind the demuxers: a local file or an HTTP URL.
+
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Shared by every file a backend opens, so totals survive source swaps.
+typedef struct MediaIoCounters_tag {
+    std::atomic<uint64_t> bytesRead{0};
+    std::atomic<uint64_t> reads{0};
+    std::atomic<uint64_t> stalls{0};    // reads that had to wait for storage or the network
+    std::atomic<int64_t>  stallNs{0};   // time spent in those reads
+    std::atomic<uint64_t> fetchedBytes{0};  // remote files: bytes downloaded, including read-ahead
+    std::atomic<uint64_t> requests{0};      // remote files: range requests issued
+}MediaIoCounters;
+
+struct IMediaFile {
+    virtual ~IMediaFile() = default;
+
+    virtual int64_t size() const = 0;
+
+    // Returns the bytes copied (short at the end of the file), or -1 for an offset past the end or an I/O error.
+    virtual ssize_t readAt(int64_t offset, void* buffer, size_t size) = 0;
+
+    // Pointer to the range in memory, valid for the life of the file, for implementations that
+    // keep the whole file mapped. nullptr means the caller has to use readAt().
+    virtual const uint8_t* map(int64_t offset, size_t size) { return nullptr; }
+};
+
+// Opens a local path, or an http:// URL. readAhead is how far ahead of the reader data is
+// prefetched (0 = no read-ahead).
+std::unique_ptr<IMediaFile> OpenMediaFile(const char* path, int64_t readAhead, std::shared_ptr<MediaIoCounters> counters);
+
+// Reads a whole (small) file or URL, such as a manifest or a media segment. Remote files are
+// fetched over every connection at once.
+bool ReadMediaFile(const char* path, std::shared_ptr<MediaIoCounters> counters, std::vector<uint8_t>& data);
+
+bool IsRemoteMediaPath(const char* path);
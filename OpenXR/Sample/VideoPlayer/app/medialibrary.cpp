@@ -0,0 +1,515 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Media library: a directory tree of videos scanned once into a memory-mapped metadata index.
+
+#include "pch.h"
+#include "common.h"
+#include "options.h"
+#include "medialibrary.h"
+#include "cachefile.h"
+#include "mediaclock.h"
+#include "common/filesystem_utils.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr uint32_t kLibraryMagic = 0x42494c58;  // "XLIB"
+
+typedef struct LibraryHeader_tag {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordCount;
+    uint32_t rootLength;
+    uint64_t stringsSize;
+}LibraryHeader;
+
+constexpr uint8_t kRecordPlayable = 1;
+constexpr uint8_t kRecordHasAudio = 2;
+
+constexpr const char* kMediaExtensions[] = {".mp4", ".m4v", ".mov", ".mkv", ".webm", ".3gp", ".ts", ".y4m"};
+
+size_t AlignUp(size_t value) { return (value + 7) & ~(size_t)7; }
+
+bool HasMediaExtension(const std::string& name) {
+    const size_t dot = name.rfind('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    const std::string extension = name.substr(dot);
+    for (const char* known : kMediaExtensions) {
+        if (EqualsIgnoreCase(extension, known)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef struct ScannedFile_tag {
+    std::string path;
+    int64_t fileSize;
+    int64_t mtimeNs;
+    int32_t previous;   // record in the old index, -1 when new
+}ScannedFile;
+
+// Depth-first over the tree. Hidden entries (".", "..", ".thumbnails"...) are skipped.
+void ListMediaFiles(const std::string& directory, int32_t depth, std::vector<ScannedFile>& files, LibraryScanStats& stats) {
+    std::vector<std::string> names;
+    if (depth > CMediaLibrary::kMaxDepth || !FileSysUtilsFindFilesInPath(directory, names)) {
+        return;
+    }
+    stats.directories++;
+    for (const std::string& name : names) {
+        if (name.empty() || name[0] == '.') {
+            continue;
+        }
+        std::string path;
+        FileSysUtilsCombinePaths(directory, name, path);
+        struct stat statbuff;
+        if (stat(path.c_str(), &statbuff) != 0) {
+            continue;
+        }
+        if (S_ISDIR(statbuff.st_mode)) {
+            ListMediaFiles(path, depth + 1, files, stats);
+        } else if (S_ISREG(statbuff.st_mode) && HasMediaExtension(name)) {
+            ScannedFile file;
+            file.path = std::move(path);
+            file.fileSize = statbuff.st_size;
+            file.mtimeNs = (int64_t)statbuff.st_mtim.tv_sec * 1000000000 + statbuff.st_mtim.tv_nsec;
+            file.previous = -1;
+            files.push_back(std::move(file));
+        }
+    }
+}
+
+void ProbeMediaFile(IMediaBackend& backend, LibraryEntry& entry) {
+    std::shared_ptr<IMediaSource> source = backend.createSegmentSource();
+    if (source == nullptr || !source->open(entry.path.c_str())) {
+        return;
+    }
+    for (size_t i = 0; i < source->getTrackCount(); i++) {
+        MediaTrackInfo info;
+        if (!source->getTrackInfo(i, info)) {
+            continue;
+        }
+        if (info.type == mediaTypeVideo && !entry.playable) {
+            entry.playable = true;
+            entry.width = info.width;
+            entry.height = info.height;
+            entry.mime = info.mime;
+            entry.durationUs = std::max(entry.durationUs, info.durationUs);
+        } else if (info.type == mediaTypeAudio) {
+            entry.hasAudio = true;
+            entry.durationUs = std::max(entry.durationUs, info.durationUs);
+        }
+    }
+    entry.layout = entry.playable ? GuessStereoLayout(entry.path, entry.width, entry.height) : stereoLayoutUnknown;
+}
+
+// Lower-cased alphanumeric runs of the file name, without the extension.
+std::vector<std::string> NameTokens(const std::string& path) {
+    const size_t slash = path.rfind('/');
+    std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    const size_t dot = name.rfind('.');
+    if (dot != std::string::npos) {
+        name.resize(dot);
+    }
+    std::vector<std::string> tokens(1);
+    for (char c : name) {
+        if (isalnum((unsigned char)c)) {
+            tokens.back() += (char)tolower((unsigned char)c);
+        } else if (!tokens.back().empty()) {
+            tokens.emplace_back();
+        }
+    }
+    return tokens;
+}
+}  // namespace
+
+struct CMediaLibrary::Record {
+    uint32_t pathOffset;    // into the string table
+    uint32_t pathLength;
+    int64_t  fileSize;
+    int64_t  mtimeNs;
+    int64_t  durationUs;
+    int32_t  width;
+    int32_t  height;
+    uint32_t mimeOffset;
+    uint16_t mimeLength;
+    uint8_t  layout;
+    uint8_t  flags;
+};
+
+const char* GetStereoLayoutVideoMode(StereoLayout layout) {
+    switch (layout) {
+        case stereoLayout2D:
+            return "2D";
+        case stereoLayoutSideBySide:
+            return "3D-SBS";
+        case stereoLayoutOverUnder:
+            return "3D-OU";
+        case stereoLayout360:
+            return "360";
+        default:
+            return nullptr;
+    }
+}
+
+StereoLayout GuessStereoLayout(const std::string& path, int32_t width, int32_t height) {
+    for (const std::string& token : NameTokens(path)) {
+        if (token == "sbs" || token == "lr" || token == "hsbs" || token == "fsbs" || token == "3dh") {
+            return stereoLayoutSideBySide;
+        } else if (token == "ou" || token == "tb" || token == "tab" || token == "hou" || token == "fou" || token == "3dv") {
+            return stereoLayoutOverUnder;
+        } else if (token == "360" || token == "vr360" || token == "equirect") {
+            return stereoLayout360;
+        }
+    }
+    if (width <= 0 || height <= 0) {
+        return stereoLayoutUnknown;
+    }
+    const double aspect = (double)width / height;
+    if (aspect >= 3.2) {
+        return stereoLayoutSideBySide;
+    } else if (aspect > 1.98 && aspect < 2.02) {
+        return stereoLayout360;
+    } else if (aspect > 0.8 && aspect < 0.95) {
+        return stereoLayoutOverUnder;
+    }
+    return stereoLayout2D;
+}
+
+std::string GetLibraryIndexPath(const std::string& directory, const std::string& root) {
+    if (directory.empty()) {
+        return std::string();
+    }
+    // The root is also stored in the header.
+    return Fmt("%s/%016llx.library", directory.c_str(), (unsigned long long)HashCacheKey(root));
+}
+
+CMediaLibrary::CMediaLibrary(std::string indexPath) : mIndexPath(std::move(indexPath)) {
+}
+
+CMediaLibrary::~CMediaLibrary() {
+    unmap();
+}
+
+void CMediaLibrary::unmap() {
+    if (mMap) {
+        munmap(mMap, mMapSize);
+        mMap = nullptr;
+        mMapSize = 0;
+    }
+    mData = nullptr;
+    mDataSize = 0;
+    mRecordCount = 0;
+}
+
+bool CMediaLibrary::load(const std::string& root) {
+    unmap();
+    if (mIndexPath.empty()) {
+        return false;
+    }
+    int fd = ::open(mIndexPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat statbuff;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &statbuff) == 0 && statbuff.st_size >= (off_t)sizeof(LibraryHeader)) {
+        map = mmap(nullptr, statbuff.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    mMap = map;
+    mMapSize = statbuff.st_size;
+    mData = (const uint8_t*)map;
+    mDataSize = mMapSize;
+    if (!attach(root)) {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+bool CMediaLibrary::attach(const std::string& root) {
+    LibraryHeader header;
+    memcpy(&header, mData, sizeof(header));
+    const size_t recordsOffset = AlignUp(sizeof(header) + header.rootLength);
+    const size_t stringsOffset = recordsOffset + (size_t)header.recordCount * sizeof(Record);
+    if (header.magic != kLibraryMagic || header.version != kFormatVersion || header.rootLength != root.size() ||
+        stringsOffset > mDataSize || header.stringsSize != mDataSize - stringsOffset ||
+        memcmp(mData + sizeof(header), root.data(), root.size()) != 0) {
+        return false;
+    }
+    mRecordCount = header.recordCount;
+    mRecordsOffset = recordsOffset;
+    mStringsOffset = stringsOffset;
+    return true;
+}
+
+const CMediaLibrary::Record* CMediaLibrary::record(size_t index) const {
+    return (const Record*)(mData + mRecordsOffset) + index;
+}
+
+std::string CMediaLibrary::recordPath(const Record& record) const {
+    return std::string((const char*)mData + mStringsOffset + record.pathOffset, record.pathLength);
+}
+
+bool CMediaLibrary::getEntry(size_t index, LibraryEntry& entry) const {
+    if (index >= mRecordCount) {
+        return false;
+    }
+    const Record& r = *record(index);
+    const size_t stringsSize = mDataSize - mStringsOffset;
+    if ((size_t)r.pathOffset + r.pathLength > stringsSize || (size_t)r.mimeOffset + r.mimeLength > stringsSize) {
+        return false;
+    }
+    entry.path = recordPath(r);
+    entry.mime.assign((const char*)mData + mStringsOffset + r.mimeOffset, r.mimeLength);
+    entry.fileSize = r.fileSize;
+    entry.mtimeNs = r.mtimeNs;
+    entry.durationUs = r.durationUs;
+    entry.width = r.width;
+    entry.height = r.height;
+    entry.layout = (StereoLayout)r.layout;
+    entry.playable = (r.flags & kRecordPlayable) != 0;
+    entry.hasAudio = (r.flags & kRecordHasAudio) != 0;
+    return true;
+}
+
+int32_t CMediaLibrary::find(const std::string& path) const {
+    const size_t stringsSize = mDataSize - mStringsOffset;
+    size_t low = 0;
+    size_t high = mRecordCount;
+    while (low < high) {
+        const size_t mid = (low + high) / 2;
+        const Record& r = *record(mid);
+        if ((size_t)r.pathOffset + r.pathLength > stringsSize) {
+            return -1;  // a damaged index: nothing in it can be trusted to be in order either
+        }
+        const int32_t order = path.compare(0, std::string::npos, (const char*)mData + mStringsOffset + r.pathOffset, r.pathLength);
+        if (order == 0) {
+            return (int32_t)mid;
+        } else if (order < 0) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return -1;
+}
+
+bool CMediaLibrary::scan(const std::string& root, IMediaBackend& backend, LibraryScanStats* stats) {
+    const int64_t startNs = CMediaClock::monotonicNow();
+    LibraryScanStats scanStats;
+    if (!FileSysUtilsIsDirectory(root)) {
+        Log::Write(Log::Level::Error, Fmt("library: %s is not a directory", root.c_str()));
+        return false;
+    }
+    if (mData == nullptr || !attach(root)) {
+        load(root);
+    }
+
+    std::vector<ScannedFile> files;
+    ListMediaFiles(root, 0, files, scanStats);
+    std::sort(files.begin(), files.end(), [](const ScannedFile& a, const ScannedFile& b) { return a.path < b.path; });
+    scanStats.files = (uint32_t)files.size();
+
+    // Unchanged files keep their record; the rest are probed.
+    std::vector<LibraryEntry> entries(files.size());
+    std::vector<size_t> toProbe;
+    size_t stillPresent = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        ScannedFile& file = files[i];
+        file.previous = find(file.path);
+        stillPresent += (file.previous >= 0) ? 1 : 0;
+        if (file.previous >= 0 && record(file.previous)->fileSize == file.fileSize && record(file.previous)->mtimeNs == file.mtimeNs &&
+            getEntry(file.previous, entries[i])) {
+            continue;
+        }
+        entries[i].path = file.path;
+        entries[i].fileSize = file.fileSize;
+        entries[i].mtimeNs = file.mtimeNs;
+        toProbe.push_back(i);
+    }
+    scanStats.removed = (uint32_t)(mRecordCount - stillPresent);
+    scanStats.probed = (uint32_t)toProbe.size();
+
+    std::atomic<size_t> next{0};
+    auto probe = [&]() {
+        for (size_t i = next++; i < toProbe.size(); i = next++) {
+            ProbeMediaFile(backend, entries[toProbe[i]]);
+        }
+    };
+    std::vector<std::thread> probers;
+    for (int32_t i = 1; i < kProbeThreads && (size_t)i < toProbe.size(); i++) {
+        probers.emplace_back(probe);
+    }
+    probe();
+    for (std::thread& prober : probers) {
+        prober.join();
+    }
+    for (size_t i : toProbe) {
+        scanStats.failed += entries[i].playable ? 0 : 1;
+    }
+
+    const bool changed = !toProbe.empty() || scanStats.removed > 0 || mData == nullptr;
+    bool stored = true;
+    if (changed) {
+        // Serialize: header, root, records, then the strings (mime types shared between records).
+        std::vector<Record> records(entries.size());
+        std::string strings;
+        std::map<std::string, uint32_t> mimes;
+        for (size_t i = 0; i < entries.size(); i++) {
+            const LibraryEntry& entry = entries[i];
+            Record& r = records[i];
+            memset(&r, 0, sizeof(r));
+            r.pathOffset = (uint32_t)strings.size();
+            r.pathLength = (uint32_t)entry.path.size();
+            strings += entry.path;
+            auto mime = mimes.find(entry.mime);
+            if (mime == mimes.end()) {
+                mime = mimes.emplace(entry.mime, (uint32_t)strings.size()).first;
+                strings += entry.mime;
+            }
+            r.mimeOffset = mime->second;
+            r.mimeLength = (uint16_t)entry.mime.size();
+            r.fileSize = entry.fileSize;
+            r.mtimeNs = entry.mtimeNs;
+            r.durationUs = entry.durationUs;
+            r.width = entry.width;
+            r.height = entry.height;
+            r.layout = (uint8_t)entry.layout;
+            r.flags = (entry.playable ? kRecordPlayable : 0) | (entry.hasAudio ? kRecordHasAudio : 0);
+        }
+        LibraryHeader header = {};
+        header.magic = kLibraryMagic;
+        header.version = kFormatVersion;
+        header.recordCount = (uint32_t)records.size();
+        header.rootLength = (uint32_t)root.size();
+        header.stringsSize = strings.size();
+        std::vector<uint8_t> image(AlignUp(sizeof(header) + root.size()), 0);
+        memcpy(image.data(), &header, sizeof(header));
+        memcpy(image.data() + sizeof(header), root.data(), root.size());
+        image.insert(image.end(), (const uint8_t*)records.data(), (const uint8_t*)(records.data() + records.size()));
+        image.insert(image.end(), strings.begin(), strings.end());
+
+        unmap();
+        stored = false;
+        if (!mIndexPath.empty()) {
+            MakeCacheDirectories(mIndexPath.substr(0, mIndexPath.rfind('/')));
+            if (WriteCacheFile(mIndexPath, {&image})) {
+                stored = load(root);
+            } else {
+                Log::Write(Log::Level::Warning, Fmt("library: can't write %s", mIndexPath.c_str()));
+            }
+        }
+        if (!stored) {
+            // Keep serving this scan from memory.
+            mImage = std::move(image);
+            mData = mImage.data();
+            mDataSize = mImage.size();
+            attach(root);
+        }
+    }
+
+    scanStats.scanNs = CMediaClock::monotonicNow() - startNs;
+    Log::Write(Log::Level::Info, Fmt("library %s: %u files in %u directories, %u probed (%u unplayable), %u removed, %lld ms%s",
+                                     root.c_str(), scanStats.files, scanStats.directories, scanStats.probed, scanStats.failed,
+                                     scanStats.removed, (long long)(scanStats.scanNs / 1000000), changed ? "" : ", index unchanged"));
+    if (stats) {
+        *stats = scanStats;
+    }
+    return true;
+}
+
+bool SelectLibraryItem(Options& options) {
+    std::string path = options.VideoFileName;
+    StereoLayout layout = stereoLayoutUnknown;
+    if (FileSysUtilsIsDirectory(path)) {
+        std::shared_ptr<IMediaBackend> backend = CreateMediaBackend(options);
+        CMediaLibrary library(GetLibraryIndexPath(options.IndexCacheDir, path));
+        if (backend == nullptr || !library.scan(path, *backend)) {
+            return false;
+        }
+        const int64_t startNs = CMediaClock::monotonicNow();
+        uint32_t playable = 0;
+        LibraryEntry entry;
+        for (size_t i = 0; i < library.size(); i++) {
+            if (library.getEntry(i, entry) && entry.playable && playable++ == options.LibraryItem) {
+                break;
+            }
+            entry = LibraryEntry();
+        }
+        if (!entry.playable) {
+            Log::Write(Log::Level::Error, Fmt("library %s: no item %u, %u playable", path.c_str(), options.LibraryItem, playable));
+            return false;
+        }
+        Log::Write(Log::Level::Info, Fmt("library item %u: %s, %s %dx%d, %.1f s, %s, selected in %lld us", options.LibraryItem, entry.path.c_str(),
+                                         entry.mime.c_str(), entry.width, entry.height, entry.durationUs / 1e6,
+                                         GetStereoLayoutVideoMode(entry.layout) ? GetStereoLayoutVideoMode(entry.layout) : "unknown layout",
+                                         (long long)((CMediaClock::monotonicNow() - startNs) / 1000)));
+        path = entry.path;
+        layout = entry.layout;
+    } else if (options.VideoMode == "Auto") {
+        layout = GuessStereoLayout(path, 0, 0);
+    }
+    options.VideoFileName = path;
+    if (options.VideoMode == "Auto") {
+        const char* mode = GetStereoLayoutVideoMode(layout);
+        options.VideoMode = mode ? mode : "3D-SBS";
+    }
+    return true;
+}
+
+bool ReadPlaylist(const Options& options, std::vector<std::string>& items) {
+    items.clear();
+    const std::string& path = options.Playlist;
+    if (FileSysUtilsIsDirectory(path)) {
+        std::shared_ptr<IMediaBackend> backend = CreateMediaBackend(options);
+        CMediaLibrary library(GetLibraryIndexPath(options.IndexCacheDir, path));
+        if (backend == nullptr || !library.scan(path, *backend)) {
+            return false;
+        }
+        LibraryEntry entry;
+        for (size_t i = 0; i < library.size(); i++) {
+            if (library.getEntry(i, entry) && entry.playable) {
+                items.push_back(entry.path);
+            }
+        }
+    } else {
+        FILE* file = fopen(path.c_str(), "r");
+        if (file == nullptr) {
+            Log::Write(Log::Level::Error, Fmt("playlist %s: open error %d", path.c_str(), errno));
+            return false;
+        }
+        std::string parent;
+        FileSysUtilsGetParentPath(path, parent);
+        char line[4096];
+        while (fgets(line, sizeof(line), file)) {
+            std::string item(line);
+            item.erase(item.find_last_not_of(" \t\r\n") + 1);
+            item.erase(0, item.find_first_not_of(" \t"));
+            if (item.empty() || item[0] == '#') {
+                continue;
+            }
+            std::string combined;
+            if (!FileSysUtilsIsAbsolutePath(item) && item.find("://") == std::string::npos && FileSysUtilsCombinePaths(parent, item, combined)) {
+                item = combined;
+            }
+            items.push_back(item);
+        }
+        fclose(file);
+    }
+    if (items.empty()) {
+        Log::Write(Log::Level::Error, Fmt("playlist %s: no items", path.c_str()));
+        return false;
+    }
+    Log::Write(Log::Level::Info, Fmt("playlist %s: %d items", path.c_str(), (int32_t)items.size()));
+    return true;
+}
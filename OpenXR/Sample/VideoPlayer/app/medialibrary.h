@@ -0,0 +1,121 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Media library: a directory tree of videos scanned once into a memory-mapped metadata index.
+
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "mediabackend.h"
+
+typedef enum {
+    stereoLayoutUnknown = 0,
+    stereoLayout2D,
+    stereoLayoutSideBySide,
+    stereoLayoutOverUnder,
+    stereoLayout360
+}StereoLayout;
+
+// The VideoMode option value for a layout ("2D", "3D-SBS", "3D-OU", "360"); nullptr when unknown.
+const char* GetStereoLayoutVideoMode(StereoLayout layout);
+
+// From tags in the file name ("_SBS", ".LR.", "-TB", "360"...), then from the picture shape:
+// full-width side by side (>= 32:9), full-height over/under (about 16:18) or equirectangular (2:1).
+// Half-resolution 3D looks like any 2D picture, so without a tag it is reported as 2D.
+StereoLayout GuessStereoLayout(const std::string& path, int32_t width, int32_t height);
+
+typedef struct LibraryEntry_tag {
+    LibraryEntry_tag() : fileSize(0), mtimeNs(0), durationUs(0), width(0), height(0), layout(stereoLayoutUnknown), hasAudio(false), playable(false) {};
+    std::string path;
+    int64_t fileSize;
+    int64_t mtimeNs;
+    int64_t durationUs;
+    int32_t width;
+    int32_t height;
+    std::string mime;       // video track
+    StereoLayout layout;
+    bool hasAudio;
+    bool playable;          // the backend could open it and found a video track
+}LibraryEntry;
+
+typedef struct LibraryScanStats_tag {
+    LibraryScanStats_tag() : directories(0), files(0), probed(0), failed(0), removed(0), scanNs(0) {};
+    uint32_t directories;
+    uint32_t files;         // media files found
+    uint32_t probed;        // new or changed since the last scan; the rest came from the index
+    uint32_t failed;        // probed but not playable
+    uint32_t removed;       // in the index but gone from disk
+    int64_t scanNs;
+}LibraryScanStats;
+
+// The index is one file: a header, fixed-size records sorted by path, then a string table. It is
+// mapped read-only and records are read in place, so opening a library of any size costs one
+// mmap and looking an entry up is a binary search. A scan lists the tree with
+// FileSysUtilsFindFilesInPath and stats every media file, but only probes files whose size or
+// mtime differ from their record, on kProbeThreads sources at a time; unplayable files keep a
+// record too, so they are not probed again until they change. Without an index path the index
+// is only kept in memory.
+class CMediaLibrary {
+
+public:
+    explicit CMediaLibrary(std::string indexPath);
+
+    ~CMediaLibrary();
+
+    CMediaLibrary(const CMediaLibrary&) = delete;
+    CMediaLibrary& operator=(const CMediaLibrary&) = delete;
+
+    // Maps the index written by the last scan of root. False if there is none, it is from
+    // another root or another format version.
+    bool load(const std::string& root);
+
+    // Rescans root, rewrites the index if anything changed and maps it.
+    bool scan(const std::string& root, IMediaBackend& backend, LibraryScanStats* stats = nullptr);
+
+    size_t size() const { return mRecordCount; }
+
+    // Entries are ordered by path.
+    bool getEntry(size_t index, LibraryEntry& entry) const;
+
+    // Index of the entry for path, or -1.
+    int32_t find(const std::string& path) const;
+
+    static constexpr uint32_t kFormatVersion = 1;
+    static constexpr int32_t  kProbeThreads = 4;
+    static constexpr int32_t  kMaxDepth = 16;   // guards against symlink loops
+
+private:
+    struct Record;
+
+    const Record* record(size_t index) const;
+
+    std::string recordPath(const Record& record) const;
+
+    // Checks the header of the image at mData and takes the record and string table bounds from it.
+    bool attach(const std::string& root);
+
+    void unmap();
+
+    std::string mIndexPath;
+    void*       mMap = nullptr;
+    size_t      mMapSize = 0;
+    std::vector<uint8_t> mImage;         // the index built by the last scan, when it is not kept on disk
+    const uint8_t* mData = nullptr;      // mMap or mImage
+    size_t      mDataSize = 0;
+    size_t      mRecordCount = 0;
+    size_t      mRecordsOffset = 0;
+    size_t      mStringsOffset = 0;
+};
+
+// Index file for the library at root inside directory, or "" when directory is empty.
+std::string GetLibraryIndexPath(const std::string& directory, const std::string& root);
+
+// When options.VideoFileName names a directory, scans it as a library and replaces VideoFileName
+// with its LibraryItem-th playable entry. A VideoMode of "Auto" is then resolved from the entry,
+// or from the file name when VideoFileName is not a directory, falling back to "3D-SBS".
+bool SelectLibraryItem(struct Options& options);
+
+// Items of options.Playlist: every playable entry of a library directory in path order, or the lines
+// of a text file (M3U), skipping blank lines and "#" comments. Relative paths in a file are taken
+// from its directory.
+bool ReadPlaylist(const struct Options& options, std::vector<std::string>& items);
@@ -0,0 +1,907 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// ISO-BMFF (MP4 / MOV) demuxer serving samples from a mapped (or remote) file.
+
+#include "pch.h"
+#include "common.h"
+#include "mp4demuxer.h"
+#include "mediaclock.h"
+
+namespace {
+
+constexpr uint32_t BoxType(const char (&name)[5]) {
+    return ((uint32_t)(uint8_t)name[0] << 24) | ((uint32_t)(uint8_t)name[1] << 16) | ((uint32_t)(uint8_t)name[2] << 8) | (uint8_t)name[3];
+}
+
+inline uint16_t Read16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+
+inline uint32_t Read32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+
+inline uint64_t Read64(const uint8_t* p) { return ((uint64_t)Read32(p) << 32) | Read32(p + 4); }
+
+// Walks the boxes laid out back to back in a buffer. next() fails at the end or on a box that
+// overruns the buffer.
+struct BoxReader {
+    BoxReader(const uint8_t* data, size_t size) : pos(data), end(data + size) {}
+
+    bool next(uint32_t& type, const uint8_t*& body, size_t& bodySize) {
+        if (end - pos < 8) {
+            return false;
+        }
+        uint64_t boxSize = Read32(pos);
+        size_t headerSize = 8;
+        type = Read32(pos + 4);
+        if (boxSize == 1) {
+            if (end - pos < 16) {
+                return false;
+            }
+            boxSize = Read64(pos + 8);
+            headerSize = 16;
+        } else if (boxSize == 0) {
+            boxSize = end - pos;
+        }
+        if (boxSize < headerSize || boxSize > (uint64_t)(end - pos)) {
+            return false;
+        }
+        body = pos + headerSize;
+        bodySize = boxSize - headerSize;
+        pos += boxSize;
+        return true;
+    }
+
+    const uint8_t* pos;
+    const uint8_t* end;
+};
+
+bool FindBox(const uint8_t* data, size_t size, uint32_t wanted, const uint8_t*& body, size_t& bodySize) {
+    BoxReader reader(data, size);
+    uint32_t type = 0;
+    while (reader.next(type, body, bodySize)) {
+        if (type == wanted) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Appends a counted list of 16-bit length prefixed NAL units (avcC / hvcC parameter sets) with
+// Annex-B start codes; pos ends past the list, or at size if it is truncated.
+void AppendParameterSets(const uint8_t* data, size_t size, size_t& pos, uint32_t count, std::vector<uint8_t>& out) {
+    static const uint8_t kStartCode[4] = {0, 0, 0, 1};
+    for (uint32_t i = 0; i < count; i++) {
+        if (pos + 2 > size || pos + 2 + Read16(data + pos) > size) {
+            pos = size;
+            return;
+        }
+        const size_t length = Read16(data + pos);
+        out.insert(out.end(), kStartCode, kStartCode + sizeof(kStartCode));
+        out.insert(out.end(), data + pos + 2, data + pos + 2 + length);
+        pos += 2 + length;
+    }
+}
+
+// value * 1000000 / timescale without overflowing for long files at high timescales.
+inline int64_t ToMicroseconds(int64_t value, uint32_t timescale) {
+    return value / timescale * 1000000 + value % timescale * 1000000 / timescale;
+}
+}  // namespace
+
+CMp4Demuxer::CMp4Demuxer(int64_t readAhead, std::shared_ptr<MediaIoCounters> ioCounters, std::shared_ptr<CIndexCache> indexCache)
+    : mReadAhead(readAhead), mIoCounters(std::move(ioCounters)), mIndexCache(std::move(indexCache)) {
+}
+
+bool CMp4Demuxer::probe(const char* source) {
+    std::unique_ptr<IMediaFile> file = OpenMediaFile(source, 0, nullptr);
+    uint8_t header[8];
+    if (file == nullptr || file->readAt(0, header, sizeof(header)) != sizeof(header)) {
+        return false;
+    }
+    switch (Read32(header + 4)) {
+        case BoxType("ftyp"):
+        case BoxType("moov"):
+        case BoxType("mdat"):
+        case BoxType("free"):
+        case BoxType("skip"):
+        case BoxType("wide"):
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool CMp4Demuxer::open(const char* source) {
+    const int64_t startNs = CMediaClock::monotonicNow();
+    mTracks.clear();
+    mIndexEntry.reset();
+    mFile = OpenMediaFile(source, mReadAhead, mIoCounters);
+    if (mFile == nullptr) {
+        return false;
+    }
+    if (loadIndex(source)) {
+        mIndexBuildNs = CMediaClock::monotonicNow() - startNs;
+        Log::Write(Log::Level::Info, Fmt("mp4 demuxer: %s, %d tracks, index loaded from cache in %lld us", source, (int32_t)mTracks.size(),
+                                         (long long)(mIndexBuildNs / 1000)));
+        return true;
+    }
+
+    // Only box headers are read until moov turns up; mdat is skipped, not scanned. A fragmented
+    // file is read on to the end for its moofs, still skipping every mdat.
+    std::vector<uint8_t> box;
+    const int64_t fileSize = mFile->size();
+    int64_t offset = 0;
+    bool haveMoov = false;
+    bool fragmented = false;
+    while (offset + 8 <= fileSize) {
+        uint8_t header[16];
+        const ssize_t got = mFile->readAt(offset, header, sizeof(header));
+        if (got < 8) {
+            break;  // a read error, or the file shrank under us
+        }
+        uint64_t boxSize = Read32(header);
+        int64_t headerSize = 8;
+        const uint32_t type = Read32(header + 4);
+        if (boxSize == 1) {
+            if (got < 16) {
+                break;
+            }
+            boxSize = Read64(header + 8);
+            headerSize = 16;
+        } else if (boxSize == 0) {
+            boxSize = fileSize - offset;
+        }
+        if (boxSize < (uint64_t)headerSize || boxSize > (uint64_t)(fileSize - offset)) {
+            break;
+        }
+        if (type == BoxType("moov") || (type == BoxType("moof") && fragmented)) {
+            box.resize(boxSize - headerSize);
+            if (mFile->readAt(offset + headerSize, box.data(), box.size()) != (ssize_t)box.size()) {
+                break;
+            }
+            if (type == BoxType("moov")) {
+                haveMoov = parseMoov(box.data(), box.size(), fragmented);
+                if (!haveMoov || !fragmented) {
+                    break;
+                }
+            } else if (!parseMoof(box.data(), box.size(), offset)) {
+                Log::Write(Log::Level::Warning, Fmt("mp4 demuxer: bad fragment at %lld in %s, ignoring the rest", (long long)offset, source));
+                break;
+            }
+        } else if (type == BoxType("moof")) {
+            Log::Write(Log::Level::Error, Fmt("mp4 demuxer: %s has a fragment before moov", source));
+            break;
+        }
+        offset += boxSize;
+    }
+    for (Track& track : mTracks) {
+        bindSamples(track);
+    }
+    if (!haveMoov) {
+        Log::Write(Log::Level::Error, Fmt("mp4 demuxer: no playable moov in %s", source));
+        mTracks.clear();
+        mFile.reset();
+        return false;
+    }
+
+    mIndexBuildNs = CMediaClock::monotonicNow() - startNs;
+    size_t samples = 0;
+    for (const Track& track : mTracks) {
+        samples += track.samples.count;
+    }
+    Log::Write(Log::Level::Info, Fmt("mp4 demuxer: %s, %d tracks, %d samples indexed in %lld us", source, (int32_t)mTracks.size(),
+                                     (int32_t)samples, (long long)(mIndexBuildNs / 1000)));
+    storeIndex(source);
+    return true;
+}
+
+bool CMp4Demuxer::loadIndex(const char* source) {
+    std::shared_ptr<CIndexCacheEntry> entry = mIndexCache ? mIndexCache->load(source, kIndexCacheKind) : nullptr;
+    if (entry == nullptr) {
+        return false;
+    }
+    CIndexReader reader(entry->data(), entry->size());
+    const uint32_t trackCount = reader.get<uint32_t>();
+    for (uint32_t i = 0; i < trackCount && !reader.failed(); i++) {
+        Track track;
+        track.info.type = (mediaType)reader.get<int32_t>();
+        track.info.mime = reader.getString();
+        track.info.width = reader.get<int32_t>();
+        track.info.height = reader.get<int32_t>();
+        track.info.durationUs = reader.get<int64_t>();
+        track.info.channelCount = reader.get<int32_t>();
+        track.info.sampleRate = reader.get<int32_t>();
+        track.info.maxInputSize = reader.get<int32_t>();
+        const std::string codecConfig = reader.getString();
+        track.info.codecConfig.assign(codecConfig.begin(), codecConfig.end());
+        track.timescale = reader.get<uint32_t>();
+        track.nalLengthSize = reader.get<int32_t>();
+        track.samples.count = (size_t)reader.get<uint64_t>();
+        track.samples.offsets = reader.getArray<int64_t>(track.samples.count);
+        track.samples.ptsUs = reader.getArray<int64_t>(track.samples.count);
+        track.samples.sizes = reader.getArray<uint32_t>(track.samples.count);
+        track.samples.sync = reader.getArray<uint8_t>(track.samples.count);
+        mTracks.push_back(std::move(track));
+    }
+    if (reader.failed() || mTracks.empty()) {
+        mTracks.clear();
+        return false;
+    }
+    mIndexEntry = std::move(entry);
+    return true;
+}
+
+void CMp4Demuxer::storeIndex(const char* source) {
+    if (mIndexCache == nullptr) {
+        return;
+    }
+    CIndexWriter writer;
+    writer.put<uint32_t>((uint32_t)mTracks.size());
+    for (const Track& track : mTracks) {
+        writer.put<int32_t>(track.info.type);
+        writer.putString(track.info.mime);
+        writer.put<int32_t>(track.info.width);
+        writer.put<int32_t>(track.info.height);
+        writer.put<int64_t>(track.info.durationUs);
+        writer.put<int32_t>(track.info.channelCount);
+        writer.put<int32_t>(track.info.sampleRate);
+        writer.put<int32_t>(track.info.maxInputSize);
+        writer.putString(std::string(track.info.codecConfig.begin(), track.info.codecConfig.end()));
+        writer.put<uint32_t>(track.timescale);
+        writer.put<int32_t>(track.nalLengthSize);
+        writer.put<uint64_t>(track.samples.count);
+        writer.putArray(track.samples.offsets, track.samples.count);
+        writer.putArray(track.samples.ptsUs, track.samples.count);
+        writer.putArray(track.samples.sizes, track.samples.count);
+        writer.putArray(track.samples.sync, track.samples.count);
+    }
+    mIndexCache->store(source, kIndexCacheKind, writer.payload());
+}
+
+bool CMp4Demuxer::parseMoov(const uint8_t* data, size_t size, bool& fragmented) {
+    BoxReader reader(data, size);
+    uint32_t type = 0;
+    const uint8_t* body = nullptr;
+    size_t bodySize = 0;
+    const uint8_t* mvex = nullptr;
+    size_t mvexSize = 0;
+    while (reader.next(type, body, bodySize)) {
+        if (type == BoxType("mvex")) {
+            mvex = body;
+            mvexSize = bodySize;
+        }
+        if (type != BoxType("trak")) {
+            continue;
+        }
+        Track track;
+        if (parseTrak(body, bodySize, track)) {
+            mTracks.push_back(std::move(track));
+        }
+    }
+    fragmented = mvex != nullptr;
+    BoxReader trexReader(mvex, mvexSize);
+    while (mvex && trexReader.next(type, body, bodySize)) {
+        // trex: version/flags, track_ID, default sample description index, duration, size, flags.
+        if (type != BoxType("trex") || bodySize < 24) {
+            continue;
+        }
+        for (Track& track : mTracks) {
+            if (track.trackId == Read32(body + 4)) {
+                track.defaults.duration = Read32(body + 12);
+                track.defaults.size = Read32(body + 16);
+                track.defaults.flags = Read32(body + 20);
+            }
+        }
+    }
+    if (!fragmented) {
+        // Only a fragmented file can have tracks whose samples all come later.
+        for (size_t i = mTracks.size(); i-- > 0;) {
+            if (mTracks[i].storage.offsets.empty()) {
+                mTracks.erase(mTracks.begin() + i);
+            }
+        }
+    }
+    return !mTracks.empty();
+}
+
+bool CMp4Demuxer::parseMoof(const uint8_t* data, size_t size, int64_t moofOffset) {
+    BoxReader reader(data, size);
+    uint32_t type = 0;
+    const uint8_t* body = nullptr;
+    size_t bodySize = 0;
+    while (reader.next(type, body, bodySize)) {
+        if (type == BoxType("traf") && !parseTraf(body, bodySize, moofOffset)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CMp4Demuxer::parseTraf(const uint8_t* data, size_t size, int64_t moofOffset) {
+    const uint8_t* tfhd = nullptr;
+    size_t tfhdSize = 0;
+    if (!FindBox(data, size, BoxType("tfhd"), tfhd, tfhdSize) || tfhdSize < 8) {
+        return false;
+    }
+    Track* track = nullptr;
+    for (Track& candidate : mTracks) {
+        if (candidate.trackId == Read32(tfhd + 4)) {
+            track = &candidate;
+        }
+    }
+    if (track == nullptr) {
+        return true;  // a track we don't play
+    }
+
+    // tfhd: optional fields follow track_ID in flag order.
+    const uint32_t tfhdFlags = Read32(tfhd) & 0xffffff;
+    FragmentDefaults defaults = track->defaults;
+    const size_t tfhdFieldsSize = 8 + 8 * !!(tfhdFlags & 0x000001) + 4 * (!!(tfhdFlags & 0x000002) + !!(tfhdFlags & 0x000008) +
+                                                                          !!(tfhdFlags & 0x000010) + !!(tfhdFlags & 0x000020));
+    if (tfhdFieldsSize > tfhdSize) {
+        return false;
+    }
+    int64_t baseOffset = moofOffset;
+    const uint8_t* field = tfhd + 8;
+    if (tfhdFlags & 0x000001) {
+        baseOffset = (int64_t)Read64(field);
+        field += 8;
+    }
+    if (tfhdFlags & 0x000002) {
+        field += 4;  // sample description index
+    }
+    if (tfhdFlags & 0x000008) {
+        defaults.duration = Read32(field);
+        field += 4;
+    }
+    if (tfhdFlags & 0x000010) {
+        defaults.size = Read32(field);
+        field += 4;
+    }
+    if (tfhdFlags & 0x000020) {
+        defaults.flags = Read32(field);
+    }
+
+    const uint8_t* tfdt = nullptr;
+    size_t tfdtSize = 0;
+    if (FindBox(data, size, BoxType("tfdt"), tfdt, tfdtSize) && tfdtSize >= 8) {
+        track->fragmentDts = (tfdt[0] == 1 && tfdtSize >= 12) ? (int64_t)Read64(tfdt + 4) : Read32(tfdt + 4);
+    }
+
+    const bool pcmChunks = track->info.mime == kMimeRawAudio;
+    SampleStorage& table = track->storage;
+    int64_t dataOffset = baseOffset;
+    BoxReader reader(data, size);
+    uint32_t type = 0;
+    const uint8_t* trun = nullptr;
+    size_t trunSize = 0;
+    while (reader.next(type, trun, trunSize)) {
+        if (type != BoxType("trun")) {
+            continue;
+        }
+        if (trunSize < 8) {
+            return false;
+        }
+        const uint32_t flags = Read32(trun) & 0xffffff;
+        const uint32_t count = Read32(trun + 4);
+        size_t pos = 8;
+        if (flags & 0x000001) {
+            if (pos + 4 > trunSize) {
+                return false;
+            }
+            dataOffset = baseOffset + (int32_t)Read32(trun + pos);
+            pos += 4;
+        }
+        uint32_t firstFlags = defaults.flags;
+        const bool hasFirstFlags = (flags & 0x000004) != 0;
+        if (hasFirstFlags) {
+            if (pos + 4 > trunSize) {
+                return false;
+            }
+            firstFlags = Read32(trun + pos);
+            pos += 4;
+        }
+        const size_t entrySize = 4 * (!!(flags & 0x000100) + !!(flags & 0x000200) + !!(flags & 0x000400) + !!(flags & 0x000800));
+        if (pos + (uint64_t)count * entrySize > trunSize) {
+            return false;
+        }
+        const int64_t runOffset = dataOffset;
+        int64_t runBytes = 0;
+        const int64_t runDts = track->fragmentDts;
+        // Each entry holds the fields its flags select, in this order.
+        auto entryField = [&](uint32_t flag, uint32_t fallback) {
+            if (!(flags & flag)) {
+                return fallback;
+            }
+            const uint32_t value = Read32(trun + pos);
+            pos += 4;
+            return value;
+        };
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t duration = entryField(0x000100, defaults.duration);
+            const uint32_t sampleSize = entryField(0x000200, defaults.size);
+            uint32_t sampleFlags = entryField(0x000400, defaults.flags);
+            const int64_t compositionOffset = (int32_t)entryField(0x000800, 0);
+            if (i == 0 && hasFirstFlags) {
+                sampleFlags = firstFlags;
+            }
+            if (!pcmChunks) {
+                table.offsets.push_back(dataOffset);
+                table.sizes.push_back(sampleSize);
+                table.ptsUs.push_back(ToMicroseconds(track->fragmentDts + compositionOffset, track->timescale));
+                // sample_is_non_sync_sample; audio samples are all sync points.
+                table.sync.push_back((track->info.type == mediaTypeAudio || !(sampleFlags & 0x10000)) ? 1 : 0);
+            }
+            dataOffset += sampleSize;
+            runBytes += sampleSize;
+            track->fragmentDts += duration;
+        }
+        if (pcmChunks && runBytes > 0) {
+            // As for chunks in stbl, a run of PCM frames is served as one sample.
+            table.offsets.push_back(runOffset);
+            table.sizes.push_back((uint32_t)runBytes);
+            table.ptsUs.push_back(ToMicroseconds(runDts, track->timescale));
+            table.sync.push_back(1);
+        }
+    }
+    const int64_t endUs = ToMicroseconds(track->fragmentDts, track->timescale);
+    track->info.durationUs = std::max(track->info.durationUs, endUs);
+    return true;
+}
+
+void CMp4Demuxer::bindSamples(Track& track) {
+    const SampleStorage& table = track.storage;
+    track.samples.offsets = table.offsets.data();
+    track.samples.sizes = table.sizes.data();
+    track.samples.ptsUs = table.ptsUs.data();
+    track.samples.sync = table.sync.data();
+    track.samples.count = table.offsets.size();
+    uint32_t maxSize = 0;
+    for (uint32_t size : table.sizes) {
+        maxSize = std::max(maxSize, size);
+    }
+    track.info.maxInputSize = (int32_t)(track.nalLengthSize > 0 && track.nalLengthSize < 4 ? maxSize * 2 : maxSize);
+}
+
+bool CMp4Demuxer::parseTrak(const uint8_t* data, size_t size, Track& track) {
+    const uint8_t* mdia = nullptr;
+    size_t mdiaSize = 0;
+    const uint8_t* body = nullptr;
+    size_t bodySize = 0;
+    if (!FindBox(data, size, BoxType("mdia"), mdia, mdiaSize)) {
+        return false;
+    }
+    if (FindBox(data, size, BoxType("tkhd"), body, bodySize) && bodySize >= 24) {
+        track.trackId = Read32(body + (body[0] == 1 ? 20 : 12));
+    }
+
+    if (!FindBox(mdia, mdiaSize, BoxType("hdlr"), body, bodySize) || bodySize < 12) {
+        return false;
+    }
+    const uint32_t handler = Read32(body + 8);
+    if (handler != BoxType("vide") && handler != BoxType("soun")) {
+        return false;
+    }
+    track.info.type = handler == BoxType("vide") ? mediaTypeVideo : mediaTypeAudio;
+
+    if (!FindBox(mdia, mdiaSize, BoxType("mdhd"), body, bodySize) || bodySize < 24) {
+        return false;
+    }
+    int64_t duration = 0;
+    if (body[0] == 1) {
+        if (bodySize < 36) {
+            return false;
+        }
+        track.timescale = Read32(body + 20);
+        duration = (int64_t)Read64(body + 24);
+    } else {
+        track.timescale = Read32(body + 12);
+        duration = Read32(body + 16);
+    }
+    if (track.timescale == 0) {
+        return false;
+    }
+    track.info.durationUs = ToMicroseconds(duration, track.timescale);
+
+    const uint8_t* minf = nullptr;
+    size_t minfSize = 0;
+    if (!FindBox(mdia, mdiaSize, BoxType("minf"), minf, minfSize) || !FindBox(minf, minfSize, BoxType("stbl"), body, bodySize)) {
+        return false;
+    }
+    return parseStbl(body, bodySize, track);
+}
+
+bool CMp4Demuxer::parseSampleEntry(const uint8_t* data, size_t size, Track& track) {
+    // stsd: version/flags, entry count, then the sample entries; only the first one is used.
+    uint32_t type = 0;
+    const uint8_t* entry = nullptr;
+    size_t entrySize = 0;
+    if (size < 8 || !BoxReader(data + 8, size - 8).next(type, entry, entrySize)) {
+        return false;
+    }
+    const uint8_t* child = nullptr;
+    size_t childSize = 0;
+    if (track.info.type == mediaTypeVideo) {
+        constexpr size_t kVisualEntrySize = 78;
+        if (entrySize < kVisualEntrySize) {
+            return false;
+        }
+        track.info.width = Read16(entry + 24);
+        track.info.height = Read16(entry + 26);
+        const uint8_t* children = entry + kVisualEntrySize;
+        const size_t childrenSize = entrySize - kVisualEntrySize;
+        switch (type) {
+            case BoxType("avc1"):
+            case BoxType("avc3"):
+                track.info.mime = "video/avc";
+                if (FindBox(children, childrenSize, BoxType("avcC"), child, childSize) && childSize > 5) {
+                    track.nalLengthSize = (child[4] & 3) + 1;
+                    // SPS count and list, then PPS count and list.
+                    size_t pos = 6;
+                    AppendParameterSets(child, childSize, pos, child[5] & 0x1f, track.info.codecConfig);
+                    if (pos < childSize) {
+                        const uint32_t ppsCount = child[pos++];
+                        AppendParameterSets(child, childSize, pos, ppsCount, track.info.codecConfig);
+                    }
+                }
+                break;
+            case BoxType("hvc1"):
+            case BoxType("hev1"):
+                track.info.mime = "video/hevc";
+                if (FindBox(children, childrenSize, BoxType("hvcC"), child, childSize) && childSize > 22) {
+                    track.nalLengthSize = (child[21] & 3) + 1;
+                    // Arrays of one NAL unit type each: type byte, then a counted list.
+                    size_t pos = 23;
+                    for (uint32_t array = 0; array < child[22] && pos + 3 <= childSize; array++) {
+                        const uint32_t count = Read16(child + pos + 1);
+                        pos += 3;
+                        AppendParameterSets(child, childSize, pos, count, track.info.codecConfig);
+                    }
+                }
+                break;
+            case BoxType("mp4v"): track.info.mime = "video/mp4v-es"; break;
+            case BoxType("I420"):
+            case BoxType("i420"): {
+                track.info.mime = kMimeRawVideo;
+                const int32_t size[2] = {track.info.width, track.info.height};
+                track.info.codecConfig.assign((const uint8_t*)size, (const uint8_t*)size + sizeof(size));
+                break;
+            }
+            default: break;
+        }
+    } else {
+        // QuickTime sound entries v1/v2 extend the ISO layout; v2 moves rate and channels.
+        if (entrySize < 28) {
+            return false;
+        }
+        const uint16_t version = Read16(entry + 8);
+        track.info.channelCount = Read16(entry + 16);
+        track.info.sampleRate = Read32(entry + 24) >> 16;
+        int32_t bitsPerSample = Read16(entry + 18);
+        if (version == 2 && entrySize >= 48) {
+            const uint64_t bits = Read64(entry + 32);
+            double rate = 0;
+            memcpy(&rate, &bits, sizeof(rate));
+            track.info.sampleRate = (int32_t)rate;
+            track.info.channelCount = Read32(entry + 40);
+            bitsPerSample = Read32(entry + 44);
+        }
+        switch (type) {
+            case BoxType("mp4a"): track.info.mime = "audio/mp4a-latm"; break;
+            case BoxType("Opus"): track.info.mime = "audio/opus"; break;
+            case BoxType("sowt"):
+                if (bitsPerSample == 16) {
+                    track.info.mime = kMimeRawAudio;
+                }
+                break;
+            default: break;
+        }
+    }
+    if (track.info.mime.empty()) {
+        Log::Write(Log::Level::Warning, Fmt("mp4 demuxer: skipping track with unsupported sample entry %c%c%c%c", (char)(type >> 24),
+                                            (char)(type >> 16), (char)(type >> 8), (char)type));
+        return false;
+    }
+    return true;
+}
+
+bool CMp4Demuxer::parseStbl(const uint8_t* data, size_t size, Track& track) {
+    const uint8_t* stsd = nullptr;
+    const uint8_t* stts = nullptr;
+    const uint8_t* ctts = nullptr;
+    const uint8_t* stsc = nullptr;
+    const uint8_t* stsz = nullptr;
+    const uint8_t* chunks = nullptr;
+    const uint8_t* stss = nullptr;
+    size_t stsdSize = 0, sttsSize = 0, cttsSize = 0, stscSize = 0, stszSize = 0, chunksSize = 0, stssSize = 0;
+    uint32_t stszType = 0;
+    uint32_t chunksType = 0;
+
+    BoxReader reader(data, size);
+    uint32_t type = 0;
+    const uint8_t* body = nullptr;
+    size_t bodySize = 0;
+    while (reader.next(type, body, bodySize)) {
+        switch (type) {
+            case BoxType("stsd"): stsd = body; stsdSize = bodySize; break;
+            case BoxType("stts"): stts = body; sttsSize = bodySize; break;
+            case BoxType("ctts"): ctts = body; cttsSize = bodySize; break;
+            case BoxType("stsc"): stsc = body; stscSize = bodySize; break;
+            case BoxType("stsz"):
+            case BoxType("stz2"): stsz = body; stszSize = bodySize; stszType = type; break;
+            case BoxType("stco"):
+            case BoxType("co64"): chunks = body; chunksSize = bodySize; chunksType = type; break;
+            case BoxType("stss"): stss = body; stssSize = bodySize; break;
+            default: break;
+        }
+    }
+    if (!stsd || !stts || !stsc || !stsz || !chunks || sttsSize < 8 || stscSize < 8 || stszSize < 12 || chunksSize < 8) {
+        return false;
+    }
+    if (!parseSampleEntry(stsd, stsdSize, track)) {
+        return false;
+    }
+
+    // Check every table against its box size once, so the walk below needs no bounds checks.
+    const uint32_t sampleCount = Read32(stsz + 8);
+    const uint32_t fixedSize = stszType == BoxType("stsz") ? Read32(stsz + 4) : 0;
+    const uint32_t fieldBits = stszType == BoxType("stz2") ? stsz[7] : 32;
+    if (fixedSize == 0 && (fieldBits != 4 && fieldBits != 8 && fieldBits != 16 && fieldBits != 32)) {
+        return false;
+    }
+    if (fixedSize == 0 && 12 + ((uint64_t)sampleCount * fieldBits + 7) / 8 > stszSize) {
+        return false;
+    }
+    const uint32_t chunkCount = Read32(chunks + 4);
+    const size_t chunkEntrySize = chunksType == BoxType("co64") ? 8 : 4;
+    const uint32_t stscCount = Read32(stsc + 4);
+    const uint32_t sttsCount = Read32(stts + 4);
+    const uint32_t cttsCount = cttsSize >= 8 ? Read32(ctts + 4) : 0;
+    const uint32_t stssCount = stssSize >= 8 ? Read32(stss + 4) : 0;
+    if (8 + (uint64_t)chunkCount * chunkEntrySize > chunksSize || 8 + (uint64_t)stscCount * 12 > stscSize ||
+        8 + (uint64_t)sttsCount * 8 > sttsSize || (ctts && 8 + (uint64_t)cttsCount * 8 > cttsSize) ||
+        (stss && 8 + (uint64_t)stssCount * 4 > stssSize)) {
+        return false;
+    }
+
+    // Uncompressed PCM stores one frame per "sample"; serve each chunk as one sample instead.
+    const bool pcmChunks = track.info.mime == kMimeRawAudio;
+    const int64_t bytesPerFrame = (int64_t)track.info.channelCount * (int64_t)sizeof(int16_t);
+    if (pcmChunks && bytesPerFrame <= 0) {
+        return false;
+    }
+    SampleStorage& table = track.storage;
+    if (!pcmChunks) {
+        table.offsets.reserve(sampleCount);
+        table.sizes.reserve(sampleCount);
+        table.ptsUs.reserve(sampleCount);
+        table.sync.reserve(sampleCount);
+    }
+
+    uint32_t sample = 0;
+    uint32_t stscIndex = 0;
+    uint32_t sttsIndex = 0, sttsLeft = sttsCount ? Read32(stts + 8) : 0;
+    uint32_t cttsIndex = 0, cttsLeft = cttsCount ? Read32(ctts + 8) : 0;
+    uint32_t stssIndex = 0;
+    int64_t dts = 0;
+    for (uint32_t chunk = 0; chunk < chunkCount && sample < sampleCount; chunk++) {
+        while (stscIndex + 1 < stscCount && Read32(stsc + 8 + (stscIndex + 1) * 12) <= chunk + 1) {
+            stscIndex++;
+        }
+        const uint32_t samplesInChunk = stscCount ? Read32(stsc + 8 + stscIndex * 12 + 4) : 0;
+        int64_t offset = chunkEntrySize == 8 ? (int64_t)Read64(chunks + 8 + chunk * 8) : Read32(chunks + 8 + chunk * 4);
+        for (uint32_t i = 0; i < samplesInChunk && sample < sampleCount; i++, sample++) {
+            uint32_t sampleSize = fixedSize;
+            if (fixedSize == 0) {
+                const uint8_t* field = stsz + 12;
+                switch (fieldBits) {
+                    case 4: sampleSize = (field[sample / 2] >> ((sample & 1) ? 0 : 4)) & 0xf; break;
+                    case 8: sampleSize = field[sample]; break;
+                    case 16: sampleSize = Read16(field + sample * 2); break;
+                    default: sampleSize = Read32(field + sample * 4); break;
+                }
+            }
+            int64_t compositionOffset = 0;
+            if (cttsIndex < cttsCount) {
+                compositionOffset = (int32_t)Read32(ctts + 8 + cttsIndex * 8 + 4);
+            }
+            bool sync = stss == nullptr;
+            if (stssIndex < stssCount && Read32(stss + 8 + stssIndex * 4) == sample + 1) {
+                sync = true;
+                stssIndex++;
+            }
+
+            if (!pcmChunks) {
+                table.offsets.push_back(offset);
+                table.sizes.push_back(sampleSize);
+                table.ptsUs.push_back(ToMicroseconds(dts + compositionOffset, track.timescale));
+                table.sync.push_back(sync ? 1 : 0);
+                offset += sampleSize;
+            } else if (i == 0) {
+                const int64_t chunkBytes = std::min<int64_t>(samplesInChunk, sampleCount - sample) * bytesPerFrame;
+                table.offsets.push_back(offset);
+                table.sizes.push_back((uint32_t)chunkBytes);
+                table.ptsUs.push_back(ToMicroseconds(dts, track.timescale));
+                table.sync.push_back(1);
+            }
+
+            if (sttsIndex < sttsCount) {
+                dts += Read32(stts + 8 + sttsIndex * 8 + 4);
+                if (--sttsLeft == 0 && ++sttsIndex < sttsCount) {
+                    sttsLeft = Read32(stts + 8 + sttsIndex * 8);
+                }
+            }
+            if (cttsIndex < cttsCount && --cttsLeft == 0 && ++cttsIndex < cttsCount) {
+                cttsLeft = Read32(ctts + 8 + cttsIndex * 8);
+            }
+        }
+    }
+    if (table.offsets.empty() && sampleCount > 0) {
+        return false;
+    }
+    track.fragmentDts = dts;
+    if (track.info.durationUs <= 0) {
+        track.info.durationUs = ToMicroseconds(dts, track.timescale);
+    }
+    return true;
+}
+
+bool CMp4Demuxer::getTrackInfo(size_t track, MediaTrackInfo& info) {
+    if (track >= mTracks.size()) {
+        return false;
+    }
+    info = mTracks[track].info;
+    return true;
+}
+
+bool CMp4Demuxer::selectTrack(size_t track) {
+    if (track >= mTracks.size()) {
+        return false;
+    }
+    mTracks[track].selected = true;
+    return true;
+}
+
+CMp4Demuxer::Track* CMp4Demuxer::currentTrack() {
+    Track* best = nullptr;
+    for (Track& track : mTracks) {
+        if (!track.selected || track.position >= track.samples.count) {
+            continue;
+        }
+        if (best == nullptr || track.samples.ptsUs[track.position] < best->samples.ptsUs[best->position]) {
+            best = &track;
+        }
+    }
+    return best;
+}
+
+int32_t CMp4Demuxer::getSampleTrackIndex() {
+    Track* track = currentTrack();
+    return track ? (int32_t)(track - mTracks.data()) : -1;
+}
+
+int64_t CMp4Demuxer::getSampleTime() {
+    Track* track = currentTrack();
+    return track ? track->samples.ptsUs[track->position] : -1;
+}
+
+bool CMp4Demuxer::getSyncSampleTimes(size_t track, std::vector<int64_t>& timesUs) {
+    if (track >= mTracks.size()) {
+        return false;
+    }
+    const SampleTable& table = mTracks[track].samples;
+    timesUs.clear();
+    for (size_t i = 0; i < table.count; i++) {
+        if (table.sync[i]) {
+            timesUs.push_back(table.ptsUs[i]);
+        }
+    }
+    // Decode order; with B-frames the presentation times of sync samples need not ascend.
+    std::sort(timesUs.begin(), timesUs.end());
+    return true;
+}
+
+uint32_t CMp4Demuxer::getSampleFlags() {
+    Track* track = currentTrack();
+    return (track && track->samples.sync[track->position]) ? kSampleFlagSync : 0;
+}
+
+ssize_t CMp4Demuxer::readSampleData(uint8_t* buffer, size_t capacity) {
+    Track* track = currentTrack();
+    if (track == nullptr) {
+        return -1;
+    }
+    const int64_t offset = track->samples.offsets[track->position];
+    const size_t size = track->samples.sizes[track->position];
+    if (track->nalLengthSize > 0) {
+        const uint8_t* sample = mFile->map(offset, size);
+        if (sample == nullptr) {
+            mScratch.resize(size);
+            if (mFile->readAt(offset, mScratch.data(), size) != (ssize_t)size) {
+                return -1;
+            }
+            sample = mScratch.data();
+        }
+        return toAnnexB(*track, sample, size, buffer, capacity);
+    }
+    if (capacity < size) {
+        return -1;
+    }
+    return mFile->readAt(offset, buffer, size);
+}
+
+const uint8_t* CMp4Demuxer::getSampleData(size_t& size) {
+    Track* track = currentTrack();
+    if (track == nullptr || track->nalLengthSize > 0) {
+        return nullptr;
+    }
+    size = track->samples.sizes[track->position];
+    return mFile->map(track->samples.offsets[track->position], size);
+}
+
+ssize_t CMp4Demuxer::toAnnexB(const Track& track, const uint8_t* sample, size_t size, uint8_t* buffer, size_t capacity) {
+    static const uint8_t kStartCode[4] = {0, 0, 0, 1};
+    const size_t lengthSize = track.nalLengthSize;
+    size_t in = 0;
+    size_t out = 0;
+    while (in + lengthSize <= size) {
+        size_t nalSize = 0;
+        for (size_t i = 0; i < lengthSize; i++) {
+            nalSize = (nalSize << 8) | sample[in + i];
+        }
+        in += lengthSize;
+        if (nalSize > size - in || out + sizeof(kStartCode) + nalSize > capacity) {
+            return -1;
+        }
+        memcpy(buffer + out, kStartCode, sizeof(kStartCode));
+        memcpy(buffer + out + sizeof(kStartCode), sample + in, nalSize);
+        out += sizeof(kStartCode) + nalSize;
+        in += nalSize;
+    }
+    return (ssize_t)out;
+}
+
+bool CMp4Demuxer::advance() {
+    Track* track = currentTrack();
+    if (track == nullptr) {
+        return false;
+    }
+    track->position++;
+    return currentTrack() != nullptr;
+}
+
+bool CMp4Demuxer::seekTo(int64_t timeUs) {
+    // Like AMEDIAEXTRACTOR_SEEK_CLOSEST_SYNC: the selected video track (else the first selected one)
+    // moves to the sync sample nearest timeUs, the others to their last sync sample at or before it.
+    Track* reference = nullptr;
+    for (Track& track : mTracks) {
+        if (track.selected && (reference == nullptr || (track.info.type == mediaTypeVideo && reference->info.type != mediaTypeVideo))) {
+            reference = &track;
+        }
+    }
+    if (reference == nullptr || reference->samples.count == 0) {
+        return false;
+    }
+    const SampleTable& table = reference->samples;
+    size_t best = 0;
+    int64_t bestDistance = INT64_MAX;
+    for (size_t i = 0; i < table.count; i++) {
+        const int64_t distance = llabs(table.ptsUs[i] - timeUs);
+        if (table.sync[i] && distance < bestDistance) {
+            best = i;
+            bestDistance = distance;
+        }
+    }
+    reference->position = best;
+    const int64_t anchorUs = table.ptsUs[best];
+    for (Track& track : mTracks) {
+        if (!track.selected || &track == reference) {
+            continue;
+        }
+        track.position = 0;
+        for (size_t i = 0; i < track.samples.count; i++) {
+            if (track.samples.sync[i] && track.samples.ptsUs[i] <= anchorUs) {
+                track.position = i;
+            }
+        }
+    }
+    return true;
+}
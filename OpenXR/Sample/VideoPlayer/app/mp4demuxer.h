@@ -0,0 +1,130 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// ISO-BMFF (MP4 / MOV) demuxer serving samples from a mapped (or remote) file.
+
+#pragma once
+#include "mediabackend.h"
+#include "mediafile.h"
+#include "indexcache.h"
+#include <vector>
+
+// Parses moov/trak/stbl once at open() into a per-track sample index and then never touches
+// the container structure again: sample reads are an index lookup plus a copy (or pointer)
+// into the mapped file. Fragmented files (moov/mvex, then moof/mdat pairs such as CMAF segments
+// appended to their init segment) are indexed the same way from every moof. Edit lists are ignored.
+// With an index cache the index is stored after the first parse, and later opens of the
+// unchanged file use the cached arrays in place without reading moov at all.
+//
+// Track mimes follow AMediaExtractor ("video/avc", "video/hevc", "audio/mp4a-latm"), and AVC/HEVC
+// samples are returned with Annex-B start codes like it does. Uncompressed 'I420' video and
+// 'sowt' 16-bit PCM map to kMimeRawVideo / kMimeRawAudio, which the host backend decodes.
+class CMp4Demuxer : public IMediaSource {
+
+public:
+    CMp4Demuxer(int64_t readAhead, std::shared_ptr<MediaIoCounters> ioCounters, std::shared_ptr<CIndexCache> indexCache);
+
+    // True if the file starts with a top-level ISO-BMFF box (ftyp, moov, mdat...).
+    static bool probe(const char* source);
+
+    bool open(const char* source) override;
+
+    size_t getTrackCount() override { return mTracks.size(); }
+
+    bool getTrackInfo(size_t track, MediaTrackInfo& info) override;
+
+    bool selectTrack(size_t track) override;
+
+    int32_t getSampleTrackIndex() override;
+
+    int64_t getSampleTime() override;
+
+    uint32_t getSampleFlags() override;
+
+    ssize_t readSampleData(uint8_t* buffer, size_t capacity) override;
+
+    const uint8_t* getSampleData(size_t& size) override;
+
+    bool advance() override;
+
+    bool seekTo(int64_t timeUs) override;
+
+    bool getSyncSampleTimes(size_t track, std::vector<int64_t>& timesUs) override;
+
+    // Time open() spent building (or loading) the sample index.
+    int64_t getIndexBuildNs() const { return mIndexBuildNs; }
+
+    static constexpr const char* kIndexCacheKind = "mp4idx";
+
+private:
+    // One entry per sample in decode order, kept as parallel arrays so a scan over one field
+    // (seek over sync/pts, interleaving over pts) stays in cache. The arrays live either in
+    // the track's own storage (parsed) or in a mapped cache entry.
+    struct SampleTable {
+        const int64_t*  offsets{nullptr};
+        const uint32_t* sizes{nullptr};
+        const int64_t*  ptsUs{nullptr};
+        const uint8_t*  sync{nullptr};
+        size_t          count{0};
+    };
+
+    struct SampleStorage {
+        std::vector<int64_t>  offsets;
+        std::vector<uint32_t> sizes;
+        std::vector<int64_t>  ptsUs;
+        std::vector<uint8_t>  sync;
+    };
+
+    // Per-track sample defaults from mvex/trex, overridden per fragment by tfhd.
+    struct FragmentDefaults {
+        uint32_t duration{0};
+        uint32_t size{0};
+        uint32_t flags{0};
+    };
+
+    struct Track {
+        MediaTrackInfo   info;
+        SampleTable      samples;
+        SampleStorage    storage;
+        uint32_t         trackId{0};
+        uint32_t         timescale{0};
+        int32_t          nalLengthSize{0};  // AVC/HEVC: NAL unit length prefix bytes, rewritten to start codes
+        FragmentDefaults defaults;
+        int64_t          fragmentDts{0};    // decode time following the last fragment, for moofs without tfdt
+        bool             selected{false};
+        size_t           position{0};
+    };
+
+    // Returns false without a playable track; fragmented is set when moov has an mvex.
+    bool parseMoov(const uint8_t* data, size_t size, bool& fragmented);
+
+    bool parseTrak(const uint8_t* data, size_t size, Track& track);
+
+    bool parseSampleEntry(const uint8_t* data, size_t size, Track& track);
+
+    bool parseStbl(const uint8_t* data, size_t size, Track& track);
+
+    // Appends the samples of every traf to its track; moofOffset is the file offset of the moof box.
+    bool parseMoof(const uint8_t* data, size_t size, int64_t moofOffset);
+
+    bool parseTraf(const uint8_t* data, size_t size, int64_t moofOffset);
+
+    // Points the sample table of a parsed track at its storage once nothing more is appended.
+    void bindSamples(Track& track);
+
+    bool loadIndex(const char* source);
+
+    void storeIndex(const char* source);
+
+    ssize_t toAnnexB(const Track& track, const uint8_t* sample, size_t size, uint8_t* buffer, size_t capacity);
+
+    Track* currentTrack();
+
+    std::unique_ptr<IMediaFile>       mFile;
+    int64_t                           mReadAhead;
+    std::shared_ptr<MediaIoCounters>  mIoCounters;
+    std::vector<Track>                mTracks;
+    std::vector<uint8_t>              mScratch;
+    std::shared_ptr<CIndexCache>      mIndexCache;
+    std::shared_ptr<CIndexCacheEntry> mIndexEntry;  // backs the sample tables when loaded from the cache
+    int64_t                           mIndexBuildNs{0};
+};
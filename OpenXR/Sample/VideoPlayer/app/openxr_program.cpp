@@ -13,6 +13,10 @@
 #include <array>
 #include <cmath>
 #include "player.h"
+#include "medialibrary.h"
+#include "thumbnailatlas.h"
+#include "manifest.h"
+#include "livesource.h"
 #include <sys/time.h>
 
 namespace {
@@ -181,6 +185,20 @@ struct OpenXrProgram : IOpenXrProgram {
         std::transform(graphicsExtensions.begin(), graphicsExtensions.end(), std::back_inserter(extensions),
                        [](const std::string& ext) { return ext.c_str(); });
 
+#ifdef XR_USE_TIMESPEC
+        // Optional: lets frame selection map XrTime onto the player's CLOCK_MONOTONIC timestamps exactly.
+        uint32_t availableExtensionCount = 0;
+        CHECK_XRCMD(xrEnumerateInstanceExtensionProperties(nullptr, 0, &availableExtensionCount, nullptr));
+        std::vector<XrExtensionProperties> availableExtensions(availableExtensionCount, {XR_TYPE_EXTENSION_PROPERTIES});
+        CHECK_XRCMD(xrEnumerateInstanceExtensionProperties(nullptr, availableExtensionCount, &availableExtensionCount, availableExtensions.data()));
+        for (const XrExtensionProperties& extension : availableExtensions) {
+            if (strcmp(extension.extensionName, XR_KHR_CONVERT_TIMESPEC_TIME_EXTENSION_NAME) == 0) {
+                extensions.push_back(XR_KHR_CONVERT_TIMESPEC_TIME_EXTENSION_NAME);
+                m_timespecTimeSupported = true;
+            }
+        }
+#endif
+
         XrInstanceCreateInfo createInfo{XR_TYPE_INSTANCE_CREATE_INFO};
         createInfo.next = m_platformPlugin->GetInstanceCreateExtension();
         createInfo.enabledExtensionCount = (uint32_t)extensions.size();
@@ -190,6 +208,27 @@ struct OpenXrProgram : IOpenXrProgram {
         createInfo.applicationInfo.apiVersion = XR_CURRENT_API_VERSION;
 
         CHECK_XRCMD(xrCreateInstance(&createInfo, &m_instance));
+
+#ifdef XR_USE_TIMESPEC
+        if (m_timespecTimeSupported) {
+            CHECK_XRCMD(xrGetInstanceProcAddr(m_instance, "xrConvertTimeToTimespecTimeKHR",
+                                              reinterpret_cast<PFN_xrVoidFunction*>(&m_xrConvertTimeToTimespecTimeKHR)));
+        }
+#endif
+    }
+
+    // Converts an XrTime to CLOCK_MONOTONIC nanoseconds, the time base of the player's frame timestamps.
+    int64_t ToMonotonicTime(XrTime time) const {
+#ifdef XR_USE_TIMESPEC
+        if (m_xrConvertTimeToTimespecTimeKHR != nullptr) {
+            struct timespec ts;
+            if (XR_SUCCEEDED(m_xrConvertTimeToTimespecTimeKHR(m_instance, time, &ts))) {
+                return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+            }
+        }
+#endif
+        // Android runtimes express XrTime in CLOCK_MONOTONIC nanoseconds.
+        return time;
     }
 
     void CreateInstance() override {
@@ -964,7 +1003,7 @@ struct OpenXrProgram : IOpenXrProgram {
         XrCompositionLayerProjection layer{XR_TYPE_COMPOSITION_LAYER_PROJECTION};
         std::vector<XrCompositionLayerProjectionView> projectionLayerViews;
         if (frameState.shouldRender == XR_TRUE) {
-            if (RenderLayer(frameState.predictedDisplayTime, projectionLayerViews, layer)) {
+            if (RenderLayer(frameState.predictedDisplayTime, frameState.predictedDisplayPeriod, projectionLayerViews, layer)) {
                 layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader*>(&layer));
             }
         }
@@ -977,7 +1016,7 @@ struct OpenXrProgram : IOpenXrProgram {
         CHECK_XRCMD(xrEndFrame(m_session, &frameEndInfo));
     }
 
-    bool RenderLayer(XrTime predictedDisplayTime, std::vector<XrCompositionLayerProjectionView>& projectionLayerViews,
+    bool RenderLayer(XrTime predictedDisplayTime, XrDuration predictedDisplayPeriod, std::vector<XrCompositionLayerProjectionView>& projectionLayerViews,
                      XrCompositionLayerProjection& layer) {
         XrResult res;
 
@@ -1003,7 +1042,13 @@ struct OpenXrProgram : IOpenXrProgram {
 
         projectionLayerViews.resize(viewCountOutput);
 
-        std::shared_ptr<MediaFrame> frame = m_player->getFrame();
+        // Both eyes share the head's orientation; spatial audio is turned by it.
+        const XrQuaternionf& headOrientation = m_views[0].pose.orientation;
+        const float orientation[4] = {headOrientation.x, headOrientation.y, headOrientation.z, headOrientation.w};
+        m_player->setHeadOrientation(orientation);
+
+        const MediaFrame* frame = m_player->getFrame(ToMonotonicTime(predictedDisplayTime), predictedDisplayPeriod);
+        m_graphicsPlugin->UploadFrame(frame);
 
         // Render view to the appropriate part of the swapchain image.
         for (uint32_t i = 0; i < viewCountOutput; i++) {
@@ -1033,8 +1078,6 @@ struct OpenXrProgram : IOpenXrProgram {
             CHECK_XRCMD(xrReleaseSwapchainImage(viewSwapchain.handle, &releaseInfo));
         }
 
-        m_player->releaseFrame(frame);
-
         layer.space = m_appSpace;
         layer.layerFlags = m_options.Parsed.EnvironmentBlendMode == XR_ENVIRONMENT_BLEND_MODE_ALPHA_BLEND
                          ? XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT | XR_COMPOSITION_LAYER_UNPREMULTIPLIED_ALPHA_BIT
@@ -1045,13 +1088,33 @@ struct OpenXrProgram : IOpenXrProgram {
     }
 
     bool StartPlayer() override {
-        m_player = new CPlayer();
+        std::shared_ptr<IMediaBackend> backend = CreateMediaBackend(m_options);
+        m_player = new CPlayer(backend, m_options.FrameQueueDepth);
         if (m_player == nullptr) {
             Log::Write(Log::Level::Error, Fmt("new CPlayer error"));
             return false;
         }
-        m_player->setDataSource(m_options.VideoFileName.c_str(), m_videoWidth, m_videoHeight);
+        m_player->setLateFramePolicy(GetLateFramePolicy(m_options.LateFramePolicy), (int64_t)m_options.DecodeAheadMs * 1000 * 1000);
+        m_player->setGaplessLoop(m_options.GaplessLoop);
+        m_player->setLoopCache((uint64_t)m_options.LoopCacheMB << 20);
+        m_player->setAdaptiveStreaming(m_options.SegmentCacheDir, (uint64_t)m_options.SegmentCacheMB << 20, (int64_t)m_options.PrefetchMs * 1000);
+        m_player->setLiveIngest(GetLiveCodecMime(m_options.LiveCodec), (int64_t)m_options.LiveMaxJitterMs * 1000 * 1000);
+        m_player->setSpatialAudio(m_options.VideoMode == "360" && m_options.AmbisonicAudio);
+        std::string videoFile = m_options.VideoFileName;
+        std::vector<std::string> playlist;
+        if (!m_options.Playlist.empty() && ReadPlaylist(m_options, playlist)) {
+            videoFile = playlist[0];
+            m_player->setPlaylist(std::move(playlist));
+        }
+        m_player->setDataSource(videoFile.c_str(), m_videoWidth, m_videoHeight);
         m_player->start();
+        // Local files only: a remote source would compete with playback for bandwidth and can't be cached.
+        const char* path = videoFile.c_str();
+        if (m_options.Thumbnails && !IsRemoteMediaPath(path) && !IsAdaptiveManifestPath(path) && !IsLiveSourcePath(path)) {
+            CPlayer* player = m_player;
+            m_thumbnails.reset(new CThumbnailAtlas(backend, [player]() { return player->isBusy(); }));
+            m_thumbnails->start(videoFile);
+        }
         Log::Write(Log::Level::Error, Fmt("m_videoWidth:%d, m_videoHeight:%d", m_videoWidth, m_videoHeight));
         return true;
     }
@@ -1079,6 +1142,11 @@ struct OpenXrProgram : IOpenXrProgram {
     InputState m_input;
 
     CPlayer* m_player;
+    std::unique_ptr<CThumbnailAtlas> m_thumbnails;
+    bool m_timespecTimeSupported{false};
+#ifdef XR_USE_TIMESPEC
+    PFN_xrConvertTimeToTimespecTimeKHR m_xrConvertTimeToTimespecTimeKHR{nullptr};
+#endif
     int32_t m_videoWidth;
     int32_t m_videoHeight;
 };
@@ -15,9 +15,45 @@ struct Options {
 
     std::string AppSpace{"Local"};
 
-    std::string VideoMode{"3D-SBS"};              //Configurable: 2D, 3D-SBS, 3D-OU, 360
+    std::string VideoMode{"3D-SBS"};              //Configurable: 2D, 3D-SBS, 3D-OU, 360, Auto (from the library entry or file name)
 
-    std::string VideoFileName{"/sdcard/test3d.mp4"};
+    std::string VideoFileName{"/sdcard/test3d.mp4"};   //local path, library directory, http:// URL, DASH .mpd / HLS .m3u8 manifest, or live udp://[address]:port / FIFO
+
+    uint32_t LibraryItem{0};                      //when VideoFileName is a directory: the playable file to open, in path order
+
+    std::string Playlist{""};                     //M3U file or library directory played in order instead of VideoFileName, empty = VideoFileName alone
+
+    std::string MediaBackend{"NDK"};              //Configurable: NDK, Host (raw .y4m video + .wav audio)
+
+    std::string AudioDumpFile{""};                //Host backend: append the 16-bit PCM its null audio sink plays to this file, empty = discard
+
+    uint32_t FrameQueueDepth{4};                  //decoded frames buffered between decode and render threads
+
+    std::string LateFramePolicy{"Drop"};          //Configurable: None, Drop, SkipNonReference, CatchUpToKeyframe
+
+    uint32_t DecodeAheadMs{250};                  //media time the decoder may run ahead of the clock, 0 = queue depth only
+
+    bool GaplessLoop{true};                       //pre-roll the file start on a second decoder before looping
+
+    uint32_t LoopCacheMB{0};                      //keep the decoded frames of a clip this small and replay them instead of decoding, 0 = off
+
+    bool AmbisonicAudio{true};                    //360 mode: play 4- and 9-channel audio as AmbiX, rendered binaurally and turned with the head
+
+    uint32_t ReadAheadMB{16};                     //mmap the media file and prefetch this far ahead of the demuxer, 0 = plain file reads
+
+    std::string IndexCacheDir{"/sdcard/Android/data/com.khronos.player/cache"};  //demux/keyframe indexes kept across runs, empty = rebuild on every open
+
+    bool Thumbnails{true};                        //build a seek-bar thumbnail atlas from keyframes in the background, kept in IndexCacheDir
+
+    std::string SegmentCacheDir{"/sdcard/Android/data/com.khronos.player/cache/segments"};  //downloaded DASH/HLS segments, empty = no adaptive streaming
+
+    uint32_t SegmentCacheMB{512};                 //segment cache budget, least recently used segments are deleted past it
+
+    uint32_t PrefetchMs{12000};                   //adaptive streams: media downloaded ahead of playback, also the ABR buffer target
+
+    std::string LiveCodec{"H264"};                //Configurable: H264, HEVC; Annex-B elementary stream of live sources
+
+    uint32_t LiveMaxJitterMs{50};                 //live sources: longest the jitter buffer may hold a frame, 0 = show on arrival
 
     struct {
         XrFormFactor FormFactor{XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY};
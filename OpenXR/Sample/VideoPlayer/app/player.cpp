@@ -7,320 +7,1445 @@
 #include "player.h"
 #include "pch.h"
 #include "common.h"
-#include <sys/stat.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <EGL/egl.h>
-#include <GLES3/gl3.h>
-#include <chrono>
 
-CPlayer::CPlayer() : mExtractor(nullptr), mVideoCodec(nullptr), mFd(-1), mStarted(false) {
+LateFramePolicy GetLateFramePolicy(const std::string& name) {
+    if (EqualsIgnoreCase(name, "None")) {
+        return lateFramePolicyNone;
+    } else if (EqualsIgnoreCase(name, "Drop")) {
+        return lateFramePolicyDrop;
+    } else if (EqualsIgnoreCase(name, "SkipNonReference")) {
+        return lateFramePolicySkipNonReference;
+    } else if (EqualsIgnoreCase(name, "CatchUpToKeyframe")) {
+        return lateFramePolicyCatchUpToKeyframe;
+    }
+    throw std::invalid_argument(Fmt("Unknown late frame policy '%s'", name.c_str()));
+}
+
+CPlayer::CPlayer(std::shared_ptr<IMediaBackend> backend, uint32_t frameQueueDepth) : mBackend(std::move(backend)), mStarted(false),
+                                             mFramePool(2 * frameQueueDepth + kFramePoolSlack),
+                                             mVideoPackets(kVideoPacketQueueDepth), mAudioPackets(kAudioPacketQueueDepth),
+                                             mFrameQueue(frameQueueDepth) {
+    // The queue and a pre-rolled standby can each hold frameQueueDepth frames.
+    mStandbyFrames.reserve(frameQueueDepth);
+    ksSignal_Create(&mDemuxWake, true);
+    ksSignal_Create(&mVideoWake, true);
+    ksSignal_Create(&mAudioWake, true);
 }
 
 CPlayer::~CPlayer() {
-    if (mExtractor) {
-        AMediaExtractor_delete(mExtractor);
-        mExtractor = nullptr;
-    }
-    if (mFd > 0) {
-        close(mFd);
-        mFd = -1;
-    }
+    stop();
+    ksSignal_Destroy(&mDemuxWake);
+    ksSignal_Destroy(&mVideoWake);
+    ksSignal_Destroy(&mAudioWake);
 }
 
 bool CPlayer::setDataSource(const char* source, int32_t& videoWidth, int32_t& videoHeight) {
-    if (mExtractor == nullptr) {
-        mExtractor = AMediaExtractor_new();
-        if (mExtractor == nullptr) {
-            Log::Write(Log::Level::Error, "AMediaExtractor_new error");
-            return false;
-        }
+    if (mBackend == nullptr) {
+        Log::Write(Log::Level::Error, "setDataSource error, no media backend");
+        return false;
     }
-
-    struct stat statbuff;
-    int32_t fileLen = -1;
-    if (stat(source, &statbuff) < 0) {
+    mDataSource = source;
+    mOpenStartNs = CMediaClock::monotonicNow();
+    std::shared_ptr<CIndexCache> indexCache = mBackend->getIndexCache();
+    mOpenCacheHits = indexCache ? indexCache->hits() : 0;
+    mOpenCacheMisses = indexCache ? indexCache->misses() : 0;
+    mTimeToFirstFrameNs = 0;
+    mAdaptive = IsAdaptiveManifestPath(source);
+    mLive = !mAdaptive && IsLiveSourcePath(source);
+    if (mAdaptive) {
+        mSource = std::make_shared<CAdaptiveSource>(mBackend, mSegmentCache, mPrefetchUs, mAdaptiveCounters);
+    } else if (mLive) {
+        mSource = std::make_shared<CLiveSource>(mLiveMime, mLiveMaxJitterNs, mLiveCounters);
+    } else {
+        mSource = mBackend->createSource();
+    }
+    if (mSource == nullptr || !mSource->open(source)) {
         Log::Write(Log::Level::Error, Fmt("setDataSource error, open file %s error", source));
-        return false;  
-    } else {  
-        fileLen = statbuff.st_size;  
-    } 
-
-    if (mFd) {
-        close(mFd);
-        mFd = -1;
-    }
-    mFd = open(source, O_RDONLY);
-    if (mFd < 0) {
-        Log::Write(Log::Level::Error, Fmt("setDataSource error, open file %s error, ret=%d", source, mFd));
+        mSource.reset();
         return false;
     }
-
-    media_status_t status = AMediaExtractor_setDataSourceFd(mExtractor, mFd, 0, fileLen);
-    if (status != AMEDIA_OK) {
-        Log::Write(Log::Level::Error, Fmt("setDataSource error, ret = %d", status));
-        return false;
+    if ((mAdaptive || mLive) && !mPlaylist.empty()) {
+        Log::Write(Log::Level::Error, "a playlist can only hold media files, playing the first item alone");
+        mPlaylist.clear();
     }
+    mPlaylistItem = 0;
 
-    size_t track = AMediaExtractor_getTrackCount(mExtractor);
-    Log::Write(Log::Level::Error, Fmt("setDataSource success, file size %d track = %d", fileLen, track));
-    for (auto i = 0; i < track; i++) {
-        const char *mime = nullptr;
-        AMediaFormat *format = AMediaExtractor_getTrackFormat(mExtractor, i);
-        AMediaFormat_getString(format, "mime", &mime);
-        if (strstr(mime, "video")) {
-            AMediaFormat_getInt32(format, "width", &videoWidth);
-            AMediaFormat_getInt32(format, "height", &videoHeight);
+    mKeyframeIndex.clear();
+    size_t track = mSource->getTrackCount();
+    for (size_t i = 0; i < track; i++) {
+        MediaTrackInfo info;
+        if (mSource->getTrackInfo(i, info) && info.type == mediaTypeVideo) {
+            videoWidth = info.width;
+            videoHeight = info.height;
             getAlignment(videoWidth, videoHeight, mAlignment);
             Log::Write(Log::Level::Error, Fmt("setDataSource video width:%d height:%d", videoWidth, videoHeight));
+            if (mAdaptive) {
+                mKeyframeIndex.assign(static_cast<CAdaptiveSource*>(mSource.get())->getSegmentTimes());
+            } else if (mKeyframeIndex.empty() && !mLive) {
+                mKeyframeIndex.build(*mBackend, *mSource, source, i, true);
+            }
         }
     }
     return true;
 }
 
+bool CPlayer::openCodecs() {
+    size_t track = mSource->getTrackCount();
+    for (size_t i = 0; i < track; i++) {
+        MediaTrackInfo info;
+        if (!mSource->getTrackInfo(i, info)) {
+            continue;
+        }
+        Log::Write(Log::Level::Error, Fmt("track %d mime %s", (int32_t)i, info.mime.c_str()));
+        if (info.maxInputSize > mMaxInputSize) {
+            mMaxInputSize = info.maxInputSize;
+        }
+        if (info.type == mediaTypeVideo && mVideoDecoder == nullptr) {
+            mVideoTrackIndex = i;
+            mVideoWidth = info.width;
+            mVideoHeight = info.height;
+            mVideoMime = info.mime;
+            mVideoDurationUs = info.durationUs;
+            getAlignment(mVideoWidth, mVideoHeight, mAlignment);
+            mVideoDecoder = mBackend->createDecoder(*mSource, i);
+            if (mVideoDecoder == nullptr) {
+                Log::Write(Log::Level::Error, Fmt("create video decoder %s error", info.mime.c_str()));
+            } else if (mGaplessLoop && !mAdaptive && !mLive && mPlaylist.empty()) {
+                mStandbyDecoder = mBackend->createDecoder(*mSource, i);
+                mStandbySource = mBackend->createSource();
+                if (mStandbyDecoder == nullptr || mStandbySource == nullptr || !mStandbySource->open(mDataSource.c_str())) {
+                    Log::Write(Log::Level::Error, "create standby decoder error, looping will seek in place");
+                    mStandbyDecoder.reset();
+                    mStandbySource.reset();
+                }
+            }
+        } else if (info.type == mediaTypeAudio && mAudioDecoder == nullptr) {
+            mAudioTrackIndex = i;
+            mAudioChannelCount = info.channelCount;
+            mAudioSampleRate = info.sampleRate;
+            mAudioMime = info.mime;
+            if (mVideoDurationUs == 0) {
+                mVideoDurationUs = info.durationUs;
+            }
+            mAudioDecoder = mBackend->createDecoder(*mSource, i);
+            if (mAudioDecoder == nullptr) {
+                Log::Write(Log::Level::Error, Fmt("create audio decoder %s error", info.mime.c_str()));
+                continue;
+            }
+
+            //init audio output
+            mAudioSink = mBackend->createAudioSink();
+            mAudioAmbisonicOrder = 0;
+            if (mSpatialAudio && (mAudioChannelCount == 4 || mAudioChannelCount == 9)) {
+                mAudioAmbisonicOrder = mAudioChannelCount == 4 ? 1 : 2;
+            }
+            if (mAudioSink == nullptr || !mAudioSink->open(mAudioChannelCount, mAudioSampleRate, mAudioAmbisonicOrder)) {
+                Log::Write(Log::Level::Error, "Failed to open audio sink");
+                return false;
+            }
+            mAudioSink->getFormat(mAudioOutputChannelCount, mAudioOutputSampleRate);
+            if (!mAudioConverter.configure(mAudioChannelCount, mAudioSampleRate, mAudioOutputChannelCount, mAudioOutputSampleRate)) {
+                Log::Write(Log::Level::Error, "Failed to convert audio to the sink format");
+                return false;
+            }
+        }
+    }
+
+    if (mVideoDecoder) {
+        if (!mVideoDecoder->start()) {
+            Log::Write(Log::Level::Error, "video decoder start error");
+        }
+        if (!mSource->selectTrack(mVideoTrackIndex)) {
+            Log::Write(Log::Level::Error, "video selectTrack error");
+            return false;
+        }
+    }
+    if (mAudioDecoder) {
+        if (!mAudioDecoder->start()) {
+            Log::Write(Log::Level::Error, "audio decoder start error");
+        }
+        if (!mSource->selectTrack(mAudioTrackIndex)) {
+            Log::Write(Log::Level::Error, "audio selectTrack error");
+            return false;
+        }
+    }
+    // Pre-rolls of the same file use the same tracks; playlist items replace these with their own.
+    mStandbyVideoTrack = mVideoTrackIndex;
+    mStandbyAudioTrack = mAudioTrackIndex;
+    mStandbyDurationUs = mVideoDurationUs;
+    mStandbyVideoMime = mVideoMime;
+    if (mVideoDecoder) {
+        mSource->getTrackInfo(mVideoTrackIndex, mVideoDecoderFormat);
+        mStandbyDecoderFormat = mVideoDecoderFormat;
+    }
+    if (mStandbyDecoder) {
+        bool ready = mStandbyDecoder->start() && mStandbySource->selectTrack(mVideoTrackIndex);
+        if (ready && mAudioDecoder) {
+            ready = mStandbySource->selectTrack(mAudioTrackIndex);
+        }
+        if (!ready) {
+            Log::Write(Log::Level::Error, "standby decoder start error, looping will seek in place");
+            mStandbyDecoder.reset();
+            mStandbySource.reset();
+        }
+    }
+    return true;
+}
+
+void CPlayer::drainQueues() {
+    while (mFrameQueue.front()) {
+        mFrameQueue.pop();
+    }
+    while (mVideoPackets.front()) {
+        mVideoPackets.pop();
+    }
+    while (mAudioPackets.front()) {
+        mAudioPackets.pop();
+    }
+    mStandbyFrames.clear();
+    mStandbyAudio.clear();
+    mStandbyPrimed.store(false, std::memory_order_relaxed);
+}
+
+void CPlayer::closeCodecs() {
+    // Hand any frames still queued for rendering back to the decoder before it goes away.
+    drainQueues();
+    if (mAudioSink) {
+        mAudioSink->close();
+        mAudioSink.reset();
+    }
+    if (mVideoDecoder) {
+        mVideoDecoder->stop();
+        mVideoDecoder.reset();
+    }
+    if (mStandbyDecoder) {
+        mStandbyDecoder->stop();
+        mStandbyDecoder.reset();
+    }
+    mStandbySource.reset();
+    mRetiredSource.reset();
+    mLoopCache.clear();
+    mLoopCacheState = loopCacheOff;
+    if (mAudioDecoder) {
+        mAudioDecoder->stop();
+        mAudioDecoder.reset();
+    }
+}
+
 bool CPlayer::start() {
-    if (mExtractor == nullptr) {
+    if (mSource == nullptr) {
         return false;
     }
     if (mStarted) {
         return true;
     }
+    if (!openCodecs()) {
+        closeCodecs();
+        return false;
+    }
+
+    mClock.reset();
+    mAvDrift = 0;
+    mAudioWrites.clear();
+    mAudioFramesWritten = 0;
+    mVideoFrameIntervalNs = 0;
+    mLastShownPts = -1;
+    mLoopOffsetUs = 0;
+    mPrerollUs = -1;
+    mSeekStartNs = -1;
+    mLoopSwitchesSent = 0;
+    mLoopSwitchesDone = 0;
+    mLoopStartNs = -1;
+    mLastNewFrameTime = -1;
+    mLoopAvMeasuredFor = -1;
+    mVideoStartsClock = (mAudioDecoder == nullptr && !mLive);
+    mLoopCache.clear();
+    const bool loopCache = mLoopCache.budget() > 0 && mVideoDecoder && !mAdaptive && !mLive && mPlaylist.empty() && mVideoDurationUs > 0;
+    mLoopCacheState = loopCache ? loopCacheRecording : loopCacheOff;
+    mLoopCacheWholePass = true;
+    mLoopCachePassNs = 0;
+    mLoopCacheFrames = 0;
+    mLoopCacheBytes = 0;
+    mLoopCacheFramesServed = 0;
+
+    startThreads();
+    mStarted = true;
+    return true;
+}
+
+bool CPlayer::stop() {
+    if (!mStarted) {
+        return true;
+    }
+    stopThreads();
+    closeCodecs();
+    mStarted = false;
+    return true;
+}
+
+void CPlayer::startThreads() {
+    mRunning = true;
+    mDemuxThread = std::thread(&CPlayer::demuxLoop, this);
+    if (mVideoDecoder) {
+        mVideoThread = std::thread(&CPlayer::videoDecodeLoop, this);
+    }
+    if (mAudioDecoder) {
+        mAudioThread = std::thread(&CPlayer::audioDecodeLoop, this);
+    }
+}
+
+void CPlayer::stopThreads() {
+    mRunning = false;
+    ksSignal_Raise(&mDemuxWake);
+    ksSignal_Raise(&mVideoWake);
+    ksSignal_Raise(&mAudioWake);
+    for (std::thread* thread : {&mDemuxThread, &mVideoThread, &mAudioThread, &mStandbyThread}) {
+        if (thread->joinable()) {
+            thread->join();
+        }
+    }
+}
 
-    std::thread ([=](){
-
-        int32_t videoTrackIndex = -1;
-        int32_t audioTrackIndex = -1;
-        AMediaCodec *videoCodec = nullptr;
-        AMediaCodec *audioCodec = nullptr;
-        int32_t audioChannelCount = 0;
-        int32_t audioSampleRate = 0;
-        int32_t videoWidth = 0;
-        int32_t videoHeight = 0;
-        int64_t videoDurationUs = 0;
-
-        int count = 0;
-        std::shared_ptr<oboe::AudioStream> audioStreamPlay;
-
-        size_t track = AMediaExtractor_getTrackCount(mExtractor);
-        for (auto i = 0; i < track; i++) {
-            const char *mime = nullptr;
-            AMediaFormat *format = AMediaExtractor_getTrackFormat(mExtractor, i);
-            Log::Write(Log::Level::Error, Fmt("track %d format %s", i, AMediaFormat_toString(format)));
-            AMediaFormat_getString(format, "mime", &mime);
-            if (strstr(mime, "video")) {
-                videoTrackIndex = i;
-                AMediaFormat_getInt32(format, "width", &videoWidth);
-                AMediaFormat_getInt32(format, "height", &videoHeight);
-                AMediaFormat_getInt64(format, "durationUs", &videoDurationUs);
-                getAlignment(videoWidth, videoHeight, mAlignment);
-                videoCodec = AMediaCodec_createDecoderByType(mime);
-                if (videoCodec == nullptr) {
-                    Log::Write(Log::Level::Error, Fmt("create mediacodec %s error", mime));
+// The stages are parked rather than coordinated with flags: joining three threads costs far less
+// than the decode work a seek triggers, and the codecs and audio sink stay open throughout.
+bool CPlayer::seek(int64_t timeUs, SeekMode mode) {
+    if (!mStarted || mLive) {
+        return false;
+    }
+    const int64_t startNs = CMediaClock::monotonicNow();
+    // The demux thread may move on to the next playlist item, so its duration and index are read once it has stopped.
+    stopThreads();
+    if (mLoopSwitchesDone != mLoopSwitchesSent) {
+        // The demuxer had moved on but nothing of the new pass or item was shown yet: seek in the one on screen.
+        swapStandbySource();
+    }
+    if (mVideoDurationUs > 0) {
+        timeUs = std::min(timeUs, mVideoDurationUs);
+    }
+    timeUs = std::max<int64_t>(timeUs, 0);
+    const int64_t syncUs = (mode == seekModeNextSync) ? mKeyframeIndex.findAtOrAfter(timeUs) : mKeyframeIndex.findAtOrBefore(timeUs);
+
+    drainQueues();
+    if (mVideoDecoder) {
+        mVideoDecoder->flush();
+    }
+    if (mAudioDecoder) {
+        mAudioDecoder->flush();
+    }
+    if (mAudioSink) {
+        // Audio still queued for the old position is dropped instead of played out.
+        mAudioSink->flush();
+    }
+    if (!mSource->seekTo(syncUs)) {
+        Log::Write(Log::Level::Error, Fmt("seek to %lld us error", (long long)syncUs));
+    }
+
+    // The media timeline restarts at file time; the clock waits for the first output from the new position.
+    const double rate = mClock.getRate();
+    const bool paused = mClock.isPaused();
+    mClock.reset();
+    mClock.setRate(rate);
+    if (paused) {
+        mClock.pause();
+    }
+    mAudioWrites.clear();
+    mLoopOffsetUs = 0;
+    mPrerollUs = (mode == seekModeExact) ? timeUs : syncUs;
+    mLastShownPts = -1;
+    mLastNewFrameTime = -1;
+    // A loop switch still in the packet queue was discarded with it; the standby is pre-rolled afresh.
+    mLoopSwitchesSent = 0;
+    mLoopSwitchesDone = 0;
+    mLoopStartNs = -1;
+    mLoopAvMeasuredFor = -1;
+    mVideoStartsClock = (mAudioDecoder == nullptr || mAudioTrackIndex < 0);  // a playlist item may be silent
+    if (mLoopCacheState == loopCacheReplaying) {
+        // Video resumes from the cache at the target itself, with no keyframe to decode from.
+        mLoopCacheOffsetNs = 0;
+        mLoopCacheNext = mLoopCache.findAtOrAfter(mPrerollUs * 1000);
+        if (mLoopCacheNext >= mLoopCache.size()) {
+            mLoopCacheNext = 0;
+            mLoopCacheOffsetNs = mVideoDurationUs * 1000;
+        }
+    } else if (mLoopCacheState != loopCacheOff) {
+        // Part of a pass is no use to replay: the next whole one is recorded instead.
+        mLoopCache.clear();
+        mLoopCacheState = loopCacheRecording;
+        mLoopCacheWholePass = false;
+    }
+    mSeekStartNs = startNs;
+    mSeekPrerollFrames = 0;
+    mSeekCount++;
+    startThreads();
+
+    Log::Write(Log::Level::Info, Fmt("seek to %lld us (keyframe %lld us, mode %d)", (long long)timeUs, (long long)syncUs, (int32_t)mode));
+    return true;
+}
+
+void CPlayer::setLateFramePolicy(LateFramePolicy policy, int64_t decodeAheadNs) {
+    mLatePolicy = policy;
+    mDecodeAheadNs = decodeAheadNs;
+}
+
+void CPlayer::setGaplessLoop(bool enable) {
+    mGaplessLoop = enable;
+}
+
+void CPlayer::setPlaylist(std::vector<std::string> items) {
+    mPlaylist = std::move(items);
+}
+
+void CPlayer::setLoopCache(uint64_t budgetBytes) {
+    mLoopCache.setBudget(budgetBytes);
+}
+
+void CPlayer::setSpatialAudio(bool enable) {
+    mSpatialAudio = enable;
+}
+
+void CPlayer::setHeadOrientation(const float orientation[4]) {
+    if (mAudioSink && mAudioAmbisonicOrder > 0) {
+        mAudioSink->setHeadOrientation(orientation);
+    }
+}
+
+void CPlayer::setAdaptiveStreaming(const std::string& segmentCacheDir, uint64_t segmentCacheBytes, int64_t prefetchUs) {
+    mSegmentCache = std::make_shared<CSegmentCache>(segmentCacheDir, segmentCacheBytes);
+    mPrefetchUs = prefetchUs;
+}
+
+void CPlayer::setLiveIngest(const std::string& mime, int64_t maxJitterDelayNs) {
+    mLiveMime = mime;
+    mLiveMaxJitterNs = maxJitterDelayNs;
+}
+
+void CPlayer::pause() {
+    mClock.pause();
+    if (mAudioSink) {
+        mAudioSink->pause();
+    }
+}
+
+void CPlayer::resume() {
+    if (mAudioSink) {
+        mAudioSink->resume();
+    }
+    mClock.resume();
+    ksSignal_Raise(&mAudioWake);
+}
+
+void CPlayer::setPlaybackRate(double rate) {
+    mClock.setRate(rate);
+    ksSignal_Raise(&mAudioWake);
+}
+
+// Demux stage: reads samples in file order and routes them to the per-track packet queues.
+void CPlayer::demuxLoop() {
+    std::vector<uint8_t> sampleBuffer(mMaxInputSize);
+    std::deque<std::pair<bool, MediaPacket>> outbox;  // (video?, packet) read but not yet queued
+
+    // Timestamps stay on the media timeline; each loop continues where the previous pass ended
+    // (mLoopOffsetUs) so the clock never runs backwards. mClock maps this timeline onto display time.
+
+    while (mRunning) {
+        if (outbox.empty()) {
+            const LoopCacheState cacheState = mLoopCacheState;
+            if (cacheState == loopCacheDraining || (cacheState == loopCacheReplaying && mAudioDecoder == nullptr)) {
+                // Waiting for the video stage to judge the pass it recorded, or video comes from the
+                // loop cache and there is no audio left to demux.
+                ksSignal_Wait(&mDemuxWake, SIGNAL_TIMEOUT_INFINITE);
+                continue;
+            }
+            int32_t index = mSource->getSampleTrackIndex();
+            if (index == IMediaSource::kSampleNotReady) {
+                continue;
+            }
+            if (index < 0 && mLive) {
+                Log::Write(Log::Level::Error, "live source failed, demux thread stops");
+                break;
+            }
+            if (index < 0 && !mPlaylist.empty() && !mStandbyThread.joinable() && !mStandbyPrimed.load(std::memory_order_acquire)) {
+                // An item shorter than the queues ends before the video stage has taken up the switch
+                // to it, so its successor could not be pre-rolled yet. That is done here once the
+                // standby decoder is free, so the playlist moves on instead of repeating the item.
+                if (!canPrerollStandby()) {
+                    ksSignal_Wait(&mDemuxWake, kStandbyWaitNs);
+                    continue;
                 }
-                this->mVideoCodec = videoCodec;
-                media_status_t status = AMediaCodec_configure(videoCodec, format, nullptr, nullptr, 0);
-                if (status != AMEDIA_OK) {
-                    Log::Write(Log::Level::Error, Fmt("AMediaCodec_configure error, status = %d", status));
-                } else {
-                    Log::Write(Log::Level::Info, Fmt("video AMediaCodec_configure successfuly"));
+                prerollStandby(mLoopOffsetUs + mVideoDurationUs);
+            }
+            if (index < 0) {
+                // Play from the beginning when reach end of the file
+                Log::Write(Log::Level::Info, Fmt("the video file is end, index:%d", index));
+                mLoopOffsetUs += mVideoDurationUs;
+                if (cacheState != loopCacheReplaying) {
+                    // Passes replayed from the loop cache are counted by the video stage.
+                    mLoopStartNs = mLoopOffsetUs * 1000;
+                    mLoopCount++;
                 }
-            } else if (strstr(mime, "audio")) {
-                audioTrackIndex = i;
-                AMediaFormat_getInt32(format, "channel-count", &audioChannelCount);
-                AMediaFormat_getInt32(format, "sample-rate", &audioSampleRate);
-                audioCodec = AMediaCodec_createDecoderByType(mime);
-                if (audioCodec == nullptr) {
-                    Log::Write(Log::Level::Error, Fmt("create mediacodec %s error", mime));
+                LoopCacheState recording = loopCacheRecording;
+                if (mStandbyThread.joinable()) {
+                    mStandbyThread.join();
                 }
-                media_status_t status = AMediaCodec_configure(audioCodec, format, nullptr, nullptr, 0);
-                if (status != AMEDIA_OK) {
-                    Log::Write(Log::Level::Error, Fmt("AMediaCodec_configure error, status = %d", status));
+                if (mStandbyPrimed.load(std::memory_order_acquire)) {
+                    // The standby source is already past the pre-rolled samples: carry on reading from it,
+                    // and tell the video stage to drain the outgoing decoder and take over the standby.
+                    swapStandbySource();
+                    if (!mPlaylist.empty()) {
+                        if (sampleBuffer.size() < (size_t)mMaxInputSize) {
+                            sampleBuffer.resize(mMaxInputSize);
+                        }
+                        mPlaylistSwitches++;
+                        Log::Write(Log::Level::Info, Fmt("playlist item %d: %s", mPlaylistItem.load(), mPlaylist[mPlaylistItem].c_str()));
+                    }
+                    MediaPacket loopSwitch;
+                    loopSwitch.pts = mLoopOffsetUs;
+                    loopSwitch.flags = MediaPacket::kFlagLoopSwitch;
+                    outbox.emplace_back(true, std::move(loopSwitch));
+                    for (MediaPacket& audio : mStandbyAudio) {
+                        outbox.emplace_back(false, std::move(audio));
+                    }
+                    mStandbyAudio.clear();
+                    mStandbyPrimed.store(false, std::memory_order_relaxed);
+                    mLoopSwitchesSent++;
+                } else if (mLoopCacheState.compare_exchange_strong(recording, loopCacheDraining)) {
+                    // Nothing more is demuxed until the video stage has the last frames of the pass and
+                    // has decided whether to replay it.
+                    mSource->seekTo(0);
+                    MediaPacket passEnd;
+                    passEnd.pts = mLoopOffsetUs;
+                    passEnd.flags = MediaPacket::kFlagLoopCache;
+                    outbox.emplace_back(true, std::move(passEnd));
                 } else {
-                    Log::Write(Log::Level::Info, Fmt("audio AMediaCodec_configure successfuly"));
-                }
-
-                //init audio output
-                oboe::AudioStreamBuilder playStreamBuilder;
-                playStreamBuilder.setDirection(oboe::Direction::Output);
-                playStreamBuilder.setPerformanceMode(oboe::PerformanceMode::None);
-                playStreamBuilder.setSharingMode(oboe::SharingMode::Exclusive);
-                playStreamBuilder.setFormat(oboe::AudioFormat::I16);
-                playStreamBuilder.setChannelCount(oboe::ChannelCount(audioChannelCount));
-                playStreamBuilder.setSampleRate(audioSampleRate);
-
-                oboe::Result ret = playStreamBuilder.openStream(audioStreamPlay);
-                if (ret != oboe::Result::OK) {
-                    Log::Write(Log::Level::Error, Fmt("Failed to open playback stream. Error: %s", oboe::convertToText(ret)));
-                    return false;
+                    mSource->seekTo(0);
                 }
-                int32_t bufferSizeFrames = audioStreamPlay->getFramesPerBurst() * 2;
-                ret = audioStreamPlay->setBufferSizeInFrames(bufferSizeFrames);
-                Log::Write(Log::Level::Error, Fmt("bufferSizeFrames: %d", bufferSizeFrames));
-                if (ret != oboe::Result::OK) {
-                    Log::Write(Log::Level::Error, Fmt("Failed to set playback stream buffer size to: %d. Error: %s", bufferSizeFrames, oboe::convertToText(ret)));
-                    return false;
+                PipelineStats stats = getStats();
+                Log::Write(Log::Level::Info, Fmt("pipeline demux:%llu/%llu video:%llu/%llu audio:%llu/%llu (processed/stalls), queues v:%u a:%u f:%u, av drift %lld us",
+                                                 (unsigned long long)stats.demuxPackets, (unsigned long long)stats.demuxStalls,
+                                                 (unsigned long long)stats.videoFrames, (unsigned long long)stats.videoStalls,
+                                                 (unsigned long long)stats.audioBuffers, (unsigned long long)stats.audioStalls,
+                                                 stats.videoPacketQueueDepth, stats.audioPacketQueueDepth, stats.frameQueueDepth,
+                                                 (long long)(stats.avDriftNs / 1000)));
+                Log::Write(Log::Level::Info, Fmt("audio output latency %lld us, %d frames buffered, %llu underruns, %llu full-ring writes",
+                                                 (long long)(stats.audioOutputLatencyNs / 1000), stats.audioBufferedFrames,
+                                                 (unsigned long long)stats.audioUnderruns, (unsigned long long)stats.audioRingFullWrites));
+                if (stats.audioAmbisonicOrder > 0) {
+                    Log::Write(Log::Level::Info, Fmt("spatial audio order %d, %lld us per block (max %lld), pose to audio %lld us (max %lld)",
+                                                     stats.audioAmbisonicOrder, (long long)(stats.audioSpatialBlockNs / 1000),
+                                                     (long long)(stats.audioSpatialMaxBlockNs / 1000), (long long)(stats.poseToAudioNs / 1000),
+                                                     (long long)(stats.maxPoseToAudioNs / 1000)));
                 }
-                ret = audioStreamPlay->start();
-                if (ret != oboe::Result::OK) {
-                    Log::Write(Log::Level::Error, Fmt("Failed to start playback stream. Error: %s", oboe::convertToText(ret)));
-                    return false;
+                Log::Write(Log::Level::Info, Fmt("loop %llu (%llu gapless), last loop frame gap %lld us, a/v offset %lld us",
+                                                 (unsigned long long)stats.loopCount, (unsigned long long)stats.gaplessLoops,
+                                                 (long long)(stats.lastLoopFrameGapNs / 1000), (long long)(stats.lastLoopAvOffsetNs / 1000)));
+                Log::Write(Log::Level::Info, Fmt("file io %llu KB in %llu reads, %llu stalls, %lld us stalled; %llu range requests, %llu KB fetched",
+                                                 (unsigned long long)(stats.ioBytesRead >> 10), (unsigned long long)stats.ioReads,
+                                                 (unsigned long long)stats.ioStalls, (long long)(stats.ioStallNs / 1000),
+                                                 (unsigned long long)stats.ioRequests, (unsigned long long)(stats.ioFetchedBytes >> 10)));
+                if (mAdaptive) {
+                    Log::Write(Log::Level::Info, Fmt("adaptive rendition %d, %llu switches, %lld kbps estimated, %lld ms buffered, %llu segments downloaded, %llu cache hits",
+                                                     stats.rendition, (unsigned long long)stats.renditionSwitches, (long long)(stats.throughputBps / 1000),
+                                                     (long long)(stats.bufferedUs / 1000), (unsigned long long)stats.segmentsDownloaded,
+                                                     (unsigned long long)stats.segmentCacheHits));
                 }
+                continue;
             }
-            AMediaFormat_delete(format);
+            if (index == mVideoTrackIndex && cacheState == loopCacheReplaying) {
+                mSource->advance();
+                continue;
+            }
+            const int64_t sampleTime = mSource->getSampleTime();
+            const int64_t prerollLeadUs = mPlaylist.empty() ? kLoopPrerollLeadUs : kPlaylistPrerollLeadUs;
+            if (sampleTime >= mVideoDurationUs - prerollLeadUs && canPrerollStandby()) {
+                mStandbyThread = std::thread(&CPlayer::prerollStandby, this, mLoopOffsetUs + mVideoDurationUs);
+            }
+            MediaPacket packet;
+            size_t mappedSize = 0;
+            const uint8_t* mapped = mSource->getSampleData(mappedSize);
+            ssize_t size = mapped ? (ssize_t)mappedSize : mSource->readSampleData(sampleBuffer.data(), sampleBuffer.size());
+            const uint8_t* sample = mapped ? mapped : sampleBuffer.data();
+            const uint32_t sampleFlags = mSource->getSampleFlags();
+            packet.pts = sampleTime + mLoopOffsetUs;
+            packet.flags = (sampleFlags & IMediaSource::kSampleFlagSync) ? MediaPacket::kFlagSync : 0;
+            // Read the new format while the sample that carries it is still current.
+            MediaTrackInfo info;
+            const bool formatChange = (sampleFlags & IMediaSource::kSampleFlagFormatChange) && mSource->getTrackInfo(index, info);
+            mSource->advance();
+            if (size < 0 || (index != mVideoTrackIndex && index != mAudioTrackIndex)) {
+                continue;
+            }
+            if (formatChange && !info.codecConfig.empty()) {
+                // The decoder reconfigures in-band from here on, without a flush.
+                MediaPacket config;
+                config.pts = packet.pts;
+                config.flags = MediaPacket::kFlagCodecConfig;
+                config.data = std::move(info.codecConfig);
+                outbox.emplace_back(index == mVideoTrackIndex, std::move(config));
+            }
+            if (index == mVideoTrackIndex && isNonReferenceSample(mVideoMime, sample, size)) {
+                packet.flags |= MediaPacket::kFlagNonReference;
+            }
+            if (mapped) {
+                packet.mapped = mapped;
+                packet.mappedSize = size;
+            } else {
+                packet.data.assign(sampleBuffer.data(), sampleBuffer.data() + size);
+            }
+            outbox.emplace_back(index == mVideoTrackIndex, std::move(packet));
         }
 
-        if (videoCodec) {
-            media_status_t status = AMediaCodec_start(videoCodec);
-            if (status != AMEDIA_OK) {
-                Log::Write(Log::Level::Error, Fmt("AMediaCodec_start error, status = %d", status));
-            } else {
-                Log::Write(Log::Level::Info, "video AMediaCodec_start successfully");
+        const bool isVideo = outbox.front().first;
+        SpscRing<MediaPacket>& queue = isVideo ? mVideoPackets : mAudioPackets;
+        if (queue.push(std::move(outbox.front().second))) {
+            outbox.pop_front();
+            mDemuxCounters.processed++;
+            ksSignal_Raise(isVideo ? &mVideoWake : &mAudioWake);
+        } else {
+            mDemuxCounters.stalls++;
+            ksSignal_Wait(&mDemuxWake, SIGNAL_TIMEOUT_INFINITE);
+        }
+    }
+    Log::Write(Log::Level::Info, "demux thread exit");
+}
+
+// Demux thread at a switch, or seek() taking a switch back. Decoders are swapped by the video thread.
+void CPlayer::swapStandbySource() {
+    std::swap(mSource, mStandbySource);
+    if (mPlaylist.empty()) {
+        return;
+    }
+    std::swap(mVideoTrackIndex, mStandbyVideoTrack);
+    std::swap(mAudioTrackIndex, mStandbyAudioTrack);
+    std::swap(mVideoDurationUs, mStandbyDurationUs);
+    std::swap(mVideoMime, mStandbyVideoMime);
+    std::swap(mKeyframeIndex, mStandbyKeyframeIndex);
+    mStandbyItem = mPlaylistItem.exchange(mStandbyItem);
+}
+
+// Demux thread. The standby decoder is only reused once the video stage has switched away from it
+// and the renderer has released every frame of the pass it decoded (flush would invalidate them).
+// Playlist items get a decoder of their own when there is none to reuse, and may be of any length.
+bool CPlayer::canPrerollStandby() {
+    // A running standby thread owns mStandbyDecoder and mStandbyPrimed (openStandbyItem() replaces
+    // the decoder) until the demux thread joins it at the end of the pass.
+    if (mStandbyThread.joinable()) {
+        return false;
+    }
+    const bool playlist = !mPlaylist.empty();
+    return (mStandbyDecoder || playlist) && mLoopCacheState == loopCacheOff && !mStandbyPrimed.load(std::memory_order_acquire) &&
+           (playlist || mVideoDurationUs > kLoopPrerollLeadUs) &&
+           mLoopSwitchesDone.load(std::memory_order_acquire) == mLoopSwitchesSent &&
+           (mStandbyDecoder == nullptr || mStandbyDecoder.use_count() == 1);
+}
+
+bool CPlayer::openStandbyItem() {
+    for (size_t step = 1; step <= mPlaylist.size() && mRunning; step++) {
+        const int32_t item = (int32_t)((mPlaylistItem + step) % mPlaylist.size());
+        const char* path = mPlaylist[item].c_str();
+        std::shared_ptr<IMediaSource> source = mBackend->createSource();
+        if (source == nullptr || !source->open(path)) {
+            Log::Write(Log::Level::Error, Fmt("playlist item %d: open %s error, skipped", item, path));
+            continue;
+        }
+        int32_t videoTrack = -1;
+        int32_t audioTrack = -1;
+        MediaTrackInfo video;
+        MediaTrackInfo audio;
+        for (size_t i = 0; i < source->getTrackCount(); i++) {
+            MediaTrackInfo info;
+            if (!source->getTrackInfo(i, info)) {
+                continue;
             }
-            status = AMediaExtractor_selectTrack(mExtractor, videoTrackIndex);
-            if (status != AMEDIA_OK) {
-                Log::Write(Log::Level::Error, Fmt("video AMediaExtractor_selectTrack error, status = %d", status));
-                return false;
+            if (info.type == mediaTypeVideo && videoTrack < 0) {
+                videoTrack = i;
+                video = std::move(info);
+            } else if (info.type == mediaTypeAudio && audioTrack < 0) {
+                audioTrack = i;
+                audio = std::move(info);
             }
         }
-        if (audioCodec) {
-            media_status_t status = AMediaCodec_start(audioCodec);
-            if (status != AMEDIA_OK) {
-                Log::Write(Log::Level::Error, Fmt("AMediaCodec_start error, status = %d", status));
-            } else {
-                Log::Write(Log::Level::Info, "audio AMediaCodec_start successfully");
+        if (videoTrack < 0) {
+            Log::Write(Log::Level::Error, Fmt("playlist item %d: no video track in %s, skipped", item, path));
+            continue;
+        }
+        // The audio decoder and sink stay open across items, so only audio they can take is played.
+        if (audioTrack >= 0 && (mAudioDecoder == nullptr || audio.mime != mAudioMime || audio.channelCount != mAudioChannelCount ||
+                                audio.sampleRate != mAudioSampleRate)) {
+            Log::Write(Log::Level::Info, Fmt("playlist item %d: audio %s %d ch %d Hz does not match the output, playing it silently",
+                                             item, audio.mime.c_str(), audio.channelCount, audio.sampleRate));
+            audioTrack = -1;
+        }
+        if (!source->selectTrack(videoTrack) || (audioTrack >= 0 && !source->selectTrack(audioTrack))) {
+            Log::Write(Log::Level::Error, Fmt("playlist item %d: selectTrack error, skipped", item));
+            continue;
+        }
+
+        // Same codec and size: the standby decoder only needs a flush. Otherwise it is replaced, so at
+        // most two video decoders exist at a time.
+        const bool reuse = mStandbyDecoder && video.mime == mStandbyDecoderFormat.mime &&
+                           video.width == mStandbyDecoderFormat.width && video.height == mStandbyDecoderFormat.height;
+        if (reuse) {
+            mStandbyDecoder->flush();
+        } else {
+            if (mStandbyDecoder) {
+                mStandbyDecoder->stop();
+                mStandbyDecoder.reset();
             }
-            status = AMediaExtractor_selectTrack(mExtractor, audioTrackIndex);
-            if (status != AMEDIA_OK) {
-                Log::Write(Log::Level::Error, Fmt("audio AMediaExtractor_selectTrack error, status = %d", status));
-                return false;
-            }          
+            std::shared_ptr<IMediaDecoder> decoder = mBackend->createDecoder(*source, videoTrack);
+            if (decoder == nullptr || !decoder->start()) {
+                Log::Write(Log::Level::Error, Fmt("playlist item %d: create video decoder %s error, skipped", item, video.mime.c_str()));
+                continue;
+            }
+            mStandbyDecoder = std::move(decoder);
+            mStandbyDecoderFormat = video;
         }
 
-        uint64_t pts_offset = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        mMaxInputSize = std::max(mMaxInputSize, std::max(video.maxInputSize, audioTrack >= 0 ? audio.maxInputSize : 0));
+        mStandbyKeyframeIndex.clear();
+        mStandbyKeyframeIndex.build(*mBackend, *source, path, videoTrack, true);
+        mRetiredSource = std::move(mStandbySource);
+        mStandbySource = std::move(source);
+        mStandbyItem = item;
+        mStandbyVideoTrack = videoTrack;
+        mStandbyAudioTrack = audioTrack;
+        mStandbyDurationUs = (video.durationUs > 0) ? video.durationUs : audio.durationUs;
+        mStandbyVideoMime = video.mime;
+        mStandbyAudio.clear();
+        if (audioTrack >= 0 && !audio.codecConfig.empty()) {
+            // Same format, but the stream parameters may differ from the previous item's.
+            MediaPacket config;
+            config.flags = MediaPacket::kFlagCodecConfig;
+            config.data = std::move(audio.codecConfig);
+            mStandbyAudio.push_back(std::move(config));
+        }
+        Log::Write(Log::Level::Info, Fmt("playlist item %d opened: %s %dx%d, %s decoder", item, video.mime.c_str(),
+                                         video.width, video.height, reuse ? "reused" : "new"));
+        return true;
+    }
+    return false;
+}
 
-        while (true) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+// Standby thread: decodes the start of the file with pts on the next pass, holding up to a frame
+// queue's worth of output. Audio read on the way is kept for the demux thread to queue at the switch.
+void CPlayer::prerollStandby(int64_t loopOffsetUs) {
+    const int64_t startNs = CMediaClock::monotonicNow();
+    if (mPlaylist.empty()) {
+        mStandbyDecoder->flush();  // also clears the end of stream left from its previous pass
+        mStandbySource->seekTo(0);
+        mStandbyAudio.clear();
+    } else if (!openStandbyItem()) {
+        Log::Write(Log::Level::Error, "no playable playlist item, repeating the current one");
+        return;
+    }
+    for (MediaPacket& config : mStandbyAudio) {
+        config.pts = loopOffsetUs;  // only the next item's audio config is queued yet
+    }
+    mStandbyInFlight = 0;
+    std::vector<uint8_t> sampleBuffer(mMaxInputSize);
+    uint32_t packets = 0;
+    while (mRunning && mStandbyFrames.size() < mFrameQueue.capacity()) {
+        const int32_t index = mStandbySource->getSampleTrackIndex();
+        const bool inputDone = (index < 0 || packets >= kLoopPrerollMaxPackets);
+        DecoderBufferInfo info;
+        ssize_t bufferIdx = mStandbyDecoder->dequeueOutputBuffer(info, inputDone ? kCodecWaitUs : 0);
+        if (bufferIdx >= 0) {
+            mStandbyInFlight = std::max(mStandbyInFlight - 1, 0);
+            MediaFrameHandle frame = makeVideoFrame(mStandbyDecoder, bufferIdx, info);
+            if (frame) {
+                mStandbyFrames.push_back(std::move(frame));
+            }
+            continue;
+        }
+        if (inputDone) {
+            break;
+        }
 
-            int32_t index = AMediaExtractor_getSampleTrackIndex(mExtractor);
-            int64_t pts = AMediaExtractor_getSampleTime(mExtractor);
-            pts += pts_offset;
-            if (index < 0) {
-                // Play from the beginning when reach end of the file
-                Log::Write(Log::Level::Info, Fmt("the video file is end, index:%d", index));
-                AMediaExtractor_seekTo(mExtractor, 0, AMEDIAEXTRACTOR_SEEK_CLOSEST_SYNC);
-                pts_offset += videoDurationUs;
-            } else if (index == audioTrackIndex) {
-                //audio
-                ssize_t bufferIdx_a = AMediaCodec_dequeueInputBuffer(audioCodec, 1);
-                if (bufferIdx_a >= 0) {
-                    size_t bufferSize = 0;
-                    uint8_t *buffer = AMediaCodec_getInputBuffer(audioCodec, bufferIdx_a, &bufferSize);
-                    ssize_t size = AMediaExtractor_readSampleData(mExtractor, buffer, bufferSize);
-                    if (size > 0) {
-                        AMediaCodec_queueInputBuffer(audioCodec, bufferIdx_a, 0, size, pts, 0);
-                    }
-                    AMediaExtractor_advance(mExtractor);
+        const int64_t sampleTime = mStandbySource->getSampleTime();
+        if (index == mStandbyAudioTrack) {
+            size_t mappedSize = 0;
+            const uint8_t* mapped = mStandbySource->getSampleData(mappedSize);
+            ssize_t size = mapped ? (ssize_t)mappedSize : mStandbySource->readSampleData(sampleBuffer.data(), sampleBuffer.size());
+            if (size >= 0) {
+                MediaPacket packet;
+                packet.pts = sampleTime + loopOffsetUs;
+                packet.flags = MediaPacket::kFlagSync;
+                if (mapped) {
+                    packet.mapped = mapped;
+                    packet.mappedSize = size;
                 } else {
-                    Log::Write(Log::Level::Info, Fmt("audio AMediaCodec_dequeueInputBuffer bufferIdx_a:%d", bufferIdx_a));
+                    packet.data.assign(sampleBuffer.data(), sampleBuffer.data() + size);
                 }
-            } else if (index == videoTrackIndex) {
-                //video
-                ssize_t bufferIdx = AMediaCodec_dequeueInputBuffer(videoCodec, 1);
+                mStandbyAudio.push_back(std::move(packet));
+            }
+            mStandbySource->advance();
+            continue;
+        }
+        if (index != mStandbyVideoTrack) {
+            mStandbySource->advance();
+            continue;
+        }
+        bufferIdx = mStandbyDecoder->dequeueInputBuffer(kCodecWaitUs);
+        if (bufferIdx < 0) {
+            continue;
+        }
+        size_t bufferSize = 0;
+        uint8_t *buffer = mStandbyDecoder->getInputBuffer(bufferIdx, &bufferSize);
+        ssize_t size = mStandbySource->readSampleData(buffer, bufferSize);
+        mStandbyDecoder->queueInputBuffer(bufferIdx, std::max<ssize_t>(size, 0), sampleTime + loopOffsetUs, 0);
+        mStandbySource->advance();
+        mStandbyInFlight++;
+        packets++;
+    }
+    // Publishes the frames, audio and source position above to the demux thread.
+    mStandbyPrimed.store(!mStandbyFrames.empty(), std::memory_order_release);
+    Log::Write(Log::Level::Info, Fmt("standby pre-rolled %d frames from %u packets in %lld us%s", (int32_t)mStandbyFrames.size(), packets,
+                                     (long long)((CMediaClock::monotonicNow() - startNs) / 1000),
+                                     mPlaylist.empty() ? "" : Fmt(" (playlist item %d)", mStandbyItem).c_str()));
+}
+
+// Video decode stage: feeds the codec from the video packet queue and publishes decoded frames.
+void CPlayer::videoDecodeLoop() {
+    int32_t inFlight = 0;  // samples queued to the codec that have not come out yet
+    int64_t lastPts = -1;  // newest frame handed to the render side
+    bool catchingUp = false;
+    bool draining = false; // end of stream queued to the outgoing decoder at a loop switch
+    std::vector<MediaFrameHandle> prerolled;  // taken over from the standby, published first
+    size_t prerolledNext = 0;
+
+    auto publish = [&](MediaFrameHandle frame) {
+        // Without audio to follow, the clock starts at the first decoded frame. Live frames are
+        // shown as they come and never start it.
+        if (mVideoStartsClock && !mClock.isStarted()) {
+            mClock.start(frame->pts);
+        }
+        const int64_t loopStart = mLoopStartNs;
+        frame->loopStart = (lastPts >= 0 && lastPts < loopStart && frame->pts >= loopStart);
+        if (lastPts >= 0 && frame->pts > lastPts) {
+            mVideoFrameIntervalNs = frame->pts - lastPts;
+        }
+        lastPts = frame->pts;
+        const LoopCacheState cacheState = mLoopCacheState;
+        if ((cacheState == loopCacheRecording || cacheState == loopCacheDraining) && mLoopCacheWholePass &&
+            !mLoopCache.append(frame->data, frame->size, frame->width, frame->height, frame->stride, frame->sliceHeight, frame->planarChroma,
+                               frame->pts - mLoopCachePassNs)) {
+            LoopCacheState recording = loopCacheRecording;
+            if (mLoopCacheState.compare_exchange_strong(recording, loopCacheOff)) {
+                Log::Write(Log::Level::Info, Fmt("loop cache: clip needs more than %llu MB, every pass is decoded",
+                                                 (unsigned long long)(mLoopCache.budget() >> 20)));
+            }
+        }
+        mFrameQueue.push(std::move(frame));
+        mVideoCounters.processed++;
+    };
+
+    while (mRunning) {
+        bool fed = false;
+
+        while (prerolledNext < prerolled.size() && !mFrameQueue.full()) {
+            publish(std::move(prerolled[prerolledNext++]));
+        }
+        if (prerolledNext < prerolled.size()) {
+            mVideoCounters.stalls++;
+            ksSignal_Wait(&mVideoWake, SIGNAL_TIMEOUT_INFINITE);
+            continue;
+        }
+
+        // Decode-ahead budget: once two frames are queued the renderer retires one as the clock
+        // moves on and raises mVideoWake, so it is safe to sleep until then.
+        if (mDecodeAheadNs > 0 && mClock.isStarted() && mFrameQueue.size() >= 2 &&
+            lastPts - mClock.getMediaTime(CMediaClock::monotonicNow()) > mDecodeAheadNs) {
+            mVideoCounters.stalls++;
+            ksSignal_Wait(&mVideoWake, SIGNAL_TIMEOUT_INFINITE);
+            continue;
+        }
+
+        if (mLoopCacheState == loopCacheReplaying) {
+            // The renderer raises mVideoWake as it retires frames, freeing both queue slots and pooled frames.
+            MediaFrameHandle frame = mFrameQueue.full() ? MediaFrameHandle() : nextLoopCacheFrame();
+            if (frame) {
+                publish(std::move(frame));
+            } else {
+                mVideoCounters.stalls++;
+                ksSignal_Wait(&mVideoWake, SIGNAL_TIMEOUT_INFINITE);
+            }
+            continue;
+        }
+
+        //video input buffer
+        MediaPacket* packet = mVideoPackets.front();
+        if (packet && (packet->flags & (MediaPacket::kFlagLoopSwitch | MediaPacket::kFlagLoopCache))) {
+            // Flush the tail of the pass out of the outgoing decoder; the switch happens at its end of stream.
+            if (!draining) {
+                ssize_t bufferIdx = mVideoDecoder->dequeueInputBuffer(0);
                 if (bufferIdx >= 0) {
-                    size_t bufferSize = 0;
-                    uint8_t *buffer = AMediaCodec_getInputBuffer(videoCodec, bufferIdx, &bufferSize);
-                    ssize_t size = AMediaExtractor_readSampleData(mExtractor, buffer, bufferSize);
-                    AMediaCodec_queueInputBuffer(videoCodec, bufferIdx, 0, size, pts, 0);
-                    AMediaExtractor_advance(mExtractor);
-                } else {
-                    Log::Write(Log::Level::Info, Fmt("video AMediaCodec_dequeueInputBuffer bufferIdx:%d", bufferIdx));
+                    mVideoDecoder->queueInputBuffer(bufferIdx, 0, packet->pts, IMediaDecoder::kFlagEndOfStream);
+                    draining = true;
                 }
             }
+        } else if (packet && shouldSkipVideoPacket(*packet, catchingUp)) {
+            mVideoPackets.pop();
+            ksSignal_Raise(&mDemuxWake);
+            mFramesDropped++;
+            mLoopCacheWholePass = false;
+            continue;
+        } else if (packet) {
+            ssize_t bufferIdx = mVideoDecoder->dequeueInputBuffer(0);
+            if (bufferIdx >= 0) {
+                size_t bufferSize = 0;
+                uint8_t *buffer = mVideoDecoder->getInputBuffer(bufferIdx, &bufferSize);
+                size_t size = std::min(packet->size(), bufferSize);
+                memcpy(buffer, packet->bytes(), size);
+                const bool config = (packet->flags & MediaPacket::kFlagCodecConfig) != 0;
+                mVideoDecoder->queueInputBuffer(bufferIdx, size, packet->pts, config ? IMediaDecoder::kFlagCodecConfig : 0);
+                mVideoPackets.pop();
+                ksSignal_Raise(&mDemuxWake);
+                inFlight += config ? 0 : 1;
+                fed = true;
+            }
+        }
 
-            //audio output buffer
-            if (audioCodec) {
-                AMediaCodecBufferInfo outputBufferInfo_a;
-                ssize_t bufferIdx_a = AMediaCodec_dequeueOutputBuffer(audioCodec, &outputBufferInfo_a, 1);
-                if (bufferIdx_a >= 0) {
-                    uint8_t *outputBuffer = AMediaCodec_getOutputBuffer(audioCodec, bufferIdx_a, nullptr);
-                    size_t outputDataSize = outputBufferInfo_a.size;
-                    const uint32_t numSamples = outputDataSize / (audioChannelCount * sizeof(int16_t));
-                    const int64_t timeout = int64_t(numSamples * 1.0 * oboe::kNanosPerMillisecond / audioSampleRate);
-                    oboe::ResultWithValue<int32_t> ret = audioStreamPlay->write(outputBuffer, numSamples, timeout);
-                    if (ret.value() == numSamples) {
-                        AMediaCodec_releaseOutputBuffer(audioCodec, bufferIdx_a, true);
-                    } else {
-                        Log::Write(Log::Level::Error, Fmt("audio write ret:%d", ret));
-                        AMediaCodec_releaseOutputBuffer(audioCodec, bufferIdx_a, true);
-                    }
+        //video output buffer, left in the codec while the render side still holds a full queue
+        if (mFrameQueue.full()) {
+            if (!fed) {
+                mVideoCounters.stalls++;
+                ksSignal_Wait(&mVideoWake, SIGNAL_TIMEOUT_INFINITE);
+            }
+            continue;
+        }
+        if (!fed && packet == nullptr && inFlight == 0) {
+            // Codec is empty and there is nothing to feed it.
+            ksSignal_Wait(&mVideoWake, SIGNAL_TIMEOUT_INFINITE);
+            continue;
+        }
+
+        // Block inside the codec only when there was nothing to feed it this pass.
+        DecoderBufferInfo outputBufferInfo;
+        ssize_t bufferIdx = mVideoDecoder->dequeueOutputBuffer(outputBufferInfo, fed ? 0 : kCodecWaitUs);
+        if (bufferIdx >= 0) {
+            inFlight = std::max(inFlight - 1, 0);
+            const bool endOfStream = (outputBufferInfo.flags & IMediaDecoder::kFlagEndOfStream) != 0;
+            if (outputBufferInfo.presentationTimeUs < mPrerollUs) {
+                // Decoded after an exact seek only to reach the target frame.
+                mVideoDecoder->releaseOutputBuffer(bufferIdx, false);
+                mSeekPrerollFrames++;
+            } else if (MediaFrameHandle frame = makeVideoFrame(mVideoDecoder, bufferIdx, outputBufferInfo)) {
+                publish(std::move(frame));
+            } else if (outputBufferInfo.size > 0) {
+                mLoopCacheWholePass = false;
+            }
+
+            if (endOfStream && draining && (mVideoPackets.front()->flags & MediaPacket::kFlagLoopCache)) {
+                // The decoder is reused for the next pass unless the cache takes over.
+                const int64_t nextPassNs = mVideoPackets.front()->pts * 1000;
+                mVideoPackets.pop();
+                mVideoDecoder->flush();
+                inFlight = 0;
+                draining = false;
+                settleLoopCache(nextPassNs);
+                ksSignal_Raise(&mDemuxWake);
+            } else if (endOfStream && draining) {
+                mVideoPackets.pop();
+                ksSignal_Raise(&mDemuxWake);
+                std::swap(mVideoDecoder, mStandbyDecoder);
+                std::swap(mVideoDecoderFormat, mStandbyDecoderFormat);
+                // Swapping keeps both vectors' storage, so the switch doesn't allocate either.
+                prerolled.clear();
+                prerolledNext = 0;
+                std::swap(prerolled, mStandbyFrames);
+                inFlight = mStandbyInFlight;
+                draining = false;
+                mGaplessLoops++;
+                mLoopSwitchesDone.fetch_add(1, std::memory_order_release);
+            } else if (endOfStream) {
+                Log::Write(Log::Level::Error, Fmt("video codec end"));
+            }
+        } else if (bufferIdx == IMediaDecoder::kTryAgainLater && !fed) {
+            // The codec wants more input before it can emit a frame (reordering); don't wait on it again.
+            inFlight = 0;
+        }
+    }
+    Log::Write(Log::Level::Info, "video decode thread exit");
+}
+
+void CPlayer::settleLoopCache(int64_t nextPassNs) {
+    if (mLoopCache.overflowed()) {
+        mLoopCache.clear();
+        mLoopCacheState = loopCacheOff;
+        Log::Write(Log::Level::Info, Fmt("loop cache: clip needs more than %llu MB, every pass is decoded", (unsigned long long)(mLoopCache.budget() >> 20)));
+        return;
+    }
+    if (mLoopCacheWholePass && !mLoopCache.empty()) {
+        mLoopCacheNext = 0;
+        mLoopCacheOffsetNs = nextPassNs;
+        mLoopCacheFrames = (uint32_t)mLoopCache.size();
+        mLoopCacheBytes = mLoopCache.bytes();
+        mLoopCacheState = loopCacheReplaying;
+        Log::Write(Log::Level::Info, Fmt("loop cache: %d frames in %llu KB, later passes are not decoded", (int32_t)mLoopCache.size(),
+                                         (unsigned long long)(mLoopCache.bytes() >> 10)));
+        return;
+    }
+    // Recording started after a seek, or frames were skipped or dropped: record the pass starting now.
+    mLoopCache.clear();
+    mLoopCacheWholePass = true;
+    mLoopCachePassNs = nextPassNs;
+    mLoopCacheState = loopCacheRecording;
+}
+
+MediaFrameHandle CPlayer::nextLoopCacheFrame() {
+    if (mFramePool.available() == 0) {
+        return MediaFrameHandle();
+    }
+    if (mLoopCacheNext >= mLoopCache.size()) {
+        mLoopCacheNext = 0;
+        mLoopCacheOffsetNs += mVideoDurationUs * 1000;
+        mLoopStartNs = mLoopCacheOffsetNs;
+        mLoopCount++;
+    }
+    MediaFrameHandle frame = mFramePool.acquire(nullptr, -1);
+    if (!frame) {
+        return frame;
+    }
+    const CachedFrame& cached = mLoopCache.frame(mLoopCacheNext++);
+    frame->type = mediaTypeVideo;
+    frame->width = cached.width;
+    frame->height = cached.height;
+    frame->stride = cached.stride;
+    frame->sliceHeight = cached.sliceHeight;
+    frame->pts = cached.pts + mLoopCacheOffsetNs;
+    frame->number = mFrameNumber.fetch_add(1, std::memory_order_relaxed) + 1;
+    frame->data = cached.data.get();
+    frame->size = cached.size;
+    frame->planarChroma = cached.planarChroma;
+    frame->decodeTime = CMediaClock::monotonicNow();
+    mLoopCacheFramesServed++;
+    return frame;
+}
+
+// Audio decode stage: feeds the codec from the audio packet queue and writes PCM to the sink's ring.
+// Waiting for ring space only paces this thread, never the demux or video stages.
+void CPlayer::audioDecodeLoop() {
+    int32_t inFlight = 0;
+    while (mRunning) {
+        bool fed = false;
+
+        // Keep the decoded audio in the codec while paused; resume() raises mAudioWake.
+        if (mClock.isPaused()) {
+            ksSignal_Wait(&mAudioWake, SIGNAL_TIMEOUT_INFINITE);
+            continue;
+        }
+
+        //audio input buffer
+        MediaPacket* packet = mAudioPackets.front();
+        if (packet) {
+            ssize_t bufferIdx_a = mAudioDecoder->dequeueInputBuffer(0);
+            if (bufferIdx_a >= 0) {
+                size_t bufferSize = 0;
+                uint8_t *buffer = mAudioDecoder->getInputBuffer(bufferIdx_a, &bufferSize);
+                size_t size = std::min(packet->size(), bufferSize);
+                memcpy(buffer, packet->bytes(), size);
+                const bool config = (packet->flags & MediaPacket::kFlagCodecConfig) != 0;
+                mAudioDecoder->queueInputBuffer(bufferIdx_a, size, packet->pts, config ? IMediaDecoder::kFlagCodecConfig : 0);
+                mAudioPackets.pop();
+                ksSignal_Raise(&mDemuxWake);
+                inFlight += config ? 0 : 1;
+                fed = true;
+            }
+        }
+
+        if (!fed && packet == nullptr && inFlight == 0) {
+            ksSignal_Wait(&mAudioWake, SIGNAL_TIMEOUT_INFINITE);
+            continue;
+        }
+
+        //audio output buffer
+        DecoderBufferInfo outputBufferInfo_a;
+        ssize_t bufferIdx_a = mAudioDecoder->dequeueOutputBuffer(outputBufferInfo_a, fed ? 0 : kCodecWaitUs);
+        if (bufferIdx_a >= 0) {
+            inFlight = std::max(inFlight - 1, 0);
+            uint8_t *outputBuffer = mAudioDecoder->getOutputBuffer(bufferIdx_a);
+            size_t outputDataSize = outputBufferInfo_a.size;
+            const int32_t numSamples = outputDataSize / (mAudioChannelCount * sizeof(int16_t));
+            const int64_t pts = outputBufferInfo_a.presentationTimeUs * 1000;
+            const bool preroll = outputBufferInfo_a.presentationTimeUs + numSamples * 1000000LL / mAudioSampleRate <= mPrerollUs;
+            if (preroll || mClock.getRate() != 1.0) {
+                // Audio before a seek target is never heard. There is no time stretching either: at other
+                // rates audio is dropped and the clock free-runs.
+                mAudioDecoder->releaseOutputBuffer(bufferIdx_a, false);
+                mAudioCounters.processed++;
+                continue;
+            }
+            if (!mClock.isStarted()) {
+                mClock.start(pts);
+            }
+            if (mAudioWrites.empty() || pts - mAudioEndNs > kAudioGapNs) {
+                // After a seek, or media without audio in between such as a silent playlist item, the device
+                // may have run dry and played silence. Samples the video-started clock has not reached yet
+                // are held until due; sink positions count written frames only, so no catch-up is needed.
+                int64_t aheadNs = 0;
+                while (mRunning && (aheadNs = pts - mClock.getMediaTime(CMediaClock::monotonicNow())) > 0) {
+                    ksSignal_Wait(&mAudioWake, std::min<int64_t>(aheadNs, kCodecWaitUs * 1000));
                 }
+                if (!mRunning) {
+                    mAudioDecoder->releaseOutputBuffer(bufferIdx_a, false);
+                    break;
+                }
+                mAudioWrites.clear();
+                mAudioConverter.reset();
             }
-            
-            //video output buffer
-            if (videoCodec) {
-                AMediaCodecBufferInfo outputBufferInfo;
-                ssize_t bufferIdx = AMediaCodec_dequeueOutputBuffer(videoCodec, &outputBufferInfo, 1);
-                if (bufferIdx >= 0) {
-                    if (outputBufferInfo.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
-                        Log::Write(Log::Level::Error, Fmt("video codec end"));
-                    }
-                    uint8_t *outputBuffer = AMediaCodec_getOutputBuffer(videoCodec, bufferIdx, nullptr);
-                    if (outputBuffer) {
-                        std::shared_ptr<MediaFrame> frame = std::make_shared<MediaFrame>();
-                        frame->type = mediaTypeVideo;
-                        frame->width = videoWidth;
-                        frame->height = videoHeight;
-                        frame->pts = outputBufferInfo.presentationTimeUs / 1000;
-                        frame->number = 0;
-                        frame->data = outputBuffer + outputBufferInfo.offset;
-                        frame->size = outputBufferInfo.size;
-                        frame->bufferIndex = bufferIdx;
-                        
-                        mMediaListMutex.lock();
-                        mMediaList.push_back(frame);
-                        //Log::Write(Log::Level::Error, Fmt("mMediaList size:%d", mMediaList.size()));
-                        mMediaListMutex.unlock();
+            // Convert to the device's layout and rate; the resampler's filter delay shifts the output.
+            const int16_t* pcm = (const int16_t*)(outputBuffer + outputBufferInfo_a.offset);
+            int32_t numFrames = numSamples;
+            if (!mAudioConverter.passthrough()) {
+                numFrames = mAudioConverter.process(pcm, numSamples);
+                pcm = mAudioConverter.output();
+            }
+            const int64_t outputPts = pts - mAudioConverter.delayNs();
+            // The sink never blocks: queue what fits in its ring and sleep for roughly the time the
+            // device needs to drain the rest. Each accepted chunk gets its own write record.
+            int32_t written = 0;
+            while (mRunning && written < numFrames) {
+                const int32_t ret = mAudioSink->write(pcm + (size_t)written * mAudioOutputChannelCount, numFrames - written);
+                if (ret > 0) {
+                    mAudioWrites.emplace_back(mAudioFramesWritten, outputPts + written * 1000000000LL / mAudioOutputSampleRate);
+                    if (mAudioWrites.size() > kAudioWriteHistory) {
+                        mAudioWrites.pop_front();
                     }
+                    mAudioFramesWritten += ret;
+                    written += ret;
+                    mAudioEndNs = outputPts + written * 1000000000LL / mAudioOutputSampleRate;
+                    syncClockToAudio();
+                }
+                if (written < numFrames && mClock.isPaused()) {
+                    ksSignal_Wait(&mAudioWake, SIGNAL_TIMEOUT_INFINITE);
+                } else if (written < numFrames) {
+                    mAudioCounters.stalls++;
+                    ksSignal_Wait(&mAudioWake, (numFrames - written) * 1000000000LL / mAudioOutputSampleRate);
                 }
             }
+            mAudioDecoder->releaseOutputBuffer(bufferIdx_a, true);
+            mAudioCounters.processed++;
+        } else if (bufferIdx_a == IMediaDecoder::kTryAgainLater && !fed) {
+            inFlight = 0;
         }
-        Log::Write(Log::Level::Error, Fmt("exit thread......"));
-    }).detach();
+    }
+    Log::Write(Log::Level::Info, "audio decode thread exit");
+}
 
-    return true;
+MediaFrameHandle CPlayer::makeVideoFrame(const std::shared_ptr<IMediaDecoder>& decoder, ssize_t bufferIdx, const DecoderBufferInfo& info) {
+    uint8_t *outputBuffer = decoder->getOutputBuffer(bufferIdx);
+    if (outputBuffer == nullptr || info.size <= 0) {
+        decoder->releaseOutputBuffer(bufferIdx, false);
+        return MediaFrameHandle();
+    }
+    MediaFrameHandle frame = mFramePool.acquire(decoder, bufferIdx);
+    if (!frame) {
+        return frame;
+    }
+    // Follows the decoder through resolution changes between adaptive renditions.
+    int32_t width = mVideoWidth;
+    int32_t height = mVideoHeight;
+    if (decoder->getOutputSize(width, height)) {
+        getAlignment(width, height, mAlignment);
+    }
+    // Decoders that pad their buffers past the picture say so; the rest are packed.
+    int32_t stride = width;
+    int32_t sliceHeight = height;
+    if (!decoder->getOutputLayout(stride, sliceHeight) || stride < width || sliceHeight < height) {
+        stride = width;
+        sliceHeight = height;
+    }
+    frame->type = mediaTypeVideo;
+    frame->width = width;
+    frame->height = height;
+    frame->stride = stride;
+    frame->sliceHeight = sliceHeight;
+    frame->pts = info.presentationTimeUs * 1000;
+    frame->number = mFrameNumber.fetch_add(1, std::memory_order_relaxed) + 1;
+    frame->data = outputBuffer + info.offset;
+    frame->size = info.size;
+    frame->planarChroma = decoder->isOutputPlanar();
+    frame->decodeTime = CMediaClock::monotonicNow();
+    return frame;
 }
 
-bool CPlayer::stop() {
-    return true;
+// Input-side late handling for the skip and catch-up policies. Output-side drops happen in getFrame().
+bool CPlayer::shouldSkipVideoPacket(const MediaPacket& packet, bool& catchingUp) {
+    if (packet.flags & MediaPacket::kFlagCodecConfig) {
+        return false;
+    }
+    if (mLatePolicy < lateFramePolicySkipNonReference || !mClock.isStarted() || mClock.isPaused()) {
+        catchingUp = false;
+        return false;
+    }
+    if (catchingUp) {
+        if (packet.flags & MediaPacket::kFlagSync) {
+            catchingUp = false;
+            return false;
+        }
+        return true;
+    }
+    const int64_t lateness = mClock.getMediaTime(CMediaClock::monotonicNow()) - packet.pts * 1000;
+    if (mLatePolicy >= lateFramePolicyCatchUpToKeyframe && lateness > kCatchUpLateNs && !(packet.flags & MediaPacket::kFlagSync)) {
+        Log::Write(Log::Level::Info, Fmt("video %lld ms behind, skipping to the next keyframe", (long long)(lateness / 1000000)));
+        catchingUp = true;
+        return true;
+    }
+    return lateness > kSkipLateNs && (packet.flags & MediaPacket::kFlagNonReference);
+}
+
+// Scans the leading NAL units of an Annex-B H.264/HEVC sample for its first slice. Raw frames are
+// always disposable; other codecs are never treated as non-reference.
+bool CPlayer::isNonReferenceSample(const std::string& mime, const uint8_t* data, size_t size) {
+    const bool avc = (mime == "video/avc");
+    const bool hevc = (mime == "video/hevc");
+    if (!avc && !hevc) {
+        return mime.compare(0, 10, "video/x-raw") == 0;
+    }
+    for (size_t i = 0; i + 3 < size; i++) {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+            continue;
+        }
+        const uint8_t header = data[i + 3];
+        if (avc) {
+            const uint8_t type = header & 0x1f;
+            if (type == 1 || type == 5) {
+                return (header & 0x60) == 0;  // nal_ref_idc
+            }
+        } else {
+            const uint8_t type = (header >> 1) & 0x3f;
+            if (type < 32) {
+                return type <= 14 && (type % 2) == 0;  // TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N, RSV_VCL_N*
+            }
+        }
+        i += 3;
+    }
+    return false;
 }
 
-std::shared_ptr<MediaFrame> CPlayer::getFrame() {
-    std::lock_guard<std::mutex> guard(mMediaListMutex);
-    if (mMediaList.size()) {
-        return mMediaList.front();
+// Maps the frame the audio device is presenting back to its media time and slaves the clock to it.
+void CPlayer::syncClockToAudio() {
+    int64_t framePosition = 0;
+    int64_t presentedAt = 0;
+    if (!mAudioSink->getTimestamp(framePosition, presentedAt)) {
+        return;
+    }
+    for (auto it = mAudioWrites.rbegin(); it != mAudioWrites.rend(); ++it) {
+        if (it->first <= framePosition) {
+            const int64_t mediaTime = it->second + (framePosition - it->first) * 1000000000 / mAudioOutputSampleRate;
+            mAvDrift = mClock.syncToAudio(mediaTime, presentedAt);
+            const int64_t loopStart = mLoopStartNs;
+            if (loopStart > mLoopAvMeasuredFor && mediaTime >= loopStart) {
+                mLastLoopAvOffsetNs = mAvDrift.load();
+                mLoopAvMeasuredFor = loopStart;
+            }
+            return;
+        }
+    }
+}
+
+bool CPlayer::isBusy() const {
+    if (mTimeToFirstFrameNs == 0) {
+        return true;
+    }
+    return mRunning && mFrameQueue.size() < std::min(kBusyQueueFrames, mFrameQueue.capacity());
+}
+
+PipelineStats CPlayer::getStats() {
+    PipelineStats stats;
+    stats.videoPacketQueueDepth = mVideoPackets.size();
+    stats.audioPacketQueueDepth = mAudioPackets.size();
+    stats.frameQueueDepth = mFrameQueue.size();
+    stats.demuxPackets = mDemuxCounters.processed;
+    stats.demuxStalls = mDemuxCounters.stalls;
+    stats.videoFrames = mVideoCounters.processed;
+    stats.videoStalls = mVideoCounters.stalls;
+    stats.audioBuffers = mAudioCounters.processed;
+    stats.audioStalls = mAudioCounters.stalls;
+    stats.framesDropped = mFramesDropped;
+    stats.framesLate = mFramesLate;
+    stats.framesRepeated = mFramesRepeated;
+    stats.seekCount = mSeekCount;
+    stats.seekPrerollFrames = mSeekPrerollFrames;
+    stats.lastSeekLatencyNs = mLastSeekLatencyNs;
+    stats.maxSeekLatencyNs = mMaxSeekLatencyNs;
+    stats.loopCount = mLoopCount;
+    stats.gaplessLoops = mGaplessLoops;
+    stats.lastLoopFrameGapNs = mLastLoopFrameGapNs;
+    stats.maxLoopFrameGapNs = mMaxLoopFrameGapNs;
+    stats.lastLoopAvOffsetNs = mLastLoopAvOffsetNs;
+    stats.avDriftNs = mAvDrift;
+    const AudioSinkStats sink = mAudioSink ? mAudioSink->getStats() : AudioSinkStats();
+    stats.audioUnderruns = sink.underruns;
+    stats.audioRingFullWrites = sink.ringFullWrites;
+    stats.audioOutputLatencyNs = sink.outputLatencyNs;
+    stats.audioBufferedFrames = sink.bufferedFrames;
+    stats.audioAmbisonicOrder = sink.ambisonicOrder;
+    stats.audioSpatialBlockNs = sink.spatialBlockNs;
+    stats.audioSpatialMaxBlockNs = sink.maxSpatialBlockNs;
+    stats.poseToAudioNs = sink.poseToAudioNs;
+    stats.maxPoseToAudioNs = sink.maxPoseToAudioNs;
+    std::shared_ptr<MediaIoCounters> io = mBackend->getIoCounters();
+    stats.ioBytesRead = io ? io->bytesRead.load() : 0;
+    stats.ioReads = io ? io->reads.load() : 0;
+    stats.ioStalls = io ? io->stalls.load() : 0;
+    stats.ioStallNs = io ? io->stallNs.load() : 0;
+    stats.ioRequests = io ? io->requests.load() : 0;
+    stats.ioFetchedBytes = io ? io->fetchedBytes.load() : 0;
+    stats.timeToFirstFrameNs = mTimeToFirstFrameNs;
+    stats.warmOpen = mWarmOpen;
+    stats.rendition = mAdaptive ? mAdaptiveCounters->rendition.load() : -1;
+    stats.renditionSwitches = mAdaptiveCounters->renditionSwitches;
+    stats.throughputBps = mAdaptiveCounters->throughputBps;
+    stats.bufferedUs = mAdaptiveCounters->bufferedUs;
+    stats.segmentsDownloaded = mAdaptiveCounters->segmentsDownloaded;
+    stats.segmentCacheHits = mAdaptiveCounters->segmentCacheHits;
+    stats.liveFrames = mLiveFrames;
+    stats.liveUnitsDiscarded = mLiveCounters->unitsDiscarded;
+    stats.jitterDelayNs = mLiveCounters->jitterDelayNs;
+    stats.ingestToDecodeP50Ns = mIngestToDecode.percentileNs(0.5);
+    stats.ingestToDecodeP99Ns = mIngestToDecode.percentileNs(0.99);
+    stats.decodeToDisplayP50Ns = mDecodeToDisplay.percentileNs(0.5);
+    stats.decodeToDisplayP99Ns = mDecodeToDisplay.percentileNs(0.99);
+    stats.ingestToDisplayP50Ns = mIngestToDisplay.percentileNs(0.5);
+    stats.ingestToDisplayP99Ns = mIngestToDisplay.percentileNs(0.99);
+    stats.playlistItem = mPlaylist.empty() ? -1 : mPlaylistItem.load();
+    stats.playlistSwitches = mPlaylistSwitches;
+    stats.loopCacheReplaying = (mLoopCacheState == loopCacheReplaying);
+    stats.loopCacheFrames = mLoopCacheFrames;
+    stats.loopCacheBytes = mLoopCacheBytes;
+    stats.loopCacheFramesServed = mLoopCacheFramesServed;
+    return stats;
+}
+
+const MediaFrame* CPlayer::getFrame(int64_t displayTime, int64_t displayPeriod) {
+    if (mSeekStartNs >= 0 && mFrameQueue.front()) {
+        const int64_t latency = CMediaClock::monotonicNow() - mSeekStartNs;
+        mLastSeekLatencyNs = latency;
+        mMaxSeekLatencyNs = std::max<int64_t>(mMaxSeekLatencyNs, latency);
+        mSeekStartNs = -1;
+        Log::Write(Log::Level::Info, Fmt("seek latency %lld us, %llu preroll frames", (long long)(latency / 1000), (unsigned long long)mSeekPrerollFrames));
+    }
+    if (mOpenStartNs >= 0 && mFrameQueue.front()) {
+        // Warm means the open ran entirely off the index cache: hits and no misses since setDataSource().
+        std::shared_ptr<CIndexCache> indexCache = mBackend->getIndexCache();
+        mWarmOpen = indexCache && indexCache->misses() == mOpenCacheMisses && indexCache->hits() > mOpenCacheHits;
+        mTimeToFirstFrameNs = CMediaClock::monotonicNow() - mOpenStartNs;
+        mOpenStartNs = -1;
+        Log::Write(Log::Level::Info, Fmt("time to first frame %lld us (%s open)", (long long)(mTimeToFirstFrameNs / 1000), mWarmOpen ? "warm" : "cold"));
+    }
+    if (mLive) {
+        return getLiveFrame(displayTime);
+    }
+    if (!mClock.isStarted()) {
+        MediaFrameHandle* front = mFrameQueue.front();
+        if (front == nullptr) {
+            return nullptr;
+        }
+        mLastShownPts = (*front)->pts;
+        mLastNewFrameTime = displayTime;
+        return front->get();
+    }
+    // A frame is due if it starts no later than half a refresh after the display instant,
+    // so each video frame lands on the refresh closest to its timestamp.
+    const double rate = mClock.getRate();
+    const int64_t mediaAt = mClock.getMediaTime(displayTime);
+    const int64_t dueBy = mediaAt + (int64_t)(displayPeriod * rate / 2);
+    uint32_t due = 0;
+    if (mLatePolicy == lateFramePolicyNone) {
+        // Step at most one frame per refresh, and only past a frame that has been shown.
+        MediaFrameHandle* front = mFrameQueue.front();
+        MediaFrameHandle* next = mFrameQueue.at(1);
+        if (next && (*front)->pts == mLastShownPts && (*next)->pts <= dueBy) {
+            due = 1;
+        }
     } else {
+        while (MediaFrameHandle* next = mFrameQueue.at(due + 1)) {
+            if ((*next)->pts > dueBy) {
+                break;
+            }
+            due++;
+        }
+    }
+    // Popping drops the handle, which returns the codec buffer.
+    for (uint32_t i = 0; i < due; i++) {
+        if ((*mFrameQueue.front())->pts != mLastShownPts) {
+            mFramesDropped++;
+        }
+        mFrameQueue.pop();
+    }
+    if (due > 0) {
+        ksSignal_Raise(&mVideoWake);
+    }
+
+    // Until the next frame is due the current one stays on screen; before the first one is
+    // due it is shown early rather than leaving the screen black.
+    MediaFrameHandle* front = mFrameQueue.front();
+    if (front == nullptr) {
         return nullptr;
     }
+    const MediaFrame& frame = **front;
+    if (frame.pts != mLastShownPts) {
+        if (mediaAt - frame.pts > (int64_t)(displayPeriod * rate)) {
+            mFramesLate++;
+        }
+        if (frame.loopStart && mLastNewFrameTime >= 0) {
+            const int64_t gap = displayTime - mLastNewFrameTime;
+            mLastLoopFrameGapNs = gap;
+            mMaxLoopFrameGapNs = std::max<int64_t>(mMaxLoopFrameGapNs, gap);
+            if (!mPlaylist.empty()) {
+                Log::Write(Log::Level::Info, Fmt("playlist switch to item %d: frame gap %lld us, %dx%d, %s", mPlaylistItem.load(), (long long)(gap / 1000),
+                                                 frame.width, frame.height,
+                                                 (frame.width == mLastShownWidth && frame.height == mLastShownHeight) ? "same size" : "resized"));
+            }
+        }
+        mLastShownPts = frame.pts;
+        mLastShownWidth = frame.width;
+        mLastShownHeight = frame.height;
+        mLastNewFrameTime = displayTime;
+    } else if (!mClock.isPaused() && mVideoFrameIntervalNs > 0 && frame.pts + mVideoFrameIntervalNs <= dueBy) {
+        mFramesRepeated++;
+    }
+    return front->get();
 }
 
-bool CPlayer::releaseFrame(std::shared_ptr<MediaFrame> &frame) {
-    if (frame.get() == nullptr) {
-        return true;
+// The jitter buffer already paced the frames, so whatever is newest is shown, and older frames
+// still queued are dropped rather than adding a refresh of latency each.
+const MediaFrame* CPlayer::getLiveFrame(int64_t displayTime) {
+    uint32_t stale = 0;
+    while (mFrameQueue.at(stale + 1)) {
+        stale++;
     }
-    uint64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();  //in millisecond
-    if (now < frame->pts) {
-        return false;
+    for (uint32_t i = 0; i < stale; i++) {
+        if ((*mFrameQueue.front())->pts != mLastShownPts) {
+            mFramesDropped++;
+        }
+        mFrameQueue.pop();
     }
-    std::lock_guard<std::mutex> guard(mMediaListMutex);
-    if (mMediaList.size() <= 1) {
-        return true;
+    if (stale > 0) {
+        ksSignal_Raise(&mVideoWake);
     }
-    auto &it = mMediaList.front();
-    if (it.get() && it == frame) {
-        AMediaCodec_releaseOutputBuffer(this->mVideoCodec, it->bufferIndex, true);
-        mMediaList.pop_front();
+    MediaFrameHandle* front = mFrameQueue.front();
+    if (front == nullptr) {
+        return nullptr;
     }
-    return true;
+    const MediaFrame& frame = **front;
+    if (frame.pts != mLastShownPts) {
+        mIngestToDecode.add(frame.decodeTime - frame.pts);
+        mDecodeToDisplay.add(displayTime - frame.decodeTime);
+        mIngestToDisplay.add(displayTime - frame.pts);
+        mLastShownPts = frame.pts;
+        mLastNewFrameTime = displayTime;
+        if (++mLiveFrames % kLiveLatencyLogFrames == 0) {
+            PipelineStats stats = getStats();
+            Log::Write(Log::Level::Info, Fmt("live %llu frames, %llu dropped, %llu units discarded, jitter delay %lld us; latency p50/p99 ingest->decode %lld/%lld us, decode->display %lld/%lld us, ingest->display %lld/%lld us",
+                                             (unsigned long long)stats.liveFrames, (unsigned long long)stats.framesDropped,
+                                             (unsigned long long)stats.liveUnitsDiscarded, (long long)(stats.jitterDelayNs / 1000),
+                                             (long long)(stats.ingestToDecodeP50Ns / 1000), (long long)(stats.ingestToDecodeP99Ns / 1000),
+                                             (long long)(stats.decodeToDisplayP50Ns / 1000), (long long)(stats.decodeToDisplayP99Ns / 1000),
+                                             (long long)(stats.ingestToDisplayP50Ns / 1000), (long long)(stats.ingestToDisplayP99Ns / 1000)));
+        }
+    }
+    return front->get();
 }
 
 void CPlayer::getAlignment(int32_t &width, int32_t &height, int32_t alignment) {
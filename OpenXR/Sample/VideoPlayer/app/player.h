@@ -7,33 +7,158 @@
 #pragma once
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <thread>
 #include <list>
 #include <memory>
-#include <media/NdkMediaExtractor.h>
-#include "oboe/Oboe.h"
-
-typedef enum {
-    mediaTypeVideo = 0,
-    mediaTypeAudio
-}mediaType;
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <string>
+#include "mediabackend.h"
+#include "mediaclock.h"
+#include "keyframeindex.h"
+#include "adaptivesource.h"
+#include "livesource.h"
+#include "latencyhistogram.h"
+#include "framepool.h"
+#include "loopframecache.h"
+#include "audiodsp.h"
+#include "spscring.h"
+#include "utils/threading.h"
 
 typedef struct MediaFrame_tag {
-    MediaFrame_tag() : type(mediaTypeVideo), pts(0), number(0), data(nullptr), size(0) {};
+    MediaFrame_tag() : type(mediaTypeVideo), pts(0), width(0), height(0), stride(0), sliceHeight(0), number(0), data(nullptr), size(0), planarChroma(false), bufferIndex(-1), loopStart(false), decodeTime(0) {};
     mediaType type;
-    uint64_t pts;
+    int64_t pts;        // presentation time on the media timeline, nanoseconds
     int32_t width;
     int32_t height;
-    uint32_t number;
+    int32_t stride;      // bytes per luma row in data, at least width
+    int32_t sliceHeight; // luma rows before the chroma plane(s), at least height
+    uint32_t number;    // publish order, from 1: the same number is the same picture
     uint8_t* data;
     uint32_t size;
+    bool planarChroma;  // I420 (U plane, then V) rather than NV12's interleaved UV plane
     ssize_t bufferIndex;
+    std::shared_ptr<IMediaDecoder> decoder;   // owner of bufferIndex; changes at gapless loop switches
+    bool loopStart;     // first frame of a new pass through the file
+    int64_t decodeTime; // CLOCK_MONOTONIC ns the decoder output it
 }MediaFrame;
 
+// One compressed sample handed from the demux stage to a decode stage.
+typedef struct MediaPacket_tag {
+    static constexpr uint32_t kFlagSync = 1;          // decodable on its own (keyframe)
+    static constexpr uint32_t kFlagNonReference = 2;  // no later frame depends on it
+    static constexpr uint32_t kFlagLoopSwitch = 4;    // no data: drain the decoder and switch to the pre-rolled standby
+    static constexpr uint32_t kFlagCodecConfig = 8;   // data is the codec config of a new rendition, ahead of its first sample
+    static constexpr uint32_t kFlagLoopCache = 16;    // no data: end of a pass recorded into the loop cache, drain the decoder and judge it
+
+    MediaPacket_tag() : pts(0), flags(0), mapped(nullptr), mappedSize(0) {};
+    const uint8_t* bytes() const { return mapped ? mapped : data.data(); }
+    size_t size() const { return mapped ? mappedSize : data.size(); }
+    std::vector<uint8_t> data;
+    int64_t pts;        // media timeline, microseconds
+    uint32_t flags;
+    const uint8_t* mapped;  // sample in place in the source's mapped file, used instead of data when set
+    size_t mappedSize;
+}MediaPacket;
+
+// What to do with video that cannot be shown on time. Each policy includes the ones before it.
+typedef enum {
+    lateFramePolicyNone = 0,            // show every frame for at least one refresh, even late
+    lateFramePolicyDrop,                // retire overdue frames without uploading them
+    lateFramePolicySkipNonReference,    // also skip late non-reference samples before decoding
+    lateFramePolicyCatchUpToKeyframe    // also discard input up to the next keyframe when far behind
+}LateFramePolicy;
+
+// Throws std::invalid_argument for an unknown name.
+LateFramePolicy GetLateFramePolicy(const std::string& name);
+
+// Video decode thread's use of the loop cache. The demux thread moves recording to draining at the
+// end of a pass; the video thread settles draining into replaying, or back to recording.
+typedef enum {
+    loopCacheOff = 0,       // not enabled, not eligible, or the clip needs more than the budget
+    loopCacheRecording,     // copying decoded frames of the current pass
+    loopCacheDraining,      // the pass ended; the demux thread waits until the video thread has its last frames
+    loopCacheReplaying      // every later pass is served from the cache, nothing is demuxed or decoded for video
+}LoopCacheState;
+
+typedef enum {
+    seekModePreviousSync = 0,   // keyframe at or before the target, fastest
+    seekModeNextSync,           // keyframe at or after the target
+    seekModeExact               // decode from the previous keyframe and discard frames before the target
+}SeekMode;
+
+// Snapshot of the decode pipeline. A stall is counted each time a stage had work
+// but could not hand it on because the next stage (or the codec/sink) was full.
+typedef struct PipelineStats_tag {
+    uint32_t videoPacketQueueDepth;
+    uint32_t audioPacketQueueDepth;
+    uint32_t frameQueueDepth;
+    uint64_t demuxPackets;
+    uint64_t demuxStalls;
+    uint64_t videoFrames;
+    uint64_t videoStalls;
+    uint64_t audioBuffers;
+    uint64_t audioStalls;
+    uint64_t framesDropped;     // decoded or demuxed but never shown
+    uint64_t framesLate;        // first shown more than a refresh after its timestamp
+    uint64_t framesRepeated;    // refreshes that kept a frame because its successor was not decoded in time
+    uint64_t seekCount;
+    uint64_t seekPrerollFrames; // frames decoded and discarded to reach the last exact seek target
+    int64_t lastSeekLatencyNs;  // seek() call to the first frame from the new position returned by getFrame()
+    int64_t maxSeekLatencyNs;
+    uint64_t loopCount;
+    uint64_t gaplessLoops;      // loops served by the pre-rolled standby decoder
+    int64_t lastLoopFrameGapNs; // display time between the last frame of a pass and the first of the next
+    int64_t maxLoopFrameGapNs;
+    int64_t lastLoopAvOffsetNs; // A/V drift at the first audio sync after the last loop
+    int64_t avDriftNs;      // audio position minus media clock at the last sync, before correction
+    uint64_t audioUnderruns;    // device callbacks that found the PCM ring empty mid-playback
+    uint64_t audioRingFullWrites;   // sink writes that found the PCM ring full and left the rest for later
+    int32_t audioAmbisonicOrder;    // order rendered binaurally, 0 when the channels are played as loudspeakers
+    int64_t audioSpatialBlockNs;    // binaural renderer cost per block in the device callback, averaged, and the worst seen
+    int64_t audioSpatialMaxBlockNs;
+    int64_t poseToAudioNs;  // setHeadOrientation() to the first audio rendered with it being heard
+    int64_t maxPoseToAudioNs;
+    int64_t audioOutputLatencyNs;   // measured delay from the device callback to the speaker
+    int32_t audioBufferedFrames;    // queued in the PCM ring ahead of the device
+    uint64_t ioBytesRead;   // media file bytes handed to the demuxers
+    uint64_t ioReads;
+    uint64_t ioStalls;      // reads that had to wait for data the read-ahead had not brought in; the rest were cache hits
+    int64_t ioStallNs;
+    uint64_t ioRequests;    // remote sources: range requests, and the bytes they fetched
+    uint64_t ioFetchedBytes;
+    int64_t timeToFirstFrameNs; // setDataSource() call to the first frame returned by getFrame(), 0 until then
+    bool warmOpen;          // every index needed for that open came from the index cache
+    int32_t rendition;      // adaptive streams: rendition being demuxed (by ascending bandwidth), -1 otherwise
+    uint64_t renditionSwitches;
+    int64_t throughputBps;  // adaptive streams: download throughput estimate
+    int64_t bufferedUs;     // adaptive streams: media downloaded ahead of the demuxer
+    uint64_t segmentsDownloaded;
+    uint64_t segmentCacheHits;
+    uint64_t liveFrames;    // live sources: frames shown
+    uint64_t liveUnitsDiscarded;    // live sources: access units dropped before decoding (no keyframe yet, or backlog)
+    int64_t jitterDelayNs;  // live sources: current jitter buffer delay
+    int64_t ingestToDecodeP50Ns;    // live sources: arrival of an access unit to its decoded frame
+    int64_t ingestToDecodeP99Ns;
+    int64_t decodeToDisplayP50Ns;   // decoded frame to the display time it was first returned for
+    int64_t decodeToDisplayP99Ns;
+    int64_t ingestToDisplayP50Ns;
+    int64_t ingestToDisplayP99Ns;
+    int32_t playlistItem;   // playlists: item being demuxed, -1 otherwise
+    uint64_t playlistSwitches;  // playlists: switches served by a pre-rolled next item
+    bool loopCacheReplaying;    // video is served from the loop cache
+    uint32_t loopCacheFrames;
+    uint64_t loopCacheBytes;
+    uint64_t loopCacheFramesServed; // frames published from the cache instead of the decoder
+}PipelineStats;
+
 class CPlayer {
 
 public:
-    CPlayer();
+    explicit CPlayer(std::shared_ptr<IMediaBackend> backend, uint32_t frameQueueDepth = kDefaultFrameQueueDepth);
 
     ~CPlayer();
 
@@ -43,21 +168,289 @@ public:
 
     bool stop();
 
-    std::shared_ptr<MediaFrame> getFrame();
+    // decodeAheadNs bounds how far (media time) decoded frames may run ahead of the clock; 0 leaves
+    // only the frame queue depth as the limit. Call before start().
+    void setLateFramePolicy(LateFramePolicy policy, int64_t decodeAheadNs);
+
+    // Pre-roll the start of the file on a second decoder while the tail plays, so looping has no
+    // gap. Costs a second decoder instance. Call before start().
+    void setGaplessLoop(bool enable);
+
+    // Lets setDataSource() take a DASH (.mpd) or HLS (.m3u8) manifest. Segments are downloaded up
+    // to prefetchUs ahead and kept in segmentCacheDir, which an adaptive stream cannot play without.
+    // Adaptive streams loop by seeking in place. Call before setDataSource().
+    void setAdaptiveStreaming(const std::string& segmentCacheDir, uint64_t segmentCacheBytes, int64_t prefetchUs);
+
+    // Lets setDataSource() take a live Annex-B elementary stream ("udp://[address]:port", a FIFO, or
+    // "pipe:path") in the codec of the given mime. Frames are released through a jitter buffer
+    // holding them at most maxJitterDelayNs, and getFrame() always returns the newest decoded frame.
+    // Live streams cannot seek or loop. Call before setDataSource().
+    void setLiveIngest(const std::string& mime, int64_t maxJitterDelayNs);
+
+    // Plays the items in order, then from the first again. The next item's source and decoder are
+    // opened and pre-rolled during the last kPlaylistPrerollLeadUs of the current one, so the switch
+    // has no gap. Its audio is only played when the format matches the first item's. setDataSource()
+    // must then be given items[0]. Call before setDataSource().
+    void setPlaylist(std::vector<std::string> items);
 
-    bool releaseFrame(std::shared_ptr<MediaFrame> &frame);
+    // Keeps the decoded frames of a clip that fits in budgetBytes of NV12 (0 disables): the first whole
+    // pass is copied as it plays, and every later pass is shown from those copies with the video
+    // demuxer and decoder idle. Clips that turn out larger give the memory back and loop as before.
+    // Not used for playlists, adaptive or live sources. Call before start().
+    void setLoopCache(uint64_t budgetBytes);
+
+    // Plays 4- and 9-channel audio as first- and second-order AmbiX, rendered binaurally against the
+    // orientation given to setHeadOrientation(). Call before setDataSource().
+    void setSpatialAudio(bool enable);
+
+    // Head orientation for spatial audio: an x, y, z, w quaternion in the space the video is drawn
+    // in. Call once per frame from the render thread, right after the views are located.
+    void setHeadOrientation(const float orientation[4]);
+
+    // Repositions playback; timeUs is in file time. Call from the thread that calls getFrame().
+    // Until the keyframe index is known (a file without a sample table is scanned in the
+    // background, a remote one not at all) the demuxer picks the sync sample itself.
+    bool seek(int64_t timeUs, SeekMode mode);
+
+    void pause();
+
+    void resume();
+
+    // Video keeps following the clock at any rate > 0; audio is only played at rate 1.
+    void setPlaybackRate(double rate);
+
+    // Returns the frame that should be on screen at displayTime (CLOCK_MONOTONIC ns), i.e. the
+    // newest frame due by the middle of that refresh on the media clock, and retires every older
+    // frame in the queue. The returned frame stays valid until the next call; nullptr before the first frame.
+    const MediaFrame* getFrame(int64_t displayTime, int64_t displayPeriod);
+
+    PipelineStats getStats();
+
+    // True while playback would notice competition for the CPU or decoder: until the first frame is
+    // shown, and whenever the decoded frame queue runs below kBusyQueueFrames. Safe from any thread;
+    // background jobs poll it to stay out of the way.
+    bool isBusy() const;
 
 private:
+    struct StageCounters {
+        std::atomic<uint64_t> processed{0};
+        std::atomic<uint64_t> stalls{0};
+    };
+
+    bool openCodecs();
+
+    void closeCodecs();
+
+    void startThreads();
+
+    void stopThreads();
+
+    // Hands queued frames back to the decoder and discards queued packets. Threads must be stopped.
+    void drainQueues();
+
+    void demuxLoop();
+
+    void videoDecodeLoop();
+
+    void audioDecodeLoop();
+
+    void syncClockToAudio();
+
+    // Takes ownership of the output buffer; it is released right away if no frame can be made of it.
+    MediaFrameHandle makeVideoFrame(const std::shared_ptr<IMediaDecoder>& decoder, ssize_t bufferIdx, const DecoderBufferInfo& info);
+
+    bool canPrerollStandby();
+
+    // Video thread, at the kFlagLoopCache marker once the decoder has drained: replays the cache if it
+    // holds the whole pass just ended, otherwise records the next one (or gives up when over budget).
+    void settleLoopCache(int64_t nextPassNs);
+
+    // Video thread while replaying: the next cached frame on the media timeline, or an empty handle
+    // when the frame pool is exhausted.
+    MediaFrameHandle nextLoopCacheFrame();
+
+    void swapStandbySource();
+
+    // Standby thread, playlists only: opens the next playable item into mStandbySource and gives it a
+    // started decoder, reusing the standby decoder when the video format is unchanged.
+    bool openStandbyItem();
+
+    void prerollStandby(int64_t loopOffsetUs);
+
+    bool shouldSkipVideoPacket(const MediaPacket& packet, bool& catchingUp);
+
+    // getFrame() for live sources: no media clock, the newest decoded frame is always shown.
+    const MediaFrame* getLiveFrame(int64_t displayTime);
+
+    static bool isNonReferenceSample(const std::string& mime, const uint8_t* data, size_t size);
+
     void getAlignment(int32_t &width, int32_t &height, int32_t alignment);
 
 public:
-    AMediaExtractor* mExtractor;
-    AMediaCodec*     mVideoCodec;
-    int32_t          mFd;
+    static constexpr uint32_t kDefaultFrameQueueDepth = 4;
+    static constexpr uint32_t kVideoPacketQueueDepth = 16;
+    static constexpr uint32_t kAudioPacketQueueDepth = 64;   // audio packets are small and interleaved densely
+    static constexpr int32_t  kDefaultMaxInputSize = 4 * 1024 * 1024;
+    static constexpr uint32_t kBusyQueueFrames = 2;
+    static constexpr int64_t  kCodecWaitUs = 10000;  // blocking dequeue while the codec still holds queued input
+    static constexpr size_t   kAudioWriteHistory = 32;  // written buffers remembered to map device positions to media time
+    static constexpr int64_t  kAudioGapNs = 100 * 1000 * 1000;      // a jump this large in audio pts is a stretch of media without audio
+    static constexpr int64_t  kSkipLateNs = 50 * 1000 * 1000;      // input this late is skipped if disposable
+    static constexpr int64_t  kCatchUpLateNs = 500 * 1000 * 1000;  // input this late triggers a jump to the next keyframe
+    static constexpr int64_t  kLoopPrerollLeadUs = 1000000;          // start pre-rolling the next pass this long before the end
+    static constexpr int64_t  kPlaylistPrerollLeadUs = 3000000;      // the next item also has to be opened and its decoder configured
+    static constexpr uint32_t kLoopPrerollMaxPackets = 64;           // bounds the pre-roll when the codec holds output back
+    static constexpr int64_t  kStandbyWaitNs = 5000000;              // demux recheck while a playlist item waits for the standby decoder
+    static constexpr uint32_t kFramePoolSlack = 2;                   // frames in hand outside the queues
+    static constexpr uint64_t kLiveLatencyLogFrames = 600;           // live sources: latency percentiles are logged this often
+
+    std::shared_ptr<IMediaBackend> mBackend;
+    std::shared_ptr<IMediaSource>  mSource;
+    std::shared_ptr<IMediaDecoder> mVideoDecoder;
+    std::shared_ptr<IMediaDecoder> mAudioDecoder;
+    std::shared_ptr<IAudioSink>    mAudioSink;
     bool             mStarted;
     uint32_t         mAlignment = 16;  //16-byte alignment
 
-    std::mutex       mMediaListMutex;
-    std::list<std::shared_ptr<MediaFrame>> mMediaList;
+    int32_t          mVideoTrackIndex = -1;
+    int32_t          mAudioTrackIndex = -1;
+    int32_t          mVideoWidth = 0;
+    int32_t          mVideoHeight = 0;
+    std::string      mVideoMime;
+    int64_t          mVideoDurationUs = 0;
+    int32_t          mAudioChannelCount = 0;
+    int32_t          mAudioSampleRate = 0;
+    int32_t          mAudioOutputChannelCount = 0;  // format the sink plays, after mAudioConverter
+    int32_t          mAudioOutputSampleRate = 0;
+    bool             mSpatialAudio = false;
+    int32_t          mAudioAmbisonicOrder = 0;      // of the open sink, 0 for loudspeaker channels
+    std::string      mAudioMime;
+    int32_t          mMaxInputSize = kDefaultMaxInputSize;
+    std::string      mDataSource;
+    bool             mAdaptive = false;             // mSource is a CAdaptiveSource
+
+    std::shared_ptr<CSegmentCache> mSegmentCache;
+    int64_t          mPrefetchUs = 0;
+    std::shared_ptr<AdaptiveStreamCounters> mAdaptiveCounters = std::make_shared<AdaptiveStreamCounters>();
+
+    // Live ingest. Frame pts are arrival times on CLOCK_MONOTONIC, so latencies are measured from them.
+    bool             mLive = false;                 // mSource is a CLiveSource
+    std::string      mLiveMime = "video/avc";
+    int64_t          mLiveMaxJitterNs = 0;
+    std::shared_ptr<LiveIngestCounters> mLiveCounters = std::make_shared<LiveIngestCounters>();
+    std::atomic<uint64_t> mLiveFrames{0};
+    CLatencyHistogram mIngestToDecode;
+    CLatencyHistogram mDecodeToDisplay;
+    CLatencyHistogram mIngestToDisplay;
+
+    std::atomic<bool> mRunning{false};
+    std::thread      mDemuxThread;
+    std::thread      mVideoThread;
+    std::thread      mAudioThread;
+
+    // Backs every decoded video frame, so it is declared (and destroyed) outside the queues holding them.
+    CFramePool       mFramePool;
+    std::atomic<uint32_t> mFrameNumber{0};          // last MediaFrame::number handed out
+
+    // demux -> decode stages
+    SpscRing<MediaPacket> mVideoPackets;
+    SpscRing<MediaPacket> mAudioPackets;
+
+    // Decoded video frames, pushed by the video decode thread and consumed by the render thread.
+    SpscRing<MediaFrameHandle> mFrameQueue;
+
+    // Auto-reset wakeups: a stage only sleeps on its signal when it has genuinely nothing to do.
+    ksSignal         mDemuxWake;   // a packet queue drained
+    ksSignal         mVideoWake;   // a video packet arrived or the renderer released a frame
+    ksSignal         mAudioWake;   // an audio packet arrived
+
+    StageCounters    mDemuxCounters;
+    StageCounters    mVideoCounters;
+    StageCounters    mAudioCounters;
+
+    LateFramePolicy  mLatePolicy = lateFramePolicyDrop;
+    int64_t          mDecodeAheadNs = 0;
+    std::atomic<int64_t> mVideoFrameIntervalNs{0};  // last pts step seen by the video decode stage
+    std::atomic<uint64_t> mFramesDropped{0};
+    std::atomic<uint64_t> mFramesLate{0};
+    std::atomic<uint64_t> mFramesRepeated{0};
+
+    CKeyframeIndex   mKeyframeIndex;
+    int64_t          mLoopOffsetUs = 0;             // demux thread; added to file time to form the media timeline
+    int64_t          mPrerollUs = -1;               // decoded output before this media time is discarded
+    int64_t          mSeekStartNs = -1;             // render thread; set until the first frame after a seek is returned
+    std::atomic<uint64_t> mSeekCount{0};
+    std::atomic<uint64_t> mSeekPrerollFrames{0};
+    std::atomic<int64_t> mLastSeekLatencyNs{0};
+    std::atomic<int64_t> mMaxSeekLatencyNs{0};
+    int64_t          mOpenStartNs = -1;             // set by setDataSource() until the first frame is returned
+    uint64_t         mOpenCacheHits = 0;            // index cache counters when the open started
+    uint64_t         mOpenCacheMisses = 0;
+    std::atomic<int64_t> mTimeToFirstFrameNs{0};
+    std::atomic<bool> mWarmOpen{false};
+
+    // Gapless looping. The demux thread owns the standby source and starts mStandbyThread near the
+    // end of each pass; after joining it at EOF it swaps sources and sends kFlagLoopSwitch, and the
+    // video thread swaps decoders once the outgoing one has drained.
+    bool             mGaplessLoop = true;
+    std::shared_ptr<IMediaSource>  mStandbySource;
+    std::shared_ptr<IMediaDecoder> mStandbyDecoder;
+    std::thread      mStandbyThread;
+    std::atomic<bool> mStandbyPrimed{false};      // set with release by the standby thread when it is done
+    int32_t          mStandbyInFlight = 0;
+    std::vector<MediaFrameHandle> mStandbyFrames;
+    std::vector<MediaPacket> mStandbyAudio;        // audio read while pre-rolling, queued at the switch
+    uint32_t         mLoopSwitchesSent = 0;        // demux thread
+    std::atomic<uint32_t> mLoopSwitchesDone{0};    // video thread, after swapping decoders
+    std::atomic<int64_t> mLoopStartNs{-1};         // media time of the latest pass start
+    std::atomic<uint64_t> mLoopCount{0};
+    std::atomic<uint64_t> mGaplessLoops{0};
+    std::atomic<int64_t> mLastLoopFrameGapNs{0};
+    std::atomic<int64_t> mMaxLoopFrameGapNs{0};
+    std::atomic<int64_t> mLastLoopAvOffsetNs{0};
+    int64_t          mLastNewFrameTime = -1;       // render thread; display time a new frame was first returned
+    int64_t          mLoopAvMeasuredFor = -1;      // audio thread; loop start whose A/V offset was recorded
+    int64_t          mLastShownPts = -1;            // render thread only
+
+    // Playlists. The standby thread opens the next item with its own track indices, duration and
+    // keyframe index; the demux thread swaps them in with the source at the switch, and the video
+    // thread swaps the decoder formats with the decoders. Outside playlists the two sides are equal.
+    std::vector<std::string> mPlaylist;
+    int32_t          mStandbyItem = 0;              // item the standby source holds
+    std::atomic<int32_t> mPlaylistItem{0};          // item being demuxed
+    std::atomic<uint64_t> mPlaylistSwitches{0};
+    int32_t          mStandbyVideoTrack = -1;
+    int32_t          mStandbyAudioTrack = -1;
+    int64_t          mStandbyDurationUs = 0;
+    std::string      mStandbyVideoMime;
+    CKeyframeIndex   mStandbyKeyframeIndex;
+    MediaTrackInfo   mVideoDecoderFormat;           // what each decoder was configured for
+    MediaTrackInfo   mStandbyDecoderFormat;
+    std::shared_ptr<IMediaSource> mRetiredSource;   // the item before, while packets mapped from it may still be queued
+    int32_t          mLastShownWidth = 0;           // render thread
+    int32_t          mLastShownHeight = 0;
+
+    // Loop cache. The video thread owns the cache and the replay position; seek() and start() reset
+    // them with the threads stopped.
+    CLoopFrameCache  mLoopCache;
+    std::atomic<LoopCacheState> mLoopCacheState{loopCacheOff};
+    bool             mLoopCacheWholePass = false;   // recording began at the start of the pass
+    int64_t          mLoopCachePassNs = 0;          // media time of the start of the pass being recorded
+    size_t           mLoopCacheNext = 0;            // replay: next cached frame
+    int64_t          mLoopCacheOffsetNs = 0;        // replay: media time of the start of the pass being served
+    std::atomic<uint32_t> mLoopCacheFrames{0};
+    std::atomic<uint64_t> mLoopCacheBytes{0};
+    std::atomic<uint64_t> mLoopCacheFramesServed{0};
+
+    // Media timeline -> CLOCK_MONOTONIC, slaved to the audio device when there is audio.
+    CMediaClock      mClock;
+    bool             mVideoStartsClock = false;     // no audio to start it from the current position
+    std::atomic<int64_t> mAvDrift{0};
+
+    // Audio thread only: (first frame position, media time ns) of each buffer written to the sink.
+    std::deque<std::pair<int64_t, int64_t>> mAudioWrites;
+    CAudioConverter  mAudioConverter;               // audio thread only
+    int64_t          mAudioFramesWritten = 0;
+    int64_t          mAudioEndNs = 0;               // media time the last written buffer ends
 
 };
\ No newline at end of file
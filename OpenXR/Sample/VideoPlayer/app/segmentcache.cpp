@@ -0,0 +1,121 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// On-disk LRU cache of downloaded DASH/HLS segments.
+
+#include "pch.h"
+#include "common.h"
+#include "segmentcache.h"
+#include "cachefile.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr const char* kSegmentSuffix = ".seg";
+
+int64_t MtimeNs(const struct stat& statbuff) {
+    return (int64_t)statbuff.st_mtim.tv_sec * 1000000000 + statbuff.st_mtim.tv_nsec;
+}
+}  // namespace
+
+CSegmentCache::CSegmentCache(std::string directory, uint64_t maxBytes) : mDirectory(std::move(directory)), mMaxBytes(maxBytes) {
+}
+
+std::string CSegmentCache::entryName(const std::string& key) const {
+    // Over the segment and init URLs; 64 bits make a collision between two URLs of the same cache
+    // vanishingly unlikely, and the file has no room for the key itself.
+    return Fmt("%016llx%s", (unsigned long long)HashCacheKey(key), kSegmentSuffix);
+}
+
+void CSegmentCache::scan() {
+    if (mScanned) {
+        return;
+    }
+    mScanned = true;
+    // Create the directory chain on first use.
+    MakeCacheDirectories(mDirectory);
+    DIR* dir = opendir(mDirectory.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+    const size_t suffixLength = strlen(kSegmentSuffix);
+    while (struct dirent* entry = readdir(dir)) {
+        const std::string name = entry->d_name;
+        struct stat statbuff;
+        if (name.size() <= suffixLength || name.compare(name.size() - suffixLength, suffixLength, kSegmentSuffix) != 0 ||
+            stat((mDirectory + "/" + name).c_str(), &statbuff) != 0) {
+            continue;
+        }
+        mEntries[name] = Entry{(uint64_t)statbuff.st_size, MtimeNs(statbuff)};
+        mTotalBytes += statbuff.st_size;
+    }
+    closedir(dir);
+    Log::Write(Log::Level::Info, Fmt("segment cache: %s, %d segments, %llu MB", mDirectory.c_str(), (int32_t)mEntries.size(),
+                                     (unsigned long long)(mTotalBytes >> 20)));
+}
+
+std::string CSegmentCache::lookup(const std::string& key) {
+    if (mDirectory.empty()) {
+        return std::string();
+    }
+    std::lock_guard<std::mutex> guard(mMutex);
+    scan();
+    const std::string name = entryName(key);
+    auto it = mEntries.find(name);
+    const std::string path = mDirectory + "/" + name;
+    struct stat statbuff;
+    if (it == mEntries.end() || utimensat(AT_FDCWD, path.c_str(), nullptr, 0) != 0 || stat(path.c_str(), &statbuff) != 0) {
+        if (it != mEntries.end()) {
+            mTotalBytes -= it->second.bytes;
+            mEntries.erase(it);
+        }
+        mMisses++;
+        return std::string();
+    }
+    it->second.lastUseNs = MtimeNs(statbuff);
+    mHits++;
+    return path;
+}
+
+std::string CSegmentCache::store(const std::string& key, const std::vector<const std::vector<uint8_t>*>& parts) {
+    if (mDirectory.empty()) {
+        return std::string();
+    }
+    std::lock_guard<std::mutex> guard(mMutex);
+    scan();
+    const std::string name = entryName(key);
+    const std::string path = mDirectory + "/" + name;
+    if (!WriteCacheFile(path, parts)) {
+        Log::Write(Log::Level::Warning, Fmt("segment cache: can't write %s, errno %d", path.c_str(), errno));
+        return std::string();
+    }
+    uint64_t total = 0;
+    for (const std::vector<uint8_t>* part : parts) {
+        total += part->size();
+    }
+    Entry& entry = mEntries[name];
+    mTotalBytes += total - entry.bytes;
+    entry.bytes = total;
+    struct stat statbuff;
+    entry.lastUseNs = stat(path.c_str(), &statbuff) == 0 ? MtimeNs(statbuff) : INT64_MAX;
+    evict(name);
+    return path;
+}
+
+void CSegmentCache::evict(const std::string& keep) {
+    while (mTotalBytes > mMaxBytes && mEntries.size() > 1) {
+        auto oldest = mEntries.end();
+        for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+            if (it->first != keep && (oldest == mEntries.end() || it->second.lastUseNs < oldest->second.lastUseNs)) {
+                oldest = it;
+            }
+        }
+        // A source still reading an evicted file keeps it open (or mapped) until it is done.
+        unlink((mDirectory + "/" + oldest->first).c_str());
+        mTotalBytes -= oldest->second.bytes;
+        mEntries.erase(oldest);
+        mEvictions++;
+    }
+}
@@ -0,0 +1,60 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// On-disk LRU cache of downloaded DASH/HLS segments.
+
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Each segment is stored as one playable file: its rendition's init segment followed by the
+// media segment, so any demuxer can open it on its own. Files are named by a hash of the key
+// and survive restarts; once the total passes maxBytes the least recently used ones are deleted.
+// Safe to share between sources and threads.
+class CSegmentCache {
+
+public:
+    // An empty directory disables the cache, and with it adaptive streaming.
+    CSegmentCache(std::string directory, uint64_t maxBytes);
+
+    bool enabled() const { return !mDirectory.empty(); }
+
+    // Path of the cached file for key, marked as just used; empty if it isn't cached.
+    std::string lookup(const std::string& key);
+
+    // Writes the parts back to back as the file for key (a temporary file, then renamed) and
+    // evicts down to the budget. Returns its path, empty on failure.
+    std::string store(const std::string& key, const std::vector<const std::vector<uint8_t>*>& parts);
+
+    uint64_t hits() const { return mHits; }
+
+    uint64_t misses() const { return mMisses; }
+
+    uint64_t evictions() const { return mEvictions; }
+
+private:
+    struct Entry {
+        uint64_t bytes{0};
+        int64_t  lastUseNs{0};  // file mtime, refreshed on every lookup
+    };
+
+    std::string entryName(const std::string& key) const;
+
+    // Builds mEntries from the directory on first use.
+    void scan();
+
+    void evict(const std::string& keep);
+
+    std::string                  mDirectory;
+    uint64_t                     mMaxBytes;
+    std::mutex                   mMutex;
+    bool                         mScanned{false};
+    std::map<std::string, Entry> mEntries;  // by file name
+    uint64_t                     mTotalBytes{0};
+    std::atomic<uint64_t>        mHits{0};
+    std::atomic<uint64_t>        mMisses{0};
+    std::atomic<uint64_t>        mEvictions{0};
+};
@@ -0,0 +1,294 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Head-tracked binaural rendering of ambisonic audio for 360 video, run block by block inside
+// the audio device callback.
+
+#include "pch.h"
+#include "common.h"
+#include "spatialaudio.h"
+#include "mediaclock.h"
+
+#include <cmath>
+
+namespace {
+
+constexpr int32_t kSpeakerCount = 12;
+constexpr double kHeadRadius = 0.0875;      // metres
+constexpr double kSpeedOfSound = 343.0;     // metres per second
+constexpr double kShadowMinAlpha = 0.1;     // head shadow at its deepest...
+constexpr double kShadowMinAngle = 5.0 * M_PI / 6.0;   // ...150 degrees from the ear
+constexpr int32_t kHrirOffset = 2;          // frames before the earliest arrival
+
+// Ambisonic axes: x ahead, y left, z up. The 360 sphere puts the video centre at OpenXR -z.
+inline void ToAmbisonicAxes(const float xr[3], float out[3]) {
+    out[0] = -xr[2];
+    out[1] = -xr[0];
+    out[2] = xr[1];
+}
+
+// Real spherical harmonics up to order 2 in ACN order with SN3D normalisation, for a unit vector.
+void EvaluateHarmonics(int32_t order, float x, float y, float z, float* out) {
+    static const float kSqrt3 = 1.7320508f;
+    out[0] = 1.0f;
+    out[1] = y;
+    out[2] = z;
+    out[3] = x;
+    if (order >= 2) {
+        out[4] = kSqrt3 * x * y;
+        out[5] = kSqrt3 * y * z;
+        out[6] = 0.5f * (3.0f * z * z - 1.0f);
+        out[7] = kSqrt3 * x * z;
+        out[8] = 0.5f * kSqrt3 * (x * x - y * y);
+    }
+}
+
+inline int32_t ChannelOrder(int32_t channel) { return channel == 0 ? 0 : (channel < 4 ? 1 : 2); }
+
+// Unit vectors to the vertices of an icosahedron, a spherical 5-design: sums over it integrate
+// products of harmonics up to order 2 exactly. The set is symmetric under y -> -y.
+void IcosahedronVertices(float* out) {
+    const float phi = 1.6180340f;
+    const float scale = 1.0f / std::sqrt(1.0f + phi * phi);
+    const float vertices[kSpeakerCount][3] = {
+        {0, 1, phi}, {0, -1, phi}, {0, 1, -phi}, {0, -1, -phi},
+        {1, phi, 0}, {-1, phi, 0}, {1, -phi, 0}, {-1, -phi, 0},
+        {phi, 0, 1}, {-phi, 0, 1}, {phi, 0, -1}, {-phi, 0, -1},
+    };
+    for (int32_t k = 0; k < kSpeakerCount; k++) {
+        for (int32_t a = 0; a < 3; a++) {
+            out[k * 3 + a] = vertices[k][a] * scale;
+        }
+    }
+}
+
+// Left-ear response to a plane wave from direction (x ahead, y left, z up), after Brown and Duda's
+// spherical head: the Woodworth path delay around the head and a one-pole, one-zero shelf for its
+// shadow, bilinear-transformed. Unity gain at DC.
+void SphericalHeadResponse(const float direction[3], int32_t sampleRate, float* out, int32_t length) {
+    const double angle = std::acos(std::max(-1.0, std::min(1.0, (double)direction[1])));  // from the left ear axis
+    const double pathDelay = (angle < M_PI / 2) ? (1.0 - std::cos(angle)) : (angle - M_PI / 2 + 1.0);
+    const double delayFrames = kHrirOffset + pathDelay * kHeadRadius / kSpeedOfSound * sampleRate;
+    const double alpha = (1.0 + kShadowMinAlpha / 2) + (1.0 - kShadowMinAlpha / 2) * std::cos(angle / kShadowMinAngle * M_PI);
+
+    const double beta = 2.0 * kSpeedOfSound / kHeadRadius;
+    const double k = 2.0 * sampleRate;
+    const double b0 = (beta + alpha * k) / (beta + k);
+    const double b1 = (beta - alpha * k) / (beta + k);
+    const double a1 = (beta - k) / (beta + k);
+
+    // A linearly interpolated impulse at the fractional delay, through the shadow filter.
+    const int32_t whole = (int32_t)delayFrames;
+    const double fraction = delayFrames - whole;
+    double previousIn = 0.0;
+    double previousOut = 0.0;
+    for (int32_t n = 0; n < length; n++) {
+        const double in = (n == whole) ? 1.0 - fraction : (n == whole + 1 ? fraction : 0.0);
+        const double y = b0 * in + b1 * previousIn - a1 * previousOut;
+        out[n] = (float)y;
+        previousIn = in;
+        previousOut = y;
+    }
+}
+
+}  // namespace
+
+bool CAmbisonicRenderer::configure(int32_t order, int32_t sampleRate) {
+    if (order < 1 || order > 2 || sampleRate <= 0) {
+        return false;
+    }
+    mOrder = order;
+    mActiveOrder = order;
+    mChannelCount = (order + 1) * (order + 1);
+    mBudgetNs = (int64_t)kBlockFrames * 1000000000 / sampleRate * kBudgetPercent / 100;
+    mBlockNs = 0;
+    mMaxBlockNs = 0;
+    mBlocks = 0;
+    mFft.configure(kFftSize);
+
+    mSpeakerDirections.resize(kSpeakerCount * 3);
+    IcosahedronVertices(mSpeakerDirections.data());
+    mSpeakerHarmonics.resize((size_t)kSpeakerCount * mChannelCount);
+    for (int32_t k = 0; k < kSpeakerCount; k++) {
+        const float* d = &mSpeakerDirections[k * 3];
+        EvaluateHarmonics(order, d[0], d[1], d[2], &mSpeakerHarmonics[(size_t)k * mChannelCount]);
+    }
+
+    // Sampling decoder with max-rE weights, folded with each loudspeaker's left-ear response into
+    // one filter per channel.
+    static const float kMaxReWeights[3][3] = {{1.0f, 0.0f, 0.0f}, {1.0f, 0.577350f, 0.0f}, {1.0f, 0.774597f, 0.400000f}};
+    std::vector<float> filters((size_t)mChannelCount * kFilterLength, 0.0f);
+    std::vector<float> response(kFilterLength);
+    for (int32_t k = 0; k < kSpeakerCount; k++) {
+        SphericalHeadResponse(&mSpeakerDirections[k * 3], sampleRate, response.data(), kFilterLength);
+        for (int32_t c = 0; c < mChannelCount; c++) {
+            const int32_t n = ChannelOrder(c);
+            const float gain = (2 * n + 1) * kMaxReWeights[order][n] * mSpeakerHarmonics[(size_t)k * mChannelCount + c] / kSpeakerCount;
+            for (int32_t t = 0; t < kFilterLength; t++) {
+                filters[(size_t)c * kFilterLength + t] += gain * response[t];
+            }
+        }
+    }
+    // Reflected in y the layout maps onto itself, so the right ear's filter is the left one with
+    // the sign of the harmonics odd in y.
+    mMirrored.assign(mChannelCount, false);
+    for (int32_t c : {1, 4, 5}) {
+        if (c < mChannelCount) {
+            mMirrored[c] = true;
+        }
+    }
+
+    // Partition spectra, zero-padded for overlap-save, with the inverse FFT's 1/N folded in.
+    mFilterRe.assign((size_t)mChannelCount * kPartitions * kFftSize, 0.0f);
+    mFilterIm.assign((size_t)mChannelCount * kPartitions * kFftSize, 0.0f);
+    for (int32_t c = 0; c < mChannelCount; c++) {
+        for (int32_t p = 0; p < kPartitions; p++) {
+            float* re = &mFilterRe[((size_t)c * kPartitions + p) * kFftSize];
+            float* im = &mFilterIm[((size_t)c * kPartitions + p) * kFftSize];
+            for (int32_t t = 0; t < kBlockFrames; t++) {
+                re[t] = filters[(size_t)c * kFilterLength + p * kBlockFrames + t] / kFftSize;
+            }
+            mFft.forward(re, im);
+        }
+    }
+
+    mRotation.assign((size_t)mChannelCount * mChannelCount, 0.0f);
+    for (int32_t c = 0; c < mChannelCount; c++) {
+        mRotation[(size_t)c * mChannelCount + c] = 1.0f;
+    }
+    mNextRotation = mRotation;
+    mInput.assign((size_t)kBlockFrames * mChannelCount, 0.0f);
+    mPlanar.assign((size_t)kBlockFrames * mChannelCount, 0.0f);
+    mRotated.assign((size_t)kFftSize * mChannelCount, 0.0f);
+    mSpectrumRe.assign(kFftSize, 0.0f);
+    mSpectrumIm.assign(kFftSize, 0.0f);
+    mDelayLineRe.assign((size_t)mChannelCount * kPartitions * kFftSize, 0.0f);
+    mDelayLineIm.assign((size_t)mChannelCount * kPartitions * kFftSize, 0.0f);
+    mSumRe.assign(kFftSize, 0.0f);
+    mSumIm.assign(kFftSize, 0.0f);
+    mDiffRe.assign(kFftSize, 0.0f);
+    mDiffIm.assign(kFftSize, 0.0f);
+    mOutput.assign((size_t)kBlockFrames * 2, 0.0f);
+    reset();
+    Log::Write(Log::Level::Info, Fmt("ambisonic renderer: order %d, %d-frame blocks, %d partitions, budget %lld us", order, kBlockFrames,
+                                     kPartitions, (long long)(mBudgetNs / 1000)));
+    return true;
+}
+
+void CAmbisonicRenderer::reset() {
+    std::fill(mRotated.begin(), mRotated.end(), 0.0f);
+    std::fill(mDelayLineRe.begin(), mDelayLineRe.end(), 0.0f);
+    std::fill(mDelayLineIm.begin(), mDelayLineIm.end(), 0.0f);
+    mDelayIndex = 0;
+}
+
+// Coefficients of the field as heard from the head: b = T a with
+// T[j][i] = (2n + 1) / K * sum over loudspeakers k of Y_i(R d_k) Y_j(d_k), exact on the 5-design
+// for each order n, and zero between orders since rotation keeps them apart.
+void CAmbisonicRenderer::computeRotation(const float orientation[4], float* rotation) const {
+    const float x = orientation[0];
+    const float y = orientation[1];
+    const float z = orientation[2];
+    const float w = orientation[3];
+    const float head[3][3] = {
+        {1 - 2 * (y * y + z * z), 2 * (x * y - z * w), 2 * (x * z + y * w)},
+        {2 * (x * y + z * w), 1 - 2 * (x * x + z * z), 2 * (y * z - x * w)},
+        {2 * (x * z - y * w), 2 * (y * z + x * w), 1 - 2 * (x * x + y * y)},
+    };
+    std::fill(rotation, rotation + (size_t)mChannelCount * mChannelCount, 0.0f);
+    float harmonics[9];
+    for (int32_t k = 0; k < kSpeakerCount; k++) {
+        // Loudspeaker direction from head to world axes, through the OpenXR frame.
+        const float* d = &mSpeakerDirections[k * 3];
+        const float xr[3] = {-d[1], d[2], -d[0]};
+        float world[3];
+        for (int32_t r = 0; r < 3; r++) {
+            world[r] = head[r][0] * xr[0] + head[r][1] * xr[1] + head[r][2] * xr[2];
+        }
+        float ambisonic[3];
+        ToAmbisonicAxes(world, ambisonic);
+        EvaluateHarmonics(mOrder, ambisonic[0], ambisonic[1], ambisonic[2], harmonics);
+        const float* local = &mSpeakerHarmonics[(size_t)k * mChannelCount];
+        for (int32_t j = 0; j < mChannelCount; j++) {
+            const int32_t n = ChannelOrder(j);
+            const int32_t first = n * n;
+            for (int32_t i = first; i < first + 2 * n + 1; i++) {
+                rotation[(size_t)j * mChannelCount + i] += (2 * n + 1) * harmonics[i] * local[j] / kSpeakerCount;
+            }
+        }
+    }
+}
+
+void CAmbisonicRenderer::process(const int16_t* in, const float orientation[4], int16_t* out) {
+    const int64_t startNs = CMediaClock::monotonicNow();
+    const int32_t channels = (mActiveOrder + 1) * (mActiveOrder + 1);
+
+    ConvertInt16ToFloat(in, mInput.data(), kBlockFrames * mChannelCount);
+    for (int32_t c = 0; c < channels; c++) {
+        float* plane = &mPlanar[(size_t)c * kBlockFrames];
+        for (int32_t f = 0; f < kBlockFrames; f++) {
+            plane[f] = mInput[(size_t)f * mChannelCount + c];
+        }
+    }
+
+    // Rotate, fading from the last block's matrix to this one's so head movement does not click.
+    computeRotation(orientation, mNextRotation.data());
+    for (int32_t j = 0; j < channels; j++) {
+        float* plane = &mRotated[(size_t)j * kFftSize];
+        memcpy(plane, plane + kBlockFrames, kBlockFrames * sizeof(float));
+        std::fill(plane + kBlockFrames, plane + kFftSize, 0.0f);
+        const int32_t n = ChannelOrder(j);
+        for (int32_t i = n * n; i < (n + 1) * (n + 1); i++) {
+            const float from = mRotation[(size_t)j * mChannelCount + i];
+            const float to = mNextRotation[(size_t)j * mChannelCount + i];
+            RampedMultiplyAccumulate(&mPlanar[(size_t)i * kBlockFrames], from, (to - from) / kBlockFrames, plane + kBlockFrames, kBlockFrames);
+        }
+    }
+    mRotation.swap(mNextRotation);
+
+    // Overlap-save: each channel's last two blocks into the frequency-domain delay line, then every
+    // partition against the spectrum of the block it lines up with.
+    std::fill(mSumRe.begin(), mSumRe.end(), 0.0f);
+    std::fill(mSumIm.begin(), mSumIm.end(), 0.0f);
+    std::fill(mDiffRe.begin(), mDiffRe.end(), 0.0f);
+    std::fill(mDiffIm.begin(), mDiffIm.end(), 0.0f);
+    for (int32_t c = 0; c < channels; c++) {
+        const size_t line = (size_t)c * kPartitions * kFftSize;
+        float* re = &mDelayLineRe[line + (size_t)mDelayIndex * kFftSize];
+        float* im = &mDelayLineIm[line + (size_t)mDelayIndex * kFftSize];
+        memcpy(re, &mRotated[(size_t)c * kFftSize], kFftSize * sizeof(float));
+        std::fill(im, im + kFftSize, 0.0f);
+        mFft.forward(re, im);
+        float* accRe = mMirrored[c] ? mDiffRe.data() : mSumRe.data();
+        float* accIm = mMirrored[c] ? mDiffIm.data() : mSumIm.data();
+        for (int32_t p = 0; p < kPartitions; p++) {
+            const size_t slot = line + (size_t)((mDelayIndex + kPartitions - p) % kPartitions) * kFftSize;
+            const size_t filter = ((size_t)c * kPartitions + p) * kFftSize;
+            ComplexMultiplyAccumulate(&mDelayLineRe[slot], &mDelayLineIm[slot], &mFilterRe[filter], &mFilterIm[filter], accRe, accIm, kFftSize);
+        }
+    }
+    mDelayIndex = (mDelayIndex + 1) % kPartitions;
+
+    // Both ears are real, so one inverse transform of left + i * right yields them together.
+    for (int32_t k = 0; k < kFftSize; k++) {
+        const float leftRe = mSumRe[k] + mDiffRe[k];
+        const float leftIm = mSumIm[k] + mDiffIm[k];
+        const float rightRe = mSumRe[k] - mDiffRe[k];
+        const float rightIm = mSumIm[k] - mDiffIm[k];
+        mSpectrumRe[k] = leftRe - rightIm;
+        mSpectrumIm[k] = leftIm + rightRe;
+    }
+    mFft.inverse(mSpectrumRe.data(), mSpectrumIm.data());
+    for (int32_t f = 0; f < kBlockFrames; f++) {
+        mOutput[2 * f] = mSpectrumRe[kBlockFrames + f];
+        mOutput[2 * f + 1] = mSpectrumIm[kBlockFrames + f];
+    }
+    ConvertFloatToInt16(mOutput.data(), out, kBlockFrames * 2);
+
+    // The block cost is the same every time, so a budget overrun is persistent: render order 1 only.
+    const int64_t blockNs = CMediaClock::monotonicNow() - startNs;
+    mBlockNs = mBlocks == 0 ? blockNs : mBlockNs + (blockNs - mBlockNs) / 16;
+    mMaxBlockNs = std::max(mMaxBlockNs, blockNs);
+    if (++mBlocks >= 64 && mActiveOrder > 1 && mBlockNs > mBudgetNs) {
+        mActiveOrder = 1;
+    }
+}
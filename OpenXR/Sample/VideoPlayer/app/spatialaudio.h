@@ -0,0 +1,80 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Head-tracked binaural rendering of ambisonic audio for 360 video, run block by block inside
+// the audio device callback.
+
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "audiodsp.h"
+
+// Renders AmbiX (ACN channel order, SN3D normalisation) of order 1 or 2 to stereo for headphones.
+// Each block is first rotated against the listener's head, with the rotation matrix faded from the
+// previous block's across it, then decoded to an icosahedron of virtual loudspeakers whose head-related
+// impulse responses come from a spherical head model. The decoder and the responses are folded into
+// one filter per ambisonic channel, applied as a uniformly partitioned FFT convolution, and the left
+// and right ears share each filter because the loudspeaker layout is mirror-symmetric.
+// Not thread-safe; process() never locks or allocates, so it can run on the device callback.
+class CAmbisonicRenderer {
+
+public:
+    bool configure(int32_t order, int32_t sampleRate);
+
+    // Forgets the convolution history, as after a flush.
+    void reset();
+
+    int32_t channelCount() const { return mChannelCount; }
+
+    // Order being rendered: drops to 1 when order 2 runs over budget.
+    int32_t activeOrder() const { return mActiveOrder; }
+
+    // Renders one block: kBlockFrames interleaved frames of channelCount() in, as many stereo
+    // frames out. orientation is the head's x, y, z, w quaternion in the space the 360 sphere is
+    // drawn in (OpenXR axes: -z ahead, +y up), with the video centre straight ahead.
+    void process(const int16_t* in, const float orientation[4], int16_t* out);
+
+    // Block cost, exponentially averaged, and the worst seen.
+    int64_t blockNs() const { return mBlockNs; }
+
+    int64_t maxBlockNs() const { return mMaxBlockNs; }
+
+    static constexpr int32_t kBlockFrames = 64;
+    static constexpr int32_t kFilterLength = 256;   // head-related responses, in frames
+    static constexpr int32_t kPartitions = kFilterLength / kBlockFrames;
+    static constexpr int32_t kFftSize = 2 * kBlockFrames;
+    static constexpr int32_t kBudgetPercent = 25;   // of the block's duration, before order 2 drops to 1
+
+private:
+    void computeRotation(const float orientation[4], float* rotation) const;
+
+    int32_t               mOrder = 0;
+    int32_t               mActiveOrder = 0;
+    int32_t               mChannelCount = 0;
+    int64_t               mBudgetNs = 0;
+    int64_t               mBlockNs = 0;
+    int64_t               mMaxBlockNs = 0;
+    uint64_t              mBlocks = 0;
+    CFft                  mFft;
+
+    std::vector<float>    mSpeakerDirections;   // per loudspeaker, x ahead, y left, z up
+    std::vector<float>    mSpeakerHarmonics;    // per loudspeaker, the channelCount() harmonics of its direction
+    std::vector<float>    mRotation;            // channelCount() x channelCount(), applied to the last block
+    std::vector<float>    mNextRotation;
+    std::vector<bool>     mMirrored;            // channels that change sign between the ears (odd in y)
+
+    std::vector<float>    mInput;               // interleaved float input
+    std::vector<float>    mPlanar;              // the same, kBlockFrames per channel
+    std::vector<float>    mRotated;             // planar, kFftSize per channel: previous block, then this one
+    std::vector<float>    mSpectrumRe;          // FFT scratch
+    std::vector<float>    mSpectrumIm;
+    std::vector<float>    mFilterRe;            // per channel, per partition: kFftSize bins
+    std::vector<float>    mFilterIm;
+    std::vector<float>    mDelayLineRe;         // per channel, kPartitions past input spectra, newest at mDelayIndex
+    std::vector<float>    mDelayLineIm;
+    int32_t               mDelayIndex = 0;
+    std::vector<float>    mSumRe;               // both ears from the mirrored and unmirrored channels
+    std::vector<float>    mSumIm;
+    std::vector<float>    mDiffRe;
+    std::vector<float>    mDiffIm;
+    std::vector<float>    mOutput;              // interleaved stereo
+};
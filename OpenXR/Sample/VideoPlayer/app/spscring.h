@@ -0,0 +1,103 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Fixed-capacity single-producer/single-consumer ring used to hand decoded
+// data from the decode thread to the render thread without locking.
+
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+// One thread may call push()/full(), one other thread may call front()/at()/pop()/empty().
+// The producer publishes a slot with a release store of mTail and the consumer hands
+// it back with a release store of mHead, so neither side ever blocks the other.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(uint32_t capacity) {
+        uint32_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mSlots.resize(size);
+        mMask = size - 1;
+        mCapacity = capacity < 1 ? 1 : capacity;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side. Returns false and leaves 'item' untouched when the ring is full.
+    bool push(T&& item) {
+        const uint32_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHeadCache >= mCapacity) {
+            mHeadCache = mHead.load(std::memory_order_acquire);
+            if (tail - mHeadCache >= mCapacity) {
+                return false;
+            }
+        }
+        mSlots[tail & mMask] = std::move(item);
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool full() {
+        const uint32_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHeadCache < mCapacity) {
+            return false;
+        }
+        mHeadCache = mHead.load(std::memory_order_acquire);
+        return tail - mHeadCache >= mCapacity;
+    }
+
+    // Consumer side. The returned slot stays owned by the consumer until pop().
+    T* front() {
+        const uint32_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mTailCache) {
+            mTailCache = mTail.load(std::memory_order_acquire);
+            if (head == mTailCache) {
+                return nullptr;
+            }
+        }
+        return &mSlots[head & mMask];
+    }
+
+    // Consumer side. Peeks 'index' slots behind front(), or nullptr if fewer are published.
+    T* at(uint32_t index) {
+        const uint32_t head = mHead.load(std::memory_order_relaxed);
+        if (mTailCache - head <= index) {
+            mTailCache = mTail.load(std::memory_order_acquire);
+            if (mTailCache - head <= index) {
+                return nullptr;
+            }
+        }
+        return &mSlots[(head + index) & mMask];
+    }
+
+    void pop() {
+        const uint32_t head = mHead.load(std::memory_order_relaxed);
+        mSlots[head & mMask] = T();
+        mHead.store(head + 1, std::memory_order_release);
+    }
+
+    bool empty() { return front() == nullptr; }
+
+    // Approximate when called concurrently with the other side; exact from either side alone.
+    uint32_t size() const {
+        return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+    }
+
+    uint32_t capacity() const { return mCapacity; }
+
+private:
+    std::vector<T> mSlots;
+    uint32_t       mMask;
+    uint32_t       mCapacity;
+
+    // Keep the indices on separate cache lines so the two threads don't false-share.
+    alignas(64) std::atomic<uint32_t> mHead{0};
+    uint32_t                          mTailCache{0};   // consumer's last view of mTail
+    alignas(64) std::atomic<uint32_t> mTail{0};
+    uint32_t                          mHeadCache{0};   // producer's last view of mHead
+};
@@ -0,0 +1,68 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Plain scalar versions of the audiodsp kernels, written from the contracts in audiodsp.h. The
+// tests check the NEON and SSE2 paths against them, and the benchmarks time both.
+
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+inline void ReferenceInt16ToFloat(const int16_t* in, float* out, int32_t count) {
+    for (int32_t i = 0; i < count; i++) {
+        out[i] = in[i] / 32768.0f;
+    }
+}
+
+inline void ReferenceFloatToInt16(const float* in, int16_t* out, int32_t count) {
+    for (int32_t i = 0; i < count; i++) {
+        const float s = std::nearbyint(in[i] * 32768.0f);
+        out[i] = (int16_t)std::min(32767.0f, std::max(-32768.0f, s));
+    }
+}
+
+// Interleaved output with outChannels per frame.
+inline void ReferenceMix(const float* in, int32_t inChannels, int32_t numFrames, const float* matrix, float* out, int32_t outChannels) {
+    for (int32_t i = 0; i < numFrames; i++) {
+        for (int32_t c = 0; c < outChannels; c++) {
+            float sum = 0.0f;
+            for (int32_t k = 0; k < inChannels; k++) {
+                sum += in[(size_t)i * inChannels + k] * matrix[(size_t)c * inChannels + k];
+            }
+            out[(size_t)i * outChannels + c] = sum;
+        }
+    }
+}
+
+inline void ReferenceComplexMultiplyAccumulate(const float* aRe, const float* aIm, const float* bRe, const float* bIm, float* accRe, float* accIm,
+                                               int32_t count) {
+    for (int32_t i = 0; i < count; i++) {
+        accRe[i] += aRe[i] * bRe[i] - aIm[i] * bIm[i];
+        accIm[i] += aRe[i] * bIm[i] + aIm[i] * bRe[i];
+    }
+}
+
+inline void ReferenceRampedMultiplyAccumulate(const float* in, float gain, float step, float* out, int32_t count) {
+    for (int32_t i = 0; i < count; i++) {
+        out[i] += (gain + step * (i + 1)) * in[i];
+    }
+}
+
+// Direct O(n^2) DFT in double precision, unscaled, with the sign of CFft::forward().
+inline void ReferenceDft(std::vector<float>& re, std::vector<float>& im) {
+    const size_t n = re.size();
+    std::vector<double> outRe(n, 0.0);
+    std::vector<double> outIm(n, 0.0);
+    for (size_t k = 0; k < n; k++) {
+        for (size_t t = 0; t < n; t++) {
+            const double angle = -2.0 * M_PI * (double)((k * t) % n) / (double)n;
+            outRe[k] += re[t] * std::cos(angle) - im[t] * std::sin(angle);
+            outIm[k] += re[t] * std::sin(angle) + im[t] * std::cos(angle);
+        }
+    }
+    for (size_t k = 0; k < n; k++) {
+        re[k] = (float)outRe[k];
+        im[k] = (float)outIm[k];
+    }
+}
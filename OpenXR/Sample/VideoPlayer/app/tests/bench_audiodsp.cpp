@@ -0,0 +1,105 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Throughput of the audiodsp kernels next to their scalar references (as the compiler builds
+// them, which may vectorize the simplest loops itself), and the cost of CAudioConverter per 10 ms
+// buffer for the conversions the player meets most.
+
+#include "pch.h"
+#include "common.h"
+#include "audiodsp.h"
+#include "audiodspreference.h"
+#include "testing.h"
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int32_t kSamples = 4096;
+constexpr int32_t kRepeats = 256;
+constexpr int32_t kRuns = 5;
+
+// Best time per sample of kRepeats calls of f over kSamples samples.
+template <typename F>
+double NsPerSample(F f) {
+    const int64_t best = BenchBestNs(kRuns, [&] {
+        for (int32_t r = 0; r < kRepeats; r++) {
+            f();
+        }
+    });
+    return (double)best / ((double)kRepeats * kSamples);
+}
+
+void Report(const char* name, double kernelNs, double referenceNs) {
+    printf("%-28s %7.3f ns/sample, reference %7.3f ns/sample (x%.1f)\n", name, kernelNs, referenceNs, referenceNs / kernelNs);
+}
+
+void BenchKernels() {
+    std::vector<int16_t> pcm(kSamples);
+    for (int32_t i = 0; i < kSamples; i++) {
+        pcm[i] = (int16_t)((i * 7919) % 65536 - 32768);
+    }
+    std::vector<float> a(kSamples), b(kSamples), c(kSamples), d(kSamples), e(kSamples), f(kSamples);
+    for (int32_t i = 0; i < kSamples; i++) {
+        a[i] = b[i] = c[i] = d[i] = (float)std::sin(i * 0.01);
+    }
+    std::vector<int16_t> pcmOut(kSamples);
+
+    Report("ConvertInt16ToFloat", NsPerSample([&] { ConvertInt16ToFloat(pcm.data(), e.data(), kSamples); }),
+           NsPerSample([&] { ReferenceInt16ToFloat(pcm.data(), e.data(), kSamples); }));
+    Report("ConvertFloatToInt16", NsPerSample([&] { ConvertFloatToInt16(a.data(), pcmOut.data(), kSamples); }),
+           NsPerSample([&] { ReferenceFloatToInt16(a.data(), pcmOut.data(), kSamples); }));
+    Report("ComplexMultiplyAccumulate",
+           NsPerSample([&] { ComplexMultiplyAccumulate(a.data(), b.data(), c.data(), d.data(), e.data(), f.data(), kSamples); }),
+           NsPerSample([&] { ReferenceComplexMultiplyAccumulate(a.data(), b.data(), c.data(), d.data(), e.data(), f.data(), kSamples); }));
+    Report("RampedMultiplyAccumulate", NsPerSample([&] { RampedMultiplyAccumulate(a.data(), 0.5f, 1e-5f, e.data(), kSamples); }),
+           NsPerSample([&] { ReferenceRampedMultiplyAccumulate(a.data(), 0.5f, 1e-5f, e.data(), kSamples); }));
+
+    // kSamples interleaved samples: stereo deinterleave, and 5.1 and 7.1 to stereo through the matrix.
+    for (int32_t inChannels : {2, 6, 8}) {
+        const int32_t frames = kSamples / inChannels;
+        const std::vector<float> matrix = CreateDownmixMatrix(inChannels, 2);
+        float* planes[2] = {e.data(), f.data()};
+        const double kernelNs = NsPerSample([&] { MixChannels(a.data(), inChannels, frames, matrix.data(), planes, 2, 1); });
+        const double referenceNs = NsPerSample([&] { ReferenceMix(a.data(), inChannels, frames, matrix.data(), e.data(), 2); });
+        const std::string name = "MixChannels " + std::to_string(inChannels) + " -> 2";
+        Report(name.c_str(), kernelNs, referenceNs);
+    }
+
+    CFft fft;
+    fft.configure(512);
+    const int64_t fftNs = BenchBestNs(kRuns, [&] {
+        for (int32_t r = 0; r < kRepeats; r++) {
+            fft.forward(a.data(), b.data());
+        }
+    });
+    printf("%-28s %7.0f ns per 512-point transform\n", "CFft", (double)fftNs / kRepeats);
+}
+
+// 10 ms buffers of 16-bit input through the whole converter, as the audio decode thread runs it.
+void BenchConverter(int32_t inChannels, int32_t inRate, int32_t outChannels, int32_t outRate) {
+    const int32_t frames = inRate / 100;
+    std::vector<int16_t> in((size_t)frames * inChannels);
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = (int16_t)(8000 * std::sin(i * 0.003));
+    }
+    CAudioConverter converter;
+    TEST_CHECK(converter.configure(inChannels, inRate, outChannels, outRate));
+    const int32_t buffers = 100;
+    const int64_t best = BenchBestNs(kRuns, [&] {
+        for (int32_t i = 0; i < buffers; i++) {
+            converter.process(in.data(), frames);
+        }
+    });
+    const double perBufferNs = (double)best / buffers;
+    printf("CAudioConverter %d ch %5d Hz -> %d ch %5d Hz: %7.1f us per 10 ms buffer (%.2f%% of real time)\n", inChannels, inRate, outChannels,
+           outRate, perBufferNs / 1000, perBufferNs / 1e7 * 100);
+}
+}  // namespace
+
+int main() {
+    BenchKernels();
+    BenchConverter(6, 48000, 2, 48000);
+    BenchConverter(2, 44100, 2, 48000);
+    BenchConverter(6, 44100, 2, 48000);
+    return TestResult("bench_audiodsp");
+}
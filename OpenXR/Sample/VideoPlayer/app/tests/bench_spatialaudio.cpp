@@ -0,0 +1,48 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Cost of one CAmbisonicRenderer block at orders 1 and 2 with the head turning, against the
+// budget after which order 2 drops to order 1.
+
+#include "pch.h"
+#include "common.h"
+#include "spatialaudio.h"
+#include "testing.h"
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int32_t kSampleRate = 48000;
+constexpr int32_t kBlocks = 2000;
+constexpr int32_t kRuns = 5;
+
+void BenchOrder(int32_t order) {
+    CAmbisonicRenderer renderer;
+    TEST_CHECK(renderer.configure(order, kSampleRate));
+    const int32_t blockSamples = CAmbisonicRenderer::kBlockFrames * renderer.channelCount();
+    std::vector<int16_t> in((size_t)blockSamples);
+    for (int32_t i = 0; i < blockSamples; i++) {
+        in[i] = (int16_t)(4000 * std::sin(i * 0.05));
+    }
+    std::vector<int16_t> out((size_t)CAmbisonicRenderer::kBlockFrames * 2);
+    const int64_t best = BenchBestNs(kRuns, [&] {
+        for (int32_t b = 0; b < kBlocks; b++) {
+            // A new orientation every block, as from a head turning steadily.
+            const float yaw = b * 0.002f;
+            const float orientation[4] = {0.0f, std::sin(yaw), 0.0f, std::cos(yaw)};
+            renderer.process(in.data(), orientation, out.data());
+        }
+    });
+    const double blockNs = (double)best / kBlocks;
+    const double blockDurationNs = CAmbisonicRenderer::kBlockFrames * 1e9 / kSampleRate;
+    printf("order %d: %6.1f us per %d-frame block, %.1f%% of its %.0f us (budget %d%%), still rendering order %d\n", order, blockNs / 1000,
+           CAmbisonicRenderer::kBlockFrames, blockNs / blockDurationNs * 100, blockDurationNs / 1000, CAmbisonicRenderer::kBudgetPercent,
+           renderer.activeOrder());
+}
+}  // namespace
+
+int main() {
+    BenchOrder(1);
+    BenchOrder(2);
+    return TestResult("bench_spatialaudio");
+}
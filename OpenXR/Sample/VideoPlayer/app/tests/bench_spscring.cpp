@@ -0,0 +1,185 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Hands frames from a producer thread to a consumer thread through SpscRing and through the
+// std::list + std::mutex queue CPlayer used before it. Prints the cost per frame of each with both
+// sides contending flat out, and the push-to-pop latency of each when frames arrive paced.
+
+#include <stdio.h>
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "spscring.h"
+#include "testing.h"
+
+TEST_MAIN_STATE;
+
+namespace {
+
+struct Frame {
+    int64_t pts = 0;
+    uint32_t number = 0;
+};
+typedef std::shared_ptr<Frame> FramePtr;
+
+constexpr uint32_t kFrames = 1000000;
+constexpr uint32_t kLatencyFrames = 200000;
+constexpr int64_t kLatencyIntervalNs = 2000;   // one frame every 2 us, so the queue is mostly empty
+
+// The queue CPlayer had: every push and pop takes the same lock.
+template <typename T>
+class CLockedQueue {
+public:
+    explicit CLockedQueue(uint32_t capacity) : mCapacity(capacity) {}
+
+    bool push(T&& item) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mList.size() >= mCapacity) {
+            return false;
+        }
+        mList.push_back(std::move(item));
+        return true;
+    }
+
+    bool pop(T& item) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mList.empty()) {
+            return false;
+        }
+        item = std::move(mList.front());
+        mList.pop_front();
+        return true;
+    }
+
+private:
+    uint32_t             mCapacity;
+    std::mutex           mMutex;
+    std::list<T>         mList;
+};
+
+// Both sides yield instead of spinning, so the numbers also mean something on a single core.
+template <typename Push, typename Pop>
+int64_t Transfer(const std::vector<FramePtr>& pool, Push push, Pop pop) {
+    const int64_t start = TestNowNs();
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < kFrames; i++) {
+            FramePtr frame = pool[i % pool.size()];
+            while (!push(frame)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < kFrames; i++) {
+        FramePtr frame;
+        while (!pop(frame)) {
+            std::this_thread::yield();
+        }
+        sum += frame->number;
+    }
+    producer.join();
+    TEST_CHECK(sum == (uint64_t)kFrames / pool.size() * (pool.size() * (pool.size() - 1) / 2));
+    return TestNowNs() - start;
+}
+
+// Push time of a frame, read back by the consumer.
+struct Stamp {
+    int64_t pushNs = 0;
+};
+
+struct Latency {
+    int64_t p50Ns;
+    int64_t p99Ns;
+};
+
+// The producer pushes a stamped frame every kLatencyIntervalNs; the consumer polls, as the render
+// thread does, and records how long each frame took from push() to being popped.
+template <typename Push, typename Pop>
+Latency MeasureLatency(Push push, Pop pop) {
+    std::thread producer([&] {
+        int64_t next = TestNowNs();
+        for (uint32_t i = 0; i < kLatencyFrames; i++) {
+            while (TestNowNs() < next) {
+                std::this_thread::yield();
+            }
+            next += kLatencyIntervalNs;
+            Stamp stamp;
+            stamp.pushNs = TestNowNs();
+            while (!push(stamp)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    std::vector<int64_t> latencies;
+    latencies.reserve(kLatencyFrames);
+    for (uint32_t i = 0; i < kLatencyFrames; i++) {
+        Stamp stamp;
+        while (!pop(stamp)) {
+            std::this_thread::yield();
+        }
+        latencies.push_back(TestNowNs() - stamp.pushNs);
+    }
+    producer.join();
+    std::sort(latencies.begin(), latencies.end());
+    TEST_CHECK(latencies.front() >= 0);
+    return Latency{latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100]};
+}
+
+}  // namespace
+
+int main() {
+    std::vector<FramePtr> pool(8);
+    for (uint32_t i = 0; i < pool.size(); i++) {
+        pool[i] = std::make_shared<Frame>();
+        pool[i]->number = i;
+    }
+
+    for (uint32_t capacity : {4u, 64u}) {
+        int64_t ringNs = INT64_MAX;
+        int64_t lockedNs = INT64_MAX;
+        for (int32_t run = 0; run < 3; run++) {
+            SpscRing<FramePtr> ring(capacity);
+            ringNs = std::min(ringNs, Transfer(pool,
+                [&](FramePtr& frame) { return ring.push(std::move(frame)); },
+                [&](FramePtr& frame) {
+                    FramePtr* slot = ring.front();
+                    if (slot == nullptr) {
+                        return false;
+                    }
+                    frame = std::move(*slot);
+                    ring.pop();
+                    return true;
+                }));
+            CLockedQueue<FramePtr> queue(capacity);
+            lockedNs = std::min(lockedNs, Transfer(pool,
+                [&](FramePtr& frame) { return queue.push(std::move(frame)); },
+                [&](FramePtr& frame) { return queue.pop(frame); }));
+        }
+        printf("capacity %3u: SpscRing %6.1f ns/frame, list+mutex %6.1f ns/frame\n", capacity,
+               (double)ringNs / kFrames, (double)lockedNs / kFrames);
+    }
+
+    const uint32_t capacity = 8;
+    SpscRing<Stamp> ring(capacity);
+    const Latency ringLatency = MeasureLatency(
+        [&](Stamp& stamp) { return ring.push(std::move(stamp)); },
+        [&](Stamp& stamp) {
+            Stamp* slot = ring.front();
+            if (slot == nullptr) {
+                return false;
+            }
+            stamp = *slot;
+            ring.pop();
+            return true;
+        });
+    CLockedQueue<Stamp> queue(capacity);
+    const Latency lockedLatency = MeasureLatency(
+        [&](Stamp& stamp) { return queue.push(std::move(stamp)); },
+        [&](Stamp& stamp) { return queue.pop(stamp); });
+    printf("push to pop, a frame every %lld ns: SpscRing p50 %lld ns p99 %lld ns, list+mutex p50 %lld ns p99 %lld ns\n",
+           (long long)kLatencyIntervalNs, (long long)ringLatency.p50Ns, (long long)ringLatency.p99Ns, (long long)lockedLatency.p50Ns,
+           (long long)lockedLatency.p99Ns);
+    return TestResult("bench_spscring");
+}
@@ -0,0 +1,74 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// How CThumbnailAtlas shares the CPU with playback: builds the atlas of a Host-backend clip with
+// busy() never set, then with busy() set for part of every period as playback would during its
+// decode bursts, and prints the yields, the time spent decoding and throttled, and the duty cycle
+// the job achieved against kDutyCyclePercent.
+
+#include "pch.h"
+#include "common.h"
+#include "options.h"
+#include "mediaclock.h"
+#include "thumbnailatlas.h"
+#include "mediafixtures.h"
+#include "testing.h"
+#include <thread>
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int32_t kWidth = 640;
+constexpr int32_t kHeight = 360;
+constexpr int32_t kFps = 25;
+constexpr int32_t kFrames = 100;     // every frame of a .y4m is a keyframe: one tile each
+constexpr int64_t kTimeoutNs = 60000000000LL;
+
+void Run(const char* name, std::shared_ptr<IMediaBackend> backend, const std::string& clip, int64_t busyNs, int64_t periodNs) {
+    const int64_t startNs = CMediaClock::monotonicNow();
+    // Busy for the first busyNs of every periodNs since the start.
+    auto busy = [startNs, busyNs, periodNs] { return busyNs > 0 && (CMediaClock::monotonicNow() - startNs) % periodNs < busyNs; };
+    CThumbnailAtlas atlas(backend, busy);
+    if (!atlas.start(clip)) {
+        printf("%s: can't start\n", name);
+        return;
+    }
+    while (!atlas.ready() && CMediaClock::monotonicNow() - startNs < kTimeoutNs) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    const ThumbnailStats stats = atlas.getStats();
+    atlas.stop();
+    if (!atlas.ready() || stats.totalNs <= 0) {
+        printf("%s: not ready after %lld s\n", name, (long long)(kTimeoutNs / 1000000000));
+        return;
+    }
+    // The duty cycle counts the sleeps between tiles but not the waits for playback, which the
+    // job has no say in.
+    const int64_t yieldedNs = std::min<int64_t>(stats.throttledNs, (int64_t)stats.yields * CThumbnailAtlas::kBusyPollNs);
+    const int64_t ownNs = stats.totalNs - yieldedNs;
+    printf("%-30s %3u tiles in %7.1f ms: decode %6.1f ms, throttled %7.1f ms, %3u yields, duty %5.1f%% of all, %5.1f%% outside yields (target %d%%)\n",
+           name, stats.thumbnails, stats.totalNs / 1e6, stats.decodeNs / 1e6, stats.throttledNs / 1e6, stats.yields,
+           100.0 * stats.decodeNs / stats.totalNs, ownNs > 0 ? 100.0 * stats.decodeNs / ownNs : 0.0, CThumbnailAtlas::kDutyCyclePercent);
+}
+}  // namespace
+
+int main() {
+    const std::string directory = MakeTempDirectory();
+    const std::string clip = directory + "/clip.y4m";
+    if (directory.empty() || !WriteY4m(clip, kWidth, kHeight, kFps, 1, kFrames)) {
+        fprintf(stderr, "can't write %s\n", clip.c_str());
+        return 1;
+    }
+    Options options;
+    options.MediaBackend = "Host";
+    options.IndexCacheDir = "";  // build the atlas every run
+    std::shared_ptr<IMediaBackend> backend = CreateMediaBackend(options);
+
+    printf("%d tiles from a %dx%d clip, busy() polled every %lld ms:\n", kFrames, kWidth, kHeight,
+           (long long)(CThumbnailAtlas::kBusyPollNs / 1000000));
+    Run("never busy", backend, clip, 0, 1);
+    Run("busy 50 of every 200 ms", backend, clip, 50000000, 200000000);
+    Run("busy 100 of every 200 ms", backend, clip, 100000000, 200000000);
+    RemoveTempDirectory(directory);
+    return 0;
+}
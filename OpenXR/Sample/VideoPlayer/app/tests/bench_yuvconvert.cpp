@@ -0,0 +1,83 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// CPU cost of packing one 4K 4:2:0 frame into the staging buffer, as the graphics plugins upload
+// it: the scalar U/V split the Vulkan plugin used to do, NV12 chroma copied as it is, and I420
+// chroma interleaved into NV12's, unpadded and with decoder row padding.
+
+#include "pch.h"
+#include "common.h"
+#include "yuvconvert.h"
+#include "testing.h"
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int32_t kWidth = 3840;
+constexpr int32_t kHeight = 2160;
+constexpr int32_t kRuns = 50;
+
+void Report(const char* name, int64_t frameNs, int64_t chromaNs) {
+    printf("%-34s %6.3f ms per frame, chroma %6.3f ms\n", name, frameNs / 1e6, chromaNs / 1e6);
+}
+
+void BenchLayout(int32_t stride, int32_t sliceHeight) {
+    const size_t lumaSize = (size_t)kWidth * kHeight;
+    const size_t chromaSize = lumaSize / 2;
+    std::vector<uint8_t> frame(std::max(GetYuv420BufferSize(kWidth, kHeight, stride, sliceHeight, false),
+                                        GetYuv420BufferSize(kWidth, kHeight, stride, sliceHeight, true)));
+    for (size_t i = 0; i < frame.size(); i++) {
+        frame[i] = (uint8_t)(i * 7);
+    }
+    std::vector<uint8_t> staging(lumaSize + chromaSize);
+    uint8_t* luma = staging.data();
+    uint8_t* uv = staging.data() + lumaSize;
+    const uint8_t* chroma = frame.data() + (size_t)stride * sliceHeight;
+    const size_t chromaStride = (size_t)stride / 2;
+    const uint8_t* v = chroma + chromaStride * (sliceHeight / 2);
+
+    auto copyLuma = [&] { CopyPlane(frame.data(), stride, luma, kWidth, kWidth, kHeight); };
+    auto copyNv12 = [&] { CopyPlane(chroma, stride, uv, kWidth, kWidth, kHeight / 2); };
+    auto interleaveI420 = [&] { InterleaveChromaRows(chroma, v, chromaStride, uv, kWidth, kWidth / 2, kHeight / 2); };
+
+    printf("%dx%d, stride %d, slice height %d, best of %d:\n", kWidth, kHeight, stride, sliceHeight, kRuns);
+    if (stride == kWidth && sliceHeight == kHeight) {
+        // The upload before NV12 chroma went up as one R8G8 texture: U and V split into planes.
+        auto splitNv12 = [&] {
+            uint8_t* uPlane = uv;
+            uint8_t* vPlane = uv + chromaSize / 2;
+            for (size_t i = 0; i < chromaSize; i += 2) {
+                *uPlane++ = chroma[i];
+                *vPlane++ = chroma[i + 1];
+            }
+        };
+        Report("NV12, scalar U/V split (old)", BenchBestNs(kRuns, [&] {
+                   copyLuma();
+                   splitNv12();
+               }),
+               BenchBestNs(kRuns, splitNv12));
+    }
+    Report("NV12, chroma copied as is", BenchBestNs(kRuns, [&] {
+               copyLuma();
+               copyNv12();
+           }),
+           BenchBestNs(kRuns, copyNv12));
+    Report("I420, chroma interleaved", BenchBestNs(kRuns, [&] {
+               copyLuma();
+               interleaveI420();
+           }),
+           BenchBestNs(kRuns, interleaveI420));
+
+    // The timed loops must have done their job.
+    interleaveI420();
+    TEST_CHECK(uv[0] == chroma[0] && uv[1] == v[0]);
+    TEST_CHECK(uv[chromaSize - 2] == chroma[chromaStride * (kHeight / 2 - 1) + kWidth / 2 - 1]);
+    TEST_CHECK(uv[chromaSize - 1] == v[chromaStride * (kHeight / 2 - 1) + kWidth / 2 - 1]);
+}
+}  // namespace
+
+int main() {
+    BenchLayout(kWidth, kHeight);
+    BenchLayout(4096, 2176);    // a decoder aligning rows to 256 bytes and the height to 64 rows
+    return TestResult("bench_yuvconvert");
+}
@@ -0,0 +1,202 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// HTTP/1.1 server on 127.0.0.1 for the host tests.
+
+#include "loopbackhttpserver.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace {
+
+bool SendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+// Sends in slices of 10 ms at the given rate, each one once the link would have carried it.
+bool SendPaced(int fd, const char* data, size_t size, int64_t bytesPerSecond) {
+    if (bytesPerSecond <= 0) {
+        return SendAll(fd, data, size);
+    }
+    const size_t slice = (size_t)std::max<int64_t>(bytesPerSecond / 100, 1);
+    const auto start = std::chrono::steady_clock::now();
+    size_t sent = 0;
+    while (sent < size) {
+        const size_t length = std::min(slice, size - sent);
+        sent += length;
+        std::this_thread::sleep_until(start + std::chrono::nanoseconds((int64_t)(sent * 1000000000.0 / bytesPerSecond)));
+        if (!SendAll(fd, data + sent - length, length)) {
+            return false;
+        }
+    }
+    return true;
+}
+}  // namespace
+
+CLoopbackHttpServer::~CLoopbackHttpServer() {
+    stop();
+}
+
+bool CLoopbackHttpServer::start() {
+    mListenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (mListenFd < 0) {
+        return false;
+    }
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if (bind(mListenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(mListenFd, 16) != 0 ||
+        getsockname(mListenFd, (sockaddr*)&address, &length) != 0) {
+        close(mListenFd);
+        mListenFd = -1;
+        return false;
+    }
+    mPort = ntohs(address.sin_port);
+    mStopping = false;
+    mAcceptThread = std::thread(&CLoopbackHttpServer::acceptLoop, this);
+    return true;
+}
+
+void CLoopbackHttpServer::stop() {
+    if (mListenFd < 0) {
+        return;
+    }
+    mStopping = true;
+    shutdown(mListenFd, SHUT_RDWR);
+    mAcceptThread.join();
+    close(mListenFd);
+    mListenFd = -1;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (int fd : mClientFds) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    for (std::thread& client : mClients) {
+        client.join();
+    }
+    mClients.clear();
+    mClientFds.clear();
+}
+
+std::string CLoopbackHttpServer::url(const std::string& path) const {
+    return "http://127.0.0.1:" + std::to_string(mPort) + (path.empty() || path[0] != '/' ? "/" : "") + path;
+}
+
+void CLoopbackHttpServer::setFile(const std::string& path, std::string data) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFiles[path[0] == '/' ? path : "/" + path] = std::move(data);
+}
+
+uint32_t CLoopbackHttpServer::requestCount(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mRequestCounts[path[0] == '/' ? path : "/" + path];
+}
+
+void CLoopbackHttpServer::acceptLoop() {
+    while (!mStopping) {
+        const int fd = accept(mListenFd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        connections++;
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClientFds.push_back(fd);
+        mClients.emplace_back(&CLoopbackHttpServer::serve, this, fd);
+    }
+}
+
+void CLoopbackHttpServer::serve(int fd) {
+    std::string pending;
+    char chunk[4096];
+    while (!mStopping) {
+        const size_t headerEnd = pending.find("\r\n\r\n");
+        if (headerEnd == std::string::npos) {
+            const ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+            if (got <= 0) {
+                break;
+            }
+            pending.append(chunk, got);
+            continue;
+        }
+        const std::string request = pending.substr(0, headerEnd + 2);
+        pending.erase(0, headerEnd + 4);
+        requests++;
+
+        char method[16] = {};
+        char target[1024] = {};
+        sscanf(request.c_str(), "%15s %1023s", method, target);
+        std::string body;
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mRequestCounts[target]++;
+            auto it = mFiles.find(target);
+            if (it != mFiles.end()) {
+                body = it->second;
+                found = true;
+            }
+        }
+        std::string headers;
+        if (!found) {
+            headers = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n";
+        } else {
+            long long first = -1;
+            long long last = -1;
+            const char* range = strcasestr(request.c_str(), "\r\nRange: bytes=");
+            if (range && !ignoreRanges) {
+                sscanf(range + 15, "%lld-%lld", &first, &last);
+            }
+            const long long total = (long long)body.size();
+            if (first >= 0 && first < total) {
+                last = (last < 0 || last >= total) ? total - 1 : last;
+                body = body.substr((size_t)first, (size_t)(last - first + 1));
+                headers = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" +
+                          std::to_string(total) + "\r\n";
+            } else if (first >= 0) {
+                headers = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + std::to_string(total) + "\r\n";
+                body.clear();
+            } else {
+                headers = "HTTP/1.1 200 OK\r\n";
+            }
+            headers += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        }
+        headers += "\r\n";
+        int32_t truncate = truncateResponses.load();
+        while (truncate > 0 && !truncateResponses.compare_exchange_weak(truncate, truncate - 1)) {
+        }
+        if (truncate > 0) {
+            SendAll(fd, headers.data(), headers.size());
+            SendAll(fd, body.data(), body.size() / 2);
+            break;
+        }
+        if (!SendAll(fd, headers.data(), headers.size()) || !SendPaced(fd, body.data(), body.size(), bytesPerSecond) || dropKeepAlive) {
+            break;
+        }
+    }
+    shutdown(fd, SHUT_RDWR);
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (int& client : mClientFds) {
+        if (client == fd) {
+            close(fd);
+            client = -1;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// HTTP/1.1 server on 127.0.0.1 for the host tests: serves byte strings by path with range
+// requests and keep-alive, and can misbehave on request to exercise the clients' retry paths.
+
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CLoopbackHttpServer {
+
+public:
+    ~CLoopbackHttpServer();
+
+    // Listens on an ephemeral port of 127.0.0.1.
+    bool start();
+
+    void stop();
+
+    // http://127.0.0.1:port/path
+    std::string url(const std::string& path) const;
+
+    void setFile(const std::string& path, std::string data);
+
+    // Requests for path so far.
+    uint32_t requestCount(const std::string& path);
+
+    // Faults. A 200 with the whole file, as a server without range support answers.
+    std::atomic<bool>     ignoreRanges{false};
+    // Closes every connection after one response without saying so in the headers.
+    std::atomic<bool>     dropKeepAlive{false};
+    // The next responses send half their body, then close the connection.
+    std::atomic<int32_t>  truncateResponses{0};
+    // Paces response bodies to this many bytes a second, as a slow link would; 0 sends them at once.
+    std::atomic<int64_t>  bytesPerSecond{0};
+
+    std::atomic<uint32_t> connections{0};
+    std::atomic<uint32_t> requests{0};
+
+private:
+    void acceptLoop();
+
+    void serve(int fd);
+
+    int                              mListenFd{-1};
+    int32_t                          mPort{0};
+    std::atomic<bool>                mStopping{false};
+    std::thread                      mAcceptThread;
+    std::mutex                       mMutex;
+    std::map<std::string, std::string> mFiles;
+    std::map<std::string, uint32_t>  mRequestCounts;
+    std::vector<int>                 mClientFds;
+    std::vector<std::thread>         mClients;
+};
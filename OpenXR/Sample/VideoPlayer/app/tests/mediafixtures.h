@@ -0,0 +1,174 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Small media files for the host backend, written by the tests that play them: YUV4MPEG2 video
+// whose every sample is a known function of frame, plane and position, the same pictures in an MP4
+// with sparse sync samples, and 16-bit PCM .wav audio whose samples encode frame and channel.
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+inline std::string MakeTempDirectory() {
+    char path[] = "/tmp/player_test_XXXXXX";
+    return mkdtemp(path) ? std::string(path) : std::string();
+}
+
+// Removes the files in a directory made by MakeTempDirectory(), then the directory.
+inline void RemoveTempDirectory(const std::string& directory) {
+    if (DIR* dir = opendir(directory.c_str())) {
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') {
+                unlink((directory + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(directory.c_str());
+}
+
+// Value of sample (x, y) of plane 0 (Y), 1 (U) or 2 (V) in frame 'frame' of a WriteY4m() file.
+inline uint8_t Y4mSample(int32_t frame, int32_t plane, int32_t x, int32_t y) {
+    return (uint8_t)(frame * 7 + plane * 50 + x * 3 + y * 11);
+}
+
+// Picture 'frame' of a WriteY4m() file: the Y, U and V planes of an I420 frame, back to back.
+inline void Y4mPicture(int32_t frame, int32_t width, int32_t height, std::vector<uint8_t>& picture) {
+    const int32_t chromaWidth = (width + 1) / 2;
+    const int32_t chromaHeight = (height + 1) / 2;
+    picture.clear();
+    for (int32_t plane = 0; plane < 3; plane++) {
+        const int32_t w = plane == 0 ? width : chromaWidth;
+        const int32_t h = plane == 0 ? height : chromaHeight;
+        for (int32_t y = 0; y < h; y++) {
+            for (int32_t x = 0; x < w; x++) {
+                picture.push_back(Y4mSample(frame, plane, x, y));
+            }
+        }
+    }
+}
+
+// I420 frames at rateNum/rateDen fps. Every third FRAME header carries a parameter, as encoders
+// may write them.
+inline bool WriteY4m(const std::string& path, int32_t width, int32_t height, int32_t rateNum, int32_t rateDen, int32_t frames,
+                     const char* colorspace = "420jpeg") {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    fprintf(file, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C%s\n", width, height, rateNum, rateDen, colorspace);
+    std::vector<uint8_t> picture;
+    for (int32_t f = 0; f < frames; f++) {
+        Y4mPicture(f, width, height, picture);
+        fputs(f % 3 == 2 ? "FRAME Ixyz\n" : "FRAME\n", file);
+        fwrite(picture.data(), 1, picture.size(), file);
+    }
+    return fclose(file) == 0;
+}
+
+// Big-endian fields and ISO-BMFF boxes, for WriteRawMp4() and tests that build their own files.
+inline std::string Be16(uint32_t value) { return std::string{(char)(value >> 8), (char)value}; }
+inline std::string Be32(uint32_t value) { return Be16(value >> 16) + Be16(value & 0xffff); }
+inline std::string Be64(uint64_t value) { return Be32((uint32_t)(value >> 32)) + Be32((uint32_t)value); }
+inline std::string Box(const char* type, const std::string& body) { return Be32((uint32_t)(8 + body.size())) + type + body; }
+inline std::string FullBox(const char* type, uint32_t version, uint32_t flags, const std::string& body) {
+    return Box(type, Be32((version << 24) | flags) + body);
+}
+
+// Visual sample entry of the given type with no child boxes.
+inline std::string VisualSampleEntry(const char* type, int32_t width, int32_t height) {
+    return Box(type, std::string(6, '\0') + Be16(1) + std::string(16, '\0') + Be16(width) + Be16(height) + Be32(0x480000) + Be32(0x480000) +
+                         Be32(0) + Be16(1) + std::string(32, '\0') + Be16(24) + Be16(0xffff));
+}
+
+// trak box of a track with the given handler ("vide" or "soun"), timescale and sample table.
+inline std::string TrakBox(uint32_t trackId, const char* handler, uint32_t timescale, uint32_t duration, const std::string& stbl) {
+    return Box("trak", FullBox("tkhd", 0, 3, Be32(0) + Be32(0) + Be32(trackId) + std::string(68, '\0')) +
+                           Box("mdia", FullBox("mdhd", 0, 0, Be32(0) + Be32(0) + Be32(timescale) + Be32(duration) + Be32(0)) +
+                                           FullBox("hdlr", 0, 0, Be32(0) + handler + std::string(13, '\0')) + Box("minf", Box("stbl", stbl))));
+}
+
+// The WriteY4m() pictures as the I420 video track of a progressive MP4 at fps, one sample per
+// chunk after the moov box, and only every syncInterval-th sample a sync sample.
+inline bool WriteRawMp4(const std::string& path, int32_t width, int32_t height, int32_t fps, int32_t frames, int32_t syncInterval) {
+    std::vector<uint8_t> picture;
+    Y4mPicture(0, width, height, picture);
+    const uint32_t frameSize = (uint32_t)picture.size();
+    const std::string ftyp = Box("ftyp", std::string("isom") + Be32(0) + "isom");
+    auto moov = [&](uint32_t dataOffset) {
+        std::string stss, stco;
+        uint32_t syncCount = 0;
+        for (int32_t f = 0; f < frames; f++) {
+            if (f % syncInterval == 0) {
+                stss += Be32(f + 1);
+                syncCount++;
+            }
+            stco += Be32(dataOffset + f * frameSize);
+        }
+        const std::string stbl = FullBox("stsd", 0, 0, Be32(1) + VisualSampleEntry("I420", width, height)) +
+                                 FullBox("stts", 0, 0, Be32(1) + Be32(frames) + Be32(1)) + FullBox("stss", 0, 0, Be32(syncCount) + stss) +
+                                 FullBox("stsc", 0, 0, Be32(1) + Be32(1) + Be32(1) + Be32(1)) +
+                                 FullBox("stsz", 0, 0, Be32(frameSize) + Be32(frames)) + FullBox("stco", 0, 0, Be32(frames) + stco);
+        return Box("moov", TrakBox(1, "vide", fps, frames, stbl));
+    };
+    const uint32_t headerSize = (uint32_t)(ftyp.size() + moov(0).size()) + 8;
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    const std::string header = ftyp + moov(headerSize) + Be32(8 + frames * frameSize) + "mdat";
+    fwrite(header.data(), 1, header.size(), file);
+    for (int32_t f = 0; f < frames; f++) {
+        Y4mPicture(f, width, height, picture);
+        fwrite(picture.data(), 1, picture.size(), file);
+    }
+    return fclose(file) == 0;
+}
+
+// Value of channel 'channel' of PCM frame 'frame' in a WriteWav() file.
+inline int16_t WavSample(int32_t frame, int32_t channel) {
+    return (int16_t)((frame * 13 + channel * 1000) % 30000 - 15000);
+}
+
+// 16-bit PCM, with an odd-sized LIST chunk before the data chunk, as tagging tools write it.
+inline bool WriteWav(const std::string& path, int32_t channels, int32_t sampleRate, int32_t frames, int32_t bitsPerSample = 16) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    auto le16 = [&](uint32_t value) {
+        const uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+        fwrite(bytes, 1, 2, file);
+    };
+    auto le32 = [&](uint32_t value) {
+        le16(value & 0xffff);
+        le16(value >> 16);
+    };
+    const uint32_t dataSize = (uint32_t)frames * channels * 2;
+    const char list[] = "INFOISFT\x04\0\0\0abc";    // 15 bytes, padded to 16 in the file
+    fwrite("RIFF", 1, 4, file);
+    le32(4 + 24 + 8 + 16 + 8 + dataSize);
+    fwrite("WAVEfmt ", 1, 8, file);
+    le32(16);
+    le16(1);
+    le16(channels);
+    le32(sampleRate);
+    le32(sampleRate * channels * bitsPerSample / 8);
+    le16(channels * bitsPerSample / 8);
+    le16(bitsPerSample);
+    fwrite("LIST", 1, 4, file);
+    le32(15);
+    fwrite(list, 1, 16, file);
+    fwrite("data", 1, 4, file);
+    le32(dataSize);
+    for (int32_t f = 0; f < frames; f++) {
+        for (int32_t c = 0; c < channels; c++) {
+            le16((uint16_t)WavSample(f, c));
+        }
+    }
+    return fclose(file) == 0;
+}
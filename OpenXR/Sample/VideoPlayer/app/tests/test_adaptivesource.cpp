@@ -0,0 +1,409 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// DASH and HLS manifest parsing from the fixtures, rendition choice, the segment cache budget,
+// and CAdaptiveSource playing fragmented-MP4 renditions from a loopback server.
+
+#include "pch.h"
+#include "common.h"
+#include "options.h"
+#include "adaptivesource.h"
+#include "loopbackhttpserver.h"
+#include "testing.h"
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int32_t kFps = 5;
+constexpr int32_t kSegments = 8;
+constexpr int32_t kSegmentFrames = kFps;        // 1 s segments, the last one 0.6 s
+constexpr int32_t kLastSegmentFrames = 3;
+const char* const kRenditionNames[] = {"lo", "mid", "hi"};
+const int32_t kRenditionSizes[][2] = {{64, 36}, {128, 72}, {256, 144}};
+
+std::string ReadFixture(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream data;
+    data << file.rdbuf();
+    return data.str();
+}
+
+std::string MakeTempDirectory() {
+    char path[] = "/tmp/player_test_XXXXXX";
+    return mkdtemp(path) ? std::string(path) : std::string();
+}
+
+// Files and bytes in a directory, which is emptied first when clear is set.
+uint64_t DirectoryBytes(const std::string& directory, bool clear = false) {
+    uint64_t total = 0;
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr) {
+        return 0;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        const std::string path = directory + "/" + entry->d_name;
+        struct stat statbuff;
+        if (entry->d_name[0] != '.' && stat(path.c_str(), &statbuff) == 0 && S_ISREG(statbuff.st_mode)) {
+            total += statbuff.st_size;
+            if (clear) {
+                unlink(path.c_str());
+            }
+        }
+    }
+    closedir(dir);
+    return total;
+}
+
+// Fragmented MP4 with one raw I420 video track, as the host demuxer reads it.
+std::string Be16(uint32_t value) { return std::string{(char)(value >> 8), (char)value}; }
+std::string Be32(uint32_t value) { return Be16(value >> 16) + Be16(value & 0xffff); }
+std::string Be64(uint64_t value) { return Be32((uint32_t)(value >> 32)) + Be32((uint32_t)value); }
+std::string Box(const char* type, const std::string& body) { return Be32((uint32_t)(8 + body.size())) + type + body; }
+std::string FullBox(const char* type, uint32_t version, uint32_t flags, const std::string& body) {
+    return Box(type, Be32((version << 24) | flags) + body);
+}
+
+std::string MakeInitSegment(int32_t width, int32_t height) {
+    const std::string sampleEntry = Box("I420", std::string(6, '\0') + Be16(1) + std::string(16, '\0') + Be16(width) + Be16(height) +
+                                                    Be32(0x480000) + Be32(0x480000) + Be32(0) + Be16(1) + std::string(32, '\0') + Be16(24) +
+                                                    Be16(0xffff));
+    const std::string stbl = Box("stbl", FullBox("stsd", 0, 0, Be32(1) + sampleEntry) + FullBox("stts", 0, 0, Be32(0)) +
+                                             FullBox("stsc", 0, 0, Be32(0)) + FullBox("stsz", 0, 0, Be32(0) + Be32(0)) +
+                                             FullBox("stco", 0, 0, Be32(0)));
+    const std::string trak = Box("trak", FullBox("tkhd", 0, 3, Be32(0) + Be32(0) + Be32(1) + std::string(68, '\0')) +
+                                             Box("mdia", FullBox("mdhd", 0, 0, Be32(0) + Be32(0) + Be32(kFps) + Be32(0) + Be32(0)) +
+                                                             FullBox("hdlr", 0, 0, Be32(0) + "vide" + std::string(13, '\0')) +
+                                                             Box("minf", stbl)));
+    const std::string mvex = Box("mvex", FullBox("trex", 0, 0, Be32(1) + Be32(1) + Be32(0) + Be32(0) + Be32(0)));
+    return Box("ftyp", std::string("iso6") + Be32(0) + "iso6") + Box("moov", trak + mvex);
+}
+
+// Every frame starts with a byte naming the rendition and one counting frames from the start of
+// the stream, so the test can tell where each sample came from.
+std::string MakeMediaSegment(int32_t rendition, int32_t segment) {
+    const int32_t frameSize = kRenditionSizes[rendition][0] * kRenditionSizes[rendition][1] * 3 / 2;
+    const int32_t frames = segment + 1 == kSegments ? kLastSegmentFrames : kSegmentFrames;
+    const int32_t firstFrame = segment * kSegmentFrames;
+    std::string mdat;
+    for (int32_t i = 0; i < frames; i++) {
+        std::string frame(frameSize, (char)0x80);
+        frame[0] = (char)(10 + rendition * 80);
+        frame[1] = (char)(firstFrame + i);
+        mdat += frame;
+    }
+    auto moof = [&](int32_t dataOffset) {
+        const std::string tfhd = FullBox("tfhd", 0, 0x020000 | 0x8 | 0x10 | 0x20, Be32(1) + Be32(1) + Be32(frameSize) + Be32(0x10000));
+        const std::string tfdt = FullBox("tfdt", 1, 0, Be64(firstFrame));
+        const std::string trun = FullBox("trun", 0, 0x1 | 0x4, Be32(frames) + Be32(dataOffset) + Be32(0));
+        return Box("moof", FullBox("mfhd", 0, 0, Be32(segment + 1)) + Box("traf", tfhd + tfdt + trun));
+    };
+    const std::string header = moof(0);
+    return moof((int32_t)header.size() + 8) + Box("mdat", mdat);
+}
+
+void TestDashManifest() {
+    AdaptiveManifest manifest;
+    TEST_CHECK(LoadAdaptiveManifest("fixtures/adaptive/stream.mpd", nullptr, manifest));
+    TEST_CHECK(manifest.durationUs == 5500000);
+    // The audio set is ignored, "odd" has another segment count, the rest sorted by bandwidth.
+    TEST_CHECK(manifest.renditions.size() == 3);
+    if (manifest.renditions.size() != 3) {
+        return;
+    }
+    TEST_CHECK(manifest.renditions[0].bandwidth == 400000 && manifest.renditions[0].width == 320 && manifest.renditions[0].height == 180);
+    TEST_CHECK(manifest.renditions[1].bandwidth == 1200000);
+    TEST_CHECK(manifest.renditions[2].bandwidth == 2400000 && manifest.renditions[2].width == 1280);
+    const Rendition& lo = manifest.renditions[0];
+    TEST_CHECK(lo.initUrl == "fixtures/adaptive/lo/init.mp4");
+    TEST_CHECK(lo.segments.size() == 3);
+    if (lo.segments.size() == 3) {
+        TEST_CHECK(lo.segments[0].url == "fixtures/adaptive/lo/seg-001.m4s" && lo.segments[0].startUs == 0 && lo.segments[0].durationUs == 2000000);
+        TEST_CHECK(lo.segments[2].url == "fixtures/adaptive/lo/seg-003.m4s" && lo.segments[2].startUs == 4000000 &&
+                   lo.segments[2].durationUs == 1500000);
+    }
+    // SegmentTimeline at the representation level, keeping the set's initialization.
+    const Rendition& mid = manifest.renditions[1];
+    TEST_CHECK(mid.initUrl == "fixtures/adaptive/mid/init.mp4");
+    TEST_CHECK(mid.segments.size() == 3);
+    if (mid.segments.size() == 3) {
+        TEST_CHECK(mid.segments[1].url == "fixtures/adaptive/mid/t180000.m4s" && mid.segments[1].startUs == 2000000);
+        TEST_CHECK(mid.segments[2].url == "fixtures/adaptive/mid/t360000.m4s" && mid.segments[2].durationUs == 1500000);
+    }
+}
+
+void TestHlsManifest() {
+    AdaptiveManifest manifest;
+    TEST_CHECK(LoadAdaptiveManifest("fixtures/adaptive/master.m3u8", nullptr, manifest));
+    TEST_CHECK(manifest.renditions.size() == 3);
+    if (manifest.renditions.size() != 3) {
+        return;
+    }
+    for (int32_t i = 0; i < 3; i++) {
+        const Rendition& rendition = manifest.renditions[i];
+        TEST_CHECK(rendition.width == kRenditionSizes[i][0] && rendition.height == kRenditionSizes[i][1]);
+        TEST_CHECK(rendition.initUrl == Fmt("fixtures/adaptive/%s/init.mp4", kRenditionNames[i]));
+        TEST_CHECK(rendition.segments.size() == kSegments);
+    }
+    TEST_CHECK(manifest.renditions[0].bandwidth == 400000 && manifest.renditions[2].bandwidth == 2400000);
+    const std::vector<MediaSegment>& segments = manifest.renditions[1].segments;
+    TEST_CHECK(segments[3].url == "fixtures/adaptive/mid/seg-003.m4s" && segments[3].startUs == 3000000);
+    TEST_CHECK(segments[kSegments - 1].durationUs == 600000);
+    TEST_CHECK(manifest.durationUs == 7600000);
+
+    TEST_CHECK(ResolveMediaUrl("http://host/a/b/master.m3u8?token=1", "c/d.m3u8") == "http://host/a/b/c/d.m3u8");
+    TEST_CHECK(ResolveMediaUrl("http://host/a/master.m3u8", "/e/f.m4s") == "http://host/e/f.m4s");
+    TEST_CHECK(ResolveMediaUrl("http://host/a/master.m3u8", "http://cdn/g.m4s") == "http://cdn/g.m4s");
+    TEST_CHECK(IsAdaptiveManifestPath("http://host/live.m3u8?x=1") && IsAdaptiveManifestPath("a.MPD") && !IsAdaptiveManifestPath("a.mp4"));
+}
+
+void TestRenditionChoice() {
+    const std::vector<int64_t> bandwidths = {400000, 1200000, 2400000};
+    const int64_t targetUs = 6000000;
+    CAbrController abr(targetUs);
+    TEST_CHECK(abr.select(bandwidths, -1, 0) == 0);             // no estimate yet: start low
+    for (int32_t i = 0; i < 4; i++) {
+        abr.addSample(1000000, 1000000000, 1000000);            // 8 Mbps
+    }
+    TEST_CHECK(abr.estimateBps() > 7000000 && abr.estimateBps() <= 8000000);
+    TEST_CHECK(abr.select(bandwidths, 0, targetUs / 4) == 0);   // room to go up, but too little buffer
+    TEST_CHECK(abr.select(bandwidths, 0, targetUs / 2) == 2);
+    TEST_CHECK(abr.select(bandwidths, 2, targetUs / 8) == 0);   // nearly empty buffer: lowest at once
+    for (int32_t i = 0; i < 6; i++) {
+        abr.addSample(125000, 1000000000, 1000000);             // 1 Mbps: the fast average follows first
+    }
+    TEST_CHECK(abr.estimateBps() < 2400000 * CAbrController::kDownSwitchSafety);
+    const int32_t down = abr.select(bandwidths, 2, targetUs);
+    TEST_CHECK(down < 2);
+    TEST_CHECK(bandwidths[down] <= abr.estimateBps() * CAbrController::kDownSwitchSafety);
+    TEST_CHECK(abr.select(bandwidths, down, targetUs) == down); // and stays there
+}
+
+// SegmentCacheMB is applied as SegmentCacheMB << 20 bytes.
+void TestSegmentCacheBudget() {
+    const std::string directory = MakeTempDirectory();
+    const uint32_t segmentCacheMB = 1;
+    const std::vector<uint8_t> init(1000, 1);
+    const std::vector<uint8_t> media(300 * 1024, 2);
+    {
+        CSegmentCache cache(directory, (uint64_t)segmentCacheMB << 20);
+        TEST_CHECK(cache.enabled());
+        // Uses are ordered by file time, which the kernel keeps at a coarse tick: space them out.
+        for (int32_t i = 0; i < 3; i++) {
+            TEST_CHECK(!cache.store(Fmt("segment %d", i), {&init, &media}).empty());
+            usleep(20000);
+        }
+        TEST_CHECK(cache.evictions() == 0);
+        TEST_CHECK(!cache.lookup("segment 0").empty());
+        usleep(20000);
+        TEST_CHECK(!cache.store("segment 3", {&init, &media}).empty());
+        // Four segments don't fit in 1 MB: the least recently used one, segment 1, goes.
+        TEST_CHECK(cache.evictions() == 1);
+        TEST_CHECK(cache.lookup("segment 1").empty());
+        TEST_CHECK(!cache.lookup("segment 0").empty());
+        TEST_CHECK(DirectoryBytes(directory) <= ((uint64_t)segmentCacheMB << 20));
+    }
+    // A new cache over the same directory finds what is left.
+    CSegmentCache reopened(directory, (uint64_t)segmentCacheMB << 20);
+    TEST_CHECK(!reopened.lookup("segment 3").empty());
+    TEST_CHECK(reopened.lookup("segment 1").empty());
+    TEST_CHECK(reopened.hits() == 1 && reopened.misses() == 1);
+    CSegmentCache disabled("", 1 << 20);
+    TEST_CHECK(!disabled.enabled() && disabled.store("segment", {&init}).empty());
+    DirectoryBytes(directory, true);
+    rmdir(directory.c_str());
+}
+
+void ServeRenditions(CLoopbackHttpServer& server) {
+    server.setFile("/master.m3u8", ReadFixture("fixtures/adaptive/master.m3u8"));
+    for (int32_t rendition = 0; rendition < 3; rendition++) {
+        const std::string name = kRenditionNames[rendition];
+        server.setFile(name + "/index.m3u8", ReadFixture("fixtures/adaptive/" + name + "/index.m3u8"));
+        server.setFile(name + "/init.mp4", MakeInitSegment(kRenditionSizes[rendition][0], kRenditionSizes[rendition][1]));
+        for (int32_t segment = 0; segment < kSegments; segment++) {
+            server.setFile(Fmt("%s/seg-%03d.m4s", name.c_str(), segment), MakeMediaSegment(rendition, segment));
+        }
+    }
+}
+
+typedef struct Playback_tag {
+    std::vector<int32_t> renditions;    // of the samples read, each run counted once
+    int32_t frames = 0;
+    bool samplesMatch = true;
+}Playback;
+
+// Reads every sample left, checking each one is the frame expected of the rendition it came from,
+// and sleeps frameSleepUs after each as a player would between frames.
+Playback ReadStream(CAdaptiveSource& source, const AdaptiveStreamCounters& counters, useconds_t frameSleepUs = 0) {
+    Playback playback;
+    std::vector<uint8_t> buffer(256 * 144 * 3 / 2);
+    while (source.getSampleTrackIndex() == 0) {
+        const int64_t timeUs = source.getSampleTime();
+        const ssize_t size = source.readSampleData(buffer.data(), buffer.size());
+        const int32_t rendition = counters.rendition;
+        if (playback.renditions.empty() || playback.renditions.back() != rendition) {
+            playback.renditions.push_back(rendition);
+        }
+        const int32_t frame = playback.frames;
+        playback.samplesMatch = playback.samplesMatch && rendition >= 0 && rendition < 3 &&
+                                size == kRenditionSizes[rendition][0] * kRenditionSizes[rendition][1] * 3 / 2 &&
+                                buffer[0] == 10 + rendition * 80 && buffer[1] == (uint8_t)frame &&
+                                timeUs == (int64_t)frame * 1000000 / kFps;
+        playback.frames++;
+        source.advance();
+        if (frameSleepUs > 0) {
+            usleep(frameSleepUs);
+        }
+    }
+    return playback;
+}
+
+bool OpenStream(CAdaptiveSource& source, CLoopbackHttpServer& server) {
+    if (!source.open(server.url("/master.m3u8").c_str()) || source.getTrackCount() != 1) {
+        return false;
+    }
+    MediaTrackInfo info;
+    return source.getTrackInfo(0, info) && info.type == mediaTypeVideo && info.durationUs == 7600000 && source.selectTrack(0) &&
+           source.getSegmentTimes().size() == kSegments;
+}
+
+void WaitForDownloads(const AdaptiveStreamCounters& counters, uint64_t segments) {
+    for (int32_t wait = 0; wait < 1000 && counters.segmentsDownloaded < segments; wait++) {
+        usleep(10000);
+    }
+}
+
+std::shared_ptr<IMediaBackend> CreateHostBackend() {
+    Options options;
+    options.MediaBackend = "Host";
+    return CreateMediaBackend(options);
+}
+
+// Plays the whole stream once every segment is downloaded over a fast link, so the renditions
+// chosen depend only on the buffer level at each download: with the prefetch as long as the
+// stream, the first four segments come from the lowest rendition and the rest, once half the
+// target is buffered, from the top one.
+void TestUpSwitch(CLoopbackHttpServer& server) {
+    const std::string directory = MakeTempDirectory();
+    auto cache = std::make_shared<CSegmentCache>(directory, 64 << 20);
+    auto counters = std::make_shared<AdaptiveStreamCounters>();
+    server.bytesPerSecond = 4 << 20;    // 33 Mbps, over ten times the top rendition
+    {
+        CAdaptiveSource source(CreateHostBackend(), cache, kSegments * 1000000, counters);
+        TEST_CHECK(OpenStream(source, server));
+        WaitForDownloads(*counters, kSegments);
+        TEST_CHECK(counters->segmentsDownloaded == kSegments);
+
+        const Playback playback = ReadStream(source, *counters);
+        TEST_CHECK(playback.samplesMatch);
+        TEST_CHECK(playback.frames == (kSegments - 1) * kSegmentFrames + kLastSegmentFrames);
+        TEST_CHECK(playback.renditions == std::vector<int32_t>({0, 2}));
+        TEST_CHECK(counters->renditionSwitches == 1);
+        TEST_CHECK(counters->fetchFailures == 0);
+        TEST_CHECK(cache->evictions() == 0);
+
+        // Seeking back starts again with an empty buffer, at the lowest rendition, whose second
+        // segment is replayed from the cache.
+        const uint64_t hits = counters->segmentCacheHits;
+        std::vector<uint8_t> buffer(256 * 144 * 3 / 2);
+        TEST_CHECK(source.seekTo(1000000 + 1));
+        TEST_CHECK(source.getSampleTrackIndex() == 0 && source.getSampleTime() == 1000000);
+        TEST_CHECK(source.readSampleData(buffer.data(), buffer.size()) > 0 && buffer[0] == 10 && buffer[1] == kFps);
+        TEST_CHECK(counters->segmentCacheHits > hits);
+    }
+    server.bytesPerSecond = 0;
+    DirectoryBytes(directory, true);
+    rmdir(directory.c_str());
+}
+
+// The link slows down once the top rendition is playing. With 512 KB/s (4.2 Mbps) the third
+// segment already comes from the top rendition; at 128 KB/s (1 Mbps) the fast average falls below
+// what the top rendition needs after two of its segments, and the next ones come from lower ones.
+// Samples are read at twice real time, so the fetch thread always sees part of a segment buffered
+// and the switch down is the estimate's doing, not a panic on an empty buffer.
+void TestDownSwitch(CLoopbackHttpServer& server) {
+    const std::string directory = MakeTempDirectory();
+    auto cache = std::make_shared<CSegmentCache>(directory, 64 << 20);
+    auto counters = std::make_shared<AdaptiveStreamCounters>();
+    server.bytesPerSecond = 512 << 10;
+    {
+        // Three segments of prefetch: enough to switch up on the third, and to stop there.
+        CAdaptiveSource source(CreateHostBackend(), cache, 3 * 1000000, counters);
+        TEST_CHECK(OpenStream(source, server));
+        WaitForDownloads(*counters, 3);
+        TEST_CHECK(counters->segmentsDownloaded == 3);
+        TEST_CHECK(counters->throughputBps > 2400000 / CAbrController::kUpSwitchSafety);
+        server.bytesPerSecond = 128 << 10;
+
+        const Playback playback = ReadStream(source, *counters, 1000000 / kFps / 2);
+        TEST_CHECK(playback.samplesMatch);
+        TEST_CHECK(playback.frames == (kSegments - 1) * kSegmentFrames + kLastSegmentFrames);
+        TEST_CHECK(playback.renditions.size() == 3 && playback.renditions[0] == 0 && playback.renditions[1] == 2 &&
+                   playback.renditions[2] < 2);
+        TEST_CHECK(counters->renditionSwitches == 2);
+        TEST_CHECK(counters->fetchFailures == 0);
+        TEST_CHECK(counters->throughputBps < 2400000 * CAbrController::kDownSwitchSafety);
+    }
+    server.bytesPerSecond = 0;
+    DirectoryBytes(directory, true);
+    rmdir(directory.c_str());
+}
+
+// A 1 MB budget holds about four top-rendition segments, so downloading the whole stream ahead
+// evicts segments before they are opened; those are fetched again, and the stream plays through.
+void TestEvictedSegments(CLoopbackHttpServer& server) {
+    const std::string directory = MakeTempDirectory();
+    const uint64_t cacheBytes = 1 << 20;
+    auto cache = std::make_shared<CSegmentCache>(directory, cacheBytes);
+    auto counters = std::make_shared<AdaptiveStreamCounters>();
+    {
+        CAdaptiveSource source(CreateHostBackend(), cache, kSegments * 1000000, counters);
+        TEST_CHECK(OpenStream(source, server));
+        WaitForDownloads(*counters, kSegments);
+        TEST_CHECK(counters->segmentsDownloaded == kSegments);
+        TEST_CHECK(cache->evictions() > 0);
+
+        const Playback playback = ReadStream(source, *counters);
+        TEST_CHECK(playback.samplesMatch);
+        TEST_CHECK(playback.frames == (kSegments - 1) * kSegmentFrames + kLastSegmentFrames);
+        TEST_CHECK(!playback.renditions.empty() && playback.renditions.front() == 0);
+        TEST_CHECK(std::find(playback.renditions.begin(), playback.renditions.end(), 2) != playback.renditions.end());
+        TEST_CHECK(counters->segmentsDownloaded > kSegments);
+        TEST_CHECK(counters->renditionSwitches == playback.renditions.size() - 1);
+        TEST_CHECK(counters->fetchFailures == 0);
+
+        // Seeking back fetches again what the budget evicted.
+        std::vector<uint8_t> buffer(256 * 144 * 3 / 2);
+        TEST_CHECK(source.seekTo(2 * 1000000 + 1));
+        TEST_CHECK(source.getSampleTrackIndex() == 0 && source.getSampleTime() == 2 * 1000000);
+        TEST_CHECK(source.readSampleData(buffer.data(), buffer.size()) > 0 && buffer[1] == 2 * kFps);
+    }
+    // The budget holds once the cache is settled; only the newest segment may overshoot it alone.
+    TEST_CHECK(DirectoryBytes(directory) <= std::max<uint64_t>(cacheBytes, 256 * 144 * 3 / 2 * kSegmentFrames + 4096));
+    DirectoryBytes(directory, true);
+    rmdir(directory.c_str());
+}
+}  // namespace
+
+int main() {
+    TestDashManifest();
+    TestHlsManifest();
+    TestRenditionChoice();
+    TestSegmentCacheBudget();
+
+    CLoopbackHttpServer server;
+    if (!server.start()) {
+        fprintf(stderr, "can't listen on 127.0.0.1\n");
+        return 1;
+    }
+    ServeRenditions(server);
+    TestUpSwitch(server);
+    TestDownSwitch(server);
+    TestEvictedSegments(server);
+    server.stop();
+    return TestResult("test_adaptivesource");
+}
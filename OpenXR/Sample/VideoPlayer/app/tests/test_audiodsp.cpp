@@ -0,0 +1,315 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// The audiodsp kernels against their scalar references, at lengths that leave every SIMD tail
+// length, plus the resampler and CAudioConverter against the signals they should produce.
+
+#include "pch.h"
+#include "common.h"
+#include "audiodsp.h"
+#include "audiodspreference.h"
+#include "testing.h"
+
+TEST_MAIN_STATE;
+
+namespace {
+
+const int32_t kLengths[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 1001};
+
+// Deterministic noise in [-range, range).
+std::vector<float> Noise(size_t count, float range, uint32_t seed) {
+    std::vector<float> values(count);
+    for (float& value : values) {
+        seed = seed * 1664525u + 1013904223u;
+        value = ((seed >> 8) / 8388608.0f - 1.0f) * range;
+    }
+    return values;
+}
+
+float MaxDifference(const float* a, const float* b, size_t count) {
+    float difference = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        difference = std::max(difference, std::fabs(a[i] - b[i]));
+    }
+    return difference;
+}
+
+void TestInt16ToFloat() {
+    for (int32_t length : kLengths) {
+        std::vector<int16_t> in(length);
+        for (int32_t i = 0; i < length; i++) {
+            in[i] = (int16_t)((i * 7919) % 65536 - 32768);
+        }
+        if (length > 1) {
+            in[0] = -32768;
+            in[length - 1] = 32767;
+        }
+        std::vector<float> out(length + 1, 42.0f);
+        std::vector<float> expected(length);
+        ConvertInt16ToFloat(in.data(), out.data(), length);
+        ReferenceInt16ToFloat(in.data(), expected.data(), length);
+        TEST_CHECK(std::equal(expected.begin(), expected.end(), out.begin()));
+        TEST_CHECK(out[length] == 42.0f);   // nothing written past the end
+    }
+}
+
+void TestFloatToInt16() {
+    // Out of range on both sides, exact halves of an LSB (rounded to even) and ordinary samples.
+    const float special[] = {-2.0f, -1.0f, -0.99999f, 0.99999f, 1.0f, 1.5f, 0.5f / 32768, 1.5f / 32768, -2.5f / 32768, 0.0f, -0.0f};
+    for (int32_t length : kLengths) {
+        std::vector<float> in = Noise(length, 1.2f, 7 + length);
+        for (int32_t i = 0; i < length; i++) {
+            if (i % 3 == 0) {
+                in[i] = special[(i / 3) % (sizeof(special) / sizeof(special[0]))];
+            }
+        }
+        std::vector<int16_t> out(length + 1, 1234);
+        std::vector<int16_t> expected(length);
+        ConvertFloatToInt16(in.data(), out.data(), length);
+        ReferenceFloatToInt16(in.data(), expected.data(), length);
+        TEST_CHECK(std::equal(expected.begin(), expected.end(), out.begin()));
+        TEST_CHECK(out[length] == 1234);
+    }
+}
+
+void TestMixChannels() {
+    for (int32_t inChannels : {1, 2, 6, 8}) {
+        for (int32_t outChannels : {1, 2}) {
+            const std::vector<float> matrix = CreateDownmixMatrix(inChannels, outChannels);
+            for (int32_t frames : kLengths) {
+                const std::vector<float> in = Noise((size_t)frames * inChannels, 1.0f, 11 + frames);
+                std::vector<float> expected((size_t)frames * outChannels);
+                ReferenceMix(in.data(), inChannels, frames, matrix.data(), expected.data(), outChannels);
+
+                // Interleaved, and planar with one pointer per plane (the stereo deinterleave path).
+                std::vector<float> interleaved((size_t)frames * outChannels);
+                std::vector<float*> outputs(outChannels);
+                for (int32_t c = 0; c < outChannels; c++) {
+                    outputs[c] = interleaved.data() + c;
+                }
+                MixChannels(in.data(), inChannels, frames, matrix.data(), outputs.data(), outChannels, outChannels);
+                TEST_CHECK(MaxDifference(interleaved.data(), expected.data(), expected.size()) <= 1e-6f);
+
+                std::vector<std::vector<float>> planes(outChannels, std::vector<float>(frames));
+                for (int32_t c = 0; c < outChannels; c++) {
+                    outputs[c] = planes[c].data();
+                }
+                MixChannels(in.data(), inChannels, frames, matrix.data(), outputs.data(), outChannels, 1);
+                for (int32_t c = 0; c < outChannels; c++) {
+                    for (int32_t i = 0; i < frames; i++) {
+                        TEST_CHECK(std::fabs(planes[c][i] - expected[(size_t)i * outChannels + c]) <= 1e-6f);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void TestComplexMultiplyAccumulate() {
+    for (int32_t length : kLengths) {
+        const std::vector<float> aRe = Noise(length, 1.0f, 1);
+        const std::vector<float> aIm = Noise(length, 1.0f, 2);
+        const std::vector<float> bRe = Noise(length, 1.0f, 3);
+        const std::vector<float> bIm = Noise(length, 1.0f, 4);
+        std::vector<float> accRe = Noise(length, 1.0f, 5);
+        std::vector<float> accIm = Noise(length, 1.0f, 6);
+        std::vector<float> expectedRe = accRe;
+        std::vector<float> expectedIm = accIm;
+        ComplexMultiplyAccumulate(aRe.data(), aIm.data(), bRe.data(), bIm.data(), accRe.data(), accIm.data(), length);
+        ReferenceComplexMultiplyAccumulate(aRe.data(), aIm.data(), bRe.data(), bIm.data(), expectedRe.data(), expectedIm.data(), length);
+        // NEON fuses the multiply-adds, so allow a few ulps.
+        TEST_CHECK(MaxDifference(accRe.data(), expectedRe.data(), length) <= 1e-6f);
+        TEST_CHECK(MaxDifference(accIm.data(), expectedIm.data(), length) <= 1e-6f);
+    }
+}
+
+void TestRampedMultiplyAccumulate() {
+    for (int32_t length : kLengths) {
+        const std::vector<float> in = Noise(length, 1.0f, 9);
+        std::vector<float> out = Noise(length, 1.0f, 10);
+        std::vector<float> expected = out;
+        const float gain = 0.25f;
+        const float step = 0.5f / std::max(length, 1);
+        RampedMultiplyAccumulate(in.data(), gain, step, out.data(), length);
+        ReferenceRampedMultiplyAccumulate(in.data(), gain, step, expected.data(), length);
+        // The SIMD paths add 4 * step per vector rather than recomputing the gain, which drifts by
+        // about an ulp per vector: 1.4e-6 after 1001 samples.
+        TEST_CHECK(MaxDifference(out.data(), expected.data(), length) <= 4e-6f);
+    }
+}
+
+void TestFft() {
+    for (int32_t size = 1; size <= 512; size *= 2) {
+        CFft fft;
+        fft.configure(size);
+        std::vector<float> re = Noise(size, 1.0f, 20 + size);
+        std::vector<float> im = Noise(size, 1.0f, 21 + size);
+        const std::vector<float> originalRe = re;
+        const std::vector<float> originalIm = im;
+        std::vector<float> expectedRe = re;
+        std::vector<float> expectedIm = im;
+        ReferenceDft(expectedRe, expectedIm);
+        fft.forward(re.data(), im.data());
+        // Rounding grows with log2(size) passes over values of magnitude up to sqrt(size).
+        const float tolerance = 1e-5f * size;
+        TEST_CHECK(MaxDifference(re.data(), expectedRe.data(), size) <= tolerance);
+        TEST_CHECK(MaxDifference(im.data(), expectedIm.data(), size) <= tolerance);
+        fft.inverse(re.data(), im.data());
+        for (int32_t i = 0; i < size; i++) {
+            TEST_CHECK(std::fabs(re[i] / size - originalRe[i]) <= 1e-5f && std::fabs(im[i] / size - originalIm[i]) <= 1e-5f);
+        }
+    }
+}
+
+// Resamples planar input in chunks of the given sizes, cycling through them; interleaved output.
+std::vector<float> Resample(CPolyphaseResampler& resampler, const std::vector<std::vector<float>>& in, const std::vector<int32_t>& chunks) {
+    std::vector<float> out;
+    const int32_t channels = (int32_t)in.size();
+    const int32_t frames = (int32_t)in[0].size();
+    std::vector<float> block;
+    for (int32_t offset = 0, chunk = 0; offset < frames; chunk++) {
+        const int32_t count = std::min(chunks[chunk % chunks.size()], frames - offset);
+        float* const* planes = resampler.prepare(count);
+        for (int32_t c = 0; c < channels; c++) {
+            std::copy(in[c].begin() + offset, in[c].begin() + offset + count, planes[c]);
+        }
+        block.resize((size_t)resampler.maxOutputFrames(count) * channels);
+        const int32_t produced = resampler.process(count, block.data());
+        TEST_CHECK(produced <= resampler.maxOutputFrames(count));
+        out.insert(out.end(), block.begin(), block.begin() + (size_t)produced * channels);
+        offset += count;
+    }
+    return out;
+}
+
+// Largest error of a resampled sine against the ideal one delayed by the filter, after the filter
+// has filled; 0 dBFS = 1.
+double SineError(const std::vector<float>& out, int32_t channels, int32_t channel, double frequency, double amplitude, int32_t outRate, double delay) {
+    double error = 0.0;
+    const size_t frames = out.size() / channels;
+    for (size_t n = (size_t)(4 * delay) + 16; n + 16 < frames; n++) {
+        const double expected = amplitude * std::sin(2.0 * M_PI * frequency * (n - delay) / outRate);
+        error = std::max(error, std::fabs(out[n * channels + channel] - expected));
+    }
+    return error;
+}
+
+void TestResampler() {
+    const int32_t rates[][2] = {{44100, 48000}, {48000, 44100}, {32000, 48000}, {48000, 16000}, {22050, 48000}};
+    for (const auto& rate : rates) {
+        const int32_t inRate = rate[0];
+        const int32_t outRate = rate[1];
+        const int32_t frames = inRate / 2;
+        std::vector<std::vector<float>> in(2, std::vector<float>(frames));
+        for (int32_t i = 0; i < frames; i++) {
+            in[0][i] = (float)(0.5 * std::sin(2.0 * M_PI * 1000.0 * i / inRate));
+            in[1][i] = (float)(0.25 * std::sin(2.0 * M_PI * 440.0 * i / inRate));
+        }
+        CPolyphaseResampler resampler;
+        TEST_CHECK(resampler.configure(2, inRate, outRate));
+        const std::vector<float> whole = Resample(resampler, in, {frames});
+        resampler.reset();
+        const std::vector<float> chunked = Resample(resampler, in, {1, 7, 480, 33, 1024, 3});
+        TEST_CHECK(whole == chunked);   // the history carries exactly across buffers and a reset
+
+        // Output frame count tracks the ratio, and both tones pass at about -70 dB error.
+        const double expectedFrames = (double)frames * outRate / inRate;
+        TEST_CHECK(std::fabs(whole.size() / 2 - expectedFrames) <= 1.0);
+        const double delay = resampler.delayFrames();
+        TEST_CHECK(SineError(whole, 2, 0, 1000.0, 0.5, outRate, delay) < 5e-4);
+        TEST_CHECK(SineError(whole, 2, 1, 440.0, 0.25, outRate, delay) < 5e-4);
+    }
+
+    // A tone above the output Nyquist rate is filtered out rather than aliased.
+    CPolyphaseResampler resampler;
+    TEST_CHECK(resampler.configure(1, 48000, 16000));
+    std::vector<std::vector<float>> in(1, std::vector<float>(48000));
+    for (int32_t i = 0; i < 48000; i++) {
+        in[0][i] = (float)(0.5 * std::sin(2.0 * M_PI * 12000.0 * i / 48000));
+    }
+    const std::vector<float> out = Resample(resampler, in, {960});
+    float peak = 0.0f;
+    for (size_t n = 200; n < out.size(); n++) {
+        peak = std::max(peak, std::fabs(out[n]));
+    }
+    TEST_CHECK(peak < 0.5f * 1e-3f);    // below -60 dB
+
+    CPolyphaseResampler tooFine;
+    TEST_CHECK(!tooFine.configure(2, 44100, 44101));
+}
+
+// 5.1 at 48 kHz to stereo: the converter matches the scalar pipeline to within rounding.
+void TestConverterDownmix() {
+    const int32_t inChannels = 6;
+    const int32_t frames = 1001;
+    std::vector<int16_t> in((size_t)frames * inChannels);
+    const std::vector<float> noise = Noise(in.size(), 0.9f, 99);
+    ReferenceFloatToInt16(noise.data(), in.data(), (int32_t)in.size());
+
+    CAudioConverter converter;
+    TEST_CHECK(converter.configure(inChannels, 48000, 2, 48000));
+    TEST_CHECK(!converter.passthrough() && converter.delayNs() == 0);
+    TEST_CHECK(converter.process(in.data(), frames) == frames);
+
+    std::vector<float> asFloat(in.size());
+    ReferenceInt16ToFloat(in.data(), asFloat.data(), (int32_t)in.size());
+    const std::vector<float> matrix = CreateDownmixMatrix(inChannels, 2);
+    std::vector<float> mixed((size_t)frames * 2);
+    ReferenceMix(asFloat.data(), inChannels, frames, matrix.data(), mixed.data(), 2);
+    std::vector<int16_t> expected(mixed.size());
+    ReferenceFloatToInt16(mixed.data(), expected.data(), (int32_t)mixed.size());
+    int32_t worst = 0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        worst = std::max(worst, std::abs(converter.output()[i] - expected[i]));
+    }
+    TEST_CHECK(worst <= 1);
+}
+
+void TestConverterPassthroughAndResample() {
+    std::vector<int16_t> in(2 * 4410);
+    for (size_t i = 0; i < in.size() / 2; i++) {
+        in[2 * i] = (int16_t)(16384 * std::sin(2.0 * M_PI * 1000.0 * i / 44100));
+        in[2 * i + 1] = (int16_t)-in[2 * i];
+    }
+    CAudioConverter passthrough;
+    TEST_CHECK(passthrough.configure(2, 44100, 2, 44100) && passthrough.passthrough());
+    TEST_CHECK(passthrough.process(in.data(), 4410) == 4410);
+    TEST_CHECK(std::equal(in.begin(), in.end(), passthrough.output()));
+
+    // 44.1 kHz stereo to 48 kHz: the tone and its inverted copy come out at the right frequency
+    // and level, behind the reported delay.
+    CAudioConverter converter;
+    TEST_CHECK(converter.configure(2, 44100, 2, 48000));
+    std::vector<float> out;
+    for (size_t offset = 0; offset < 4410; offset += 441) {
+        const int32_t produced = converter.process(in.data() + 2 * offset, 441);
+        for (int32_t i = 0; i < 2 * produced; i++) {
+            out.push_back(converter.output()[i] / 32768.0f);
+        }
+    }
+    TEST_CHECK(std::fabs(out.size() / 2.0 - 4800.0) <= 1.0);
+    const double delay = converter.delayNs() * 48000.0 / 1e9;
+    TEST_CHECK(SineError(out, 2, 0, 1000.0, 0.5, 48000, delay) < 1e-3);
+    TEST_CHECK(SineError(out, 2, 1, 1000.0, -0.5, 48000, delay) < 1e-3);
+
+    // After a reset the converter starts from silence again, as when it was new.
+    CAudioConverter fresh;
+    TEST_CHECK(fresh.configure(2, 44100, 2, 48000));
+    converter.reset();
+    const int32_t produced = converter.process(in.data(), 441);
+    TEST_CHECK(produced == fresh.process(in.data(), 441));
+    TEST_CHECK(std::equal(converter.output(), converter.output() + 2 * produced, fresh.output()));
+}
+}  // namespace
+
+int main() {
+    TestInt16ToFloat();
+    TestFloatToInt16();
+    TestMixChannels();
+    TestComplexMultiplyAccumulate();
+    TestRampedMultiplyAccumulate();
+    TestFft();
+    TestResampler();
+    TestConverterDownmix();
+    TestConverterPassthroughAndResample();
+    return TestResult("test_audiodsp");
+}
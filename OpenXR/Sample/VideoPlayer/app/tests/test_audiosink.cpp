@@ -0,0 +1,321 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// CPcmRing and CRingAudioSink: writes and reads that wrap the ring, partial writes into a full
+// one, flush(), underrun counting and the presentation timestamps render() stamps. Then a decode
+// thread and a device thread running at once, checking that every frame arrives once and in order.
+
+#include "pch.h"
+#include "common.h"
+#include "audiosink.h"
+#include "mediaclock.h"
+#include "testing.h"
+#include <thread>
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int32_t kChannels = 2;
+constexpr int32_t kSampleRate = 48000;
+
+// Never 0, so silence is told apart from frames.
+int16_t FrameSample(int64_t frame, int32_t channel) {
+    return (int16_t)((frame % 16000) * kChannels + channel + 1);
+}
+
+std::vector<int16_t> Frames(int64_t first, int32_t count) {
+    std::vector<int16_t> pcm((size_t)count * kChannels);
+    for (int32_t i = 0; i < count; i++) {
+        for (int32_t c = 0; c < kChannels; c++) {
+            pcm[(size_t)i * kChannels + c] = FrameSample(first + i, c);
+        }
+    }
+    return pcm;
+}
+
+// The count frames of pcm are frames first, first + 1...
+bool IsFrames(const int16_t* pcm, int64_t first, int32_t count) {
+    for (int32_t i = 0; i < count; i++) {
+        for (int32_t c = 0; c < kChannels; c++) {
+            if (pcm[(size_t)i * kChannels + c] != FrameSample(first + i, c)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool IsSilence(const int16_t* pcm, int32_t count) {
+    for (int32_t i = 0; i < count * kChannels; i++) {
+        if (pcm[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TestRing() {
+    CPcmRing ring;
+    ring.allocate(kChannels, 5);
+    TEST_CHECK(ring.capacity() == 8);
+
+    // A full ring takes what fits, then nothing.
+    std::vector<int16_t> out(16 * kChannels);
+    TEST_CHECK(ring.write(Frames(0, 10).data(), 10) == 8);
+    TEST_CHECK(ring.write(Frames(8, 1).data(), 1) == 0);
+    TEST_CHECK(ring.writePosition() == 8 && ring.readPosition() == 0);
+
+    // Reads and writes across the end of the buffer.
+    TEST_CHECK(ring.read(out.data(), 5) == 5 && IsFrames(out.data(), 0, 5));
+    TEST_CHECK(ring.write(Frames(8, 6).data(), 6) == 5);
+    TEST_CHECK(ring.read(out.data(), 16) == 8 && IsFrames(out.data(), 5, 8));
+    TEST_CHECK(ring.read(out.data(), 16) == 0);
+    TEST_CHECK(ring.write(Frames(13, 7).data(), 7) == 7);
+    TEST_CHECK(ring.read(out.data(), 3) == 3 && IsFrames(out.data(), 13, 3));
+    TEST_CHECK(ring.read(out.data(), 16) == 4 && IsFrames(out.data(), 16, 4));
+
+    // skipTo() stops at what was written, and never goes back.
+    TEST_CHECK(ring.write(Frames(20, 6).data(), 6) == 6);
+    ring.skipTo(22);
+    TEST_CHECK(ring.readPosition() == 22);
+    ring.skipTo(21);
+    TEST_CHECK(ring.readPosition() == 22);
+    TEST_CHECK(ring.read(out.data(), 1) == 1 && IsFrames(out.data(), 22, 1));
+    ring.skipTo(100);
+    TEST_CHECK(ring.readPosition() == 26 && ring.read(out.data(), 16) == 0);
+}
+
+// One thread writes frames in chunks of changing size, the other reads them in chunks of another
+// size; the ring is small enough to wrap and fill thousands of times.
+void TestRingThreads() {
+    constexpr int64_t kTotal = 1000000;
+    CPcmRing ring;
+    ring.allocate(kChannels, 64);
+    std::thread producer([&ring] {
+        int64_t frame = 0;
+        int32_t chunk = 1;
+        while (frame < kTotal) {
+            const int32_t count = (int32_t)std::min<int64_t>(chunk, kTotal - frame);
+            const std::vector<int16_t> pcm = Frames(frame, count);
+            const int32_t written = ring.write(pcm.data(), count);
+            frame += written;
+            chunk = chunk % 97 + 1;
+            if (written < count) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    std::vector<int16_t> out(53 * kChannels);
+    int64_t frame = 0;
+    bool inOrder = true;
+    while (frame < kTotal && inOrder) {
+        const int32_t got = ring.read(out.data(), 53);
+        inOrder = IsFrames(out.data(), frame, got);
+        frame += got;
+        if (got == 0) {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    TEST_CHECK(inOrder);
+    TEST_CHECK(frame == kTotal && ring.writePosition() == kTotal && ring.readPosition() == kTotal);
+}
+
+// The device side of CRingAudioSink, driven by the test.
+class CTestSink : public CRingAudioSink {
+
+public:
+    bool open(int32_t channelCount, int32_t sampleRate, int32_t ambisonicOrder) override {
+        return openRing(channelCount, sampleRate, ambisonicOrder);
+    }
+    void close() override {}
+    void pause() override { invalidateTimestamp(); }
+    void resume() override {}
+
+    void callback(int16_t* out, int32_t numFrames, int64_t latencyNs) { render(out, numFrames, latencyNs); }
+};
+
+void TestSinkFull() {
+    CTestSink sink;
+    TEST_CHECK(sink.open(kChannels, kSampleRate, 0));
+    // 200 ms at 48 kHz, rounded up to a power of two.
+    const int32_t capacity = 16384;
+    const std::vector<int16_t> pcm = Frames(0, capacity + 100);
+    TEST_CHECK(sink.write(pcm.data(), capacity + 100) == capacity);
+    TEST_CHECK(sink.write(pcm.data() + (size_t)capacity * kChannels, 100) == 0);
+    AudioSinkStats stats = sink.getStats();
+    TEST_CHECK(stats.ringFullWrites == 2 && stats.bufferedFrames == capacity);
+
+    // Room for part of the rest once the device has taken some.
+    std::vector<int16_t> out(64 * kChannels);
+    sink.callback(out.data(), 64, 0);
+    TEST_CHECK(IsFrames(out.data(), 0, 64));
+    TEST_CHECK(sink.write(pcm.data() + (size_t)capacity * kChannels, 100) == 64);
+    stats = sink.getStats();
+    TEST_CHECK(stats.ringFullWrites == 3 && stats.bufferedFrames == capacity);
+    TEST_CHECK(sink.write(pcm.data(), 0) == 0 && sink.getStats().ringFullWrites == 3);
+}
+
+void TestSinkUnderruns() {
+    CTestSink sink;
+    TEST_CHECK(sink.open(kChannels, kSampleRate, 0));
+    std::vector<int16_t> out(256 * kChannels);
+    // Before anything is written, and while the first frames trickle in, running dry is a start.
+    sink.callback(out.data(), 256, 0);
+    TEST_CHECK(IsSilence(out.data(), 256));
+    TEST_CHECK(sink.write(Frames(0, 100).data(), 100) == 100);
+    sink.callback(out.data(), 256, 0);
+    TEST_CHECK(IsFrames(out.data(), 0, 100) && IsSilence(out.data() + 100 * kChannels, 156));
+    TEST_CHECK(sink.getStats().underruns == 0);
+
+    // Once a whole buffer has been played, running dry is an underrun, counted once however long
+    // it lasts.
+    TEST_CHECK(sink.write(Frames(100, 400).data(), 400) == 400);
+    sink.callback(out.data(), 256, 0);
+    TEST_CHECK(IsFrames(out.data(), 100, 256));
+    sink.callback(out.data(), 256, 0);
+    TEST_CHECK(IsFrames(out.data(), 356, 144) && IsSilence(out.data() + 144 * kChannels, 112));
+    sink.callback(out.data(), 256, 0);
+    TEST_CHECK(IsSilence(out.data(), 256));
+    TEST_CHECK(sink.getStats().underruns == 1);
+
+    TEST_CHECK(sink.write(Frames(500, 600).data(), 600) == 600);
+    sink.callback(out.data(), 256, 0);
+    sink.callback(out.data(), 256, 0);
+    sink.callback(out.data(), 256, 0);
+    TEST_CHECK(IsFrames(out.data(), 1012, 88));
+    TEST_CHECK(sink.getStats().underruns == 2 && sink.getStats().bufferedFrames == 0);
+}
+
+void TestSinkFlush() {
+    CTestSink sink;
+    TEST_CHECK(sink.open(kChannels, kSampleRate, 0));
+    std::vector<int16_t> out(256 * kChannels);
+    TEST_CHECK(sink.write(Frames(0, 1000).data(), 1000) == 1000);
+    sink.callback(out.data(), 256, 0);
+    TEST_CHECK(IsFrames(out.data(), 0, 256));
+
+    // The next callback drops what was queued before the flush, and the silence after it is no
+    // underrun.
+    sink.flush();
+    sink.callback(out.data(), 256, 0);
+    TEST_CHECK(IsSilence(out.data(), 256));
+    TEST_CHECK(sink.getStats().underruns == 0 && sink.getStats().bufferedFrames == 0);
+
+    // Frames written after the flush play from their first one; positions count flushed frames.
+    TEST_CHECK(sink.write(Frames(1000, 300).data(), 300) == 300);
+    sink.flush();
+    TEST_CHECK(sink.write(Frames(1300, 300).data(), 300) == 300);
+    sink.callback(out.data(), 256, 0);
+    TEST_CHECK(IsFrames(out.data(), 1300, 256));
+    int64_t position = 0;
+    int64_t time = 0;
+    TEST_CHECK(sink.getTimestamp(position, time) && position == 1300);
+}
+
+void TestSinkTimestamps() {
+    constexpr int64_t kLatencyNs = 30000000;
+    CTestSink sink;
+    TEST_CHECK(sink.open(kChannels, kSampleRate, 0));
+    std::vector<int16_t> out(256 * kChannels);
+    int64_t position = -1;
+    int64_t time = 0;
+    TEST_CHECK(!sink.getTimestamp(position, time));
+    // Silence is not stamped.
+    sink.callback(out.data(), 256, kLatencyNs);
+    TEST_CHECK(!sink.getTimestamp(position, time));
+
+    TEST_CHECK(sink.write(Frames(0, 2000).data(), 2000) == 2000);
+    int64_t beforeNs = CMediaClock::monotonicNow();
+    sink.callback(out.data(), 256, kLatencyNs);
+    int64_t afterNs = CMediaClock::monotonicNow();
+    TEST_CHECK(sink.getTimestamp(position, time) && position == 0);
+    TEST_CHECK(time >= beforeNs + kLatencyNs && time <= afterNs + kLatencyNs);
+    sink.callback(out.data(), 256, kLatencyNs);
+    TEST_CHECK(sink.getTimestamp(position, time) && position == 256);
+    TEST_CHECK(sink.getStats().outputLatencyNs == kLatencyNs);
+
+    // A pause invalidates the stamp until a frame is played after it.
+    sink.pause();
+    TEST_CHECK(!sink.getTimestamp(position, time));
+    TEST_CHECK(!sink.getTimestamp(position, time));
+    beforeNs = CMediaClock::monotonicNow();
+    sink.callback(out.data(), 256, kLatencyNs);
+    afterNs = CMediaClock::monotonicNow();
+    TEST_CHECK(sink.getTimestamp(position, time) && position == 512);
+    TEST_CHECK(time >= beforeNs + kLatencyNs && time <= afterNs + kLatencyNs);
+
+    // Silence after a pause leaves the stamp invalid.
+    sink.pause();
+    sink.flush();
+    sink.callback(out.data(), 256, kLatencyNs);
+    TEST_CHECK(!sink.getTimestamp(position, time));
+}
+
+// A decode thread writing as fast as the ring takes it, and a device thread rendering 5 ms buffers
+// every 1 ms while a third thread reads the stamps: every frame is played once, in order, and the
+// stamped positions only move forward.
+void TestSinkThreads() {
+    constexpr int64_t kTotal = 48000;
+    constexpr int32_t kBufferFrames = 240;
+    CTestSink sink;
+    TEST_CHECK(sink.open(kChannels, kSampleRate, 0));
+    std::atomic<bool> done{false};
+    std::thread producer([&] {
+        int64_t frame = 0;
+        while (frame < kTotal) {
+            const int32_t count = (int32_t)std::min<int64_t>(1024, kTotal - frame);
+            const std::vector<int16_t> pcm = Frames(frame, count);
+            frame += sink.write(pcm.data(), count);
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+    });
+    bool stampsValid = true;
+    std::thread stamps([&] {
+        int64_t last = 0;
+        while (!done) {
+            int64_t position = 0;
+            int64_t time = 0;
+            if (sink.getTimestamp(position, time)) {
+                stampsValid = stampsValid && position >= last && position < kTotal;
+                last = position;
+            }
+            std::this_thread::yield();
+        }
+    });
+    int64_t played = 0;
+    bool inOrder = true;
+    std::thread device([&] {
+        std::vector<int16_t> out(kBufferFrames * kChannels);
+        const int64_t deadline = CMediaClock::monotonicNow() + 20000000000LL;
+        while (played < kTotal && inOrder && CMediaClock::monotonicNow() < deadline) {
+            sink.callback(out.data(), kBufferFrames, 0);
+            int32_t frames = 0;
+            while (frames < kBufferFrames && out[(size_t)frames * kChannels] != 0) {
+                frames++;
+            }
+            inOrder = IsFrames(out.data(), played, frames) && IsSilence(out.data() + (size_t)frames * kChannels, kBufferFrames - frames);
+            played += frames;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    producer.join();
+    device.join();
+    done = true;
+    stamps.join();
+    TEST_CHECK(inOrder && played == kTotal);
+    TEST_CHECK(stampsValid);
+    TEST_CHECK(sink.getStats().bufferedFrames == 0);
+}
+}  // namespace
+
+int main() {
+    TestRing();
+    TestRingThreads();
+    TestSinkFull();
+    TestSinkUnderruns();
+    TestSinkFlush();
+    TestSinkTimestamps();
+    TestSinkThreads();
+    return TestResult("test_audiosink");
+}
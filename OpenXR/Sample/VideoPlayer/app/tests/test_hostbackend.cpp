@@ -0,0 +1,240 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// The Host media backend on the files it was written for: a .y4m clip with a .wav next to it.
+// Checks the track info, the sample order and times across both tracks, seeking, and the NV12
+// planes and PCM packets its decoders hand out.
+
+#include "pch.h"
+#include "common.h"
+#include "options.h"
+#include "mediabackend.h"
+#include "mediafixtures.h"
+#include "testing.h"
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int32_t kWidth = 36;          // not a multiple of the decoder's 16-pixel alignment
+constexpr int32_t kHeight = 20;
+constexpr int32_t kAlignedWidth = 48;
+constexpr int32_t kAlignedHeight = 32;
+constexpr int32_t kFrames = 10;
+constexpr int32_t kFrameUs = 40000;     // 25 fps
+constexpr int32_t kChannels = 2;
+constexpr int32_t kSampleRate = 44100;
+constexpr int32_t kPcmFrames = 10000;
+constexpr int32_t kPacketFrames = 1024;
+
+std::shared_ptr<IMediaBackend> CreateHostBackend() {
+    Options options;
+    options.MediaBackend = "Host";
+    options.IndexCacheDir = "";
+    return CreateMediaBackend(options);
+}
+
+void TestTracks(IMediaBackend& backend, const std::string& clip) {
+    std::shared_ptr<IMediaSource> source = backend.createSource();
+    TEST_CHECK(source->open(clip.c_str()));
+    TEST_CHECK(source->getTrackCount() == 2);
+
+    MediaTrackInfo video;
+    TEST_CHECK(source->getTrackInfo(0, video));
+    TEST_CHECK(video.type == mediaTypeVideo && video.mime == kMimeRawVideo);
+    TEST_CHECK(video.width == kWidth && video.height == kHeight);
+    TEST_CHECK(video.durationUs == (int64_t)kFrames * kFrameUs);
+    TEST_CHECK(video.maxInputSize == kWidth * kHeight * 3 / 2);
+
+    MediaTrackInfo audio;
+    TEST_CHECK(source->getTrackInfo(1, audio));
+    TEST_CHECK(audio.type == mediaTypeAudio && audio.mime == kMimeRawAudio);
+    TEST_CHECK(audio.channelCount == kChannels && audio.sampleRate == kSampleRate);
+    TEST_CHECK(audio.durationUs == (int64_t)kPcmFrames * 1000000 / kSampleRate);
+    TEST_CHECK(!source->getTrackInfo(2, audio));
+
+    // Both tracks selected: samples come in time order, each track at its own exact times.
+    TEST_CHECK(source->selectTrack(0) && source->selectTrack(1));
+    int32_t videoSamples = 0;
+    int32_t audioSamples = 0;
+    int64_t lastTime = -1;
+    bool inOrder = true;
+    bool timesMatch = true;
+    bool dataMatches = true;
+    std::vector<uint8_t> buffer(64 * 1024);
+    do {
+        const int32_t track = source->getSampleTrackIndex();
+        const int64_t time = source->getSampleTime();
+        inOrder = inOrder && time >= lastTime;
+        lastTime = time;
+        TEST_CHECK(source->getSampleFlags() & IMediaSource::kSampleFlagSync);
+        const ssize_t size = source->readSampleData(buffer.data(), buffer.size());
+        size_t mappedSize = 0;
+        const uint8_t* mapped = source->getSampleData(mappedSize);
+        if (mapped != nullptr) {
+            dataMatches = dataMatches && mappedSize == (size_t)size && memcmp(mapped, buffer.data(), mappedSize) == 0;
+        }
+        if (track == 0) {
+            timesMatch = timesMatch && time == (int64_t)videoSamples * kFrameUs && size == video.maxInputSize;
+            // I420 as stored: the first luma sample, and the first U and V samples.
+            dataMatches = dataMatches && buffer[0] == Y4mSample(videoSamples, 0, 0, 0) && buffer[kWidth * kHeight] == Y4mSample(videoSamples, 1, 0, 0) &&
+                          buffer[kWidth * kHeight * 5 / 4] == Y4mSample(videoSamples, 2, 0, 0);
+            videoSamples++;
+        } else {
+            const int32_t first = audioSamples * kPacketFrames;
+            const int32_t frames = std::min(kPacketFrames, kPcmFrames - first);
+            timesMatch = timesMatch && time == (int64_t)first * 1000000 / kSampleRate && size == frames * kChannels * 2;
+            const int16_t* pcm = (const int16_t*)buffer.data();
+            dataMatches = dataMatches && pcm[0] == WavSample(first, 0) && pcm[1] == WavSample(first, 1) &&
+                          pcm[(frames - 1) * kChannels + 1] == WavSample(first + frames - 1, 1);
+            audioSamples++;
+        }
+    } while (source->advance());
+    TEST_CHECK(inOrder);
+    TEST_CHECK(timesMatch);
+    TEST_CHECK(dataMatches);
+    TEST_CHECK(videoSamples == kFrames);
+    TEST_CHECK(audioSamples == (kPcmFrames + kPacketFrames - 1) / kPacketFrames);
+    TEST_CHECK(source->getSampleTrackIndex() == -1);
+
+    // Every video frame is a sync sample; audio lands on the packet that holds the time.
+    TEST_CHECK(source->seekTo(130000));
+    TEST_CHECK(source->getSampleTrackIndex() == 1);
+    TEST_CHECK(source->getSampleTime() == (int64_t)130000 * kSampleRate / 1000000 / kPacketFrames * kPacketFrames * 1000000 / kSampleRate);
+    bool sawVideo = false;
+    while (!sawVideo && source->advance()) {
+        if (source->getSampleTrackIndex() == 0) {
+            TEST_CHECK(source->getSampleTime() == 3 * kFrameUs);
+            sawVideo = true;
+        }
+    }
+    TEST_CHECK(sawVideo);
+}
+
+void TestVideoDecoder(IMediaBackend& backend, const std::string& clip) {
+    std::shared_ptr<IMediaSource> source = backend.createSource();
+    TEST_CHECK(source->open(clip.c_str()));
+    TEST_CHECK(source->selectTrack(0));
+    std::shared_ptr<IMediaDecoder> decoder = backend.createDecoder(*source, 0);
+    TEST_CHECK(decoder != nullptr && decoder->start());
+    int32_t width = 0;
+    int32_t height = 0;
+    TEST_CHECK(decoder->getOutputSize(width, height) && width == kWidth && height == kHeight);
+    TEST_CHECK(!decoder->isOutputPlanar());
+
+    for (int32_t frame = 0; frame < 3; frame++) {
+        const ssize_t input = decoder->dequeueInputBuffer(0);
+        TEST_CHECK(input >= 0);
+        size_t capacity = 0;
+        uint8_t* data = decoder->getInputBuffer(input, &capacity);
+        const ssize_t size = source->readSampleData(data, capacity);
+        TEST_CHECK(size > 0);
+        TEST_CHECK(decoder->queueInputBuffer(input, size, source->getSampleTime(), 0));
+        source->advance();
+
+        DecoderBufferInfo info;
+        const ssize_t output = decoder->dequeueOutputBuffer(info, 100000);
+        TEST_CHECK(output >= 0);
+        if (output < 0) {
+            return;
+        }
+        TEST_CHECK(info.presentationTimeUs == (int64_t)frame * kFrameUs);
+        TEST_CHECK(info.size == kAlignedWidth * kAlignedHeight * 3 / 2);
+        const uint8_t* nv12 = decoder->getOutputBuffer(output);
+        const uint8_t* uv = nv12 + kAlignedWidth * kAlignedHeight;
+        bool luma = true;
+        bool chroma = true;
+        for (int32_t y = 0; y < kAlignedHeight; y++) {
+            for (int32_t x = 0; x < kAlignedWidth; x++) {
+                const bool inside = x < kWidth && y < kHeight;
+                luma = luma && nv12[y * kAlignedWidth + x] == (inside ? Y4mSample(frame, 0, x, y) : 0);
+            }
+        }
+        for (int32_t y = 0; y < kAlignedHeight / 2; y++) {
+            for (int32_t x = 0; x < kAlignedWidth / 2; x++) {
+                const bool inside = x < kWidth / 2 && y < kHeight / 2;
+                chroma = chroma && uv[y * kAlignedWidth + 2 * x] == (inside ? Y4mSample(frame, 1, x, y) : 128) &&
+                         uv[y * kAlignedWidth + 2 * x + 1] == (inside ? Y4mSample(frame, 2, x, y) : 128);
+            }
+        }
+        TEST_CHECK(luma);
+        TEST_CHECK(chroma);
+        decoder->releaseOutputBuffer(output, true);
+    }
+
+    // A codec config input changes the picture size for the frames after it.
+    const ssize_t input = decoder->dequeueInputBuffer(0);
+    TEST_CHECK(input >= 0);
+    const int32_t size[2] = {16, 8};
+    memcpy(decoder->getInputBuffer(input, nullptr), size, sizeof(size));
+    TEST_CHECK(decoder->queueInputBuffer(input, sizeof(size), 0, IMediaDecoder::kFlagCodecConfig));
+    DecoderBufferInfo info;
+    TEST_CHECK(decoder->dequeueOutputBuffer(info, 100000) == IMediaDecoder::kOutputFormatChanged);
+    TEST_CHECK(decoder->getOutputSize(width, height) && width == 16 && height == 8);
+    decoder->stop();
+}
+
+void TestAudioDecoder(IMediaBackend& backend, const std::string& clip) {
+    std::shared_ptr<IMediaSource> source = backend.createSource();
+    TEST_CHECK(source->open(clip.c_str()));
+    TEST_CHECK(source->selectTrack(1));
+    std::shared_ptr<IMediaDecoder> decoder = backend.createDecoder(*source, 1);
+    TEST_CHECK(decoder != nullptr && decoder->start());
+    int32_t width = 0;
+    int32_t height = 0;
+    TEST_CHECK(!decoder->getOutputSize(width, height));
+
+    const ssize_t input = decoder->dequeueInputBuffer(0);
+    TEST_CHECK(input >= 0);
+    size_t capacity = 0;
+    uint8_t* data = decoder->getInputBuffer(input, &capacity);
+    const ssize_t size = source->readSampleData(data, capacity);
+    TEST_CHECK(size == kPacketFrames * kChannels * 2);
+    TEST_CHECK(decoder->queueInputBuffer(input, size, 0, 0));
+    DecoderBufferInfo info;
+    const ssize_t output = decoder->dequeueOutputBuffer(info, 100000);
+    TEST_CHECK(output >= 0 && info.size == size);
+    if (output >= 0) {
+        const int16_t* pcm = (const int16_t*)decoder->getOutputBuffer(output);
+        bool matches = true;
+        for (int32_t f = 0; f < kPacketFrames; f++) {
+            matches = matches && pcm[f * kChannels] == WavSample(f, 0) && pcm[f * kChannels + 1] == WavSample(f, 1);
+        }
+        TEST_CHECK(matches);
+        decoder->releaseOutputBuffer(output, false);
+    }
+    decoder->stop();
+}
+
+// Files the readers must turn down rather than misread.
+void TestRejected(IMediaBackend& backend, const std::string& directory) {
+    const std::string y444 = directory + "/c444.y4m";
+    TEST_CHECK(WriteY4m(y444, 16, 16, 25, 1, 2, "444"));
+    TEST_CHECK(!backend.createSource()->open(y444.c_str()));
+
+    // Video alone is fine; an 8-bit .wav next to it is left out.
+    const std::string videoOnly = directory + "/pcm8.y4m";
+    TEST_CHECK(WriteY4m(videoOnly, 16, 16, 25, 1, 2));
+    TEST_CHECK(WriteWav(directory + "/pcm8.wav", 1, 8000, 100, 8));
+    std::shared_ptr<IMediaSource> source = backend.createSource();
+    TEST_CHECK(source->open(videoOnly.c_str()) && source->getTrackCount() == 1);
+
+    const std::string missing = directory + "/missing.y4m";
+    TEST_CHECK(!backend.createSource()->open(missing.c_str()));
+}
+}  // namespace
+
+int main() {
+    const std::string directory = MakeTempDirectory();
+    TEST_CHECK(!directory.empty());
+    const std::string clip = directory + "/clip.y4m";
+    TEST_CHECK(WriteY4m(clip, kWidth, kHeight, 25, 1, kFrames));
+    TEST_CHECK(WriteWav(directory + "/clip.wav", kChannels, kSampleRate, kPcmFrames));
+
+    std::shared_ptr<IMediaBackend> backend = CreateHostBackend();
+    TestTracks(*backend, clip);
+    TestVideoDecoder(*backend, clip);
+    TestAudioDecoder(*backend, clip);
+    TestRejected(*backend, directory);
+    RemoveTempDirectory(directory);
+    return TestResult("test_hostbackend");
+}
@@ -0,0 +1,112 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// CHttpFile against a loopback server: range reads across blocks, short reads at the end of the
+// file, and recovery from dropped keep-alive connections and truncated responses.
+
+#include "pch.h"
+#include "common.h"
+#include "httpfile.h"
+#include "loopbackhttpserver.h"
+#include "testing.h"
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int64_t kBlock = CHttpFile::kBlockSize;
+
+std::string MakeContent(size_t size) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (char)((i * 31 + i / 251) & 0xff);
+    }
+    return data;
+}
+
+bool ReadMatches(CHttpFile& file, const std::string& content, int64_t offset, size_t size) {
+    std::vector<uint8_t> buffer(size);
+    const ssize_t got = file.readAt(offset, buffer.data(), size);
+    const size_t expected = (size_t)std::min<int64_t>(size, (int64_t)content.size() - offset);
+    return got == (ssize_t)expected && memcmp(buffer.data(), content.data() + offset, expected) == 0;
+}
+
+void TestRangeReads(CLoopbackHttpServer& server, const std::string& content) {
+    auto counters = std::make_shared<MediaIoCounters>();
+    CHttpFile file;
+    TEST_CHECK(file.open(server.url("/media.mp4").c_str(), 2 * kBlock, counters));
+    TEST_CHECK(file.size() == (int64_t)content.size());
+    TEST_CHECK(ReadMatches(file, content, 0, 100));
+    TEST_CHECK(ReadMatches(file, content, kBlock - 5, 10));              // across a block boundary
+    TEST_CHECK(ReadMatches(file, content, 2 * kBlock + 100, kBlock));    // two blocks, one of them partly
+    TEST_CHECK(ReadMatches(file, content, 17, 3 * kBlock));              // a seek back over cached blocks
+    TEST_CHECK(counters->requests >= 4);
+    TEST_CHECK(counters->bytesRead == 100 + 10 + kBlock + 3 * kBlock);
+}
+
+void TestShortReads(CLoopbackHttpServer& server, const std::string& content) {
+    CHttpFile file;
+    TEST_CHECK(file.open(server.url("/media.mp4").c_str(), 0, nullptr));
+    const int64_t size = (int64_t)content.size();
+    TEST_CHECK(ReadMatches(file, content, size - 10, 100));
+    uint8_t byte = 0;
+    TEST_CHECK(file.readAt(size, &byte, 1) == 0);
+    TEST_CHECK(file.readAt(size + 1, &byte, 1) == -1);
+    TEST_CHECK(file.readAt(-1, &byte, 1) == -1);
+}
+
+void TestDroppedConnections(CLoopbackHttpServer& server, const std::string& content) {
+    server.dropKeepAlive = true;
+    const uint32_t connectionsBefore = server.connections;
+    CHttpFile file;
+    TEST_CHECK(file.open(server.url("/media.mp4").c_str(), kBlock, nullptr));
+    bool matches = true;
+    for (int64_t offset = 0; offset < (int64_t)content.size(); offset += 100000) {
+        matches = matches && ReadMatches(file, content, offset, 100000);
+    }
+    TEST_CHECK(matches);
+    // Every block after the first needed a second connection: the keep-alive one was dropped.
+    const uint32_t blocks = (uint32_t)((content.size() + kBlock - 1) / kBlock);
+    TEST_CHECK(server.connections - connectionsBefore >= blocks);
+    server.dropKeepAlive = false;
+}
+
+void TestTruncatedResponses(CLoopbackHttpServer& server, const std::string& content) {
+    // No read-ahead, so each read fetches exactly one block and the faults hit that fetch.
+    CHttpFile file;
+    TEST_CHECK(file.open(server.url("/media.mp4").c_str(), 0, nullptr));
+    server.truncateResponses = 1;
+    TEST_CHECK(ReadMatches(file, content, kBlock, 1000));           // retried once on a fresh connection
+    server.truncateResponses = 2;
+    uint8_t buffer[1000];
+    TEST_CHECK(file.readAt(2 * kBlock, buffer, sizeof(buffer)) == -1);  // both attempts cut short
+    TEST_CHECK(server.truncateResponses == 0);
+    TEST_CHECK(ReadMatches(file, content, 2 * kBlock, 1000));       // the failed block is fetched again
+}
+
+void TestUnusableServers(CLoopbackHttpServer& server) {
+    CHttpFile missing;
+    TEST_CHECK(!missing.open(server.url("/missing.mp4").c_str(), 0, nullptr));
+    server.ignoreRanges = true;
+    CHttpFile noRanges;
+    TEST_CHECK(!noRanges.open(server.url("/media.mp4").c_str(), 0, nullptr));
+    server.ignoreRanges = false;
+}
+}  // namespace
+
+int main() {
+    const std::string content = MakeContent((size_t)(3 * kBlock + 12345));
+    CLoopbackHttpServer server;
+    if (!server.start()) {
+        fprintf(stderr, "can't listen on 127.0.0.1\n");
+        return 1;
+    }
+    server.setFile("/media.mp4", content);
+
+    TestRangeReads(server, content);
+    TestShortReads(server, content);
+    TestDroppedConnections(server, content);
+    TestTruncatedResponses(server, content);
+    TestUnusableServers(server);
+    server.stop();
+    return TestResult("test_httpfile");
+}
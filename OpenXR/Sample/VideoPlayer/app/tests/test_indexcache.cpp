@@ -0,0 +1,230 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// CIndexCache entries on disk: a store/load round trip through CIndexWriter and CIndexReader, and
+// the entries that must not be used: the media file changed in size or mtime, another format
+// version, a truncated file, and counts in the payload larger than the entry.
+
+#include "pch.h"
+#include "common.h"
+#include "indexcache.h"
+#include "mediafixtures.h"
+#include "testing.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr const char* kKind = "testidx";
+const int64_t kTimes[] = {0, 40000, 80000, 1LL << 40};
+constexpr size_t kTimeCount = sizeof(kTimes) / sizeof(kTimes[0]);
+
+bool WriteMedia(const std::string& path, const std::string& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    fwrite(data.data(), 1, data.size(), file);
+    return fclose(file) == 0;
+}
+
+std::vector<uint8_t> TestPayload() {
+    CIndexWriter writer;
+    writer.put<uint8_t>(7);  // leaves the array after it to be aligned
+    writer.putString("video/avc");
+    writer.put<uint64_t>(kTimeCount);
+    writer.putArray(kTimes, kTimeCount);
+    return writer.payload();
+}
+
+// Reads TestPayload() back; false if any field differs.
+bool CheckPayload(const CIndexCacheEntry& entry) {
+    CIndexReader reader(entry.data(), entry.size());
+    const uint8_t tag = reader.get<uint8_t>();
+    const std::string mime = reader.getString();
+    const size_t count = (size_t)reader.get<uint64_t>();
+    const int64_t* times = reader.getArray<int64_t>(count);
+    if (reader.failed() || tag != 7 || mime != "video/avc" || count != kTimeCount || times == nullptr) {
+        return false;
+    }
+    // Used in place from the mapped file, so it has to be aligned for its type.
+    return ((uintptr_t)times % alignof(int64_t)) == 0 && memcmp(times, kTimes, sizeof(kTimes)) == 0;
+}
+
+// The one entry file in the cache directory.
+std::string EntryFile(const std::string& cacheDirectory) {
+    std::string found;
+    if (DIR* dir = opendir(cacheDirectory.c_str())) {
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') {
+                found = cacheDirectory + "/" + entry->d_name;
+            }
+        }
+        closedir(dir);
+    }
+    return found;
+}
+
+void TestRoundTrip(const std::string& directory) {
+    const std::string media = directory + "/clip.mp4";
+    TEST_CHECK(WriteMedia(media, "media file"));
+    // The cache directory and its parents are made on first store.
+    const std::string cacheDirectory = directory + "/cache/index";
+    CIndexCache cache(cacheDirectory);
+    TEST_CHECK(cache.load(media.c_str(), kKind) == nullptr);
+    TEST_CHECK(cache.misses() == 1 && cache.hits() == 0);
+    TEST_CHECK(cache.store(media.c_str(), kKind, TestPayload()));
+
+    std::shared_ptr<CIndexCacheEntry> entry = cache.load(media.c_str(), kKind);
+    TEST_CHECK(entry != nullptr && CheckPayload(*entry));
+    TEST_CHECK(cache.hits() == 1);
+    // Another kind for the same file, and the same kind for another file, are separate entries.
+    TEST_CHECK(cache.load(media.c_str(), "otheridx") == nullptr);
+    const std::string other = directory + "/other.mp4";
+    TEST_CHECK(WriteMedia(other, "media file"));
+    TEST_CHECK(cache.load(other.c_str(), kKind) == nullptr);
+    TEST_CHECK(cache.hits() == 1 && cache.misses() == 3);
+
+    // Replacing an entry while the old one is mapped leaves the old mapping intact.
+    CIndexWriter writer;
+    writer.put<uint32_t>(42);
+    TEST_CHECK(cache.store(media.c_str(), kKind, writer.payload()));
+    TEST_CHECK(CheckPayload(*entry));
+    std::shared_ptr<CIndexCacheEntry> replaced = cache.load(media.c_str(), kKind);
+    TEST_CHECK(replaced != nullptr && replaced->size() >= sizeof(uint32_t));
+    if (replaced) {
+        CIndexReader reader(replaced->data(), replaced->size());
+        TEST_CHECK(reader.get<uint32_t>() == 42 && !reader.failed());
+    }
+    entry.reset();
+    replaced.reset();
+
+    unlink(EntryFile(cacheDirectory).c_str());
+    unlink(other.c_str());
+    unlink(media.c_str());
+    rmdir(cacheDirectory.c_str());
+    rmdir((directory + "/cache").c_str());
+
+    // An empty directory disables the cache.
+    CIndexCache disabled("");
+    TEST_CHECK(!disabled.store(media.c_str(), kKind, TestPayload()));
+    TEST_CHECK(disabled.load(media.c_str(), kKind) == nullptr);
+}
+
+void TestStale(const std::string& directory) {
+    const std::string media = directory + "/stale.mp4";
+    const std::string cacheDirectory = directory + "/stalecache";
+    CIndexCache cache(cacheDirectory);
+
+    // A different size.
+    TEST_CHECK(WriteMedia(media, "media file"));
+    TEST_CHECK(cache.store(media.c_str(), kKind, TestPayload()));
+    TEST_CHECK(cache.load(media.c_str(), kKind) != nullptr);
+    TEST_CHECK(WriteMedia(media, "media file, longer"));
+    TEST_CHECK(cache.load(media.c_str(), kKind) == nullptr);
+
+    // The same size, another mtime.
+    TEST_CHECK(cache.store(media.c_str(), kKind, TestPayload()));
+    TEST_CHECK(cache.load(media.c_str(), kKind) != nullptr);
+    struct stat statbuff;
+    TEST_CHECK(stat(media.c_str(), &statbuff) == 0);
+    struct timespec times[2] = {statbuff.st_atim, statbuff.st_mtim};
+    times[1].tv_sec -= 60;
+    TEST_CHECK(utimensat(AT_FDCWD, media.c_str(), times, 0) == 0);
+    TEST_CHECK(cache.load(media.c_str(), kKind) == nullptr);
+
+    // The media file is gone.
+    TEST_CHECK(cache.store(media.c_str(), kKind, TestPayload()));
+    unlink(media.c_str());
+    TEST_CHECK(cache.load(media.c_str(), kKind) == nullptr);
+    TEST_CHECK(!cache.store(media.c_str(), kKind, TestPayload()));
+    RemoveTempDirectory(cacheDirectory);
+}
+
+// Overwrites size bytes at offset in a file.
+bool PatchFile(const std::string& path, long offset, const void* data, size_t size) {
+    FILE* file = fopen(path.c_str(), "r+b");
+    if (file == nullptr) {
+        return false;
+    }
+    const bool written = fseek(file, offset, SEEK_SET) == 0 && fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+void TestCorrupt(const std::string& directory) {
+    const std::string media = directory + "/corrupt.mp4";
+    const std::string cacheDirectory = directory + "/corruptcache";
+    TEST_CHECK(WriteMedia(media, "media file"));
+    CIndexCache cache(cacheDirectory);
+
+    // Another format version: the second field of the header.
+    TEST_CHECK(cache.store(media.c_str(), kKind, TestPayload()));
+    const std::string entryFile = EntryFile(cacheDirectory);
+    const uint32_t version = CIndexCache::kFormatVersion + 1;
+    TEST_CHECK(PatchFile(entryFile, sizeof(uint32_t), &version, sizeof(version)));
+    TEST_CHECK(cache.load(media.c_str(), kKind) == nullptr);
+
+    // Truncated inside the header, and inside the names after it.
+    TEST_CHECK(cache.store(media.c_str(), kKind, TestPayload()));
+    TEST_CHECK(truncate(entryFile.c_str(), 10) == 0);
+    TEST_CHECK(cache.load(media.c_str(), kKind) == nullptr);
+    TEST_CHECK(cache.store(media.c_str(), kKind, TestPayload()));
+    TEST_CHECK(truncate(entryFile.c_str(), 40) == 0);
+    TEST_CHECK(cache.load(media.c_str(), kKind) == nullptr);
+
+    // Truncated inside the payload: the header is fine, but reading the array fails.
+    TEST_CHECK(cache.store(media.c_str(), kKind, TestPayload()));
+    struct stat statbuff;
+    TEST_CHECK(stat(entryFile.c_str(), &statbuff) == 0);
+    TEST_CHECK(truncate(entryFile.c_str(), statbuff.st_size - 4) == 0);
+    std::shared_ptr<CIndexCacheEntry> entry = cache.load(media.c_str(), kKind);
+    TEST_CHECK(entry != nullptr && !CheckPayload(*entry));
+    RemoveTempDirectory(cacheDirectory);
+}
+
+// Counts read from an entry that claim more than it holds, including ones whose byte size wraps.
+void TestReaderBounds() {
+    const std::vector<uint8_t> payload = TestPayload();
+    {
+        CIndexReader reader(payload.data(), payload.size());
+        reader.get<uint8_t>();
+        reader.getString();
+        reader.get<uint64_t>();
+        TEST_CHECK(reader.getArray<int64_t>(kTimeCount + 1) == nullptr && reader.failed());
+        // Failed stays failed.
+        TEST_CHECK(reader.get<uint8_t>() == 0 && reader.getArray<uint8_t>(0) == nullptr);
+    }
+    {
+        // 8 * count wraps around to 8 bytes, which the payload has.
+        CIndexReader reader(payload.data(), payload.size());
+        TEST_CHECK(reader.getArray<int64_t>(SIZE_MAX / 8 + 2) == nullptr && reader.failed());
+    }
+    {
+        // A string length running past the end.
+        std::vector<uint8_t> bad = payload;
+        const uint32_t length = 0xffffffff;
+        memcpy(bad.data() + 1, &length, sizeof(length));
+        CIndexReader reader(bad.data(), bad.size());
+        reader.get<uint8_t>();
+        TEST_CHECK(reader.getString().empty() && reader.failed());
+    }
+    {
+        CIndexReader reader(payload.data(), payload.size());
+        TEST_CHECK(reader.getArray<uint8_t>(payload.size()) == payload.data() && !reader.failed());
+        TEST_CHECK(reader.getArray<uint8_t>(0) != nullptr && !reader.failed());
+        TEST_CHECK(reader.get<uint8_t>() == 0 && reader.failed());
+    }
+}
+}  // namespace
+
+int main() {
+    const std::string directory = MakeTempDirectory();
+    TEST_CHECK(!directory.empty());
+    TestRoundTrip(directory);
+    TestStale(directory);
+    TestCorrupt(directory);
+    TestReaderBounds();
+    RemoveTempDirectory(directory);
+    return TestResult("test_indexcache");
+}
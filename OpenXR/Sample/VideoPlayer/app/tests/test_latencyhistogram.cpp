@@ -0,0 +1,131 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// CLatencyHistogram buckets: exact below 8 us, eight per power of two above, the last one taking
+// everything larger. Then percentiles of a known distribution, and add() from several threads
+// while another reads.
+
+#include "pch.h"
+#include "common.h"
+#include "latencyhistogram.h"
+#include "testing.h"
+#include <thread>
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int64_t kLongNs = 1000000000;     // keeps maxNs() above the bucket being checked
+
+// The bound percentileNs reports for a lone sample of latencyNs, read past a longer one.
+int64_t BucketBoundNs(int64_t latencyNs) {
+    CLatencyHistogram histogram;
+    histogram.add(latencyNs);
+    histogram.add(kLongNs);
+    return histogram.percentileNs(0.5);
+}
+
+void TestBuckets() {
+    // Below 8 us every microsecond has a bucket.
+    TEST_CHECK(BucketBoundNs(0) == 999);
+    TEST_CHECK(BucketBoundNs(-5) == 999);
+    TEST_CHECK(BucketBoundNs(6999) == 6999);
+    TEST_CHECK(BucketBoundNs(7000) == 7999);
+    TEST_CHECK(BucketBoundNs(7999) == 7999);
+    // 8 to 15 us still have one each: the first power of two split eight ways.
+    TEST_CHECK(BucketBoundNs(8000) == 8999);
+    TEST_CHECK(BucketBoundNs(15000) == 15999);
+    TEST_CHECK(BucketBoundNs(15999) == 15999);
+    // From 16 us the buckets are two wide, then four from 32 us.
+    TEST_CHECK(BucketBoundNs(16000) == 17999);
+    TEST_CHECK(BucketBoundNs(17999) == 17999);
+    TEST_CHECK(BucketBoundNs(18000) == 19999);
+    TEST_CHECK(BucketBoundNs(32000) == 35999);
+
+    // The last bucket ends at 2^38 us and takes everything above; the maximum is kept exactly.
+    const int64_t topBoundNs = ((int64_t)1 << 38) * 1000 - 1;
+    CLatencyHistogram histogram;
+    histogram.add(1000);
+    histogram.add(INT64_MAX);
+    TEST_CHECK(histogram.percentileNs(1.0) == topBoundNs);
+    TEST_CHECK(histogram.maxNs() == INT64_MAX);
+    histogram.reset();
+    histogram.add(topBoundNs);
+    histogram.add(INT64_MAX);
+    TEST_CHECK(histogram.percentileNs(0.5) == topBoundNs);
+    // Below the maximum the bound is the bucket's; past it, the maximum.
+    histogram.reset();
+    histogram.add(topBoundNs - 5);
+    TEST_CHECK(histogram.percentileNs(0.5) == topBoundNs - 5);
+}
+
+// One sample at every microsecond from 1 to 1000 us, times repeat.
+void AddRamp(CLatencyHistogram& histogram, int32_t repeat) {
+    for (int32_t r = 0; r < repeat; r++) {
+        for (int64_t us = 1; us <= 1000; us++) {
+            histogram.add(us * 1000);
+        }
+    }
+}
+
+void CheckRamp(const CLatencyHistogram& histogram, uint64_t count) {
+    TEST_CHECK(histogram.count() == count);
+    TEST_CHECK(histogram.maxNs() == 1000000);
+    TEST_CHECK(histogram.percentileNs(0.005) == 5999);     // 5 us, below 8 exact
+    TEST_CHECK(histogram.percentileNs(0.5) == 511999);     // 500 us, in the 480..511 us bucket
+    TEST_CHECK(histogram.percentileNs(0.9) == 959999);     // 900 us, in 896..959 us
+    TEST_CHECK(histogram.percentileNs(0.99) == 1000000);   // 990 us, in 960..1023 us, capped at the maximum
+    TEST_CHECK(histogram.percentileNs(1.0) == 1000000);
+    // Every percentile is at or above the true one, and within an eighth of it.
+    bool within = true;
+    for (int32_t percent = 1; percent <= 100; percent++) {
+        const int64_t trueNs = percent * 10 * 1000;
+        const int64_t reportedNs = histogram.percentileNs(percent / 100.0);
+        within = within && reportedNs >= trueNs && reportedNs <= trueNs + trueNs / 8 + 999;
+    }
+    TEST_CHECK(within);
+}
+
+void TestPercentiles() {
+    CLatencyHistogram histogram;
+    TEST_CHECK(histogram.percentileNs(0.5) == 0 && histogram.count() == 0);
+    AddRamp(histogram, 1);
+    CheckRamp(histogram, 1000);
+    histogram.reset();
+    TEST_CHECK(histogram.count() == 0 && histogram.maxNs() == 0 && histogram.percentileNs(0.99) == 0);
+}
+
+// Writers on several threads lose no sample, and a reader running alongside only ever sees
+// percentiles within the range added.
+void TestConcurrentAdd() {
+    constexpr int32_t kThreads = 4;
+    constexpr int32_t kRepeat = 200;
+    CLatencyHistogram histogram;
+    std::atomic<bool> done{false};
+    bool readsInRange = true;
+    std::thread reader([&] {
+        while (!done.load()) {
+            const int64_t p50 = histogram.percentileNs(0.5);
+            readsInRange = readsInRange && (histogram.count() == 0 ? p50 == 0 : p50 >= 1000 && p50 <= 1000000);
+            std::this_thread::yield();
+        }
+    });
+    std::vector<std::thread> writers;
+    for (int32_t i = 0; i < kThreads; i++) {
+        writers.emplace_back([&] { AddRamp(histogram, kRepeat); });
+    }
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+    done = true;
+    reader.join();
+    TEST_CHECK(readsInRange);
+    CheckRamp(histogram, (uint64_t)kThreads * kRepeat * 1000);
+}
+}  // namespace
+
+int main() {
+    TestBuckets();
+    TestPercentiles();
+    TestConcurrentAdd();
+    return TestResult("test_latencyhistogram");
+}
@@ -0,0 +1,377 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Live ingest: CJitterBuffer release times against LiveMaxJitterMs, and CLiveSource cutting a
+// generated H.264 Annex-B stream into access units when it arrives over loopback UDP, split into
+// arbitrary datagrams, or through a FIFO.
+
+#include "pch.h"
+#include "common.h"
+#include "options.h"
+#include "jitterbuffer.h"
+#include "livesource.h"
+#include "testing.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <thread>
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int64_t kMs = 1000 * 1000;
+constexpr int64_t kFrameNs = 33 * kMs;
+
+// ---------------------------------------------------------------------------------------------
+// CJitterBuffer, on synthetic arrival times.
+
+void TestSteadyFeedIsNotDelayed(int64_t maxDelayNs) {
+    CJitterBuffer jitter(maxDelayNs);
+    for (int32_t i = 0; i < 60; i++) {
+        const int64_t arrival = 1000 * kMs + i * kFrameNs;
+        TEST_CHECK(jitter.schedule(arrival) == arrival);
+    }
+    TEST_CHECK(jitter.delayNs() == 0);
+    TEST_CHECK(jitter.intervalNs() == kFrameNs);
+}
+
+// Pairs of frames arriving together every two intervals: the second of a pair is held back
+// towards the frame interval, never released before it arrived, never held past the delay cap.
+void TestBurstsAreSpread(int64_t maxDelayNs) {
+    CJitterBuffer jitter(maxDelayNs);
+    int64_t previousRelease = -1;
+    int64_t spreadPairs = 0;
+    for (int32_t i = 0; i < 120; i++) {
+        const int64_t arrival = 1000 * kMs + (i / 2) * 2 * kFrameNs;
+        const int64_t release = jitter.schedule(arrival);
+        TEST_CHECK(release >= arrival);
+        TEST_CHECK(release <= arrival + maxDelayNs);
+        TEST_CHECK(previousRelease < 0 || release >= previousRelease);
+        if (i >= 80 && i % 2 == 1 && release - previousRelease >= kFrameNs / 2) {
+            spreadPairs++;
+        }
+        previousRelease = release;
+    }
+    if (maxDelayNs >= kFrameNs / 2) {
+        TEST_CHECK(spreadPairs == 20);
+    } else {
+        TEST_CHECK(spreadPairs == 0);
+    }
+    // The jitter of this feed is a whole interval, far more than any of the caps tested.
+    TEST_CHECK(jitter.delayNs() == maxDelayNs);
+}
+
+void TestGapRestartsSchedule(int64_t maxDelayNs) {
+    CJitterBuffer jitter(maxDelayNs);
+    int64_t arrival = 1000 * kMs;
+    for (int32_t i = 0; i < 60; i++, arrival += (i % 2) ? 0 : 2 * kFrameNs) {
+        jitter.schedule(arrival);
+    }
+    // The sender paused for a second: the next frame is shown on arrival, not an interval after
+    // the last release.
+    arrival += 1000 * kMs;
+    TEST_CHECK(jitter.schedule(arrival) == arrival);
+}
+
+// ---------------------------------------------------------------------------------------------
+// A generated H.264 stream: baseline SPS and PPS on keyframes, slices tagged with their frame
+// number (third byte) and slice index (fourth byte).
+
+struct BitWriter {
+    std::vector<uint8_t> bytes;
+    int32_t bits = 0;
+    uint8_t current = 0;
+    void bit(uint32_t b) {
+        current = (uint8_t)((current << 1) | (b & 1));
+        if (++bits == 8) {
+            bytes.push_back(current);
+            bits = 0;
+            current = 0;
+        }
+    }
+    void u(int32_t n, uint32_t v) {
+        for (int32_t i = n - 1; i >= 0; i--) {
+            bit(v >> i);
+        }
+    }
+    void ue(uint32_t v) {
+        const uint32_t x = v + 1;
+        int32_t n = 0;
+        while ((x >> n) > 1) {
+            n++;
+        }
+        u(n, 0);
+        u(n + 1, x);
+    }
+    std::vector<uint8_t> finish() {
+        bit(1);
+        while (bits != 0) {
+            bit(0);
+        }
+        return bytes;
+    }
+};
+
+std::vector<uint8_t> Sps(int32_t width, int32_t height) {
+    BitWriter b;
+    b.u(8, 0x67);
+    b.u(8, 66);  // baseline
+    b.u(8, 0);
+    b.u(8, 30);
+    b.ue(0);     // seq_parameter_set_id
+    b.ue(0);     // log2_max_frame_num_minus4
+    b.ue(2);     // pic_order_cnt_type
+    b.ue(1);     // max_num_ref_frames
+    b.u(1, 0);
+    b.ue(width / 16 - 1);
+    b.ue(height / 16 - 1);
+    b.u(1, 1);   // frame_mbs_only_flag
+    b.u(1, 1);
+    b.u(1, 0);   // no cropping
+    b.u(1, 0);   // no VUI
+    return b.finish();
+}
+
+std::vector<uint8_t> Slice(bool idr, int32_t frame, int32_t index, size_t size) {
+    std::vector<uint8_t> slice(size, 0x55);
+    slice[0] = idr ? 0x65 : 0x41;
+    slice[1] = index == 0 ? 0x88 : 0x48;  // first_mb_in_slice 0, or 1 for the later slices
+    slice[2] = (uint8_t)frame;
+    slice[3] = (uint8_t)index;
+    return slice;
+}
+
+void Put(std::vector<uint8_t>& out, const std::vector<uint8_t>& nal) {
+    out.insert(out.end(), {0, 0, 0, 1});
+    out.insert(out.end(), nal.begin(), nal.end());
+}
+
+typedef struct StreamLayout_tag {
+    int32_t frames{40};
+    int32_t keyInterval{10};
+    int32_t leadingFrames{3};      // non-keyframes sent before the first keyframe
+    int32_t resolutionChangeAt{30};  // a keyframe
+    int32_t multiSliceEvery{4};    // these frames have an AUD, an SEI and three slices
+    bool    bursty{false};         // pairs of frames every two intervals
+}StreamLayout;
+
+bool IsKeyFrame(const StreamLayout& layout, int32_t frame) {
+    return frame >= 0 && frame % layout.keyInterval == 0;
+}
+
+int32_t SliceCount(const StreamLayout& layout, int32_t frame) {
+    return (frame % layout.multiSliceEvery == 1) ? 3 : 1;
+}
+
+// Frame numbers start at -leadingFrames; those precede the first keyframe and must be discarded.
+std::vector<uint8_t> EncodeFrame(const StreamLayout& layout, int32_t frame) {
+    std::vector<uint8_t> out;
+    const bool key = IsKeyFrame(layout, frame);
+    const int32_t slices = SliceCount(layout, frame);
+    if (slices > 1) {
+        Put(out, {0x09, 0xf0});               // access unit delimiter
+        Put(out, {0x06, 0x05, 0x01, 0x00, 0x80});  // SEI
+    }
+    if (key) {
+        const bool changed = frame >= layout.resolutionChangeAt;
+        Put(out, Sps(changed ? 640 : 320, changed ? 480 : 240));
+        Put(out, {0x68, 0xce, 0x38, 0x80});
+    }
+    for (int32_t i = 0; i < slices; i++) {
+        Put(out, Slice(key, frame, i, key ? 3000 : 700));
+    }
+    return out;
+}
+
+template <typename Send>
+void SendStream(const StreamLayout& layout, Send send) {
+    for (int32_t frame = -layout.leadingFrames; frame < layout.frames; frame++) {
+        send(EncodeFrame(layout, frame));
+        const bool pause = !layout.bursty || (frame + layout.leadingFrames) % 2 == 1;
+        if (pause) {
+            usleep((useconds_t)((layout.bursty ? 2 : 1) * kFrameNs / 1000));
+        }
+    }
+}
+
+typedef struct ReceivedUnit_tag {
+    int32_t  frame{-1000};
+    int32_t  slices{0};
+    bool     sync{false};
+    bool     formatChange{false};
+    int32_t  width{0};
+    int32_t  height{0};
+    int64_t  heldNs{0};   // from arrival to release
+}ReceivedUnit;
+
+// Reads access units until 'count' arrived or the source stops delivering.
+std::vector<ReceivedUnit> Receive(CLiveSource& source, size_t count) {
+    std::vector<ReceivedUnit> units;
+    std::vector<uint8_t> buffer(1 << 20);
+    const int64_t deadline = TestNowNs() + 10 * 1000 * kMs;
+    while (units.size() < count && TestNowNs() < deadline) {
+        const int32_t track = source.getSampleTrackIndex();
+        if (track == IMediaSource::kSampleNotReady) {
+            continue;
+        }
+        if (track < 0) {
+            break;
+        }
+        ReceivedUnit unit;
+        unit.heldNs = TestNowNs() - source.getSampleTime() * 1000;
+        const uint32_t flags = source.getSampleFlags();
+        unit.sync = (flags & IMediaSource::kSampleFlagSync) != 0;
+        unit.formatChange = (flags & IMediaSource::kSampleFlagFormatChange) != 0;
+        MediaTrackInfo info;
+        source.getTrackInfo(0, info);
+        unit.width = info.width;
+        unit.height = info.height;
+        const ssize_t size = source.readSampleData(buffer.data(), buffer.size());
+        TEST_CHECK(size > 0);
+        for (ssize_t i = 0; i + 7 < size; i++) {
+            const uint8_t type = buffer[i + 4] & 0x1f;
+            if (buffer[i] == 0 && buffer[i + 1] == 0 && buffer[i + 2] == 0 && buffer[i + 3] == 1 && (type == 1 || type == 5)) {
+                TEST_CHECK(buffer[i + 7] == unit.slices);      // slices in order, none from another unit
+                TEST_CHECK(unit.slices == 0 || buffer[i + 6] == (uint8_t)unit.frame);
+                unit.frame = (int8_t)buffer[i + 6];
+                unit.slices++;
+            }
+        }
+        units.push_back(unit);
+        source.advance();
+    }
+    return units;
+}
+
+void CheckUnits(const StreamLayout& layout, const std::vector<ReceivedUnit>& units, const LiveIngestCounters& counters) {
+    TEST_CHECK(units.size() == (size_t)layout.frames);
+    for (size_t i = 0; i < units.size(); i++) {
+        const ReceivedUnit& unit = units[i];
+        const int32_t frame = (int32_t)i;
+        TEST_CHECK(unit.frame == (int8_t)frame);
+        TEST_CHECK(unit.slices == SliceCount(layout, frame));
+        TEST_CHECK(unit.sync == IsKeyFrame(layout, frame));
+        const bool changed = frame >= layout.resolutionChangeAt;
+        TEST_CHECK(unit.width == (changed ? 640 : 320) && unit.height == (changed ? 480 : 240));
+        TEST_CHECK(unit.formatChange == (frame == layout.resolutionChangeAt));
+    }
+    TEST_CHECK(counters.unitsDiscarded >= (uint64_t)layout.leadingFrames);
+}
+
+// Loose bounds on the hold times: the receive thread cuts a unit when the next one starts or after
+// kIdleFlushUs of quiet, and getSampleTrackIndex() polls, so releases are a few milliseconds late.
+constexpr int64_t kReleaseSlackNs = 15 * kMs;
+
+void CheckHoldTimes(const std::vector<ReceivedUnit>& units, int64_t maxDelayNs, bool expectHeld) {
+    int32_t held = 0;
+    for (const ReceivedUnit& unit : units) {
+        TEST_CHECK(unit.heldNs >= 0);
+        TEST_CHECK(unit.heldNs <= maxDelayNs + kReleaseSlackNs);
+        if (unit.heldNs >= kFrameNs / 2) {
+            held++;
+        }
+    }
+    TEST_CHECK(expectHeld ? held > 0 : held == 0);
+}
+
+// ---------------------------------------------------------------------------------------------
+// Transports.
+
+int32_t FreeUdpPort() {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    int32_t port = -1;
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) == 0 && getsockname(fd, (sockaddr*)&address, &length) == 0) {
+        port = ntohs(address.sin_port);
+    }
+    close(fd);
+    return port;
+}
+
+void TestUdp(const StreamLayout& layout, int64_t maxDelayNs, bool expectHeld) {
+    const int32_t port = FreeUdpPort();
+    TEST_CHECK(port > 0);
+    auto counters = std::make_shared<LiveIngestCounters>();
+    CLiveSource source("video/avc", maxDelayNs, counters);
+    std::thread sender([&] {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in to{};
+        to.sin_family = AF_INET;
+        to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        to.sin_port = htons((uint16_t)port);
+        usleep(100000);  // let open() bind first
+        uint32_t seed = 1;
+        SendStream(layout, [&](const std::vector<uint8_t>& data) {
+            // Datagram boundaries fall anywhere, including inside start codes.
+            size_t offset = 0;
+            while (offset < data.size()) {
+                seed = seed * 1103515245 + 12345;
+                const size_t size = std::min<size_t>(data.size() - offset, 1 + (seed >> 16) % 1400);
+                sendto(fd, data.data() + offset, size, 0, (sockaddr*)&to, sizeof(to));
+                offset += size;
+            }
+        });
+        close(fd);
+    });
+    const std::string url = "udp://127.0.0.1:" + std::to_string(port);
+    TEST_CHECK(source.open(url.c_str()));
+    const std::vector<ReceivedUnit> units = Receive(source, (size_t)layout.frames);
+    sender.join();
+    CheckUnits(layout, units, *counters);
+    CheckHoldTimes(units, maxDelayNs, expectHeld);
+}
+
+void TestFifo(const StreamLayout& layout, int64_t maxDelayNs) {
+    char directory[] = "/tmp/test_livesource.XXXXXX";
+    TEST_CHECK(mkdtemp(directory) != nullptr);
+    const std::string path = std::string(directory) + "/live.fifo";
+    TEST_CHECK(mkfifo(path.c_str(), 0600) == 0);
+    auto counters = std::make_shared<LiveIngestCounters>();
+    CLiveSource source("video/avc", maxDelayNs, counters);
+    std::thread sender([&] {
+        int fd = open(path.c_str(), O_WRONLY);
+        // Bytes that are not a stream at all, then the frames a byte short of a whole write.
+        const uint8_t junk[] = {1, 2, 3, 0, 0, 1, 0x41, 0x88, 9, 9, 9};
+        ssize_t written = write(fd, junk, sizeof(junk));
+        SendStream(layout, [&](const std::vector<uint8_t>& data) {
+            written = write(fd, data.data(), data.size() - 1);
+            written = write(fd, data.data() + data.size() - 1, 1);
+        });
+        (void)written;
+        close(fd);
+    });
+    TEST_CHECK(source.open(path.c_str()));
+    const std::vector<ReceivedUnit> units = Receive(source, (size_t)layout.frames);
+    sender.join();
+    CheckUnits(layout, units, *counters);
+    CheckHoldTimes(units, maxDelayNs, false);
+    unlink(path.c_str());
+    rmdir(directory);
+}
+}  // namespace
+
+int main() {
+    const int64_t maxDelayNs = (int64_t)Options().LiveMaxJitterMs * kMs;
+    for (int64_t cap : {maxDelayNs, 10 * kMs, (int64_t)0}) {
+        TestSteadyFeedIsNotDelayed(cap);
+        TestBurstsAreSpread(cap);
+        TestGapRestartsSchedule(cap);
+    }
+
+    StreamLayout smooth;
+    TestUdp(smooth, maxDelayNs, false);
+    TestFifo(smooth, maxDelayNs);
+
+    StreamLayout bursty;
+    bursty.frames = 60;
+    bursty.bursty = true;
+    TestUdp(bursty, maxDelayNs, true);
+    TestUdp(bursty, 0, false);  // LiveMaxJitterMs 0: every unit is shown on arrival
+    return TestResult("test_livesource");
+}
@@ -0,0 +1,212 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// CMediaLibrary over a directory of Host-backend clips: the stereo layout guessed from names and
+// picture shapes, a first scan, rescans that probe only new and changed files and count the removed
+// ones, an index whose string offsets are damaged, and ReadPlaylist() from a directory or M3U file.
+
+#include "pch.h"
+#include "common.h"
+#include "options.h"
+#include "medialibrary.h"
+#include "mediafixtures.h"
+#include "testing.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int32_t kFps = 25;
+
+void TestGuessStereoLayout() {
+    // Tags are whole alphanumeric runs of the file name, in any case; directories don't count.
+    TEST_CHECK(GuessStereoLayout("/v/movie_SBS.mp4", 1920, 1080) == stereoLayoutSideBySide);
+    TEST_CHECK(GuessStereoLayout("/v/movie.LR.mkv", 1920, 1080) == stereoLayoutSideBySide);
+    TEST_CHECK(GuessStereoLayout("/v/movie-Half-SBS.mp4", 0, 0) == stereoLayoutSideBySide);
+    TEST_CHECK(GuessStereoLayout("/v/movie-TB.mp4", 1920, 1080) == stereoLayoutOverUnder);
+    TEST_CHECK(GuessStereoLayout("/v/movie_3dv.mp4", 1920, 1080) == stereoLayoutOverUnder);
+    TEST_CHECK(GuessStereoLayout("/v/trip 360.mp4", 1920, 1080) == stereoLayout360);
+    TEST_CHECK(GuessStereoLayout("/v/sbs/movie.mp4", 1920, 1080) == stereoLayout2D);
+    TEST_CHECK(GuessStereoLayout("/v/sbsmovie.mp4", 1920, 1080) == stereoLayout2D);
+    TEST_CHECK(GuessStereoLayout("/v/movie.sbs", 1920, 1080) == stereoLayout2D);   // the extension isn't a tag
+
+    // Without a tag, from the shape.
+    TEST_CHECK(GuessStereoLayout("/v/a.mp4", 3840, 1080) == stereoLayoutSideBySide);   // 32:9
+    TEST_CHECK(GuessStereoLayout("/v/a.mp4", 3200, 1000) == stereoLayoutSideBySide);   // 3.2, the edge
+    TEST_CHECK(GuessStereoLayout("/v/a.mp4", 3190, 1000) == stereoLayout2D);
+    TEST_CHECK(GuessStereoLayout("/v/a.mp4", 3840, 1920) == stereoLayout360);          // 2:1
+    TEST_CHECK(GuessStereoLayout("/v/a.mp4", 2040, 1000) == stereoLayout2D);
+    TEST_CHECK(GuessStereoLayout("/v/a.mp4", 1920, 2160) == stereoLayoutOverUnder);    // 16:18
+    TEST_CHECK(GuessStereoLayout("/v/a.mp4", 1080, 1080) == stereoLayout2D);
+    TEST_CHECK(GuessStereoLayout("/v/a.mp4", 1920, 1080) == stereoLayout2D);
+    TEST_CHECK(GuessStereoLayout("/v/a.mp4", 0, 1080) == stereoLayoutUnknown);
+
+    TEST_CHECK(strcmp(GetStereoLayoutVideoMode(stereoLayoutOverUnder), "3D-OU") == 0);
+    TEST_CHECK(GetStereoLayoutVideoMode(stereoLayoutUnknown) == nullptr);
+}
+
+Options HostOptions(const std::string& indexDirectory) {
+    Options options;
+    options.MediaBackend = "Host";
+    options.IndexCacheDir = indexDirectory;
+    return options;
+}
+
+bool WriteText(const std::string& path, const std::string& text) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+    fputs(text.c_str(), file);
+    return fclose(file) == 0;
+}
+
+// The scan counts other than the timing, as "directories files probed failed removed".
+std::string ScanCounts(CMediaLibrary& library, const std::string& root, IMediaBackend& backend) {
+    LibraryScanStats stats;
+    if (!library.scan(root, backend, &stats)) {
+        return "scan failed";
+    }
+    return Fmt("%u %u %u %u %u", stats.directories, stats.files, stats.probed, stats.failed, stats.removed);
+}
+
+// root holds movie_SBS.y4m, plain.y4m, pano.y4m, broken.mp4, notes.txt and sub/deep.y4m.
+void WriteLibrary(const std::string& root) {
+    TEST_CHECK(WriteY4m(root + "/movie_SBS.y4m", 32, 16, kFps, 1, 5));
+    TEST_CHECK(WriteY4m(root + "/plain.y4m", 48, 16, kFps, 1, 5));
+    TEST_CHECK(WriteY4m(root + "/pano.y4m", 64, 32, kFps, 1, 5));
+    TEST_CHECK(WriteText(root + "/broken.mp4", "not a movie"));
+    TEST_CHECK(WriteText(root + "/notes.txt", "not media"));
+    TEST_CHECK(mkdir((root + "/sub").c_str(), 0770) == 0);
+    TEST_CHECK(WriteY4m(root + "/sub/deep.y4m", 32, 32, kFps, 1, 5));
+}
+
+void TestScan(const std::string& root, const std::string& indexDirectory) {
+    std::shared_ptr<IMediaBackend> backend = CreateMediaBackend(HostOptions(""));
+    TEST_CHECK(backend != nullptr);
+    if (backend == nullptr) {
+        return;
+    }
+    const std::string indexPath = GetLibraryIndexPath(indexDirectory, root);
+    TEST_CHECK(!indexPath.empty() && indexPath != GetLibraryIndexPath(indexDirectory, root + "/sub"));
+    TEST_CHECK(GetLibraryIndexPath("", root).empty());
+
+    // The first scan probes every media file; the text file isn't one, broken.mp4 fails.
+    {
+        CMediaLibrary library(indexPath);
+        TEST_CHECK(!library.load(root));
+        TEST_CHECK(ScanCounts(library, root, *backend) == "2 5 5 1 0");
+        TEST_CHECK(library.size() == 5);
+    }
+
+    // A new library maps the index, and a rescan of the unchanged tree probes nothing.
+    CMediaLibrary library(indexPath);
+    TEST_CHECK(library.load(root));
+    TEST_CHECK(!library.load(root + "/sub"));
+    TEST_CHECK(library.load(root));
+    TEST_CHECK(library.size() == 5);
+    LibraryEntry entry;
+    const int32_t sbs = library.find(root + "/movie_SBS.y4m");
+    TEST_CHECK(sbs >= 0 && library.getEntry(sbs, entry));
+    TEST_CHECK(entry.playable && entry.width == 32 && entry.height == 16 && entry.layout == stereoLayoutSideBySide);
+    TEST_CHECK(entry.durationUs == 5 * 1000000 / kFps);
+    const int32_t pano = library.find(root + "/pano.y4m");
+    TEST_CHECK(pano >= 0 && library.getEntry(pano, entry) && entry.layout == stereoLayout360);
+    const int32_t broken = library.find(root + "/broken.mp4");
+    TEST_CHECK(broken >= 0 && library.getEntry(broken, entry) && !entry.playable && entry.layout == stereoLayoutUnknown);
+    TEST_CHECK(library.find(root + "/sub/deep.y4m") >= 0);
+    TEST_CHECK(library.find(root + "/notes.txt") < 0 && library.find(root + "/missing.y4m") < 0);
+    TEST_CHECK(ScanCounts(library, root, *backend) == "2 5 0 0 0");
+
+    // A longer file, a new mtime, a new file and a deleted one: only the first three are probed.
+    TEST_CHECK(WriteY4m(root + "/plain.y4m", 48, 16, kFps, 1, 10));
+    struct stat statbuff;
+    TEST_CHECK(stat((root + "/movie_SBS.y4m").c_str(), &statbuff) == 0);
+    struct timespec times[2] = {statbuff.st_atim, statbuff.st_mtim};
+    times[1].tv_sec -= 60;
+    TEST_CHECK(utimensat(AT_FDCWD, (root + "/movie_SBS.y4m").c_str(), times, 0) == 0);
+    TEST_CHECK(WriteY4m(root + "/sub/added.y4m", 32, 16, kFps, 1, 5));
+    TEST_CHECK(unlink((root + "/pano.y4m").c_str()) == 0);
+    TEST_CHECK(ScanCounts(library, root, *backend) == "2 5 3 0 1");
+    TEST_CHECK(library.find(root + "/pano.y4m") < 0);
+    const int32_t plain = library.find(root + "/plain.y4m");
+    TEST_CHECK(plain >= 0 && library.getEntry(plain, entry) && entry.durationUs == 10 * 1000000 / kFps);
+    TEST_CHECK(library.find(root + "/sub/added.y4m") >= 0);
+
+    // The records stay in path order.
+    bool sorted = true;
+    std::string previous;
+    for (size_t i = 0; i < library.size(); i++) {
+        sorted = sorted && library.getEntry(i, entry) && entry.path > previous;
+        previous = entry.path;
+    }
+    TEST_CHECK(sorted);
+}
+
+// A record whose path runs past the string table, where find() looks first.
+void TestDamagedIndex(const std::string& root, const std::string& indexDirectory) {
+    const std::string indexPath = GetLibraryIndexPath(indexDirectory, root);
+    // The header is magic, version, record count, root length and a 64-bit string table size; the
+    // root follows, then 48-byte records, aligned to 8, that start with the path offset.
+    uint32_t header[4] = {};
+    FILE* file = fopen(indexPath.c_str(), "r+b");
+    TEST_CHECK(file != nullptr);
+    if (file == nullptr) {
+        return;
+    }
+    TEST_CHECK(fread(header, sizeof(header), 1, file) == 1);
+    const uint32_t recordCount = header[2];
+    const long recordsOffset = (long)((24 + header[3] + 7) & ~7u);
+    const long recordSize = 48;
+    const uint32_t pathOffset = 0xffffff00u;
+    TEST_CHECK(fseek(file, recordsOffset + recordSize * (recordCount / 2), SEEK_SET) == 0);
+    TEST_CHECK(fwrite(&pathOffset, sizeof(pathOffset), 1, file) == 1);
+    fclose(file);
+
+    CMediaLibrary library(indexPath);
+    TEST_CHECK(library.load(root) && library.size() == recordCount);
+    LibraryEntry entry;
+    TEST_CHECK(!library.getEntry(recordCount / 2, entry));
+    TEST_CHECK(library.find(root + "/plain.y4m") < 0);
+    TEST_CHECK(library.getEntry(0, entry));
+}
+
+void TestReadPlaylist(const std::string& root, const std::string& indexDirectory) {
+    // A directory: its playable entries in path order.
+    Options options = HostOptions(indexDirectory);
+    options.Playlist = root;
+    std::vector<std::string> items;
+    TEST_CHECK(ReadPlaylist(options, items));
+    TEST_CHECK(items == std::vector<std::string>({root + "/movie_SBS.y4m", root + "/plain.y4m", root + "/sub/added.y4m", root + "/sub/deep.y4m"}));
+
+    // An M3U file: relative items are taken from its directory, absolute ones and URLs as they are.
+    const std::string playlist = root + "/sub/list.m3u";
+    TEST_CHECK(WriteText(playlist, "#EXTM3U\n\n#EXTINF:5,Deep\n  deep.y4m  \n/media/b.mp4\r\nhttp://host/c.m3u8\n\t\n../plain.y4m"));
+    options.Playlist = playlist;
+    TEST_CHECK(ReadPlaylist(options, items));
+    TEST_CHECK(items == std::vector<std::string>({root + "/sub/deep.y4m", "/media/b.mp4", "http://host/c.m3u8", root + "/sub/../plain.y4m"}));
+
+    // Nothing to play.
+    TEST_CHECK(WriteText(playlist, "#EXTM3U\n# only comments\n\n"));
+    TEST_CHECK(!ReadPlaylist(options, items) && items.empty());
+    options.Playlist = root + "/missing.m3u";
+    TEST_CHECK(!ReadPlaylist(options, items));
+    unlink(playlist.c_str());
+}
+}  // namespace
+
+int main() {
+    const std::string root = MakeTempDirectory();
+    const std::string indexDirectory = MakeTempDirectory();
+    TEST_CHECK(!root.empty() && !indexDirectory.empty());
+    TestGuessStereoLayout();
+    WriteLibrary(root);
+    TestScan(root, indexDirectory);
+    TestReadPlaylist(root, indexDirectory);
+    TestDamagedIndex(root, indexDirectory);
+    RemoveTempDirectory(root + "/sub");
+    RemoveTempDirectory(root);
+    RemoveTempDirectory(indexDirectory);
+    return TestResult("test_medialibrary");
+}
@@ -0,0 +1,289 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// CMp4Demuxer on MP4 files built box by box: the stsc chunk runs, ctts composition offsets, stss
+// sync samples, stz2 sample sizes at 4, 8 and 16 bits, co64 chunk offsets, PCM served a chunk per
+// sample, and files whose boxes are truncated or larger than what holds them.
+
+#include "pch.h"
+#include "common.h"
+#include "mp4demuxer.h"
+#include "mediafixtures.h"
+#include "testing.h"
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr uint32_t kTimescale = 1000;
+constexpr int32_t kWidth = 64;
+constexpr int32_t kHeight = 32;
+constexpr int64_t kReadAhead = 1 << 20;
+
+// Eight video samples in three chunks: stsc gives chunks 1-2 three samples each and chunk 3 on two.
+// Their bytes are all the sample number from 1, and a few bytes of padding precede every chunk, so
+// an offset taken from the wrong chunk or run reads the wrong bytes.
+const uint32_t kSampleSizes[] = {3, 5, 2, 4, 1, 6, 2, 15};
+constexpr int32_t kSamples = sizeof(kSampleSizes) / sizeof(kSampleSizes[0]);
+const int32_t kChunkSamples[] = {3, 3, 2};
+constexpr int32_t kChunkPadding = 3;
+// stts: five samples 40 ticks apart, then three 20 apart. ctts: the first two shown 80 ticks late.
+const int64_t kPtsUs[kSamples] = {80000, 120000, 80000, 120000, 160000, 200000, 220000, 240000};
+const bool kSync[kSamples] = {true, false, false, false, true, false, false, false};
+
+std::string Ftyp() {
+    return Box("ftyp", std::string("isom") + Be32(0) + "isom");
+}
+
+// ftyp, then mdat holding the given chunks behind kChunkPadding bytes each, then moov. chunkOffsets
+// receives where each chunk starts in the file.
+std::string BuildFile(const std::vector<std::string>& chunks, std::vector<uint64_t>& chunkOffsets, const std::string& moov) {
+    std::string mdat;
+    const uint64_t dataStart = Ftyp().size() + 8;
+    chunkOffsets.clear();
+    for (const std::string& chunk : chunks) {
+        mdat += std::string(kChunkPadding, '\xee');
+        chunkOffsets.push_back(dataStart + mdat.size());
+        mdat += chunk;
+    }
+    return Ftyp() + Box("mdat", mdat) + moov;
+}
+
+bool WriteFile(const std::string& path, const std::string& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    fwrite(data.data(), 1, data.size(), file);
+    return fclose(file) == 0;
+}
+
+std::vector<std::string> VideoChunks() {
+    std::vector<std::string> chunks;
+    int32_t sample = 0;
+    for (int32_t count : kChunkSamples) {
+        std::string chunk;
+        for (int32_t i = 0; i < count; i++, sample++) {
+            chunk += std::string(kSampleSizes[sample], (char)(sample + 1));
+        }
+        chunks.push_back(chunk);
+    }
+    return chunks;
+}
+
+// stsz, or stz2 with fieldBits-bit sizes.
+std::string SampleSizeBox(uint32_t fieldBits) {
+    std::string sizes;
+    if (fieldBits == 32) {
+        for (uint32_t size : kSampleSizes) {
+            sizes += Be32(size);
+        }
+        return FullBox("stsz", 0, 0, Be32(0) + Be32(kSamples) + sizes);
+    }
+    for (int32_t i = 0; i < kSamples; i++) {
+        if (fieldBits == 4 && i % 2 == 0) {
+            sizes += (char)((kSampleSizes[i] << 4) | (i + 1 < kSamples ? kSampleSizes[i + 1] : 0));
+        } else if (fieldBits == 8) {
+            sizes += (char)kSampleSizes[i];
+        } else if (fieldBits == 16) {
+            sizes += Be16(kSampleSizes[i]);
+        }
+    }
+    return FullBox("stz2", 0, 0, std::string(3, '\0') + (char)fieldBits + Be32(kSamples) + sizes);
+}
+
+std::string ChunkOffsetBox(const std::vector<uint64_t>& chunkOffsets, bool co64) {
+    std::string offsets;
+    for (uint64_t offset : chunkOffsets) {
+        offsets += co64 ? Be64(offset) : Be32((uint32_t)offset);
+    }
+    return FullBox(co64 ? "co64" : "stco", 0, 0, Be32((uint32_t)chunkOffsets.size()) + offsets);
+}
+
+std::string VideoStbl(uint32_t fieldBits, const std::vector<uint64_t>& chunkOffsets, bool co64) {
+    return FullBox("stsd", 0, 0, Be32(1) + VisualSampleEntry("I420", kWidth, kHeight)) +
+           FullBox("stts", 0, 0, Be32(2) + Be32(5) + Be32(40) + Be32(3) + Be32(20)) +
+           FullBox("ctts", 0, 0, Be32(2) + Be32(2) + Be32(80) + Be32(6) + Be32(0)) +
+           FullBox("stss", 0, 0, Be32(2) + Be32(1) + Be32(5)) +
+           FullBox("stsc", 0, 0, Be32(2) + Be32(1) + Be32(3) + Be32(1) + Be32(3) + Be32(2) + Be32(1)) +
+           SampleSizeBox(fieldBits) + ChunkOffsetBox(chunkOffsets, co64);
+}
+
+std::string VideoMoov(uint32_t fieldBits, const std::vector<uint64_t>& chunkOffsets, bool co64) {
+    return Box("moov", TrakBox(1, "vide", kTimescale, 260, VideoStbl(fieldBits, chunkOffsets, co64)));
+}
+
+// Writes the video file with the given size and offset boxes. The moov after mdat doesn't move
+// the chunks, so the offsets of a first build are the final ones.
+bool WriteVideoFile(const std::string& path, uint32_t fieldBits, bool co64) {
+    std::vector<uint64_t> chunkOffsets;
+    BuildFile(VideoChunks(), chunkOffsets, std::string());
+    return WriteFile(path, BuildFile(VideoChunks(), chunkOffsets, VideoMoov(fieldBits, chunkOffsets, co64)));
+}
+
+void CheckVideoFile(const std::string& path, const char* variant) {
+    const int failures = g_testFailures;
+    TEST_CHECK(CMp4Demuxer::probe(path.c_str()));
+    CMp4Demuxer demuxer(kReadAhead, nullptr, nullptr);  // mapped, so getSampleData() serves samples in place
+    TEST_CHECK(demuxer.open(path.c_str()));
+    TEST_CHECK(demuxer.getTrackCount() == 1);
+    MediaTrackInfo info;
+    TEST_CHECK(demuxer.getTrackInfo(0, info));
+    TEST_CHECK(info.type == mediaTypeVideo && info.mime == kMimeRawVideo);
+    TEST_CHECK(info.width == kWidth && info.height == kHeight);
+    TEST_CHECK(info.durationUs == 260000);
+    TEST_CHECK(info.maxInputSize == 15);
+
+    std::vector<int64_t> syncTimes;
+    TEST_CHECK(demuxer.getSyncSampleTimes(0, syncTimes));
+    TEST_CHECK(syncTimes.size() == 2 && syncTimes[0] == kPtsUs[0] && syncTimes[1] == kPtsUs[4]);
+
+    TEST_CHECK(demuxer.selectTrack(0));
+    uint8_t buffer[16];
+    for (int32_t i = 0; i < kSamples; i++) {
+        TEST_CHECK(demuxer.getSampleTrackIndex() == 0);
+        TEST_CHECK(demuxer.getSampleTime() == kPtsUs[i]);
+        TEST_CHECK((demuxer.getSampleFlags() == IMediaSource::kSampleFlagSync) == kSync[i]);
+        const ssize_t size = demuxer.readSampleData(buffer, sizeof(buffer));
+        TEST_CHECK(size == (ssize_t)kSampleSizes[i]);
+        bool bytesMatch = size > 0;
+        for (ssize_t b = 0; b < size; b++) {
+            bytesMatch = bytesMatch && buffer[b] == (uint8_t)(i + 1);
+        }
+        TEST_CHECK(bytesMatch);
+        size_t mappedSize = 0;
+        const uint8_t* mapped = demuxer.getSampleData(mappedSize);
+        TEST_CHECK(mapped != nullptr && mappedSize == kSampleSizes[i] && mapped[0] == (uint8_t)(i + 1));
+        TEST_CHECK(demuxer.advance() == (i + 1 < kSamples));
+    }
+    TEST_CHECK(demuxer.getSampleTrackIndex() == -1);
+
+    // Seeks go to the nearest sync sample.
+    TEST_CHECK(demuxer.seekTo(170000) && demuxer.getSampleTime() == kPtsUs[4]);
+    TEST_CHECK(demuxer.seekTo(90000) && demuxer.getSampleTime() == kPtsUs[0]);
+    if (g_testFailures != failures) {
+        fprintf(stderr, "with %s\n", variant);
+    }
+}
+
+void TestSampleTables(const std::string& directory) {
+    const std::string path = directory + "/video.mp4";
+    TEST_CHECK(WriteVideoFile(path, 32, false));
+    CheckVideoFile(path, "stsz and stco");
+    TEST_CHECK(WriteVideoFile(path, 16, false));
+    CheckVideoFile(path, "stz2 16-bit");
+    TEST_CHECK(WriteVideoFile(path, 8, true));
+    CheckVideoFile(path, "stz2 8-bit and co64");
+    TEST_CHECK(WriteVideoFile(path, 4, true));
+    CheckVideoFile(path, "stz2 4-bit and co64");
+}
+
+// 16-bit stereo PCM at 8 kHz: one stsd "sample" per frame, ten frames in chunks of four, four and two.
+void TestPcmChunks(const std::string& directory) {
+    constexpr int32_t kChannels = 2;
+    constexpr int32_t kRate = 8000;
+    const int32_t chunkFrames[] = {4, 4, 2};
+    std::vector<std::string> chunks;
+    for (int32_t i = 0; i < 3; i++) {
+        chunks.push_back(std::string(chunkFrames[i] * kChannels * 2, (char)(i + 1)));
+    }
+    const std::string soundEntry = Box("sowt", std::string(6, '\0') + Be16(1) + Be16(0) + Be16(0) + Be32(0) + Be16(kChannels) + Be16(16) +
+                                                   Be16(0) + Be16(0) + Be32((uint32_t)kRate << 16));
+    std::vector<uint64_t> chunkOffsets;
+    auto moov = [&]() {
+        const std::string stbl = FullBox("stsd", 0, 0, Be32(1) + soundEntry) + FullBox("stts", 0, 0, Be32(1) + Be32(10) + Be32(1)) +
+                                 FullBox("stsc", 0, 0, Be32(2) + Be32(1) + Be32(4) + Be32(1) + Be32(3) + Be32(2) + Be32(1)) +
+                                 FullBox("stsz", 0, 0, Be32(kChannels * 2) + Be32(10)) + ChunkOffsetBox(chunkOffsets, false);
+        return Box("moov", TrakBox(2, "soun", kRate, 10, stbl));
+    };
+    BuildFile(chunks, chunkOffsets, std::string());
+    const std::string path = directory + "/pcm.mp4";
+    TEST_CHECK(WriteFile(path, BuildFile(chunks, chunkOffsets, moov())));
+
+    CMp4Demuxer demuxer(0, nullptr, nullptr);
+    TEST_CHECK(demuxer.open(path.c_str()));
+    MediaTrackInfo info;
+    TEST_CHECK(demuxer.getTrackInfo(0, info));
+    TEST_CHECK(info.type == mediaTypeAudio && info.mime == kMimeRawAudio);
+    TEST_CHECK(info.channelCount == kChannels && info.sampleRate == kRate);
+    TEST_CHECK(info.maxInputSize == 4 * kChannels * 2);
+    TEST_CHECK(demuxer.selectTrack(0));
+    const int64_t chunkTimesUs[] = {0, 500, 1000};
+    uint8_t buffer[64];
+    for (int32_t i = 0; i < 3; i++) {
+        TEST_CHECK(demuxer.getSampleTime() == chunkTimesUs[i]);
+        TEST_CHECK(demuxer.getSampleFlags() == IMediaSource::kSampleFlagSync);
+        const ssize_t size = demuxer.readSampleData(buffer, sizeof(buffer));
+        TEST_CHECK(size == chunkFrames[i] * kChannels * 2);
+        TEST_CHECK(size > 0 && buffer[0] == (uint8_t)(i + 1) && buffer[size - 1] == (uint8_t)(i + 1));
+        demuxer.advance();
+    }
+    TEST_CHECK(demuxer.getSampleTrackIndex() == -1);
+}
+
+// Replaces the 4 bytes after the first occurrence of type (a box's size is just before its type).
+std::string PatchBoxSize(std::string file, const char* type, uint32_t size) {
+    const size_t at = file.find(type);
+    if (at != std::string::npos && at >= 4) {
+        file.replace(at - 4, 4, Be32(size));
+    }
+    return file;
+}
+
+void TestRejected(const std::string& directory) {
+    const std::string path = directory + "/bad.mp4";
+    std::vector<uint64_t> chunkOffsets;
+    BuildFile(VideoChunks(), chunkOffsets, std::string());
+    const std::string good = BuildFile(VideoChunks(), chunkOffsets, VideoMoov(32, chunkOffsets, false));
+    CMp4Demuxer demuxer(0, nullptr, nullptr);
+    TEST_CHECK(WriteFile(path, good) && demuxer.open(path.c_str()));
+
+    // The file ends inside moov.
+    TEST_CHECK(WriteFile(path, good.substr(0, good.size() - 10)));
+    TEST_CHECK(!demuxer.open(path.c_str()));
+    // moov claims to run past the end of the file, and a 64-bit size past it as well.
+    TEST_CHECK(WriteFile(path, PatchBoxSize(good, "moov", 0x7fffffff)));
+    TEST_CHECK(!demuxer.open(path.c_str()));
+    const size_t moovAt = good.find("moov") - 4;
+    const std::string largeMoov = good.substr(0, moovAt) + Be32(1) + "moov" + Be64(0x100000000ULL) + good.substr(moovAt + 8);
+    TEST_CHECK(WriteFile(path, largeMoov));
+    TEST_CHECK(!demuxer.open(path.c_str()));
+    // A box smaller than its own header.
+    TEST_CHECK(WriteFile(path, PatchBoxSize(good, "mdat", 4)));
+    TEST_CHECK(!demuxer.open(path.c_str()));
+    // trak larger than the moov holding it.
+    TEST_CHECK(WriteFile(path, PatchBoxSize(good, "trak", (uint32_t)good.size())));
+    TEST_CHECK(!demuxer.open(path.c_str()));
+    // Tables with more entries than their boxes hold: stsz, stco, stsc, stts, ctts and stss.
+    for (const char* table : {"stsz", "stco", "stsc", "stts", "ctts", "stss"}) {
+        std::string file = good;
+        const size_t countAt = file.find(table) + 4 + 4 + (strcmp(table, "stsz") == 0 ? 4 : 0);
+        file.replace(countAt, 4, Be32(1000));
+        TEST_CHECK(WriteFile(path, file));
+        const bool opened = demuxer.open(path.c_str());
+        TEST_CHECK(!opened);
+        if (opened) {
+            fprintf(stderr, "oversized %s accepted\n", table);
+        }
+    }
+    // stz2 with a field size it doesn't define.
+    std::string stz2 = BuildFile(VideoChunks(), chunkOffsets, VideoMoov(8, chunkOffsets, false));
+    stz2[stz2.find("stz2") + 4 + 7] = 12;
+    TEST_CHECK(WriteFile(path, stz2));
+    TEST_CHECK(!demuxer.open(path.c_str()));
+    // No moov at all, and an empty file.
+    TEST_CHECK(WriteFile(path, Ftyp() + Box("mdat", "abc")));
+    TEST_CHECK(!demuxer.open(path.c_str()));
+    TEST_CHECK(WriteFile(path, std::string()));
+    TEST_CHECK(!demuxer.open(path.c_str()) && !CMp4Demuxer::probe(path.c_str()));
+}
+}  // namespace
+
+int main() {
+    const std::string directory = MakeTempDirectory();
+    TEST_CHECK(!directory.empty());
+    TestSampleTables(directory);
+    TestPcmChunks(directory);
+    TestRejected(directory);
+    RemoveTempDirectory(directory);
+    return TestResult("test_mp4demuxer");
+}
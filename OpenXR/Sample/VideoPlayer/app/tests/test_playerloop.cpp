@@ -0,0 +1,160 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Looping and playlists on Host-backend clips, played through CPlayer by a display loop at 90 Hz:
+// a gapless loop on the pre-rolled standby decoder, a two-item playlist, and a clip replayed from
+// the loop cache. Every pass must continue the media timeline one frame interval at a time.
+
+#include "pch.h"
+#include "common.h"
+#include "options.h"
+#include "mediaclock.h"
+#include "player.h"
+#include "mediafixtures.h"
+#include "testing.h"
+#include <thread>
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int32_t kWidth = 32;
+constexpr int32_t kHeight = 16;
+constexpr int32_t kOtherWidth = 48;         // the second playlist item
+constexpr int32_t kFps = 25;
+constexpr int64_t kFrameNs = 1000000000LL / kFps;
+constexpr int32_t kFrames = 30;             // 1.2 s, longer than the 1 s a gapless loop pre-rolls ahead
+constexpr int32_t kOtherFrames = 20;
+constexpr int64_t kDisplayPeriodNs = 11111111;
+constexpr int64_t kTimeoutNs = 15000000000LL;
+
+std::shared_ptr<IMediaBackend> CreateHostBackend() {
+    Options options;
+    options.MediaBackend = "Host";
+    options.IndexCacheDir = "";
+    return CreateMediaBackend(options);
+}
+
+typedef struct PlaybackResult_tag {
+    int32_t frames = 0;             // new frames shown
+    int32_t discontinuities = 0;    // new frames not one interval after the last one
+    int32_t sizeChanges = 0;        // new frames of another size than the last one
+    bool finished = false;
+}PlaybackResult;
+
+// Refreshes every kDisplayPeriodNs as a display would, on a schedule of its own so a late wakeup
+// doesn't show up as a frame gap, until the frame at untilNs on the media timeline is shown.
+PlaybackResult Play(CPlayer& player, int64_t untilNs) {
+    PlaybackResult result;
+    int64_t lastPts = -1;
+    int32_t lastWidth = 0;
+    int64_t displayTime = CMediaClock::monotonicNow();
+    const int64_t deadline = displayTime + kTimeoutNs;
+    while (displayTime < deadline) {
+        displayTime += kDisplayPeriodNs;
+        std::this_thread::sleep_for(std::chrono::nanoseconds(displayTime - kDisplayPeriodNs - CMediaClock::monotonicNow()));
+        const MediaFrame* frame = player.getFrame(displayTime, kDisplayPeriodNs);
+        if (frame != nullptr && frame->pts != lastPts) {
+            result.frames++;
+            if (lastPts >= 0 && frame->pts != lastPts + kFrameNs) {
+                result.discontinuities++;
+                fprintf(stderr, "frame at %lld us follows %lld us\n", (long long)(frame->pts / 1000), (long long)(lastPts / 1000));
+            }
+            if (lastWidth != 0 && frame->width != lastWidth) {
+                result.sizeChanges++;
+            }
+            lastPts = frame->pts;
+            lastWidth = frame->width;
+            if (lastPts >= untilNs) {
+                result.finished = true;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+void CheckLoopGap(const PipelineStats& stats) {
+    // Frames land on the refresh nearest their time, so a pass boundary may take one more refresh.
+    TEST_CHECK(stats.lastLoopFrameGapNs > 0 && stats.lastLoopFrameGapNs <= kFrameNs + kDisplayPeriodNs);
+    TEST_CHECK(stats.maxLoopFrameGapNs <= kFrameNs + kDisplayPeriodNs);
+}
+
+void TestGaplessLoop(std::shared_ptr<IMediaBackend> backend, const std::string& clip) {
+    CPlayer player(backend, 4);
+    player.setLateFramePolicy(lateFramePolicyNone, 0);
+    player.setGaplessLoop(true);
+    int32_t width = 0;
+    int32_t height = 0;
+    TEST_CHECK(player.setDataSource(clip.c_str(), width, height));
+    TEST_CHECK(player.start());
+    // Into the third pass.
+    const PlaybackResult result = Play(player, 2 * kFrames * kFrameNs);
+    const PipelineStats stats = player.getStats();
+    player.stop();
+
+    TEST_CHECK(result.finished);
+    TEST_CHECK(result.frames == 2 * kFrames + 1);
+    TEST_CHECK(result.discontinuities == 0);
+    TEST_CHECK(stats.loopCount >= 2 && stats.gaplessLoops >= 2);
+    CheckLoopGap(stats);
+}
+
+void TestPlaylist(std::shared_ptr<IMediaBackend> backend, const std::string& first, const std::string& second) {
+    CPlayer player(backend, 4);
+    player.setLateFramePolicy(lateFramePolicyNone, 0);
+    player.setPlaylist({first, second});
+    int32_t width = 0;
+    int32_t height = 0;
+    TEST_CHECK(player.setDataSource(first.c_str(), width, height));
+    TEST_CHECK(player.start());
+    // Through the second item and back to the first.
+    const PlaybackResult result = Play(player, (kFrames + kOtherFrames) * kFrameNs);
+    const PipelineStats stats = player.getStats();
+    player.stop();
+
+    TEST_CHECK(result.finished);
+    TEST_CHECK(result.frames == kFrames + kOtherFrames + 1);
+    TEST_CHECK(result.discontinuities == 0);
+    TEST_CHECK(result.sizeChanges == 2);
+    TEST_CHECK(stats.playlistSwitches >= 2);
+    CheckLoopGap(stats);
+}
+
+void TestLoopCache(std::shared_ptr<IMediaBackend> backend, const std::string& clip) {
+    CPlayer player(backend, 4);
+    player.setLateFramePolicy(lateFramePolicyNone, 0);
+    player.setLoopCache(1 << 20);
+    int32_t width = 0;
+    int32_t height = 0;
+    TEST_CHECK(player.setDataSource(clip.c_str(), width, height));
+    TEST_CHECK(player.start());
+    // The first pass is recorded; the second comes from the cache, and the third is reached from it.
+    const PlaybackResult result = Play(player, 2 * kFrames * kFrameNs);
+    const PipelineStats stats = player.getStats();
+    player.stop();
+
+    TEST_CHECK(result.finished);
+    TEST_CHECK(result.frames == 2 * kFrames + 1);
+    TEST_CHECK(result.discontinuities == 0);
+    TEST_CHECK(stats.loopCacheReplaying);
+    TEST_CHECK(stats.loopCacheFrames == (uint32_t)kFrames);
+    TEST_CHECK(stats.loopCacheFramesServed > 0);
+    CheckLoopGap(stats);
+}
+}  // namespace
+
+int main() {
+    const std::string directory = MakeTempDirectory();
+    TEST_CHECK(!directory.empty());
+    const std::string clip = directory + "/clip.y4m";
+    const std::string other = directory + "/other.y4m";
+    TEST_CHECK(WriteY4m(clip, kWidth, kHeight, kFps, 1, kFrames));
+    TEST_CHECK(WriteY4m(other, kOtherWidth, kHeight, kFps, 1, kOtherFrames));
+
+    std::shared_ptr<IMediaBackend> backend = CreateHostBackend();
+    TestGaplessLoop(backend, clip);
+    TestPlaylist(backend, clip, other);
+    TestLoopCache(backend, clip);
+    RemoveTempDirectory(directory);
+    return TestResult("test_playerloop");
+}
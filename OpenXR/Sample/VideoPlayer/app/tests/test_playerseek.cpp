@@ -0,0 +1,172 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Seeking a playing Host-backend clip: an MP4 whose I420 frames are sync samples only every
+// kSyncInterval frames. Checks the keyframe index taken from the sample table or scanned in the
+// background, then the first frame shown after a seek in each SeekMode and the seek statistics.
+
+#include "pch.h"
+#include "common.h"
+#include "options.h"
+#include "keyframeindex.h"
+#include "mediaclock.h"
+#include "player.h"
+#include "mediafixtures.h"
+#include "testing.h"
+#include <thread>
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int32_t kWidth = 32;
+constexpr int32_t kHeight = 16;
+constexpr int32_t kFps = 25;
+constexpr int64_t kFrameUs = 1000000 / kFps;
+constexpr int32_t kFrames = 60;
+constexpr int32_t kSyncInterval = 10;
+constexpr int64_t kDisplayPeriodNs = 11111111;  // 90 Hz
+constexpr int64_t kWaitNs = 5000000000LL;
+
+std::shared_ptr<IMediaBackend> CreateHostBackend() {
+    Options options;
+    options.MediaBackend = "Host";
+    options.IndexCacheDir = "";
+    return CreateMediaBackend(options);
+}
+
+// Forwards to a source but hides its sample table, as a container without one would.
+class CNoTableSource : public IMediaSource {
+public:
+    explicit CNoTableSource(std::shared_ptr<IMediaSource> source) : mSource(std::move(source)) {}
+    bool open(const char* source) override { return mSource->open(source); }
+    size_t getTrackCount() override { return mSource->getTrackCount(); }
+    bool getTrackInfo(size_t track, MediaTrackInfo& info) override { return mSource->getTrackInfo(track, info); }
+    bool selectTrack(size_t track) override { return mSource->selectTrack(track); }
+    int32_t getSampleTrackIndex() override { return mSource->getSampleTrackIndex(); }
+    int64_t getSampleTime() override { return mSource->getSampleTime(); }
+    uint32_t getSampleFlags() override { return mSource->getSampleFlags(); }
+    ssize_t readSampleData(uint8_t* buffer, size_t capacity) override { return mSource->readSampleData(buffer, capacity); }
+    bool advance() override { return mSource->advance(); }
+    bool seekTo(int64_t timeUs) override { return mSource->seekTo(timeUs); }
+
+private:
+    std::shared_ptr<IMediaSource> mSource;
+};
+
+void CheckKeyframes(CKeyframeIndex& index) {
+    TEST_CHECK(index.size() == (size_t)(kFrames + kSyncInterval - 1) / kSyncInterval);
+    TEST_CHECK(index.findAtOrBefore(13 * kFrameUs + 1000) == 10 * kFrameUs);
+    TEST_CHECK(index.findAtOrBefore(20 * kFrameUs) == 20 * kFrameUs);
+    TEST_CHECK(index.findAtOrAfter(13 * kFrameUs + 1000) == 20 * kFrameUs);
+    TEST_CHECK(index.findAtOrAfter(kFrames * kFrameUs) == 50 * kFrameUs);
+}
+
+void TestKeyframeIndex(IMediaBackend& backend, const std::string& clip) {
+    std::shared_ptr<IMediaSource> source = backend.createSource();
+    TEST_CHECK(source->open(clip.c_str()) && source->selectTrack(0));
+
+    // From the sample table: known before build() returns, even when a background scan is allowed.
+    CKeyframeIndex table;
+    TEST_CHECK(table.build(backend, *source, clip.c_str(), 0, true));
+    TEST_CHECK(table.ready() && !table.empty());
+    CheckKeyframes(table);
+    // The source was only asked for its table and is still at the first sample.
+    TEST_CHECK(source->getSampleTrackIndex() == 0 && source->getSampleTime() == 0);
+
+    // Without a table a local file is scanned on a thread; seeks use the demuxer's choice until then.
+    CNoTableSource noTable(source);
+    CKeyframeIndex scanned;
+    TEST_CHECK(scanned.build(backend, noTable, clip.c_str(), 0, true));
+    const int64_t deadline = CMediaClock::monotonicNow() + kWaitNs;
+    while (!scanned.ready() && CMediaClock::monotonicNow() < deadline) {
+        TEST_CHECK(scanned.findAtOrBefore(13 * kFrameUs) == 13 * kFrameUs);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    TEST_CHECK(scanned.ready());
+    CheckKeyframes(scanned);
+
+    // A scan still running when the index is rebuilt or destroyed is stopped, not waited out.
+    CKeyframeIndex abandoned;
+    TEST_CHECK(abandoned.build(backend, noTable, clip.c_str(), 0, true));
+    abandoned.clear();
+    TEST_CHECK(abandoned.ready() && abandoned.empty());
+
+    // A remote file is never scanned: that would download it whole.
+    CKeyframeIndex remote;
+    TEST_CHECK(!remote.build(backend, noTable, "http://127.0.0.1:1/clip.mp4", 0, true));
+    TEST_CHECK(remote.ready() && remote.empty());
+}
+
+// Polls the player as a display at kDisplayPeriodNs would, until it shows a frame.
+const MediaFrame* WaitForFrame(CPlayer& player) {
+    const int64_t deadline = CMediaClock::monotonicNow() + kWaitNs;
+    while (CMediaClock::monotonicNow() < deadline) {
+        const int64_t now = CMediaClock::monotonicNow();
+        if (const MediaFrame* frame = player.getFrame(now + kDisplayPeriodNs, kDisplayPeriodNs)) {
+            return frame;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return nullptr;
+}
+
+// Seeks to targetUs and checks the first frame shown after it is frame expectedFrame, decoded
+// after prerollFrames frames that only led up to it.
+void CheckSeek(CPlayer& player, int64_t targetUs, SeekMode mode, int32_t expectedFrame, uint64_t prerollFrames) {
+    const PipelineStats before = player.getStats();
+    const int64_t startNs = CMediaClock::monotonicNow();
+    TEST_CHECK(player.seek(targetUs, mode));
+    const MediaFrame* frame = WaitForFrame(player);
+    const int64_t elapsedNs = CMediaClock::monotonicNow() - startNs;
+    TEST_CHECK(frame != nullptr);
+    if (frame == nullptr) {
+        return;
+    }
+    TEST_CHECK(frame->pts == expectedFrame * kFrameUs * 1000);
+    TEST_CHECK(frame->width == kWidth && frame->height == kHeight);
+    TEST_CHECK(frame->data[0] == Y4mSample(expectedFrame, 0, 0, 0));
+
+    const PipelineStats stats = player.getStats();
+    TEST_CHECK(stats.seekCount == before.seekCount + 1);
+    TEST_CHECK(stats.seekPrerollFrames == prerollFrames);
+    TEST_CHECK(stats.lastSeekLatencyNs > 0 && stats.lastSeekLatencyNs <= elapsedNs);
+}
+
+void TestSeek(std::shared_ptr<IMediaBackend> backend, const std::string& clip) {
+    CPlayer player(backend, 4);
+    int32_t width = 0;
+    int32_t height = 0;
+    TEST_CHECK(player.setDataSource(clip.c_str(), width, height));
+    TEST_CHECK(width == kWidth && height == kHeight);
+    TEST_CHECK(!player.seek(0, seekModeExact));  // not started
+    TEST_CHECK(player.start());
+    const MediaFrame* first = WaitForFrame(player);
+    TEST_CHECK(first != nullptr && first->pts == 0);
+
+    // 1.33 s lies between frames 33 and 34, after the keyframe at 30 and before the one at 40.
+    const int64_t targetUs = 33 * kFrameUs + kFrameUs / 4;
+    CheckSeek(player, targetUs, seekModePreviousSync, 30, 0);
+    CheckSeek(player, targetUs, seekModeNextSync, 40, 0);
+    CheckSeek(player, targetUs, seekModeExact, 34, 4);
+    // Exact to a keyframe's own time, and back before the one the demuxer would pick as nearest.
+    CheckSeek(player, 20 * kFrameUs, seekModeExact, 20, 0);
+    CheckSeek(player, 19 * kFrameUs, seekModePreviousSync, 10, 0);
+    // Past the end: the last keyframe, then everything after it up to the last frame.
+    CheckSeek(player, 2 * kFrames * kFrameUs, seekModeNextSync, 50, 0);
+    CheckSeek(player, (kFrames - 1) * kFrameUs, seekModeExact, kFrames - 1, kFrames - 1 - 50);
+    player.stop();
+}
+}  // namespace
+
+int main() {
+    const std::string directory = MakeTempDirectory();
+    TEST_CHECK(!directory.empty());
+    const std::string clip = directory + "/clip.mp4";
+    TEST_CHECK(WriteRawMp4(clip, kWidth, kHeight, kFps, kFrames, kSyncInterval));
+
+    std::shared_ptr<IMediaBackend> backend = CreateHostBackend();
+    TestKeyframeIndex(*backend, clip);
+    TestSeek(backend, clip);
+    RemoveTempDirectory(directory);
+    return TestResult("test_playerseek");
+}
@@ -0,0 +1,154 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// CAmbisonicRenderer on fields with a known answer: an omnidirectional (W only) field sounds the
+// same in both ears whichever way the head turns, and a source encoded on the listener's left is
+// louder in the left ear, centred when the head turns to face it or away from it, and on the right
+// when the head turns around.
+
+#include "pch.h"
+#include "common.h"
+#include "spatialaudio.h"
+#include "testing.h"
+
+TEST_MAIN_STATE;
+
+namespace {
+
+constexpr int32_t kSampleRate = 48000;
+constexpr int32_t kBlocks = 200;
+constexpr int32_t kSettleBlocks = 8;    // the first blocks fade in the rotation and fill the convolution
+
+// Head orientation turned by yaw degrees about +y (to the left, seen from above), then pitched.
+void Orientation(float yawDegrees, float pitchDegrees, float* quaternion) {
+    const float yaw = yawDegrees * (float)M_PI / 360.0f;
+    const float pitch = pitchDegrees * (float)M_PI / 360.0f;
+    // q = yaw * pitch, pitch about +x.
+    quaternion[0] = std::cos(yaw) * std::sin(pitch);
+    quaternion[1] = std::sin(yaw) * std::cos(pitch);
+    quaternion[2] = -std::sin(yaw) * std::sin(pitch);
+    quaternion[3] = std::cos(yaw) * std::cos(pitch);
+}
+
+// Noise at about -12 dBFS, encoded as a plane wave from the ambisonic direction (x ahead, y left,
+// z up), or in W alone when omni is set.
+std::vector<int16_t> EncodeSource(int32_t order, float x, float y, float z, bool omni) {
+    const int32_t channels = (order + 1) * (order + 1);
+    const float sqrt3 = 1.7320508f;
+    const float harmonics[9] = {1.0f, y, z, x, sqrt3 * x * y, sqrt3 * y * z, 0.5f * (3 * z * z - 1), sqrt3 * x * z, 0.5f * sqrt3 * (x * x - y * y)};
+    std::vector<int16_t> pcm((size_t)kBlocks * CAmbisonicRenderer::kBlockFrames * channels, 0);
+    uint32_t seed = 12345;
+    for (size_t f = 0; f < pcm.size() / channels; f++) {
+        seed = seed * 1664525u + 1013904223u;
+        const float sample = ((seed >> 8) / 8388608.0f - 1.0f) * 8000.0f;
+        for (int32_t c = 0; c < (omni ? 1 : channels); c++) {
+            pcm[f * channels + c] = (int16_t)std::lrint(sample * harmonics[c]);
+        }
+    }
+    return pcm;
+}
+
+std::vector<int16_t> Render(CAmbisonicRenderer& renderer, const std::vector<int16_t>& pcm, const float orientation[4]) {
+    const int32_t blockSamples = CAmbisonicRenderer::kBlockFrames * renderer.channelCount();
+    std::vector<int16_t> out((size_t)kBlocks * CAmbisonicRenderer::kBlockFrames * 2);
+    for (int32_t b = 0; b < kBlocks; b++) {
+        renderer.process(&pcm[(size_t)b * blockSamples], orientation, &out[(size_t)b * CAmbisonicRenderer::kBlockFrames * 2]);
+    }
+    return out;
+}
+
+// Left minus right ear level in dB, after the renderer settled.
+double LeftOverRightDb(const std::vector<int16_t>& out) {
+    double left = 0.0;
+    double right = 0.0;
+    for (size_t f = (size_t)kSettleBlocks * CAmbisonicRenderer::kBlockFrames; f < out.size() / 2; f++) {
+        left += (double)out[2 * f] * out[2 * f];
+        right += (double)out[2 * f + 1] * out[2 * f + 1];
+    }
+    return 10.0 * std::log10(left / right);
+}
+
+int32_t MaxDifference(const std::vector<int16_t>& a, const std::vector<int16_t>& b, size_t from) {
+    int32_t difference = 0;
+    for (size_t i = from; i < a.size(); i++) {
+        difference = std::max(difference, std::abs(a[i] - b[i]));
+    }
+    return difference;
+}
+
+void TestOmniFieldIgnoresHead(int32_t order) {
+    const std::vector<int16_t> pcm = EncodeSource(order, 1, 0, 0, true);
+    const size_t settled = (size_t)kSettleBlocks * CAmbisonicRenderer::kBlockFrames * 2;
+    std::vector<int16_t> reference;
+    const float poses[][2] = {{0, 0}, {45, 0}, {90, 0}, {180, 0}, {-135, 30}, {20, -60}};
+    for (const auto& pose : poses) {
+        CAmbisonicRenderer renderer;
+        TEST_CHECK(renderer.configure(order, kSampleRate));
+        float orientation[4];
+        Orientation(pose[0], pose[1], orientation);
+        const std::vector<int16_t> out = Render(renderer, pcm, orientation);
+        int32_t peak = 0;
+        int32_t imbalance = 0;
+        for (size_t f = settled / 2; f < out.size() / 2; f++) {
+            peak = std::max(peak, std::abs((int32_t)out[2 * f]));
+            imbalance = std::max(imbalance, std::abs(out[2 * f] - out[2 * f + 1]));
+        }
+        TEST_CHECK(peak > 1000);        // it is heard at all
+        TEST_CHECK(imbalance <= 1);     // and identically in both ears
+        if (reference.empty()) {
+            reference = out;
+        } else {
+            TEST_CHECK(MaxDifference(out, reference, settled) <= 1);
+        }
+    }
+}
+
+void TestLeftSourceFollowsHead(int32_t order) {
+    const std::vector<int16_t> pcm = EncodeSource(order, 0, 1, 0, false);
+    double levels[4];
+    const float yaws[4] = {0, 90, -90, 180};
+    for (int32_t i = 0; i < 4; i++) {
+        CAmbisonicRenderer renderer;
+        TEST_CHECK(renderer.configure(order, kSampleRate));
+        float orientation[4];
+        Orientation(yaws[i], 0, orientation);
+        levels[i] = LeftOverRightDb(Render(renderer, pcm, orientation));
+    }
+    printf("order %d, source on the left: L-R %+.1f dB facing ahead, %+.1f dB facing it, %+.1f dB facing away, %+.1f dB turned around\n",
+           order, levels[0], levels[1], levels[2], levels[3]);
+    TEST_CHECK(levels[0] > 6.0);
+    TEST_CHECK(std::fabs(levels[1]) < 0.5);
+    TEST_CHECK(std::fabs(levels[2]) < 0.5);
+    TEST_CHECK(levels[3] < -6.0);
+    TEST_CHECK(std::fabs(levels[0] + levels[3]) < 0.5);    // the layout is mirror-symmetric
+}
+
+void TestResetAndConfigure() {
+    CAmbisonicRenderer renderer;
+    TEST_CHECK(!renderer.configure(0, kSampleRate));
+    TEST_CHECK(!renderer.configure(3, kSampleRate));
+    TEST_CHECK(!renderer.configure(1, 0));
+    TEST_CHECK(renderer.configure(1, kSampleRate) && renderer.channelCount() == 4 && renderer.activeOrder() == 1);
+    TEST_CHECK(renderer.configure(2, kSampleRate) && renderer.channelCount() == 9);
+
+    // After reset() the convolution starts from silence, as on a freshly configured renderer.
+    const std::vector<int16_t> pcm = EncodeSource(2, 0.6f, 0.8f, 0, false);
+    float orientation[4];
+    Orientation(30, 10, orientation);
+    Render(renderer, pcm, orientation);
+    renderer.reset();
+    CAmbisonicRenderer fresh;
+    TEST_CHECK(fresh.configure(2, kSampleRate));
+    Render(fresh, std::vector<int16_t>(pcm.size(), 0), orientation);    // same rotation, no history
+    fresh.reset();
+    TEST_CHECK(Render(renderer, pcm, orientation) == Render(fresh, pcm, orientation));
+}
+}  // namespace
+
+int main() {
+    for (int32_t order : {1, 2}) {
+        TestOmniFieldIgnoresHead(order);
+        TestLeftSourceFollowsHead(order);
+    }
+    TestResetAndConfigure();
+    return TestResult("test_spatialaudio");
+}
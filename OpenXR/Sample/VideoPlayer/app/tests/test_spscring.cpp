@@ -0,0 +1,141 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// SpscRing on one thread, where every call is exact: capacity rounding, at() behind front(),
+// indices wrapping the slot array, and move-only items. Then a producer
+// and a consumer thread, checking that every item arrives once and in order.
+
+#include <stdio.h>
+#include <memory>
+#include <thread>
+#include "spscring.h"
+#include "testing.h"
+
+TEST_MAIN_STATE;
+
+namespace {
+
+void TestCapacity() {
+    // The slot array rounds up to a power of two, but push() stops at the requested capacity.
+    for (uint32_t capacity : {1u, 2u, 3u, 5u, 8u, 13u}) {
+        SpscRing<int> ring(capacity);
+        TEST_CHECK(ring.capacity() == capacity);
+        TEST_CHECK(ring.empty() && ring.size() == 0);
+        for (uint32_t i = 0; i < capacity; i++) {
+            TEST_CHECK(!ring.full());
+            TEST_CHECK(ring.push(int(i)));
+        }
+        TEST_CHECK(ring.full());
+        int rejected = 99;
+        TEST_CHECK(!ring.push(std::move(rejected)));
+        TEST_CHECK(ring.size() == capacity);
+        ring.pop();
+        TEST_CHECK(!ring.full() && ring.size() == capacity - 1);
+    }
+    SpscRing<int> zero(0);    // treated as one slot
+    TEST_CHECK(zero.capacity() == 1);
+    TEST_CHECK(zero.push(1) && !zero.push(2));
+}
+
+void TestAt() {
+    SpscRing<int> ring(4);
+    TEST_CHECK(ring.at(0) == nullptr);
+    for (int i = 0; i < 3; i++) {
+        TEST_CHECK(ring.push(10 + i));
+    }
+    TEST_CHECK(ring.at(0) == ring.front());
+    TEST_CHECK(*ring.at(0) == 10 && *ring.at(1) == 11 && *ring.at(2) == 12);
+    TEST_CHECK(ring.at(3) == nullptr);
+    ring.pop();
+    TEST_CHECK(*ring.at(0) == 11 && *ring.at(1) == 12 && ring.at(2) == nullptr);
+    TEST_CHECK(ring.push(13) && ring.push(14));
+    TEST_CHECK(*ring.at(3) == 14 && ring.at(4) == nullptr);
+}
+
+// Runs the indices many times round a 3-item ring in an array of 4 slots, with the occupancy
+// changing as it goes.
+void TestWrapAround() {
+    SpscRing<uint32_t> ring(3);
+    uint32_t pushed = 0;
+    uint32_t popped = 0;
+    bool inOrder = true;
+    for (uint32_t step = 0; step < 1000; step++) {
+        const uint32_t burst = step % 4;
+        for (uint32_t i = 0; i < burst; i++) {
+            uint32_t value = pushed;
+            if (ring.push(std::move(value))) {
+                pushed++;
+            }
+        }
+        const uint32_t drain = (step * 7) % 4;
+        for (uint32_t i = 0; i < drain && !ring.empty(); i++) {
+            inOrder = inOrder && *ring.front() == popped;
+            ring.pop();
+            popped++;
+        }
+        inOrder = inOrder && ring.size() == pushed - popped && ring.size() <= 3;
+    }
+    TEST_CHECK(inOrder);
+    TEST_CHECK(pushed > 1000);
+}
+
+void TestMoveOnly() {
+    SpscRing<std::unique_ptr<int>> ring(2);
+    std::unique_ptr<int> a(new int(1));
+    std::unique_ptr<int> b(new int(2));
+    std::unique_ptr<int> c(new int(3));
+    TEST_CHECK(ring.push(std::move(a)) && a == nullptr);
+    TEST_CHECK(ring.push(std::move(b)) && b == nullptr);
+    TEST_CHECK(!ring.push(std::move(c)));
+    TEST_CHECK(c != nullptr && *c == 3);    // a full ring leaves the item with the caller
+
+    std::weak_ptr<int> watch;
+    {
+        SpscRing<std::shared_ptr<int>> shared(2);
+        std::shared_ptr<int> item = std::make_shared<int>(4);
+        watch = item;
+        TEST_CHECK(shared.push(std::move(item)));
+        shared.pop();
+        TEST_CHECK(watch.expired());    // pop() releases the slot's item, not the next push()
+    }
+
+    std::unique_ptr<int> taken = std::move(*ring.front());
+    ring.pop();
+    TEST_CHECK(taken != nullptr && *taken == 1);
+    TEST_CHECK(ring.push(std::move(c)));
+    TEST_CHECK(**ring.at(0) == 2 && **ring.at(1) == 3);
+}
+
+void TestThreads() {
+    constexpr uint32_t kItems = 200000;
+    SpscRing<std::unique_ptr<uint32_t>> ring(5);
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < kItems; i++) {
+            std::unique_ptr<uint32_t> item(new uint32_t(i));
+            while (!ring.push(std::move(item))) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    bool inOrder = true;
+    for (uint32_t i = 0; i < kItems; i++) {
+        std::unique_ptr<uint32_t>* slot;
+        while ((slot = ring.front()) == nullptr) {
+            std::this_thread::yield();
+        }
+        inOrder = inOrder && *slot != nullptr && **slot == i;
+        ring.pop();
+    }
+    producer.join();
+    TEST_CHECK(inOrder);
+    TEST_CHECK(ring.empty());
+}
+}  // namespace
+
+int main() {
+    TestCapacity();
+    TestAt();
+    TestWrapAround();
+    TestMoveOnly();
+    TestThreads();
+    return TestResult("test_spscring");
+}
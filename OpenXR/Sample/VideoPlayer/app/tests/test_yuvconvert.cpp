@@ -0,0 +1,132 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// The yuvconvert helpers on decoder layouts with and without row padding: GetYuv420BufferSize is
+// one past the last byte a packed upload reads, and CopyPlane and InterleaveChromaRows produce the
+// tightly packed planes the texture upload expects.
+
+#include "pch.h"
+#include "common.h"
+#include "yuvconvert.h"
+#include "testing.h"
+
+TEST_MAIN_STATE;
+
+namespace {
+
+struct Layout {
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    int32_t sliceHeight;
+};
+
+const Layout kLayouts[] = {
+    {64, 32, 64, 32},       // unpadded
+    {38, 22, 64, 32},       // padded rows and rows after the picture
+    {30, 18, 32, 18},       // padded rows only
+    {1920, 1080, 1920, 1088},
+    {16, 2, 16, 2},         // a single chroma row
+};
+
+uint8_t Pattern(size_t offset) {
+    return (uint8_t)(offset * 131 + (offset >> 8) * 7 + 1);
+}
+
+// Offsets of the luma and chroma samples a packed upload reads, as Android lays the planes out.
+size_t LumaOffset(const Layout& l, int32_t x, int32_t y) {
+    return (size_t)y * l.stride + x;
+}
+
+size_t ChromaOffset(const Layout& l, bool planarChroma, int32_t x, int32_t y, int32_t component) {
+    const size_t chroma = (size_t)l.stride * l.sliceHeight;
+    if (planarChroma) {
+        const size_t chromaStride = (size_t)l.stride / 2;
+        return chroma + component * chromaStride * (l.sliceHeight / 2) + y * chromaStride + x;
+    }
+    return chroma + (size_t)y * l.stride + 2 * x + component;
+}
+
+void TestLayout(const Layout& l, bool planarChroma) {
+    const size_t size = GetYuv420BufferSize(l.width, l.height, l.stride, l.sliceHeight, planarChroma);
+    const int32_t chromaWidth = l.width / 2;
+    const int32_t chromaRows = l.height / 2;
+    size_t end = 0;
+    for (int32_t y = 0; y < l.height; y++) {
+        end = std::max(end, LumaOffset(l, l.width - 1, y) + 1);
+    }
+    for (int32_t y = 0; y < chromaRows; y++) {
+        end = std::max(end, ChromaOffset(l, planarChroma, chromaWidth - 1, y, 1) + 1);
+    }
+    TEST_CHECK(size == end);
+
+    // Exactly size bytes, so that a read past the end shows up under a sanitizer.
+    std::vector<uint8_t> buffer(size);
+    for (size_t i = 0; i < size; i++) {
+        buffer[i] = Pattern(i);
+    }
+    std::vector<uint8_t> luma((size_t)l.width * l.height);
+    std::vector<uint8_t> uv((size_t)chromaWidth * 2 * chromaRows);
+    CopyPlane(buffer.data(), l.stride, luma.data(), l.width, l.width, l.height);
+    const uint8_t* chroma = buffer.data() + (size_t)l.stride * l.sliceHeight;
+    if (planarChroma) {
+        const size_t chromaStride = (size_t)l.stride / 2;
+        InterleaveChromaRows(chroma, chroma + chromaStride * (l.sliceHeight / 2), chromaStride, uv.data(), (size_t)chromaWidth * 2, chromaWidth,
+                             chromaRows);
+    } else {
+        CopyPlane(chroma, l.stride, uv.data(), (size_t)chromaWidth * 2, (size_t)chromaWidth * 2, chromaRows);
+    }
+
+    bool lumaMatches = true;
+    for (int32_t y = 0; y < l.height; y++) {
+        for (int32_t x = 0; x < l.width; x++) {
+            lumaMatches = lumaMatches && luma[(size_t)y * l.width + x] == Pattern(LumaOffset(l, x, y));
+        }
+    }
+    bool chromaMatches = true;
+    for (int32_t y = 0; y < chromaRows; y++) {
+        for (int32_t x = 0; x < chromaWidth; x++) {
+            for (int32_t c = 0; c < 2; c++) {
+                chromaMatches = chromaMatches && uv[((size_t)y * chromaWidth + x) * 2 + c] == Pattern(ChromaOffset(l, planarChroma, x, y, c));
+            }
+        }
+    }
+    TEST_CHECK(lumaMatches);
+    TEST_CHECK(chromaMatches);
+}
+
+void TestInvalidLayouts() {
+    TEST_CHECK(GetYuv420BufferSize(0, 16, 16, 16, false) == 0);
+    TEST_CHECK(GetYuv420BufferSize(16, 0, 16, 16, false) == 0);
+    TEST_CHECK(GetYuv420BufferSize(16, 16, 8, 16, false) == 0);    // stride below the width
+    TEST_CHECK(GetYuv420BufferSize(16, 16, 16, 8, true) == 0);     // slice height below the height
+    TEST_CHECK(GetYuv420BufferSize(16, 16, 16, 16, false) == 16 * 16 * 3 / 2);
+    TEST_CHECK(GetYuv420BufferSize(16, 16, 16, 16, true) == 16 * 16 * 3 / 2);
+}
+
+void TestInterleaveChroma() {
+    // Lengths around the 16-sample vector width, so the scalar tail runs too.
+    for (size_t count : {0, 1, 15, 16, 17, 33, 100}) {
+        std::vector<uint8_t> u(count), v(count), uv(2 * count + 1, 0xAA);
+        for (size_t i = 0; i < count; i++) {
+            u[i] = (uint8_t)(i * 3);
+            v[i] = (uint8_t)(255 - i);
+        }
+        InterleaveChroma(u.data(), v.data(), uv.data(), count);
+        bool matches = uv[2 * count] == 0xAA;
+        for (size_t i = 0; i < count; i++) {
+            matches = matches && uv[2 * i] == u[i] && uv[2 * i + 1] == v[i];
+        }
+        TEST_CHECK(matches);
+    }
+}
+}  // namespace
+
+int main() {
+    for (const Layout& layout : kLayouts) {
+        TestLayout(layout, false);
+        TestLayout(layout, true);
+    }
+    TestInvalidLayouts();
+    TestInterleaveChroma();
+    return TestResult("test_yuvconvert");
+}
@@ -0,0 +1,50 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Checks and timing shared by the host tests and benchmarks. Tests print every failed check and
+// return TestResult() from main(), so CTest sees a non-zero exit status.
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+
+extern int g_testFailures;
+
+#define TEST_CHECK(exp)                                                              \
+    do {                                                                             \
+        if (!(exp)) {                                                                \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #exp);  \
+            g_testFailures++;                                                        \
+        }                                                                            \
+    } while (0)
+
+// Defines g_testFailures; use once, in the file with main().
+#define TEST_MAIN_STATE int g_testFailures = 0
+
+inline int TestResult(const char* name) {
+    if (g_testFailures != 0) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, g_testFailures);
+        return 1;
+    }
+    printf("%s: passed\n", name);
+    return 0;
+}
+
+inline int64_t TestNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Best of 'runs' timings of f(), in nanoseconds: the run least disturbed by the rest of the system.
+template <typename F>
+int64_t BenchBestNs(int32_t runs, F f) {
+    int64_t best = INT64_MAX;
+    for (int32_t i = 0; i < runs; i++) {
+        const int64_t start = TestNowNs();
+        f();
+        const int64_t elapsed = TestNowNs() - start;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,312 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Seek-bar previews: keyframes decoded in the background into one cached thumbnail atlas.
+
+#include "pch.h"
+#include "common.h"
+#include "thumbnailatlas.h"
+#include "keyframeindex.h"
+#include "mediaclock.h"
+#include <algorithm>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+namespace {
+
+constexpr const char* kCacheKind = "thumbnails";
+constexpr int32_t kStrideAlignment = 16;        // decoder output stride, as CPlayer assumes
+constexpr int64_t kDecoderPollUs = 10000;
+
+// Box filter: every destination sample averages the source rectangle it covers. components
+// interleaved samples per pixel (2 for NV12 chroma) are averaged separately.
+void Downsample(const uint8_t* src, int32_t srcStride, int32_t srcWidth, int32_t srcHeight, int32_t components,
+                uint8_t* dst, int32_t dstStride, int32_t dstWidth, int32_t dstHeight) {
+    for (int32_t y = 0; y < dstHeight; y++) {
+        const int32_t y0 = y * srcHeight / dstHeight;
+        const int32_t y1 = std::max(y0 + 1, (y + 1) * srcHeight / dstHeight);
+        for (int32_t x = 0; x < dstWidth; x++) {
+            const int32_t x0 = x * srcWidth / dstWidth;
+            const int32_t x1 = std::max(x0 + 1, (x + 1) * srcWidth / dstWidth);
+            const uint32_t count = (uint32_t)((y1 - y0) * (x1 - x0));
+            for (int32_t c = 0; c < components; c++) {
+                uint32_t sum = 0;
+                for (int32_t sy = y0; sy < y1; sy++) {
+                    const uint8_t* row = src + (size_t)sy * srcStride + c;
+                    for (int32_t sx = x0; sx < x1; sx++) {
+                        sum += row[sx * components];
+                    }
+                }
+                dst[(size_t)y * dstStride + x * components + c] = (uint8_t)((sum + count / 2) / count);
+            }
+        }
+    }
+}
+}  // namespace
+
+CThumbnailAtlas::CThumbnailAtlas(std::shared_ptr<IMediaBackend> backend, std::function<bool()> busy)
+    : mBackend(std::move(backend)), mBusy(std::move(busy)) {
+    ksSignal_Create(&mStopWake, false);
+}
+
+CThumbnailAtlas::~CThumbnailAtlas() {
+    stop();
+    ksSignal_Destroy(&mStopWake);
+}
+
+bool CThumbnailAtlas::start(const std::string& source) {
+    mStartNs = CMediaClock::monotonicNow();
+    if (load(source)) {
+        mTotalNs = CMediaClock::monotonicNow() - mStartNs;
+        Log::Write(Log::Level::Info, Fmt("thumbnails: %d tiles %dx%d loaded from cache in %lld us", (int32_t)mTimesUs.size(), mTileWidth, mTileHeight,
+                                         (long long)(mTotalNs / 1000)));
+        return true;
+    }
+    ksSignal_Clear(&mStopWake);
+    mRunning = true;
+    mThread = std::thread(&CThumbnailAtlas::run, this, source);
+    return true;
+}
+
+void CThumbnailAtlas::stop() {
+    mRunning = false;
+    ksSignal_Raise(&mStopWake);
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+int32_t CThumbnailAtlas::atlasHeight() const {
+    const int32_t rows = ((int32_t)mTimesUs.size() + kColumns - 1) / kColumns;
+    return rows * mTileHeight;
+}
+
+int32_t CThumbnailAtlas::findTile(int64_t timeUs) const {
+    if (!ready() || mTimesUs.empty()) {
+        return -1;
+    }
+    auto it = std::upper_bound(mTimesUs.begin(), mTimesUs.end(), timeUs);
+    return it == mTimesUs.begin() ? 0 : (int32_t)(it - mTimesUs.begin() - 1);
+}
+
+ThumbnailStats CThumbnailAtlas::getStats() const {
+    ThumbnailStats stats;
+    stats.thumbnails = ready() ? (uint32_t)mTimesUs.size() : 0;
+    stats.decoded = mDecoded;
+    stats.failed = mFailed;
+    stats.yields = mYields;
+    stats.decodeNs = mDecodeNs;
+    stats.throttledNs = mThrottledNs;
+    stats.totalNs = mTotalNs;
+    stats.fromCache = mFromCache;
+    return stats;
+}
+
+bool CThumbnailAtlas::pause(int64_t ns) {
+    if (ns > 0) {
+        const int64_t startNs = CMediaClock::monotonicNow();
+        ksSignal_Wait(&mStopWake, ns);
+        mThrottledNs += CMediaClock::monotonicNow() - startNs;
+    }
+    return mRunning;
+}
+
+void CThumbnailAtlas::run(std::string source) {
+    // Per-thread on Linux: only this job drops below the decode and render threads.
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), kNiceness);
+
+    std::shared_ptr<IMediaSource> demuxer = mBackend->createSource();
+    if (demuxer == nullptr || !demuxer->open(source.c_str())) {
+        Log::Write(Log::Level::Error, Fmt("thumbnails: open %s error", source.c_str()));
+        return;
+    }
+    MediaTrackInfo info;
+    int32_t track = -1;
+    for (size_t i = 0; i < demuxer->getTrackCount() && track < 0; i++) {
+        if (demuxer->getTrackInfo(i, info) && info.type == mediaTypeVideo) {
+            track = (int32_t)i;
+        }
+    }
+    CKeyframeIndex keyframes;
+    if (track < 0 || info.width <= 0 || info.height <= 0 || info.durationUs <= 0 || !demuxer->selectTrack(track) ||
+        !keyframes.build(*mBackend, *demuxer, source.c_str(), track, false)) {
+        Log::Write(Log::Level::Error, Fmt("thumbnails: %s has no video keyframes to show", source.c_str()));
+        return;
+    }
+    std::shared_ptr<IMediaDecoder> decoder = mBackend->createDecoder(*demuxer, track);
+    if (decoder == nullptr || !decoder->start()) {
+        Log::Write(Log::Level::Error, Fmt("thumbnails: create decoder %s error", info.mime.c_str()));
+        return;
+    }
+
+    // Evenly spaced positions, each snapped back to its keyframe; short GOP-less clips collapse to fewer tiles.
+    std::vector<int64_t> timesUs;
+    for (size_t i = 0; i < kMaxTiles; i++) {
+        const int64_t timeUs = keyframes.findAtOrBefore(info.durationUs * (int64_t)i / (int64_t)kMaxTiles);
+        if (timesUs.empty() || timeUs > timesUs.back()) {
+            timesUs.push_back(timeUs);
+        }
+    }
+    mTimesUs = std::move(timesUs);
+    mTileHeight = std::max(2, (int32_t)((int64_t)kTileWidth * info.height / info.width) & ~1);
+    mImage.assign((size_t)atlasWidth() * atlasHeight() * 3 / 2, 0);
+    std::fill(mImage.begin() + (size_t)atlasWidth() * atlasHeight(), mImage.end(), 128);
+    mSampleBuffer.resize(info.maxInputSize > 0 ? info.maxInputSize : 4 * 1024 * 1024);
+
+    for (size_t tile = 0; tile < mTimesUs.size(); tile++) {
+        while (mBusy && mBusy()) {
+            mYields++;
+            if (!pause(kBusyPollNs)) {
+                break;
+            }
+        }
+        if (!mRunning) {
+            break;
+        }
+        const int64_t startNs = CMediaClock::monotonicNow();
+        if (decodeTile(*demuxer, *decoder, info, mTimesUs[tile], tile)) {
+            mDecoded++;
+        } else {
+            mFailed++;
+        }
+        const int64_t decodeNs = CMediaClock::monotonicNow() - startNs;
+        mDecodeNs += decodeNs;
+        if (!pause(decodeNs * (100 - kDutyCyclePercent) / kDutyCyclePercent)) {
+            break;
+        }
+    }
+    decoder->stop();
+    if (!mRunning) {
+        Log::Write(Log::Level::Info, Fmt("thumbnails: stopped after %u of %d tiles", mDecoded.load(), (int32_t)mTimesUs.size()));
+        return;
+    }
+    mAtlas = mImage.data();
+    mTotalNs = CMediaClock::monotonicNow() - mStartNs;
+    mReady.store(true, std::memory_order_release);
+    Log::Write(Log::Level::Info, Fmt("thumbnails: %d tiles %dx%d, %u decoded, %u failed in %lld ms (decoding %lld ms, throttled %lld ms, %u yields)",
+                                     (int32_t)mTimesUs.size(), mTileWidth, mTileHeight, mDecoded.load(), mFailed.load(),
+                                     (long long)(mTotalNs / 1000000), (long long)(mDecodeNs / 1000000), (long long)(mThrottledNs / 1000000), mYields.load()));
+    if (mFailed == 0) {
+        store(source);
+    }
+}
+
+bool CThumbnailAtlas::decodeTile(IMediaSource& source, IMediaDecoder& decoder, const MediaTrackInfo& info, int64_t timeUs, size_t tile) {
+    if (!source.seekTo(timeUs) || source.getSampleTrackIndex() < 0) {
+        return false;
+    }
+    decoder.flush();
+    size_t size = 0;
+    const uint8_t* sample = source.getSampleData(size);
+    if (sample == nullptr) {
+        const ssize_t read = source.readSampleData(mSampleBuffer.data(), mSampleBuffer.size());
+        if (read <= 0) {
+            return false;
+        }
+        sample = mSampleBuffer.data();
+        size = (size_t)read;
+    }
+    const int64_t sampleTimeUs = source.getSampleTime();
+
+    // The sync sample, then end of stream so the decoder hands its picture out without waiting for more.
+    const int64_t deadlineNs = CMediaClock::monotonicNow() + kDecodeTimeoutUs * 1000;
+    bool queued = false;
+    bool ended = false;
+    while (!ended && mRunning && CMediaClock::monotonicNow() < deadlineNs) {
+        ssize_t bufferIdx = decoder.dequeueInputBuffer(kDecoderPollUs);
+        if (bufferIdx < 0) {
+            continue;
+        }
+        if (!queued) {
+            size_t capacity = 0;
+            uint8_t* buffer = decoder.getInputBuffer(bufferIdx, &capacity);
+            memcpy(buffer, sample, std::min(size, capacity));
+            decoder.queueInputBuffer(bufferIdx, std::min(size, capacity), sampleTimeUs, 0);
+            queued = true;
+        } else {
+            decoder.queueInputBuffer(bufferIdx, 0, sampleTimeUs, IMediaDecoder::kFlagEndOfStream);
+            ended = true;
+        }
+    }
+
+    while (ended && mRunning && CMediaClock::monotonicNow() < deadlineNs) {
+        DecoderBufferInfo output;
+        ssize_t bufferIdx = decoder.dequeueOutputBuffer(output, kDecoderPollUs);
+        if (bufferIdx < 0) {
+            continue;
+        }
+        uint8_t* picture = decoder.getOutputBuffer(bufferIdx);
+        if (picture == nullptr || output.size <= 0) {
+            decoder.releaseOutputBuffer(bufferIdx, false);
+            if (output.flags & IMediaDecoder::kFlagEndOfStream) {
+                return false;
+            }
+            continue;
+        }
+        int32_t width = info.width;
+        int32_t height = info.height;
+        decoder.getOutputSize(width, height);
+        const int32_t stride = (width + kStrideAlignment - 1) / kStrideAlignment * kStrideAlignment;
+        const int32_t sliceHeight = (height + kStrideAlignment - 1) / kStrideAlignment * kStrideAlignment;
+        picture += output.offset;
+
+        const int32_t atlasStride = atlasWidth();
+        const int32_t tileX = (int32_t)(tile % kColumns) * mTileWidth;
+        const int32_t tileY = (int32_t)(tile / kColumns) * mTileHeight;
+        uint8_t* luma = mImage.data() + (size_t)tileY * atlasStride + tileX;
+        uint8_t* chroma = mImage.data() + (size_t)atlasStride * atlasHeight() + (size_t)(tileY / 2) * atlasStride + tileX;
+        if ((size_t)output.size >= (size_t)stride * sliceHeight * 3 / 2) {
+            Downsample(picture, stride, width, height, 1, luma, atlasStride, mTileWidth, mTileHeight);
+            Downsample(picture + (size_t)stride * sliceHeight, stride, width / 2, height / 2, 2, chroma, atlasStride, mTileWidth / 2, mTileHeight / 2);
+        }
+        decoder.releaseOutputBuffer(bufferIdx, false);
+        return true;
+    }
+    return false;
+}
+
+bool CThumbnailAtlas::load(const std::string& source) {
+    std::shared_ptr<CIndexCache> cache = mBackend->getIndexCache();
+    std::shared_ptr<CIndexCacheEntry> entry = cache ? cache->load(source.c_str(), kCacheKind) : nullptr;
+    if (entry == nullptr) {
+        return false;
+    }
+    CIndexReader reader(entry->data(), entry->size());
+    const int32_t tileWidth = reader.get<int32_t>();
+    const int32_t tileHeight = reader.get<int32_t>();
+    const int32_t columns = reader.get<int32_t>();
+    const size_t count = (size_t)reader.get<uint64_t>();
+    const int64_t* times = reader.getArray<int64_t>(count);
+    const size_t atlasSize = (size_t)reader.get<uint64_t>();
+    const uint8_t* atlas = reader.getArray<uint8_t>(atlasSize);
+    if (reader.failed() || tileWidth != kTileWidth || columns != kColumns || count == 0 || count > kMaxTiles) {
+        return false;
+    }
+    mTileHeight = tileHeight;
+    mTimesUs.assign(times, times + count);
+    if (atlasSize != (size_t)atlasWidth() * atlasHeight() * 3 / 2) {
+        mTimesUs.clear();
+        return false;
+    }
+    mCacheEntry = std::move(entry);
+    mAtlas = atlas;
+    mFromCache = true;
+    mReady.store(true, std::memory_order_release);
+    return true;
+}
+
+void CThumbnailAtlas::store(const std::string& source) {
+    std::shared_ptr<CIndexCache> cache = mBackend->getIndexCache();
+    if (cache == nullptr) {
+        return;
+    }
+    CIndexWriter writer;
+    writer.put<int32_t>(mTileWidth);
+    writer.put<int32_t>(mTileHeight);
+    writer.put<int32_t>(kColumns);
+    writer.put<uint64_t>(mTimesUs.size());
+    writer.putArray(mTimesUs.data(), mTimesUs.size());
+    writer.put<uint64_t>(mImage.size());
+    writer.putArray(mImage.data(), mImage.size());
+    cache->store(source.c_str(), kCacheKind, writer.payload());
+}
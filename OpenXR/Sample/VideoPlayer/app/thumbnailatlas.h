@@ -0,0 +1,121 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Seek-bar previews: keyframes decoded in the background into one cached thumbnail atlas.
+
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mediabackend.h"
+#include "indexcache.h"
+#include "utils/threading.h"
+
+typedef struct ThumbnailStats_tag {
+    ThumbnailStats_tag() : thumbnails(0), decoded(0), failed(0), yields(0), decodeNs(0), throttledNs(0), totalNs(0), fromCache(false) {};
+    uint32_t thumbnails;    // tiles in the atlas
+    uint32_t decoded;       // keyframes decoded by this run; 0 when the atlas came from the cache
+    uint32_t failed;        // keyframes that produced no picture
+    uint32_t yields;        // times the job paused because playback was busy
+    int64_t decodeNs;       // seeking, decoding and downsampling
+    int64_t throttledNs;    // waiting, for playback or to keep to the duty cycle
+    int64_t totalNs;        // start() to the atlas being ready
+    bool fromCache;
+}ThumbnailStats;
+
+// Picks up to kMaxTiles keyframes spread evenly over the video track and decodes each one on its
+// own (seek, one sync sample, end of stream) with a decoder of its own, so no frame that depends
+// on others is ever decoded. Each picture is box-filtered down to a tile of an NV12 atlas laid out
+// like the frames the renderer uploads, kColumns tiles per row. The job runs on a niced thread,
+// waits while busy() reports that playback needs the CPU or decoder, and sleeps between tiles so
+// that it decodes for at most kDutyCyclePercent of the wall time. The finished atlas is stored in
+// the backend's index cache and mapped from there on the next start.
+class CThumbnailAtlas {
+
+public:
+    // busy() is polled from the job thread between tiles.
+    CThumbnailAtlas(std::shared_ptr<IMediaBackend> backend, std::function<bool()> busy);
+
+    ~CThumbnailAtlas();
+
+    CThumbnailAtlas(const CThumbnailAtlas&) = delete;
+    CThumbnailAtlas& operator=(const CThumbnailAtlas&) = delete;
+
+    // Maps the cached atlas of source, or starts the job that builds it. Call once.
+    bool start(const std::string& source);
+
+    // Abandons a job still running; nothing is cached then.
+    void stop();
+
+    // The accessors below may be used once this returns true.
+    bool ready() const { return mReady.load(std::memory_order_acquire); }
+
+    int32_t tileWidth() const { return mTileWidth; }
+
+    int32_t tileHeight() const { return mTileHeight; }
+
+    int32_t atlasWidth() const { return mTileWidth * kColumns; }
+
+    int32_t atlasHeight() const;
+
+    size_t tileCount() const { return mTimesUs.size(); }
+
+    // NV12: atlasWidth() x atlasHeight() luma, then interleaved chroma at half resolution.
+    const uint8_t* atlas() const { return mAtlas; }
+
+    // The tile to show for a seek-bar position: the latest thumbnail at or before timeUs (the
+    // first one if timeUs precedes it), or -1 before ready().
+    int32_t findTile(int64_t timeUs) const;
+
+    int64_t tileTime(size_t tile) const { return mTimesUs[tile]; }
+
+    ThumbnailStats getStats() const;
+
+    static constexpr int32_t  kTileWidth = 160;            // tile height follows the picture's aspect ratio
+    static constexpr int32_t  kColumns = 10;
+    static constexpr size_t   kMaxTiles = 100;
+    static constexpr int32_t  kDutyCyclePercent = 25;
+    static constexpr int32_t  kNiceness = 10;              // below every playback thread
+    static constexpr int64_t  kBusyPollNs = 50 * 1000 * 1000;
+    static constexpr int64_t  kDecodeTimeoutUs = 1000000;  // per keyframe, from its input to its picture
+
+private:
+    void run(std::string source);
+
+    // Decodes the sync sample at or before timeUs into tile. False if no picture came out.
+    bool decodeTile(IMediaSource& source, IMediaDecoder& decoder, const MediaTrackInfo& info, int64_t timeUs, size_t tile);
+
+    bool load(const std::string& source);
+
+    void store(const std::string& source);
+
+    // Sleeps up to ns; false once stop() was called.
+    bool pause(int64_t ns);
+
+    std::shared_ptr<IMediaBackend> mBackend;
+    std::function<bool()> mBusy;
+    std::thread      mThread;
+    ksSignal         mStopWake;    // manual reset, raised by stop()
+    std::atomic<bool> mRunning{false};
+    std::atomic<bool> mReady{false};
+
+    int32_t          mTileWidth = kTileWidth;
+    int32_t          mTileHeight = 0;
+    std::vector<int64_t> mTimesUs;                  // ascending, one per tile
+    std::vector<uint8_t> mImage;                    // the atlas as built by this run
+    std::shared_ptr<CIndexCacheEntry> mCacheEntry;  // or as mapped from the cache
+    const uint8_t*   mAtlas = nullptr;
+    std::vector<uint8_t> mSampleBuffer;
+
+    std::atomic<uint32_t> mDecoded{0};
+    std::atomic<uint32_t> mFailed{0};
+    std::atomic<uint32_t> mYields{0};
+    std::atomic<int64_t> mDecodeNs{0};
+    std::atomic<int64_t> mThrottledNs{0};
+    std::atomic<int64_t> mTotalNs{0};
+    bool             mFromCache = false;
+    int64_t          mStartNs = 0;
+};
@@ -3,8 +3,7 @@
 precision highp float;
 
 layout(binding = 1) uniform sampler2D texSamplery;
-layout(binding = 2) uniform sampler2D texSampleru;
-layout(binding = 3) uniform sampler2D texSamplerv;
+layout(binding = 2) uniform sampler2D texSampleruv;
 
 layout(location = 0) in vec2 fragTexCoord;
 layout(location = 0) out vec4 outColor;
@@ -26,9 +25,11 @@ vec4 sRGBToLinearRGB(vec4 srgba)
 void main() {
 	vec3 yuv;
 	vec3 rgb;
+	vec4 uv;
 	yuv.r = texture(texSamplery, fragTexCoord).r;
-	yuv.g = texture(texSampleru, fragTexCoord).r - 0.5;
-	yuv.b = texture(texSamplerv, fragTexCoord).r - 0.5;
+	uv = texture(texSampleruv, fragTexCoord);
+	yuv.g = uv.r - 0.5;
+	yuv.b = uv.g - 0.5;
     rgb = mat3 (1.0,      1.0,      1.0,
                 0.0,     -0.21482,  2.12798,
                 1.28033, -0.38059,  0.0) * yuv;
@@ -0,0 +1,72 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Packing of decoded YUV planes for texture upload.
+
+#include "pch.h"
+#include "yuvconvert.h"
+#include <string.h>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define YUVCONVERT_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define YUVCONVERT_SSE2 1
+#endif
+
+void InterleaveChroma(const uint8_t* u, const uint8_t* v, uint8_t* uv, size_t count) {
+    size_t i = 0;
+#if defined(YUVCONVERT_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t pair;
+        pair.val[0] = vld1q_u8(u + i);
+        pair.val[1] = vld1q_u8(v + i);
+        vst2q_u8(uv + 2 * i, pair);
+    }
+#elif defined(YUVCONVERT_SSE2)
+    for (; i + 16 <= count; i += 16) {
+        __m128i pu = _mm_loadu_si128((const __m128i*)(u + i));
+        __m128i pv = _mm_loadu_si128((const __m128i*)(v + i));
+        _mm_storeu_si128((__m128i*)(uv + 2 * i), _mm_unpacklo_epi8(pu, pv));
+        _mm_storeu_si128((__m128i*)(uv + 2 * i + 16), _mm_unpackhi_epi8(pu, pv));
+    }
+#endif
+    for (; i < count; i++) {
+        uv[2 * i] = u[i];
+        uv[2 * i + 1] = v[i];
+    }
+}
+
+size_t GetYuv420BufferSize(int32_t width, int32_t height, int32_t stride, int32_t sliceHeight, bool planarChroma) {
+    if (width <= 0 || height <= 0 || stride < width || sliceHeight < height) {
+        return 0;
+    }
+    const size_t luma = (size_t)stride * sliceHeight;
+    const int32_t chromaRows = height / 2;
+    if (planarChroma) {
+        const size_t chromaStride = (size_t)stride / 2;
+        const size_t vPlane = luma + chromaStride * (sliceHeight / 2);
+        return vPlane + chromaStride * (chromaRows - 1) + width / 2;
+    }
+    return luma + (size_t)stride * (chromaRows - 1) + (size_t)(width / 2) * 2;
+}
+
+void CopyPlane(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, size_t rowBytes, int32_t rows) {
+    if (srcStride == rowBytes && dstStride == rowBytes) {
+        memcpy(dst, src, rowBytes * rows);
+        return;
+    }
+    for (int32_t r = 0; r < rows; r++) {
+        memcpy(dst + dstStride * r, src + srcStride * r, rowBytes);
+    }
+}
+
+void InterleaveChromaRows(const uint8_t* u, const uint8_t* v, size_t chromaStride, uint8_t* uv, size_t uvStride, int32_t chromaWidth, int32_t rows) {
+    if (chromaStride == (size_t)chromaWidth && uvStride == 2 * (size_t)chromaWidth) {
+        InterleaveChroma(u, v, uv, (size_t)chromaWidth * rows);
+        return;
+    }
+    for (int32_t r = 0; r < rows; r++) {
+        InterleaveChroma(u + chromaStride * r, v + chromaStride * r, uv + uvStride * r, chromaWidth);
+    }
+}
@@ -0,0 +1,26 @@
+// Copyright (2021-2023) Bytedance Ltd. and/or its affiliates, All rights reserved.
+//
+// Packing of decoded YUV planes for texture upload. The kernels use NEON on arm64 and SSE2 on
+// x86-64, with a scalar version elsewhere that defines their results.
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// I420 chroma to NV12's: uv[2 * i] = u[i], uv[2 * i + 1] = v[i]. Only needed for decoders that
+// output separate U and V planes; NV12 chroma is uploaded as it is.
+void InterleaveChroma(const uint8_t* u, const uint8_t* v, uint8_t* uv, size_t count);
+
+// Bytes a 4:2:0 picture occupies in a decoder buffer, up to the last byte of its last chroma row.
+// Luma rows are stride bytes apart and the chroma starts sliceHeight luma rows in. NV12's UV rows
+// are stride bytes apart; I420's U and V rows are stride / 2 apart, with V sliceHeight / 2 of them
+// after U, as Android lays out YUV420Planar.
+size_t GetYuv420BufferSize(int32_t width, int32_t height, int32_t stride, int32_t sliceHeight, bool planarChroma);
+
+// Copies rowBytes from each of 'rows' rows, srcStride bytes apart in src, to rows dstStride bytes
+// apart in dst. One memcpy when neither side pads its rows.
+void CopyPlane(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, size_t rowBytes, int32_t rows);
+
+// I420 chroma rows to NV12's, row by row: chromaWidth samples from each U and V row, chromaStride
+// bytes apart, to uv rows uvStride bytes apart.
+void InterleaveChromaRows(const uint8_t* u, const uint8_t* v, size_t chromaStride, uint8_t* uv, size_t uvStride, int32_t chromaWidth, int32_t rows);
@@ -401,8 +401,10 @@ static bool ksSignal_Wait( ksSignal * signal, const ksNanoseconds timeOutNanosec
 			struct timeval tp;
 			gettimeofday( &tp, NULL );
 			struct timespec ts;
-			ts.tv_sec = (time_t)( tp.tv_sec + timeOutNanoseconds / ( 1000 * 1000 * 1000 ) );
-			ts.tv_nsec = (long)( tp.tv_usec + ( timeOutNanoseconds % ( 1000 * 1000 * 1000 ) ) );
+			// tv_usec is in microseconds; carry the nanosecond sum into seconds so tv_nsec stays valid.
+			const ksNanoseconds nsec = (ksNanoseconds)tp.tv_usec * 1000 + ( timeOutNanoseconds % ( 1000 * 1000 * 1000 ) );
+			ts.tv_sec = (time_t)( tp.tv_sec + timeOutNanoseconds / ( 1000 * 1000 * 1000 ) + nsec / ( 1000 * 1000 * 1000 ) );
+			ts.tv_nsec = (long)( nsec % ( 1000 * 1000 * 1000 ) );
 			do
 			{
 				if ( pthread_cond_timedwait( &signal->cond, &signal->mutex, &ts ) == ETIMEDOUT )